@@ -39,6 +39,7 @@
 #include "aptmethod.h"
 #include "filecntl.h"
 #include "hooks.h"
+#include "stats.h"
 
 struct tobedone {
 	/*@null@*/
@@ -492,7 +493,10 @@ static retvalue requeue_or_fail(struct aptmethod *method, /*@only@*/struct tobed
 /* look which file could not be received and remove it: */
 static retvalue urierror(struct aptmethod *method, const char *uri, /*@only@*/char *message) {
 	struct tobedone *todo, *lasttodo;
+	struct stats_origin *counted = stats_origin(method->baseuri);
 
+	counted->requests++;
+	counted->failed++;
 	lasttodo = NULL; todo = method->tobedone;
 	while (todo != NULL) {
 		if (strcmp(todo->uri, uri) == 0)  {
@@ -691,6 +695,7 @@ static inline retvalue goturidone(struct aptmethod *method, const char *chunk) {
 	enum checksumtype type;
 	char *hashes[cs_COUNT];
 	struct checksums *checksums = NULL;
+	struct stats_origin *counted;
 
 	//TODO: is it worth the mess to make this in-situ?
 
@@ -750,6 +755,10 @@ static inline retvalue goturidone(struct aptmethod *method, const char *chunk) {
 			free(hashes[type]);
 		return result;
 	}
+	counted = stats_origin(method->baseuri);
+	counted->requests++;
+	if (hashes[cs_length] != NULL)
+		counted->bytes += strtoull(hashes[cs_length], NULL, 10);
 	if (RET_IS_OK(result)) {
 		/* ignore errors, we can recompute them from the file */
 		(void)checksums_init(&checksums, hashes);
@@ -17,6 +17,7 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -26,6 +27,12 @@
 #include <assert.h>
 
 #include <archive.h>
+#if ARCHIVE_VERSION_NUMBER < 3000000
+#define archive_read_support_filter_gzip archive_read_support_compression_gzip
+#define archive_read_support_filter_bzip2 archive_read_support_compression_bzip2
+#define archive_read_support_filter_lzma archive_read_support_compression_lzma
+#define archive_read_support_filter_xz archive_read_support_compression_xz
+#endif
 
 #include "error.h"
 #include "uncompression.h"
@@ -50,6 +57,12 @@ struct ar_archive {
 		char ah_magictrailer[2];
 	} currentheader;
 	off_t member_size, next_position;
+	/* the whole file mapped into memory (if that worked),
+	 * so members can be found and read without reading anything
+	 * else (especially not a large data.tar when only control.tar
+	 * is needed) */
+	/*@null@*/const char *data;
+	off_t size;
 	void *readbuffer;
 	/*@null@*/struct compressedfile *member;
 	enum compression compression;
@@ -83,6 +96,22 @@ static ssize_t readwait(int fd, /*@out@*/void *buf, size_t count) {
 	return totalread;
 }
 
+/* map the file, if that is not possible just use read and seek */
+static void ar_map(struct ar_archive *ar) {
+	struct stat st;
+	void *p;
+
+	if (fstat(ar->fd, &st) != 0 || !S_ISREG(st.st_mode)
+			|| st.st_size <= 0
+			|| (off_t)(size_t)st.st_size != st.st_size)
+		return;
+	p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, ar->fd, 0);
+	if (p == MAP_FAILED)
+		return;
+	ar->data = p;
+	ar->size = st.st_size;
+}
+
 retvalue ar_open(/*@out@*/struct ar_archive **n, const char *filename) {
 	struct ar_archive *ar;
 	char buffer[sizeof(AR_MAGIC)];
@@ -101,12 +130,18 @@ retvalue ar_open(/*@out@*/struct ar_archive **n, const char *filename) {
 		free(ar);
 		return RET_ERRNO(e);
 	}
-
-	bytesread = readwait(ar->fd, buffer, sizeof(AR_MAGIC) - 1);
+	ar_map(ar);
+
+	if (ar->data != NULL) {
+		bytesread = sizeof(AR_MAGIC) - 1;
+		if (ar->size < bytesread)
+			bytesread = ar->size;
+		memcpy(buffer, ar->data, bytesread);
+	} else
+		bytesread = readwait(ar->fd, buffer, sizeof(AR_MAGIC) - 1);
 	if (bytesread != sizeof(AR_MAGIC)-1) {
 		int e = errno;
-		(void)close(ar->fd);
-		free(ar);
+		ar_close(ar);
 		if (bytesread < 0) {
 			fprintf(stderr, "Error %d reading from %s: %s\n",
 					e, filename, strerror(e));
@@ -118,8 +153,7 @@ retvalue ar_open(/*@out@*/struct ar_archive **n, const char *filename) {
 		}
 	}
 	if (memcmp(buffer, AR_MAGIC, sizeof(AR_MAGIC)-1) != 0) {
-		(void)close(ar->fd);
-		free(ar);
+		ar_close(ar);
 		fprintf(stderr,
 "Missing ar header '!<arch>' at the beginning of %s\n",
 				filename);
@@ -127,8 +161,7 @@ retvalue ar_open(/*@out@*/struct ar_archive **n, const char *filename) {
 	}
 	ar->filename = strdup(filename);
 	if (FAILEDTOALLOC(ar->filename)) {
-		close(ar->fd);
-		free(ar);
+		ar_close(ar);
 		return RET_ERROR_OOM;
 	}
 	ar->next_position = sizeof(AR_MAGIC) - 1;
@@ -139,6 +172,8 @@ retvalue ar_open(/*@out@*/struct ar_archive **n, const char *filename) {
 
 void ar_close(/*@only@*/struct ar_archive *ar) {
 	if (ar != NULL) {
+		if (ar->data != NULL)
+			(void)munmap((void*)ar->data, ar->size);
 		if (ar->fd >= 0)
 			(void)close(ar->fd);
 		free(ar->filename);
@@ -148,6 +183,7 @@ void ar_close(/*@only@*/struct ar_archive *ar) {
 
 /* RET_OK = next is there, RET_NOTHING = eof, < 0 = error */
 retvalue ar_nextmember(struct ar_archive *ar, /*@out@*/char **filename) {
+	unsigned long long size;
 	ssize_t bytesread;
 	char *p;
 	off_t s;
@@ -155,22 +191,34 @@ retvalue ar_nextmember(struct ar_archive *ar, /*@out@*/char **filename) {
 	assert(ar->readbuffer == NULL);
 	assert(ar->fd >= 0);
 
-	/* seek over what is left from the last part: */
-	s = lseek(ar->fd, ar->next_position, SEEK_SET);
-	if (s == (off_t)-1) {
-		int e = errno;
-		fprintf(stderr,
-"Error %d seeking to next member in ar file %s: %s\n",
-				e, ar->filename, strerror(e));
-		return RET_ERRNO(e);
-	}
-	/* read the next header from the file */
-
 	if (interrupted())
 		return RET_ERROR_INTERRUPTED;
 
-	bytesread = readwait(ar->fd, &ar->currentheader,
-			sizeof(ar->currentheader));
+	if (ar->data != NULL) {
+		/* just look at the next header in the mapped file: */
+		if (ar->next_position >= ar->size)
+			bytesread = 0;
+		else if (ar->size - ar->next_position
+				< (off_t)sizeof(ar->currentheader))
+			bytesread = ar->size - ar->next_position;
+		else
+			bytesread = sizeof(ar->currentheader);
+		memcpy(&ar->currentheader, ar->data + ar->next_position,
+				bytesread);
+	} else {
+		/* seek over what is left from the last part: */
+		s = lseek(ar->fd, ar->next_position, SEEK_SET);
+		if (s == (off_t)-1) {
+			int e = errno;
+			fprintf(stderr,
+"Error %d seeking to next member in ar file %s: %s\n",
+					e, ar->filename, strerror(e));
+			return RET_ERRNO(e);
+		}
+		/* read the next header from the file */
+		bytesread = readwait(ar->fd, &ar->currentheader,
+				sizeof(ar->currentheader));
+	}
 	ar->next_position += sizeof(ar->currentheader);
 	if (bytesread == 0)
 		return RET_NOTHING;
@@ -199,13 +247,28 @@ retvalue ar_nextmember(struct ar_archive *ar, /*@out@*/char **filename) {
 			== ar->currentheader.ah_size + 10);
 	ar->currentheader.ah_magictrailer[0] = '\0';
 
-	ar->member_size = strtoul(ar->currentheader.ah_size, &p, 10);
-	if (*p != '\0' && *p != ' ') {
+	/* strtoull would also accept signs and leading spaces */
+	if (ar->currentheader.ah_size[0] < '0'
+			|| ar->currentheader.ah_size[0] > '9') {
+		fprintf(stderr,
+"Error calculating length field in ar file %s\n",
+				ar->filename);
+		return RET_ERROR;
+	}
+	size = strtoull(ar->currentheader.ah_size, &p, 10);
+	ar->member_size = size;
+	if ((*p != '\0' && *p != ' ') || ar->member_size < 0
+			|| (unsigned long long)ar->member_size != size) {
 		fprintf(stderr,
 "Error calculating length field in ar file %s\n",
 				ar->filename);
 		return RET_ERROR;
 	}
+	if (ar->data != NULL && ar->member_size > ar->size - ar->next_position) {
+		fprintf(stderr, "Premature end of ar file %s\n",
+				ar->filename);
+		return RET_ERROR;
+	}
 	ar->next_position += ar->member_size;
 	if ((ar->member_size & 1) != 0)
 		ar->next_position ++;
@@ -264,6 +327,19 @@ int ar_archivemember_open(struct archive *a, void *d) {
 
 	assert (uncompression_supported(ar->compression));
 
+	if (ar->data != NULL) {
+		/* uncompress_fdopen reads from the current position */
+		off_t start = ar->next_position - ar->member_size
+				- (ar->member_size & 1);
+
+		if (lseek(ar->fd, start, SEEK_SET) == (off_t)-1) {
+			e = errno;
+			archive_set_error(a, e, "Error seeking in %s",
+					ar->filename);
+			return ARCHIVE_FATAL;
+		}
+	}
+
 	assert (ar->readbuffer == NULL);
 	ar->readbuffer = malloc(BLOCKSIZE);
 	if (FAILEDTOALLOC(ar->readbuffer)) {
@@ -297,3 +373,62 @@ int ar_archivemember_close(struct archive *a, void *d) {
 	archive_set_error(a, e, "%s", msg);
 	return ARCHIVE_FATAL;
 }
+
+/* let libarchive do the uncompression itself, if it can do so without
+ * calling an external program */
+static bool ar_setbuiltinfilter(struct archive *tar, enum compression c) {
+	int a;
+
+	switch (c) {
+		case c_none:
+			return true;
+		case c_gzip:
+			a = archive_read_support_filter_gzip(tar);
+			break;
+		case c_bzip2:
+			a = archive_read_support_filter_bzip2(tar);
+			break;
+		case c_lzma:
+			a = archive_read_support_filter_lzma(tar);
+			break;
+		case c_xz:
+			a = archive_read_support_filter_xz(tar);
+			break;
+#if ARCHIVE_VERSION_NUMBER >= 3003003
+		case c_zstd:
+			a = archive_read_support_filter_zstd(tar);
+			break;
+#endif
+		default:
+			return false;
+	}
+	return a == ARCHIVE_OK;
+}
+
+/* The mapping does not shrink with the file, and reading a part no
+ * longer in the file is fatal (SIGBUS), so check the member is still
+ * there. If not, reading it like an unmapped file reports it. */
+static bool ar_memberstillmapped(const struct ar_archive *ar) {
+	struct stat st;
+
+	if (fstat(ar->fd, &st) != 0)
+		return false;
+	return st.st_size >= ar->next_position - (ar->member_size & 1);
+}
+
+int ar_archivemember_openarchive(struct archive *tar, struct ar_archive *ar) {
+	if (ar->data != NULL && ar_memberstillmapped(ar)
+			&& ar_setbuiltinfilter(tar, ar->compression)) {
+		const char *start = ar->data + ar->next_position
+			- ar->member_size - (ar->member_size & 1);
+
+		/* no copying, libarchive directly reads the mapped memory
+		 * (only touching the pages of this member) */
+		return archive_read_open_memory(tar, (void *)start,
+				ar->member_size);
+	}
+	return archive_read_open(tar, ar,
+			ar_archivemember_open,
+			ar_archivemember_read,
+			ar_archivemember_close);
+}
@@ -19,4 +19,10 @@ int ar_archivemember_close(struct archive *, void *);
 int ar_archivemember_open(struct archive *, void *);
 ssize_t ar_archivemember_read(struct archive *, void *, const void **);
 
+/* open the current member in the given archive (set the wanted formats
+ * first), directly from memory if the file could be mapped and
+ * libarchive can uncompress it itself, otherwise using the functions
+ * above */
+int ar_archivemember_openarchive(struct archive *, struct ar_archive *);
+
 #endif
@@ -0,0 +1,126 @@
+/*  This file is part of "reprepro"
+ *  Copyright (C) 2026 agent
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02111-1301  USA
+ */
+#include <config.h>
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+/* blocks start small (most arenas only hold a few objects) and
+ * double in size up to this, bigger requests get their own block */
+#define ARENA_FIRSTBLOCK 1024
+#define ARENA_MAXBLOCK (64*1024)
+
+struct arena_block {
+	struct arena_block *next;
+	/* to have the data suitably aligned for everything: */
+	union {
+		long double d;
+		void *p;
+		long long l;
+	} data[];
+};
+
+#define ALIGNMENT (sizeof(((struct arena_block*)NULL)->data[0]))
+
+void arena_init(struct arena *arena) {
+	arena->blocks = NULL;
+	arena->next = NULL;
+	arena->end = NULL;
+	arena->blocksize = ARENA_FIRSTBLOCK;
+}
+
+void arena_done(struct arena *arena) {
+	while (arena->blocks != NULL) {
+		struct arena_block *b = arena->blocks;
+
+		arena->blocks = b->next;
+		free(b);
+	}
+	arena->next = NULL;
+	arena->end = NULL;
+	arena->blocksize = ARENA_FIRSTBLOCK;
+}
+
+static void *newblock(struct arena *arena, size_t len) {
+	struct arena_block *b;
+	size_t size;
+
+	size = arena->blocksize;
+	if (len > size / 4) {
+		/* too big to waste the rest of the current block,
+		 * so put it in a block of its own after the current one */
+		b = malloc(sizeof(struct arena_block) + len);
+		if (b == NULL)
+			return NULL;
+		if (arena->blocks == NULL) {
+			b->next = NULL;
+			arena->blocks = b;
+		} else {
+			b->next = arena->blocks->next;
+			arena->blocks->next = b;
+		}
+		return b->data;
+	}
+	b = malloc(sizeof(struct arena_block) + size);
+	if (b == NULL)
+		return NULL;
+	if (size < ARENA_MAXBLOCK)
+		arena->blocksize = 2 * size;
+	b->next = arena->blocks;
+	arena->blocks = b;
+	arena->next = (char*)b->data + len;
+	arena->end = (char*)b->data + size;
+	return b->data;
+}
+
+void *arena_alloc(struct arena *arena, size_t len) {
+	void *p;
+
+	if (len == 0)
+		len = 1;
+	len = (len + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+	if ((size_t)(arena->end - arena->next) < len)
+		return newblock(arena, len);
+	p = arena->next;
+	arena->next += len;
+	return p;
+}
+
+void *arena_zalloc(struct arena *arena, size_t len) {
+	void *p = arena_alloc(arena, len);
+
+	if (p != NULL)
+		memset(p, 0, len);
+	return p;
+}
+
+char *arena_strndup(struct arena *arena, const char *s, size_t len) {
+	char *p = arena_alloc(arena, len + 1);
+
+	if (p == NULL)
+		return NULL;
+	memcpy(p, s, len);
+	p[len] = '\0';
+	return p;
+}
+
+char *arena_strdup(struct arena *arena, const char *s) {
+	return arena_strndup(arena, s, strlen(s));
+}
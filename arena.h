@@ -0,0 +1,31 @@
+#ifndef REPREPRO_ARENA_H
+#define REPREPRO_ARENA_H
+
+/* An arena hands out memory for many small objects that all live
+ * until the same point in time (like everything belonging to one
+ * upgradelist), so that they are freed by a single arena_done
+ * instead of one free per object.
+ * Memory from an arena must never be passed to free() or realloc(). */
+
+struct arena_block;
+
+struct arena {
+	/*@null@*/struct arena_block *blocks;
+	char *next, *end;
+	/* size of the next block to allocate */
+	size_t blocksize;
+};
+
+void arena_init(/*@out@*/struct arena *);
+void arena_done(struct arena *);
+
+/* all of those return NULL if out of memory */
+/*@null@*//*@dependent@*/void *arena_alloc(struct arena *, size_t);
+/*@null@*//*@dependent@*/void *arena_zalloc(struct arena *, size_t);
+/*@null@*//*@dependent@*/char *arena_strdup(struct arena *, const char *);
+/*@null@*//*@dependent@*/char *arena_strndup(struct arena *, const char *, size_t);
+
+#define arena_NEW(a, type) ((type *)arena_alloc(a, sizeof(type)))
+#define arena_zNEW(a, type) ((type *)arena_zalloc(a, sizeof(type)))
+
+#endif
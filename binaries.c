@@ -37,6 +37,7 @@
 #include "tracking.h"
 #include "debfile.h"
 #include "package.h"
+#include "workers.h"
 
 static const char * const deb_checksum_headers[cs_COUNT] = {
 	"MD5sum", "SHA1", "SHA256", "Size"};
@@ -493,11 +494,18 @@ void binaries_debdone(struct deb_headers *pkg) {
 
 retvalue binaries_readdeb(struct deb_headers *deb, const char *filename) {
 	retvalue r;
-	char *architecture;
 
 	r = extractcontrol(&deb->control, filename);
 	if (RET_WAS_ERROR(r))
 		return r;
+	return binaries_parsedeb(deb, filename);
+}
+
+retvalue binaries_parsedeb(struct deb_headers *deb, const char *filename) {
+	retvalue r;
+	char *architecture;
+
+	assert (deb->control != NULL);
 	/* first look for fields that should be there */
 
 	r = chunk_getname(deb->control, "Package", &deb->name, false);
@@ -555,6 +563,44 @@ retvalue binaries_readdeb(struct deb_headers *deb, const char *filename) {
 	return RET_OK;
 }
 
+struct extractcontrols {
+	const char * const *filenames;
+	char **controls;
+};
+
+/* called in the worker processes: */
+static retvalue extractcontrolfile(void *data, size_t i, char **control, size_t *len) {
+	struct extractcontrols *d = data;
+	retvalue r;
+
+	r = extractcontrol(control, d->filenames[i]);
+	if (RET_IS_OK(r))
+		*len = strlen(*control) + 1;
+	return r;
+}
+
+static retvalue gotcontrolfile(void *data, size_t i, retvalue r, const char *control, size_t len) {
+	struct extractcontrols *d = data;
+
+	if (!RET_IS_OK(r))
+		return r;
+	d->controls[i] = strndup(control, len);
+	if (FAILEDTOALLOC(d->controls[i]))
+		return RET_ERROR_OOM;
+	return RET_OK;
+}
+
+retvalue binaries_extractcontrols(int count, const char * const *filenames, char **controls) {
+	struct extractcontrols d;
+	int i;
+
+	for (i = 0 ; i < count ; i++)
+		controls[i] = NULL;
+	d.filenames = filenames;
+	d.controls = controls;
+	return workers_run(count, extractcontrolfile, gotcontrolfile, &d);
+}
+
 /* do overwrites, add Filename and Checksums to the control-item */
 retvalue binaries_complete(const struct deb_headers *pkg, const char *filekey, const struct checksums *checksums, const struct overridedata *override, const char *section, const char *priority, char **newcontrol) {
 	struct fieldtoadd *replace;
@@ -45,6 +45,11 @@ struct deb_headers {
  * - no checks for sanity of values, left to the caller */
 
 retvalue binaries_readdeb(struct deb_headers *, const char *filename);
+/* the same, but with deb_headers.control already set */
+retvalue binaries_parsedeb(struct deb_headers *, const char *filename);
+/* get the control data of multiple .deb files (in parallel, if possible),
+ * controls of files that could not be read are set to NULL */
+retvalue binaries_extractcontrols(int, const char * const * /*filenames*/, /*@out@*/char ** /*controls*/);
 void binaries_debdone(struct deb_headers *);
 
 retvalue binaries_calcfilekeys(component_t, const struct deb_headers *, packagetype_t, /*@out@*/struct strlist *);
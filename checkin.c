@@ -43,6 +43,7 @@
 #include "guesscomponent.h"
 #include "override.h"
 #include "checkindsc.h"
+#include "binaries.h"
 #include "checkindeb.h"
 #include "checkin.h"
 #include "uploaderslist.h"
@@ -1020,22 +1021,48 @@ static retvalue changes_checkfiles(const char *filename, struct changes *changes
 
 static retvalue changes_includefiles(struct changes *changes) {
 	struct fileentry *e;
+	const char **basenames, **filekeys;
+	struct checksums ***checksums;
+	int count;
 	retvalue r;
 
-	r = RET_NOTHING;
+	count = 0;
+	for (e = changes->files; e != NULL ; e = e->next)
+		count++;
+	if (count == 0)
+		return RET_NOTHING;
+	basenames = nNEW(count, const char *);
+	filekeys = nNEW(count, const char *);
+	checksums = nNEW(count, struct checksums **);
+	if (FAILEDTOALLOC(basenames) || FAILEDTOALLOC(filekeys) ||
+			FAILEDTOALLOC(checksums)) {
+		free(basenames);
+		free(filekeys);
+		free(checksums);
+		return RET_ERROR_OOM;
+	}
 
+	count = 0;
 	for (e = changes->files; e != NULL ; e = e->next) {
 		assert (e->filekey != NULL);
 
 		if (e->wasalreadythere && checksums_iscomplete(e->checksums))
 			continue;
 
-		r = files_checkincludefile(changes->incomingdirectory,
-				e->basename, e->filekey, &e->checksums);
-		if (RET_WAS_ERROR(r))
-			return r;
+		basenames[count] = e->basename;
+		filekeys[count] = e->filekey;
+		checksums[count] = &e->checksums;
+		count++;
 	}
-
+	/* this copies the files into the pool in parallel, if possible */
+	if (count > 0)
+		r = files_checkincludefiles(changes->incomingdirectory, count,
+				basenames, filekeys, checksums);
+	else
+		r = RET_NOTHING;
+	free(basenames);
+	free(filekeys);
+	free(checksums);
 	return r;
 }
 
@@ -1214,11 +1241,70 @@ static retvalue dsc_prepare(struct changes *changes, struct fileentry *dsc,  str
 }
 
 
+/* read the control data of all binary packages at once,
+ * so that can be done in parallel */
+static retvalue changes_extractcontrols(struct changes *changes, /*@out@*/int *count_p, /*@out@*/char ***controls_p) {
+	struct fileentry *e;
+	char **filenames, **controls;
+	int count, i;
+	retvalue r;
+
+	count = 0;
+	for (e = changes->files; e != NULL ; e = e->next) {
+		if (FE_BINARY(e->type))
+			count++;
+	}
+	*count_p = count;
+	*controls_p = NULL;
+	if (count == 0)
+		return RET_NOTHING;
+	filenames = nzNEW(count, char *);
+	if (FAILEDTOALLOC(filenames))
+		return RET_ERROR_OOM;
+	controls = nzNEW(count, char *);
+	if (FAILEDTOALLOC(controls)) {
+		free(filenames);
+		return RET_ERROR_OOM;
+	}
+	r = RET_OK;
+	i = 0;
+	for (e = changes->files; e != NULL ; e = e->next) {
+		if (!FE_BINARY(e->type))
+			continue;
+		filenames[i] = files_calcfullfilename(e->filekey);
+		if (FAILEDTOALLOC(filenames[i++])) {
+			r = RET_ERROR_OOM;
+			break;
+		}
+	}
+	if (RET_IS_OK(r))
+		r = binaries_extractcontrols(count,
+				(const char * const *)filenames, controls);
+	for (i = 0 ; i < count ; i++)
+		free(filenames[i]);
+	free(filenames);
+	if (RET_WAS_ERROR(r)) {
+		for (i = 0 ; i < count ; i++)
+			free(controls[i]);
+		free(controls);
+		return r;
+	}
+	*controls_p = controls;
+	return RET_OK;
+}
+
 static retvalue changes_checkpkgs(struct distribution *distribution, struct changes *changes) {
 	struct fileentry *e;
+	char **controls, *control;
+	int count, i;
 	retvalue r;
 
+	r = changes_extractcontrols(changes, &count, &controls);
+	if (RET_WAS_ERROR(r))
+		return r;
+
 	r = RET_NOTHING;
+	i = 0;
 
 	e = changes->files;
 	while (e != NULL) {
@@ -1227,15 +1313,24 @@ static retvalue changes_checkpkgs(struct distribution *distribution, struct chan
 			e = e->next;
 			continue;
 		}
+		control = NULL;
+		if (FE_BINARY(e->type)) {
+			assert (i < count);
+			control = controls[i];
+			controls[i++] = NULL;
+		}
 		fullfilename = files_calcfullfilename(e->filekey);
-		if (FAILEDTOALLOC(fullfilename))
-			return RET_ERROR_OOM;
+		if (FAILEDTOALLOC(fullfilename)) {
+			free(control);
+			r = RET_ERROR_OOM;
+			break;
+		}
 		if (e->type == fe_DEB) {
 			r = deb_prepare(&e->pkg.deb,
 				e->component, e->architecture_into,
 				e->section, e->priority,
 				pt_deb,
-				distribution, fullfilename,
+				distribution, fullfilename, control,
 				e->filekey, e->checksums,
 				&changes->binaries,
 				changes->source, changes->sourceversion);
@@ -1244,7 +1339,7 @@ static retvalue changes_checkpkgs(struct distribution *distribution, struct chan
 				e->component, e->architecture_into,
 				e->section, e->priority,
 				pt_udeb,
-				distribution, fullfilename,
+				distribution, fullfilename, control,
 				e->filekey, e->checksums,
 				&changes->binaries,
 				changes->source, changes->sourceversion);
@@ -1253,7 +1348,7 @@ static retvalue changes_checkpkgs(struct distribution *distribution, struct chan
 				e->component, e->architecture_into,
 				e->section, e->priority,
 				pt_ddeb,
-				distribution, fullfilename,
+				distribution, fullfilename, control,
 				e->filekey, e->checksums,
 				&changes->binaries,
 				changes->source, changes->sourceversion);
@@ -1277,7 +1372,9 @@ static retvalue changes_checkpkgs(struct distribution *distribution, struct chan
 			break;
 		e = e->next;
 	}
-
+	for (i = 0 ; i < count ; i++)
+		free(controls[i]);
+	free(controls);
 	return r;
 }
 
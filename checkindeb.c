@@ -73,15 +73,21 @@ void deb_free(/*@only@*/struct debpackage *pkg) {
 }
 
 /* read the data from a .deb, make some checks and extract some data */
-static retvalue deb_read(/*@out@*/struct debpackage **pkg, const char *filename) {
+static retvalue deb_read(/*@out@*/struct debpackage **pkg, const char *filename, /*@null@*//*@only@*/char *control) {
 	retvalue r;
 	struct debpackage *deb;
 
 	deb = zNEW(struct debpackage);
-	if (FAILEDTOALLOC(deb))
+	if (FAILEDTOALLOC(deb)) {
+		free(control);
 		return RET_ERROR_OOM;
+	}
 
-	r = binaries_readdeb(&deb->deb, filename);
+	if (control != NULL) {
+		deb->deb.control = control;
+		r = binaries_parsedeb(&deb->deb, filename);
+	} else
+		r = binaries_readdeb(&deb->deb, filename);
 	if (RET_IS_OK(r))
 		r = properpackagename(deb->deb.name);
 	if (RET_IS_OK(r))
@@ -243,7 +249,7 @@ static retvalue deb_preparelocation(struct debpackage *pkg, component_t forcecom
 }
 
 
-retvalue deb_prepare(/*@out@*/struct debpackage **deb, component_t forcecomponent, architecture_t forcearchitecture, const char *forcesection, const char *forcepriority, packagetype_t packagetype, struct distribution *distribution, const char *debfilename, const char * const givenfilekey, const struct checksums * checksums, const struct strlist *allowed_binaries, const char *expectedsourcepackage, const char *expectedsourceversion){
+retvalue deb_prepare(/*@out@*/struct debpackage **deb, component_t forcecomponent, architecture_t forcearchitecture, const char *forcesection, const char *forcepriority, packagetype_t packagetype, struct distribution *distribution, const char *debfilename, /*@null@*//*@only@*/char *debcontrol, const char * const givenfilekey, const struct checksums * checksums, const struct strlist *allowed_binaries, const char *expectedsourcepackage, const char *expectedsourceversion){
 	retvalue r;
 	struct debpackage *pkg;
 	const struct overridedata *oinfo;
@@ -261,7 +267,7 @@ retvalue deb_prepare(/*@out@*/struct debpackage **deb, component_t forcecomponen
 
 	/* First taking a closer look in the file: */
 
-	r = deb_read(&pkg, debfilename);
+	r = deb_read(&pkg, debfilename, debcontrol);
 	if (RET_WAS_ERROR(r)) {
 		return r;
 	}
@@ -384,7 +390,7 @@ retvalue deb_add(component_t forcecomponent, const struct atomlist *forcearchite
 
 	causingfile = debfilename;
 
-	r = deb_read(&pkg, debfilename);
+	r = deb_read(&pkg, debfilename, NULL);
 	if (RET_WAS_ERROR(r)) {
 		return r;
 	}
@@ -26,6 +26,10 @@
 #include <assert.h>
 #include <unistd.h>
 #include <fcntl.h>
+#ifdef HAVE_LINUX_FS_H
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
 
 #define CHECKSUMS_CONTEXT visible
 #include "error.h"
@@ -35,6 +39,7 @@
 #include "names.h"
 #include "dirs.h"
 #include "configparser.h"
+#include "stats.h"
 
 const char * const changes_checksum_names[] = {
 	"Files", "Checksums-Sha1", "Checksums-Sha256"
@@ -989,37 +994,74 @@ retvalue checksums_test(const char *filename, const struct checksums *checksums,
 	return RET_OK;
 }
 
-/* copy, only checking file size, perhaps add some paranoia checks later */
-static retvalue copy(const char *destination, const char *source, const struct checksums *checksums) {
-	off_t filesize = 0, expected;
-	static const size_t bufsize = 16384;
-	char *buffer = malloc(bufsize);
-	ssize_t sizeread, towrite, written;
-	const char *start;
-	int e, i;
-	int infd, outfd;
-
-	if (FAILEDTOALLOC(buffer))
-		return RET_ERROR_OOM;
+/* Let the kernel copy the file: as reflink if the filesystem can share
+ * the data (btrfs, xfs, ...), otherwise with copy_file_range.
+ * Returns RET_NOTHING if neither is possible and nothing was written yet,
+ * the caller then has to copy the data itself. */
+static retvalue kernelcopy(int infd, int outfd, const char *source, const char *destination, /*@out@*/off_t *size_p) {
+	struct stat s;
+	int e;
 
-	infd = open(source, O_RDONLY);
-	if (infd < 0) {
+	if (fstat(infd, &s) != 0) {
 		e = errno;
-		fprintf(stderr, "Error %d opening '%s': %s\n",
+		fprintf(stderr, "Error %d getting information about '%s': %s\n",
 				e, source, strerror(e));
-		free(buffer);
 		return RET_ERRNO(e);
 	}
-	outfd = open(destination, O_NOCTTY|O_WRONLY|O_CREAT|O_EXCL, 0666);
-	if (outfd < 0) {
-		e = errno;
-		fprintf(stderr, "Error %d creating '%s': %s\n",
-				e, destination, strerror(e));
-		(void)close(infd);
-		free(buffer);
-		return RET_ERRNO(e);
+	if (!S_ISREG(s.st_mode))
+		return RET_NOTHING;
+#ifdef FICLONE
+	if (ioctl(outfd, FICLONE, infd) == 0) {
+		*size_p = s.st_size;
+		return RET_OK;
 	}
-	filesize = 0;
+#endif
+#ifdef HAVE_COPY_FILE_RANGE
+	{
+		off_t copied = 0;
+		ssize_t got;
+
+		do {
+			got = copy_file_range(infd, NULL, outfd, NULL,
+					1024*1024*1024, 0);
+			if (got < 0) {
+				e = errno;
+				if (copied == 0 && (e == EXDEV || e == ENOSYS ||
+						e == EOPNOTSUPP ||
+						e == EINVAL || e == EBADF))
+					return RET_NOTHING;
+				fprintf(stderr,
+"Error %d while copying %s to %s: %s\n",
+						e, source, destination,
+						strerror(e));
+				return RET_ERRNO(e);
+			}
+			/* some filesystems do not support it but
+			 * do not say so, but just claim end of file */
+			if (got == 0 && copied == 0 && s.st_size > 0)
+				return RET_NOTHING;
+			copied += got;
+		} while (got > 0);
+		*size_p = copied;
+		return RET_OK;
+	}
+#else
+	(void)destination;
+	return RET_NOTHING;
+#endif
+}
+
+/* copy the data with read and write, hashing it if context is not NULL */
+static retvalue copyandhash(int infd, int outfd, const char *source, const char *destination, /*@null@*/struct checksumscontext *context, /*@out@*/off_t *size_p) {
+	static const size_t bufsize = 16384;
+	unsigned char *buffer = malloc(bufsize);
+	ssize_t sizeread, towrite, written;
+	const unsigned char *start;
+	off_t filesize = 0;
+	int e;
+
+	if (FAILEDTOALLOC(buffer))
+		return RET_ERROR_OOM;
 	do {
 		sizeread = read(infd, buffer, bufsize);
 		if (sizeread < 0) {
@@ -1027,10 +1069,11 @@ static retvalue copy(const char *destination, const char *source, const struct c
 			fprintf(stderr, "Error %d while reading %s: %s\n",
 					e, source, strerror(e));
 			free(buffer);
-			(void)close(infd); (void)close(outfd);
-			deletefile(destination);
-			return RET_ERRNO(e);;
+			return RET_ERRNO(e);
 		}
+		if (context != NULL)
+			checksumscontext_update(context, buffer,
+					(size_t)sizeread);
 		filesize += sizeread;
 		towrite = sizeread;
 		start = buffer;
@@ -1042,15 +1085,95 @@ static retvalue copy(const char *destination, const char *source, const struct c
 "Error %d while writing to %s: %s\n",
 						e, destination, strerror(e));
 				free(buffer);
-				(void)close(infd); (void)close(outfd);
-				deletefile(destination);
-				return RET_ERRNO(e);;
+				return RET_ERRNO(e);
 			}
 			towrite -= written;
 			start += written;
 		}
 	} while (sizeread > 0);
 	free(buffer);
+	*size_p = filesize;
+	return RET_OK;
+}
+
+/* hash what is left to read from fd */
+static retvalue hashbyreading(int fd, const char *filename, struct checksumscontext *context) {
+	static const size_t bufsize = 16384;
+	unsigned char *buffer = malloc(bufsize);
+	ssize_t sizeread;
+	int e;
+
+	if (FAILEDTOALLOC(buffer))
+		return RET_ERROR_OOM;
+	do {
+		sizeread = read(fd, buffer, bufsize);
+		if (sizeread < 0) {
+			e = errno;
+			fprintf(stderr, "Error %d while reading %s: %s\n",
+					e, filename, strerror(e));
+			free(buffer);
+			return RET_ERRNO(e);
+		}
+		checksumscontext_update(context, buffer, (size_t)sizeread);
+	} while (sizeread > 0);
+	free(buffer);
+	return RET_OK;
+}
+
+static retvalue hashfromstart(int fd, const char *filename, struct checksumscontext *context) {
+	int e;
+
+	/* kernelcopy might have moved the position already */
+	if (lseek(fd, 0, SEEK_SET) != 0) {
+		e = errno;
+		fprintf(stderr, "Error %d seeking in %s: %s\n",
+				e, filename, strerror(e));
+		return RET_ERRNO(e);
+	}
+	return hashbyreading(fd, filename, context);
+}
+
+/* hash a whole file. (Not by mapping it, as that would get a SIGBUS
+ * if the file is truncated meanwhile) */
+static retvalue hashfile(int fd, const char *filename, struct checksumscontext *context) {
+#ifdef POSIX_FADV_SEQUENTIAL
+	(void)posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+	return hashfromstart(fd, filename, context);
+}
+
+/* copy, only checking file size, perhaps add some paranoia checks later */
+static retvalue copy(const char *destination, const char *source, const struct checksums *checksums) {
+	off_t filesize = 0, expected;
+	int e, i;
+	int infd, outfd;
+	retvalue r;
+
+	infd = open(source, O_RDONLY);
+	if (infd < 0) {
+		e = errno;
+		fprintf(stderr, "Error %d opening '%s': %s\n",
+				e, source, strerror(e));
+		return RET_ERRNO(e);
+	}
+	outfd = open(destination, O_NOCTTY|O_WRONLY|O_CREAT|O_EXCL, 0666);
+	if (outfd < 0) {
+		e = errno;
+		fprintf(stderr, "Error %d creating '%s': %s\n",
+				e, destination, strerror(e));
+		(void)close(infd);
+		return RET_ERRNO(e);
+	}
+	/* the checksums are known, so no need to look at the data */
+	r = kernelcopy(infd, outfd, source, destination, &filesize);
+	if (r == RET_NOTHING)
+		r = copyandhash(infd, outfd, source, destination,
+				NULL, &filesize);
+	if (RET_WAS_ERROR(r)) {
+		(void)close(infd); (void)close(outfd);
+		deletefile(destination);
+		return r;
+	}
 	i = close(infd);
 	if (i != 0) {
 		e = errno;
@@ -1079,6 +1202,8 @@ static retvalue copy(const char *destination, const char *source, const struct c
 		deletefile(destination);
 		return RET_ERROR_WRONG_MD5;
 	}
+	stats.copied++;
+	stats.copiedbytes += filesize;
 	return RET_OK;
 }
 
@@ -1117,7 +1242,8 @@ retvalue checksums_hardlink(const char *directory, const char *filekey, const ch
 			free(fullfilename);
 			return RET_ERRNO(e);
 		}
-	}
+	} else
+		stats.linked++;
 	free(fullfilename);
 	return RET_OK;
 }
@@ -1129,6 +1255,9 @@ void checksumscontext_init(struct checksumscontext *context) {
 }
 
 void checksumscontext_update(struct checksumscontext *context, const unsigned char *data, size_t len) {
+	stats.hashed[cs_md5sum] += len;
+	stats.hashed[cs_sha1sum] += len;
+	stats.hashed[cs_sha256sum] += len;
 	MD5Update(&context->md5, data, len);
 // TODO: sha1 and sha256 share quite some stuff,
 // the code can most likely be combined with quite some synergies..
@@ -1214,14 +1343,9 @@ retvalue checksums_complete(struct checksums **checksums_p, const char *fullfile
 
 retvalue checksums_read(const char *fullfilename, /*@out@*/struct checksums **checksums_p) {
 	struct checksumscontext context;
-	static const size_t bufsize = 16384;
-	unsigned char *buffer = malloc(bufsize);
-	ssize_t sizeread;
 	int e, i;
 	int infd;
-
-	if (FAILEDTOALLOC(buffer))
-		return RET_ERROR_OOM;
+	retvalue r;
 
 	checksumscontext_init(&context);
 
@@ -1230,27 +1354,17 @@ retvalue checksums_read(const char *fullfilename, /*@out@*/struct checksums **ch
 		e = errno;
 		if ((e == EACCES || e == ENOENT) &&
 				!isregularfile(fullfilename)) {
-			free(buffer);
 			return RET_NOTHING;
 		}
 		fprintf(stderr, "Error %d opening '%s': %s\n",
 				e, fullfilename, strerror(e));
-		free(buffer);
 		return RET_ERRNO(e);
 	}
-	do {
-		sizeread = read(infd, buffer, bufsize);
-		if (sizeread < 0) {
-			e = errno;
-			fprintf(stderr, "Error %d while reading %s: %s\n",
-					e, fullfilename, strerror(e));
-			free(buffer);
-			(void)close(infd);
-			return RET_ERRNO(e);;
-		}
-		checksumscontext_update(&context, buffer, (size_t)sizeread);
-	} while (sizeread > 0);
-	free(buffer);
+	r = hashfile(infd, fullfilename, &context);
+	if (RET_WAS_ERROR(r)) {
+		(void)close(infd);
+		return r;
+	}
 	i = close(infd);
 	if (i != 0) {
 		e = errno;
@@ -1261,24 +1375,40 @@ retvalue checksums_read(const char *fullfilename, /*@out@*/struct checksums **ch
 	return checksums_from_context(checksums_p, &context);
 }
 
+/* hash the file just copied into the pool */
+static retvalue hashcopy(const char *destination, struct checksumscontext *context) {
+	int fd, e;
+	retvalue r;
+
+	fd = open(destination, O_RDONLY|O_NOCTTY);
+	if (fd < 0) {
+		e = errno;
+		fprintf(stderr, "Error %d opening '%s': %s\n",
+				e, destination, strerror(e));
+		return RET_ERRNO(e);
+	}
+	r = hashfile(fd, destination, context);
+	if (close(fd) != 0 && !RET_WAS_ERROR(r)) {
+		e = errno;
+		fprintf(stderr, "Error %d reading %s: %s\n",
+				e, destination, strerror(e));
+		r = RET_ERRNO(e);
+	}
+	return r;
+}
+
 retvalue checksums_copyfile(const char *destination, const char *source, bool deletetarget, struct checksums **checksums_p) {
 	struct checksumscontext context;
-	static const size_t bufsize = 16384;
-	unsigned char *buffer = malloc(bufsize);
-	ssize_t sizeread, towrite, written;
-	const unsigned char *start;
+	off_t filesize;
 	int e, i;
 	int infd, outfd;
-
-	if (FAILEDTOALLOC(buffer))
-		return RET_ERROR_OOM;
+	retvalue r;
 
 	infd = open(source, O_RDONLY);
 	if (infd < 0) {
 		e = errno;
 		fprintf(stderr, "Error %d opening '%s': %s\n",
 				e, source, strerror(e));
-		free(buffer);
 		return RET_ERRNO(e);
 	}
 	outfd = open(destination, O_NOCTTY|O_WRONLY|O_CREAT|O_EXCL, 0666);
@@ -1293,7 +1423,6 @@ retvalue checksums_copyfile(const char *destination, const char *source, bool de
 "Error %d deleting '%s': %s\n",
 						e, destination, strerror(e));
 					(void)close(infd);
-					free(buffer);
 					return RET_ERRNO(e);
 				}
 				outfd = open(destination,
@@ -1302,7 +1431,6 @@ retvalue checksums_copyfile(const char *destination, const char *source, bool de
 				e = errno;
 			} else {
 				(void)close(infd);
-				free(buffer);
 				return RET_ERROR_EXIST;
 			}
 		}
@@ -1311,42 +1439,24 @@ retvalue checksums_copyfile(const char *destination, const char *source, bool de
 "Error %d creating '%s': %s\n",
 					e, destination, strerror(e));
 			(void)close(infd);
-			free(buffer);
 			return RET_ERRNO(e);
 		}
 	}
 	checksumscontext_init(&context);
-	do {
-		sizeread = read(infd, buffer, bufsize);
-		if (sizeread < 0) {
-			e = errno;
-			fprintf(stderr, "Error %d while reading %s: %s\n",
-					e, source, strerror(e));
-			free(buffer);
-			(void)close(infd); (void)close(outfd);
-			deletefile(destination);
-			return RET_ERRNO(e);;
-		}
-		checksumscontext_update(&context, buffer, (size_t)sizeread);
-		towrite = sizeread;
-		start = buffer;
-		while (towrite > 0) {
-			written = write(outfd, start, (size_t)towrite);
-			if (written < 0) {
-				e = errno;
-				fprintf(stderr,
-"Error %d while writing to %s: %s\n",
-						e, destination, strerror(e));
-				free(buffer);
-				(void)close(infd); (void)close(outfd);
-				deletefile(destination);
-				return RET_ERRNO(e);;
-			}
-			towrite -= written;
-			start += written;
-		}
-	} while (sizeread > 0);
-	free(buffer);
+	/* if the kernel can copy it, the data still has to be read once
+	 * for the checksums, but not copied through userspace.
+	 * (What is hashed is the copy, as the source might change) */
+	r = kernelcopy(infd, outfd, source, destination, &filesize);
+	if (RET_IS_OK(r))
+		r = hashcopy(destination, &context);
+	else if (r == RET_NOTHING)
+		r = copyandhash(infd, outfd, source, destination,
+				&context, &filesize);
+	if (RET_WAS_ERROR(r)) {
+		(void)close(infd); (void)close(outfd);
+		deletefile(destination);
+		return r;
+	}
 	i = close(infd);
 	if (i != 0) {
 		e = errno;
@@ -1364,7 +1474,12 @@ retvalue checksums_copyfile(const char *destination, const char *source, bool de
 		deletefile(destination);
 		return RET_ERRNO(e);;
 	}
-	return checksums_from_context(checksums_p, &context);
+	r = checksums_from_context(checksums_p, &context);
+	if (RET_IS_OK(r)) {
+		stats.copied++;
+		stats.copiedbytes += checksums_getfilesize(*checksums_p);
+	}
+	return r;
 }
 
 retvalue checksums_linkorcopyfile(const char *destination, const char *source, struct checksums **checksums_p) {
@@ -1380,6 +1495,7 @@ retvalue checksums_linkorcopyfile(const char *destination, const char *source, s
 	i = link(source, destination);
 	if (i != 0)
 		return checksums_copyfile(destination, source, true, checksums_p);
+	stats.linked++;
 	*checksums_p = NULL;
 	return RET_OK;
 }
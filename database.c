@@ -25,6 +25,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <unistd.h>
 #include <db.h>
 
@@ -44,6 +45,7 @@
 #include "distribution.h"
 #include "database_p.h"
 #include "chunks.h"
+#include "stats.h"
 
 #define STRINGIFY(x) #x
 #define TOSTRING(x) STRINGIFY(x)
@@ -60,7 +62,7 @@ static /*@null@*/ char *rdb_version, *rdb_lastsupportedversion,
 static DB_ENV *rdb_env = NULL;
 
 struct table *rdb_checksums, *rdb_contents;
-struct table *rdb_references;
+struct table *rdb_references, *rdb_referrers, *rdb_referrerids, *rdb_referrerfiles;
 static struct {
 	bool createnewtables;
 } rdb_capabilities;
@@ -111,6 +113,37 @@ static retvalue database_openenv(void) {
 	return RET_OK;
 }
 
+/* Berkeley DB handles may not be used in a forked child process.
+ * So before forking processes reading the database, the parent writes
+ * out everything cached (database_sync) and each child forgets the
+ * handles of the parent (closing them would write out its copy of the
+ * parent's cache) and opens an environment of its own. */
+retvalue database_sync(void) {
+	int dbret;
+
+	if (rdb_env == NULL)
+		return RET_NOTHING;
+	dbret = rdb_env->memp_sync(rdb_env, NULL);
+	if (dbret != 0) {
+		fprintf(stderr, "Error: DB_ENV->memp_sync: %s\n",
+				db_strerror(dbret));
+		return RET_DBERR(dbret);
+	}
+	return RET_OK;
+}
+
+retvalue database_forked(void) {
+	rdb_checksums = NULL;
+	rdb_contents = NULL;
+	rdb_references = NULL;
+	rdb_referrers = NULL;
+	rdb_referrerids = NULL;
+	rdb_referrerfiles = NULL;
+	opened_tables = NULL;
+	rdb_env = NULL;
+	return database_openenv();
+}
+
 static void database_closeenv(void) {
 	int dbret;
 
@@ -125,21 +158,111 @@ static void database_closeenv(void) {
 /* lock file handling */
 /**********************/
 
-static retvalue database_lock(size_t waitforlock) {
-	char *lockfile;
-	int fd;
-	retvalue r;
-	size_t tries = 0;
+/* Every process using the database holds a fcntl lock on the first
+ * byte of db/rwlock:
+ * Commands only reading the database take a shared lock.
+ * Commands changing it also create db/lockfile (which keeps other
+ * changing commands, also those of older versions, out) and hold an
+ * exclusive lock while creating that, then only a shared one until
+ * they are about to change anything in the database for the first time
+ * (see database_changing), so reading commands can run while they
+ * are only downloading or exporting.
+ * While waiting for that exclusive lock, they hold an exclusive lock
+ * on the second byte, which new readers wait for before taking their
+ * shared lock, so a steady stream of readers cannot starve them. */
+
+#define RWLOCK_DATA 0
+#define RWLOCK_PENDING 1
+
+static int rdb_lockfd = -1;
+static bool rdb_exclusive, rdb_lockfilecreated;
+static size_t rdb_waitforlock;
+static volatile bool rdb_lockwaitexpired;
+
+static void lockwait_signaled(int) /*__attribute__((signal))*/;
+static void lockwait_signaled(UNUSED(int s)) {
+	rdb_lockwaitexpired = true;
+}
+
+static int setrwlock(off_t which, short type, bool wait) {
+	struct flock lock;
+
+	memset(&lock, 0, sizeof(lock));
+	lock.l_type = type;
+	lock.l_whence = SEEK_SET;
+	lock.l_start = which;
+	lock.l_len = 1;
+	if (fcntl(rdb_lockfd, wait?F_SETLKW:F_SETLK, &lock) == 0)
+		return 0;
+	return errno;
+}
+
+/* get the lock, waiting waitforlock times 10 seconds,
+ * returns RET_NOTHING if that was not enough */
+static retvalue getrwlock(off_t which, short type, size_t waitforlock, const char *waitmessage) {
+	struct sigaction sa, oldsa;
+	unsigned int seconds;
+	int e;
 
-	assert (!rdb_locked);
-	rdb_dircreationdepth = 0;
-	r = dir_create_needed(global.dbdir, &rdb_dircreationdepth);
-	if (RET_WAS_ERROR(r))
-		return r;
+	e = setrwlock(which, type, false);
+	if (e == 0)
+		return RET_OK;
+	if (e == EACCES || e == EAGAIN) {
+		if (waitforlock == 0)
+			return RET_NOTHING;
+		if (verbose >= 0)
+			printf("%s\n", waitmessage);
+		if (waitforlock > UINT_MAX / 10)
+			seconds = UINT_MAX;
+		else
+			seconds = 10 * waitforlock;
+		rdb_lockwaitexpired = false;
+		sigemptyset(&sa.sa_mask);
+		sa.sa_flags = 0;
+		sa.sa_handler = lockwait_signaled;
+		(void)sigaction(SIGALRM, &sa, &oldsa);
+		(void)alarm(seconds);
+		do {
+			e = setrwlock(which, type, true);
+		} while (e == EINTR && !interrupted() && !rdb_lockwaitexpired);
+		(void)alarm(0);
+		(void)sigaction(SIGALRM, &oldsa, NULL);
+		if (e == 0)
+			return RET_OK;
+		if (e == EINTR)
+			return interrupted()?RET_ERROR_INTERRUPTED:RET_NOTHING;
+	}
+	if (e == EDEADLK)
+		fprintf(stderr,
+"Error: Another reprepro process also waits to change the database while\n"
+"this one is reading it!\n");
+	else
+		fprintf(stderr, "Error %d locking '%s/rwlock': %s!\n",
+				e, global.dbdir, strerror(e));
+	return RET_ERRNO(e);
+}
+
+/* A lockfile without content was created by an older version
+ * which does not know about db/rwlock */
+static bool oldstylelockfile(const char *lockfile) {
+	struct stat s;
+
+	return lstat(lockfile, &s) == 0 && s.st_size == 0;
+}
+
+static void lockfileexists(const char *lockfile) {
+	fprintf(stderr,
+"The lock file '%s' already exists. There might be another instance with the\n"
+"same database dir running. To avoid locking overhead, only one process\n"
+"can access the database at the same time. Do not delete the lock file unless\n"
+"you are sure no other version is still running!\n", lockfile);
+}
+
+static retvalue createlockfile(const char *lockfile, size_t waitforlock) {
+	char pid[30];
+	int fd, len;
+	size_t tries = 0;
 
-	lockfile = dbfilename("lockfile");
-	if (FAILEDTOALLOC(lockfile))
-		return RET_ERROR_OOM;
 	fd = open(lockfile, O_WRONLY|O_CREAT|O_EXCL|O_NOFOLLOW|O_NOCTTY,
 			S_IRUSR|S_IWUSR);
 	while (fd < 0) {
@@ -160,60 +283,187 @@ static retvalue database_lock(size_t waitforlock) {
 				continue;
 
 			}
-			fprintf(stderr,
-"The lock file '%s' already exists. There might be another instance with the\n"
-"same database dir running. To avoid locking overhead, only one process\n"
-"can access the database at the same time. Do not delete the lock file unless\n"
-"you are sure no other version is still running!\n", lockfile);
-
+			lockfileexists(lockfile);
 		} else
 			fprintf(stderr,
 "Error %d creating lock file '%s': %s!\n",
 					e, lockfile, strerror(e));
-		free(lockfile);
 		return RET_ERRNO(e);
 	}
+	/* some content tells newer versions that db/rwlock is used */
+	len = snprintf(pid, sizeof(pid), "%lu\n", (unsigned long)getpid());
 	// TODO: do some more locking of this file to avoid problems
 	// with the non-atomity of O_EXCL with nfs-filesystems...
-	if (close(fd) != 0) {
+	if (write(fd, pid, len) != len || close(fd) != 0) {
 		int e = errno;
 		fprintf(stderr,
 "(Late) Error %d creating lock file '%s': %s!\n",
 				e, lockfile, strerror(e));
+		(void)close(fd);
 		(void)unlink(lockfile);
+		return RET_ERRNO(e);
+	}
+	rdb_lockfilecreated = true;
+	return RET_OK;
+}
+
+/* readers only wait for changing processes of older versions */
+static retvalue waitforlockfile(const char *lockfile, size_t waitforlock) {
+	size_t tries = 0;
+
+	while (oldstylelockfile(lockfile)) {
+		if (tries >= waitforlock || interrupted()) {
+			lockfileexists(lockfile);
+			return RET_ERROR;
+		}
+		if (verbose >= 0)
+			printf(
+"Could not acquire lock: %s already exists!\nWaiting 10 seconds before trying again.\n",
+					lockfile);
+		(void)sleep(10);
+		tries++;
+	}
+	return RET_OK;
+}
+
+static void releaselock(void);
+
+static retvalue database_lock(bool readonly, size_t waitforlock) {
+	char *lockfile;
+	retvalue r;
+
+	assert (!rdb_locked);
+	rdb_dircreationdepth = 0;
+	r = dir_create_needed(global.dbdir, &rdb_dircreationdepth);
+	if (RET_WAS_ERROR(r))
+		return r;
+
+	lockfile = dbfilename("rwlock");
+	if (FAILEDTOALLOC(lockfile))
+		return RET_ERROR_OOM;
+	rdb_lockfd = open(lockfile, (readonly?O_RDONLY:O_RDWR)
+			|O_CREAT|O_NOFOLLOW|O_NOCTTY, 0664);
+	if (rdb_lockfd < 0) {
+		int e = errno;
+		fprintf(stderr, "Error %d opening '%s': %s!\n",
+				e, lockfile, strerror(e));
 		free(lockfile);
+		dir_remove_new(global.dbdir, rdb_dircreationdepth);
 		return RET_ERRNO(e);
 	}
 	free(lockfile);
+	markcloseonexec(rdb_lockfd);
 	rdb_locked = true;
+	rdb_exclusive = false;
+	rdb_lockfilecreated = false;
+	rdb_waitforlock = waitforlock;
+
+	/* do not overtake a process waiting to change the database */
+	r = getrwlock(RWLOCK_PENDING, F_RDLCK, waitforlock,
+"Waiting for another reprepro process to change the database...");
+	if (RET_IS_OK(r)) {
+		r = getrwlock(RWLOCK_DATA, readonly?F_RDLCK:F_WRLCK,
+				waitforlock,
+"Waiting for another reprepro process using the database to finish...");
+		(void)setrwlock(RWLOCK_PENDING, F_UNLCK, false);
+	}
+	if (r == RET_NOTHING) {
+		fprintf(stderr,
+"The database in '%s' is in use by another reprepro process.\n"
+"(Use --waitforlock to wait for it.)\n", global.dbdir);
+		r = RET_ERROR;
+	}
+	if (RET_WAS_ERROR(r)) {
+		releaselock();
+		return r;
+	}
+
+	lockfile = dbfilename("lockfile");
+	if (FAILEDTOALLOC(lockfile)) {
+		releaselock();
+		return RET_ERROR_OOM;
+	}
+	if (readonly)
+		r = waitforlockfile(lockfile, waitforlock);
+	else
+		r = createlockfile(lockfile, waitforlock);
+	free(lockfile);
+	if (RET_WAS_ERROR(r)) {
+		releaselock();
+		return r;
+	}
+	if (!readonly) {
+		/* let readers in until something is changed */
+		(void)setrwlock(RWLOCK_DATA, F_RDLCK, false);
+	}
 
 	r = database_openenv();
 	if (RET_WAS_ERROR(r)) {
-		(void)unlink(lockfile);
-		free(lockfile);
+		releaselock();
 		return r;
 	}
 	return RET_OK;
 }
 
+/* to be called before anything in the database is changed */
+static retvalue database_changing(void) {
+	retvalue r;
+
+	assert (rdb_locked);
+	if (rdb_exclusive)
+		return RET_OK;
+	/* keep new readers out while waiting, there is only one process
+	 * changing the database at a time, so no need to wait here */
+	r = getrwlock(RWLOCK_PENDING, F_WRLCK, 0, NULL);
+	if (r == RET_NOTHING) {
+		fprintf(stderr,
+"Error: Another process is holding '%s/rwlock' in an unexpected way!\n",
+				global.dbdir);
+		r = RET_ERROR;
+	}
+	if (RET_WAS_ERROR(r))
+		return r;
+	r = getrwlock(RWLOCK_DATA, F_WRLCK, rdb_waitforlock,
+"Waiting for other reprepro processes reading the database to finish...");
+	(void)setrwlock(RWLOCK_PENDING, F_UNLCK, false);
+	if (r == RET_NOTHING) {
+		fprintf(stderr,
+"The database in '%s' is still read by another reprepro process.\n"
+"(Use --waitforlock to wait for it.)\n", global.dbdir);
+		r = RET_ERROR;
+	}
+	if (RET_IS_OK(r))
+		rdb_exclusive = true;
+	return r;
+}
+
 static void releaselock(void) {
 	char *lockfile;
 
 	assert (rdb_locked);
 
-	database_closeenv();
-	lockfile = dbfilename("lockfile");
-	if (lockfile == NULL)
-		return;
-	if (unlink(lockfile) != 0) {
-		int e = errno;
-		fprintf(stderr, "Error %d deleting lock file '%s': %s!\n",
-				e, lockfile, strerror(e));
-		(void)unlink(lockfile);
+	if (rdb_env != NULL)
+		database_closeenv();
+	if (rdb_lockfilecreated) {
+		lockfile = dbfilename("lockfile");
+		if (lockfile != NULL) {
+			if (unlink(lockfile) != 0) {
+				int e = errno;
+				fprintf(stderr,
+"Error %d deleting lock file '%s': %s!\n",
+						e, lockfile, strerror(e));
+				(void)unlink(lockfile);
+			}
+			free(lockfile);
+		}
+		rdb_lockfilecreated = false;
 	}
-	free(lockfile);
+	/* this also releases the fcntl lock */
+	(void)close(rdb_lockfd);
+	rdb_lockfd = -1;
 	dir_remove_new(global.dbdir, rdb_dircreationdepth);
 	rdb_locked = false;
+	rdb_exclusive = false;
 }
 
 static retvalue writeversionfile(void);
@@ -221,11 +471,27 @@ static retvalue writeversionfile(void);
 retvalue database_close(void) {
 	retvalue result = RET_OK, r;
 
+	references_forgetcache();
 	if (rdb_references != NULL) {
 		r = table_close(rdb_references);
 		RET_UPDATE(result, r);
 		rdb_references = NULL;
 	}
+	if (rdb_referrers != NULL) {
+		r = table_close(rdb_referrers);
+		RET_UPDATE(result, r);
+		rdb_referrers = NULL;
+	}
+	if (rdb_referrerids != NULL) {
+		r = table_close(rdb_referrerids);
+		RET_UPDATE(result, r);
+		rdb_referrerids = NULL;
+	}
+	if (rdb_referrerfiles != NULL) {
+		r = table_close(rdb_referrerfiles);
+		RET_UPDATE(result, r);
+		rdb_referrerfiles = NULL;
+	}
 	if (rdb_checksums != NULL) {
 		r = table_close(rdb_checksums);
 		RET_UPDATE(result, r);
@@ -236,8 +502,11 @@ retvalue database_close(void) {
 		RET_UPDATE(result, r);
 		rdb_contents = NULL;
 	}
-	r = writeversionfile();
-	RET_UPDATE(result, r);
+	/* readers may be many at a time, so only those changing something */
+	if (!rdb_readonly || rdb_exclusive) {
+		r = writeversionfile();
+		RET_UPDATE(result, r);
+	}
 	if (rdb_locked)
 		releaselock();
 	database_free();
@@ -257,13 +526,15 @@ static retvalue database_hasdatabasefile(const char *filename, /*@out@*/bool *ex
 
 enum database_type {
 	dbt_QUERY,
-	dbt_BTREE, dbt_BTREEDUP, dbt_BTREEPAIRS, dbt_BTREEVERSIONS,
+	dbt_BTREE, dbt_BTREEDUP, dbt_BTREEDUPSORT,
+	dbt_BTREEPAIRS, dbt_BTREEVERSIONS,
 	dbt_HASH,
 	dbt_COUNT /* must be last */
 };
 static const uint32_t types[dbt_COUNT] = {
 	DB_UNKNOWN,
-	DB_BTREE, DB_BTREE, DB_BTREE, DB_BTREE,
+	DB_BTREE, DB_BTREE, DB_BTREE,
+	DB_BTREE, DB_BTREE,
 	DB_HASH
 };
 
@@ -277,13 +548,27 @@ static int paireddatacompare(UNUSED(DB *db), const DBT *a, const DBT *b);
 static retvalue database_opentable(const char *filename, /*@null@*/const char *subtable, enum database_type type, uint32_t flags, /*@out@*/DB **result) {
 	DB *table;
 	int dbret;
+	retvalue r;
+
+	if (ISSET(flags, DB_CREATE) && !rdb_exclusive) {
+		/* creating it would be a change, so look first if
+		 * it is already there */
+		r = database_opentable(filename, subtable, type,
+				flags & ~DB_CREATE, result);
+		if (r != RET_NOTHING)
+			return r;
+		r = database_changing();
+		if (RET_WAS_ERROR(r))
+			return r;
+	}
 
 	dbret = db_create(&table, rdb_env, 0);
 	if (dbret != 0) {
 		fprintf(stderr, "db_create: %s\n", db_strerror(dbret));
 		return RET_DBERR(dbret);
 	}
-	if (type == dbt_BTREEPAIRS || type == dbt_BTREEVERSIONS) {
+	if (type == dbt_BTREEDUPSORT || type == dbt_BTREEPAIRS ||
+			type == dbt_BTREEVERSIONS) {
 		dbret = table->set_flags(table, DB_DUPSORT);
 		if (dbret != 0) {
 			table->err(table, dbret, "db_set_flags(DB_DUPSORT):");
@@ -421,7 +706,11 @@ retvalue database_dropsubtable(const char *table, const char *subtable) {
 	char *filename;
 	DB *db;
 	int dbret;
+	retvalue r;
 
+	r = database_changing();
+	if (RET_WAS_ERROR(r))
+		return r;
 	filename = dbfilename(table);
 	if (FAILEDTOALLOC(filename))
 		return RET_ERROR_OOM;
@@ -892,7 +1181,7 @@ retvalue database_create(struct distribution *alldistributions, bool fast, bool
 	rdb_initialized = true;
 	rdb_used = true;
 
-	r = database_lock(waitforlock);
+	r = database_lock(readonly, waitforlock);
 	assert (r != RET_NOTHING);
 	if (!RET_IS_OK(r)) {
 		database_free();
@@ -1008,6 +1297,8 @@ struct table {
 	DB *sec_berkeleydb;
 	bool readonly, verbose;
 	uint32_t flags;
+	/* counters for --stats-json */
+	struct stats_table *stats;
 };
 
 static void table_printerror(struct table *table, int dbret, const char *action) {
@@ -1131,6 +1422,7 @@ retvalue table_getrecord(struct table *table, bool secondary, const char *key, c
 		db = table->sec_berkeleydb;
 	else
 		db = table->berkeleydb;
+	table->stats->gets++;
 	dbret = db->get(db, NULL, &Key, &Data, 0);
 	// TODO: find out what error code means out of memory...
 	if (dbret == DB_NOTFOUND)
@@ -1174,6 +1466,7 @@ retvalue table_getpair(struct table *table, const char *key, const char *value,
 	SETDBT(Key, key);
 	SETDBTl(Data, value, valuelen + 1);
 
+	table->stats->gets++;
 	dbret = table->berkeleydb->get(table->berkeleydb, NULL,
 			&Key, &Data, DB_GET_BOTH);
 	if (dbret == DB_NOTFOUND || dbret == DB_KEYEMPTY)
@@ -1214,6 +1507,7 @@ retvalue table_gettemprecord(struct table *table, const char *key, const char **
 	SETDBT(Key, key);
 	CLEARDBT(Data);
 
+	table->stats->gets++;
 	dbret = table->berkeleydb->get(table->berkeleydb, NULL,
 			&Key, &Data, 0);
 	// TODO: find out what error code means out of memory...
@@ -1253,6 +1547,9 @@ retvalue table_checkrecord(struct table *table, const char *key, const char *dat
 	DBC *cursor;
 	retvalue r;
 
+	r = database_changing();
+	if (RET_WAS_ERROR(r))
+		return r;
 	SETDBT(Key, key);
 	SETDBT(Data, data);
 	dbret = table->berkeleydb->cursor(table->berkeleydb, NULL, &cursor, 0);
@@ -1260,6 +1557,7 @@ retvalue table_checkrecord(struct table *table, const char *key, const char *dat
 		table_printerror(table, dbret, "cursor");
 		return RET_DBERR(dbret);
 	}
+	table->stats->gets++;
 	dbret=cursor->c_get(cursor, &Key, &Data, DB_GET_BOTH);
 	if (dbret == 0) {
 		r = RET_OK;
@@ -1291,6 +1589,7 @@ retvalue table_removerecord(struct table *table, const char *key, const char *da
 		table_printerror(table, dbret, "cursor");
 		return RET_DBERR(dbret);
 	}
+	table->stats->deletes++;
 	dbret=cursor->c_get(cursor, &Key, &Data, DB_GET_BOTH);
 
 	if (dbret == 0)
@@ -1323,12 +1622,17 @@ bool table_recordexists(struct table *table, const char *key) {
 retvalue table_addrecord(struct table *table, const char *key, const char *data, size_t datalen, bool ignoredups) {
 	int dbret;
 	DBT Key, Data;
+	retvalue r;
 
 	assert (table != NULL);
 	assert (!table->readonly && table->berkeleydb != NULL);
 
+	r = database_changing();
+	if (RET_WAS_ERROR(r))
+		return r;
 	SETDBT(Key, key);
 	SETDBTl(Data, data, datalen + 1);
+	table->stats->puts++;
 	dbret = table->berkeleydb->put(table->berkeleydb, NULL,
 			&Key, &Data, ISSET(table->flags, DB_DUPSORT) ? DB_NODUPDATA : 0);
 	if (dbret != 0 && !(ignoredups && dbret == DB_KEYEXIST)) {
@@ -1349,13 +1653,18 @@ retvalue table_addrecord(struct table *table, const char *key, const char *data,
 retvalue table_adduniqsizedrecord(struct table *table, const char *key, const char *data, size_t data_size, bool allowoverwrite, bool nooverwrite) {
 	int dbret;
 	DBT Key, Data;
+	retvalue r;
 
 	assert (table != NULL);
 	assert (!table->readonly && table->berkeleydb != NULL);
 	assert (data_size > 0 && data[data_size-1] == '\0');
 
+	r = database_changing();
+	if (RET_WAS_ERROR(r))
+		return r;
 	SETDBT(Key, key);
 	SETDBTl(Data, data, data_size);
+	table->stats->puts++;
 	dbret = table->berkeleydb->put(table->berkeleydb, NULL,
 			&Key, &Data, allowoverwrite?0:DB_NOOVERWRITE);
 	if (nooverwrite && dbret == DB_KEYEXIST) {
@@ -1387,11 +1696,16 @@ retvalue table_adduniqrecord(struct table *table, const char *key, const char *d
 retvalue table_deleterecord(struct table *table, const char *key, bool ignoremissing) {
 	int dbret;
 	DBT Key;
+	retvalue r;
 
 	assert (table != NULL);
 	assert (!table->readonly && table->berkeleydb != NULL);
 
+	r = database_changing();
+	if (RET_WAS_ERROR(r))
+		return r;
 	SETDBT(Key, key);
+	table->stats->deletes++;
 	dbret = table->berkeleydb->del(table->berkeleydb, NULL, &Key, 0);
 	if (dbret != 0) {
 		if (dbret == DB_NOTFOUND && ignoremissing)
@@ -1533,6 +1847,42 @@ static inline retvalue parse_pair(struct table *table, DBT Key, DBT Data, /*@nul
 	return RET_OK;
 }
 
+/* position a cursor on the first key not sorting before the given one */
+retvalue table_newrangecursor(struct table *table, const char *key, struct cursor **cursor_p, const char **key_p, const char **data_p, size_t *datalen_p) {
+	struct cursor *cursor;
+	int dbret;
+	DBT Key, Data;
+	retvalue r;
+
+	r = newcursor(table, DB_NEXT, &cursor);
+	if (!RET_IS_OK(r))
+		return r;
+	SETDBT(Key, key);
+	CLEARDBT(Data);
+	table->stats->cursorsteps++;
+	dbret = cursor->cursor->c_get(cursor->cursor, &Key, &Data,
+			DB_SET_RANGE);
+	if (dbret == DB_NOTFOUND || dbret == DB_KEYEMPTY) {
+		(void)cursor->cursor->c_close(cursor->cursor);
+		free(cursor);
+		return RET_NOTHING;
+	}
+	if (dbret != 0) {
+		table_printerror(table, dbret, "c_get(DB_SET_RANGE)");
+		(void)cursor->cursor->c_close(cursor->cursor);
+		free(cursor);
+		return RET_DBERR(dbret);
+	}
+	r = parse_data(table, Key, Data, key_p, data_p, datalen_p);
+	if (RET_WAS_ERROR(r)) {
+		(void)cursor->cursor->c_close(cursor->cursor);
+		free(cursor);
+		return r;
+	}
+	*cursor_p = cursor;
+	return RET_OK;
+}
+
 retvalue table_newduplicatecursor(struct table *table, const char *key, long long skip, struct cursor **cursor_p, const char **key_p, const char **data_p, size_t *datalen_p) {
 	struct cursor *cursor;
 	int dbret;
@@ -1545,6 +1895,7 @@ retvalue table_newduplicatecursor(struct table *table, const char *key, long lon
 	}
 	SETDBT(Key, key);
 	CLEARDBT(Data);
+	table->stats->cursorsteps++;
 	dbret = cursor->cursor->c_get(cursor->cursor, &Key, &Data, DB_SET);
 	if (dbret == DB_NOTFOUND || dbret == DB_KEYEMPTY) {
 		(void)cursor->cursor->c_close(cursor->cursor);
@@ -1601,6 +1952,7 @@ retvalue table_newduplicatepairedcursor(struct table *table, const char *key, st
 	cursor = *cursor_p;
 	SETDBT(Key, key);
 	CLEARDBT(Data);
+	table->stats->cursorsteps++;
 	dbret = cursor->cursor->c_get(cursor->cursor, &Key, &Data, DB_SET);
 	if (dbret == DB_NOTFOUND || dbret == DB_KEYEMPTY) {
 		(void)cursor->cursor->c_close(cursor->cursor);
@@ -1640,6 +1992,7 @@ retvalue table_newpairedcursor(struct table *table, const char *key, const char
 	cursor = *cursor_p;
 	SETDBT(Key, key);
 	SETDBTl(Data, value, valuelen + 1);
+	table->stats->cursorsteps++;
 	dbret = cursor->cursor->c_get(cursor->cursor, &Key, &Data, DB_GET_BOTH);
 	if (dbret != 0) {
 		if (dbret == DB_NOTFOUND || dbret == DB_KEYEMPTY) {
@@ -1700,6 +2053,7 @@ static bool cursor_next(struct table *table, struct cursor *cursor, DBT *Key, DB
 	CLEARDBT(*Key);
 	CLEARDBT(*Data);
 
+	table->stats->cursorsteps++;
 	dbret = cursor->cursor->c_get(cursor->cursor, Key, Data,
 			cursor->flags);
 	if (dbret == DB_NOTFOUND)
@@ -1753,13 +2107,18 @@ bool cursor_nextpair(struct table *table, struct cursor *cursor, /*@null@*/const
 retvalue cursor_replace(struct table *table, struct cursor *cursor, const char *data, size_t datalen) {
 	DBT Key, Data;
 	int dbret;
+	retvalue r;
 
 	assert (cursor != NULL);
 	assert (!table->readonly);
 
+	r = database_changing();
+	if (RET_WAS_ERROR(r))
+		return r;
 	CLEARDBT(Key);
 	SETDBTl(Data, data, datalen + 1);
 
+	table->stats->puts++;
 	dbret = cursor->cursor->c_put(cursor->cursor, &Key, &Data, DB_CURRENT);
 
 	if (dbret != 0) {
@@ -1771,10 +2130,15 @@ retvalue cursor_replace(struct table *table, struct cursor *cursor, const char *
 
 retvalue cursor_delete(struct table *table, struct cursor *cursor, const char *key, const char *value) {
 	int dbret;
+	retvalue r;
 
 	assert (cursor != NULL);
 	assert (!table->readonly);
 
+	r = database_changing();
+	if (RET_WAS_ERROR(r))
+		return r;
+	table->stats->deletes++;
 	dbret = cursor->cursor->c_del(cursor->cursor, 0);
 
 	if (dbret != 0) {
@@ -1888,6 +2252,7 @@ static retvalue database_table_secondary(const char *filename, const char *subta
 	table->readonly = ISSET(flags, DB_RDONLY);
 	table->verbose = rdb_verbose;
 	table->flags = flags;
+	table->stats = stats_table(filename);
 	r = database_opentable(filename, subtable, type, flags,
 			&table->berkeleydb);
 	if (RET_WAS_ERROR(r)) {
@@ -1959,10 +2324,70 @@ static retvalue database_table(const char *filename, const char *subtable, enum
 	return database_table_secondary(filename, subtable, type, flags, NULL, 0, table_p);
 }
 
+/* the tables of the compact format (see reference.c), which is
+ * recognized by the referrers table being there */
+static const struct {
+	const char *subtable;
+	enum database_type type;
+	struct table **table_p;
+} compactreferences[] = {
+	{ "references",		dbt_BTREE,		&rdb_references },
+	{ "referrers",		dbt_BTREE,		&rdb_referrers },
+	{ "referrerids",	dbt_BTREE,		&rdb_referrerids },
+	{ "referrerfiles",	dbt_BTREEDUPSORT,	&rdb_referrerfiles },
+	{ NULL, 0, NULL }
+};
+
+static retvalue database_closecompactreferences(void) {
+	retvalue result = RET_OK, r;
+	int i;
+
+	references_forgetcache();
+	for (i = 0 ; compactreferences[i].subtable != NULL ; i++) {
+		r = table_close(*compactreferences[i].table_p);
+		RET_UPDATE(result, r);
+		*compactreferences[i].table_p = NULL;
+	}
+	return result;
+}
+
+static retvalue database_opencompactreferences(void) {
+	retvalue r;
+	int i;
+
+	references_forgetcache();
+	for (i = 0 ; compactreferences[i].subtable != NULL ; i++) {
+		struct table **table_p = compactreferences[i].table_p;
+
+		r = database_table("references.db",
+				compactreferences[i].subtable,
+				compactreferences[i].type, DB_CREATE, table_p);
+		assert (r != RET_NOTHING);
+		if (RET_WAS_ERROR(r)) {
+			*table_p = NULL;
+			(void)database_closecompactreferences();
+			return r;
+		}
+		(*table_p)->verbose = false;
+	}
+	return RET_OK;
+}
+
 retvalue database_openreferences(void) {
+	struct strlist subtables;
+	bool compact;
 	retvalue r;
 
 	assert (rdb_references == NULL);
+	r = database_listsubtables("references.db", &subtables);
+	if (RET_WAS_ERROR(r))
+		return r;
+	compact = RET_IS_OK(r) && strlist_in(&subtables, "referrers");
+	if (RET_IS_OK(r))
+		strlist_done(&subtables);
+	if (compact)
+		return database_opencompactreferences();
+
 	r = database_table("references.db", "references",
 			dbt_BTREEDUP, DB_CREATE, &rdb_references);
 	assert (r != RET_NOTHING);
@@ -2004,7 +2429,11 @@ static int debianversioncompare(UNUSED(DB *db), const DBT *a, const DBT *b) {
 	}
 	b_version++;
 
-	r = dpkgversions_cmp(a_version, b_version, &versioncmp);
+	r = dpkgversions_cmp_l(a_version,
+			(const char*)a->data + a->size - 1 - a_version,
+			b_version,
+			(const char*)b->data + b->size - 1 - b_version,
+			&versioncmp);
 	if (RET_WAS_ERROR(r)) {
 		fprintf(stderr, "Parse errors processing versions.\n");
 		return r;
@@ -2085,6 +2514,10 @@ static retvalue database_translate_legacy_packages(void) {
 		return RET_ERROR;
 	}
 
+	r = database_changing();
+	if (RET_WAS_ERROR(r))
+		return r;
+
 	packages_filename = dbfilename("packages.db");
 	legacy_filename = dbfilename("packages.legacy.db");
 	ret = rename(packages_filename, legacy_filename);
@@ -2324,6 +2757,12 @@ retvalue database_openreleasecache(const char *codename, struct table **cachedb_
 	if (isregularfile(oldcachefilename)) {
 		char *newcachefilename;
 
+		r = database_changing();
+		if (RET_WAS_ERROR(r)) {
+			free(oldcachefilename);
+			return r;
+		}
+
 		newcachefilename = dbfilename("release.caches.db");
 		if (FAILEDTOALLOC(newcachefilename)) {
 			free(oldcachefilename);
@@ -2398,6 +2837,10 @@ retvalue database_translate_filelists(void) {
 		strlist_done(&identifiers);
 	}
 
+	r = database_changing();
+	if (RET_WAS_ERROR(r))
+		return r;
+
 	dbname = dbfilename("contents.cache.db");
 	if (FAILEDTOALLOC(dbname))
 		return RET_ERROR_OOM;
@@ -2475,6 +2918,109 @@ retvalue database_translate_filelists(void) {
 	return RET_OK;
 }
 
+retvalue database_compactreferences(void) {
+	char *dbname, *tmpdbname;
+	struct table *oldtable;
+	struct strlist subtables;
+	bool exists;
+	int ret;
+	retvalue r, r2;
+
+	assert (rdb_references == NULL);
+
+	r = database_listsubtables("references.db", &subtables);
+	if (RET_WAS_ERROR(r))
+		return r;
+	exists = RET_IS_OK(r);
+	if (exists) {
+		if (strlist_in(&subtables, "referrers")) {
+			fprintf(stderr,
+"Your %s/references.db file is already in the compact format!\n",
+					global.dbdir);
+			strlist_done(&subtables);
+			return RET_NOTHING;
+		}
+		strlist_done(&subtables);
+	}
+
+	r = database_changing();
+	if (RET_WAS_ERROR(r))
+		return r;
+
+	if (!exists) {
+		r = database_opencompactreferences();
+		if (RET_WAS_ERROR(r))
+			return r;
+		r = database_closecompactreferences();
+		if (RET_WAS_ERROR(r))
+			return r;
+		r = database_requireversion(VERSION);
+		return RET_WAS_ERROR(r)?r:RET_OK;
+	}
+
+	dbname = dbfilename("references.db");
+	if (FAILEDTOALLOC(dbname))
+		return RET_ERROR_OOM;
+	tmpdbname = dbfilename("old.references.db");
+	if (FAILEDTOALLOC(tmpdbname)) {
+		free(dbname);
+		return RET_ERROR_OOM;
+	}
+	ret = rename(dbname, tmpdbname);
+	if (ret != 0) {
+		int e = errno;
+		fprintf(stderr, "Could not rename '%s' into '%s': %s(%d)\n",
+				dbname, tmpdbname, strerror(e), e);
+		free(dbname);
+		free(tmpdbname);
+		return RET_ERRNO(e);
+	}
+	oldtable = NULL;
+	r = database_table("old.references.db", "references",
+			dbt_BTREEDUP, DB_RDONLY, &oldtable);
+	if (r == RET_NOTHING) {
+		fprintf(stderr, "Could not find old-style database!\n");
+		r = RET_ERROR;
+	}
+	if (RET_IS_OK(r)) {
+		oldtable->verbose = false;
+		r = database_opencompactreferences();
+		if (RET_IS_OK(r)) {
+			r = references_translate(oldtable);
+			if (r == RET_NOTHING)
+				r = RET_OK;
+			r2 = database_closecompactreferences();
+			RET_ENDUPDATE(r, r2);
+		}
+		r2 = table_close(oldtable);
+		RET_ENDUPDATE(r, r2);
+	}
+	if (RET_IS_OK(r))
+		(void)unlink(tmpdbname);
+
+	if (RET_WAS_ERROR(r)) {
+		(void)unlink(dbname);
+		ret = rename(tmpdbname, dbname);
+		if (ret != 0) {
+			int e = errno;
+			fprintf(stderr,
+"Could not rename '%s' back into '%s': %s(%d)\n",
+					tmpdbname, dbname, strerror(e), e);
+			free(tmpdbname);
+			free(dbname);
+			return RET_ERRNO(e);
+		}
+		free(tmpdbname);
+		free(dbname);
+		return r;
+	}
+	free(tmpdbname);
+	free(dbname);
+	/* older versions would not understand the new format */
+	r = database_requireversion(VERSION);
+	return RET_WAS_ERROR(r)?r:RET_OK;
+}
+
 /* This is already implemented as standalone functions duplicating a bit
  * of database_create and from files.c,
  * because database_create is planed to error out if * there is still an old
@@ -2645,8 +3191,13 @@ retvalue database_translate_legacy_checksums(bool verbosedb) {
 	rdb_initialized = true;
 	rdb_used = true;
 
-	r = database_lock(0);
+	r = database_lock(READWRITE, 0);
 	assert (r != RET_NOTHING);
+	if (RET_IS_OK(r)) {
+		r = database_changing();
+		if (RET_WAS_ERROR(r))
+			releaselock();
+	}
 	if (!RET_IS_OK(r)) {
 		database_free();
 		return r;
@@ -2724,3 +3275,25 @@ retvalue database_translate_legacy_checksums(bool verbosedb) {
 bool database_allcreated(void) {
 	return rdb_capabilities.createnewtables;
 }
+
+/* the database now contains things only reprepro versions starting with
+ * <version> understand, so have older ones refuse to touch it */
+retvalue database_requireversion(const char *version) {
+	char *v;
+	retvalue r;
+	int c;
+
+	if (rdb_lastsupportedversion != NULL) {
+		r = dpkgversions_cmp(rdb_lastsupportedversion, version, &c);
+		if (RET_WAS_ERROR(r))
+			return r;
+		if (c >= 0)
+			return RET_NOTHING;
+	}
+	v = strdup(version);
+	if (FAILEDTOALLOC(v))
+		return RET_ERROR_OOM;
+	free(rdb_lastsupportedversion);
+	rdb_lastsupportedversion = v;
+	return RET_OK;
+}
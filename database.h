@@ -27,7 +27,12 @@ retvalue database_openreleasecache(const char *, /*@out@*/struct table **);
 retvalue database_opentracking(const char *, bool /*readonly*/, /*@out@*/struct table **);
 retvalue database_translate_filelists(void);
 retvalue database_translate_legacy_checksums(bool /*verbosedb*/);
+retvalue database_compactreferences(void);
 bool database_allcreated(void);
+/* before forking children reading the database and in those */
+retvalue database_sync(void);
+retvalue database_forked(void);
+retvalue database_requireversion(const char *);
 
 retvalue table_close(/*@only@*/struct table *);
 
@@ -48,6 +53,7 @@ retvalue table_checkrecord(struct table *, const char *key, const char *data);
 retvalue table_removerecord(struct table *, const char *key, const char *data);
 
 retvalue table_newglobalcursor(struct table *, bool /*duplicate*/, /*@out@*/struct cursor **);
+retvalue table_newrangecursor(struct table *, const char *, /*@out@*/struct cursor **, /*@out@*/const char **, /*@out@*/const char **, /*@out@*/size_t *);
 retvalue table_newduplicatecursor(struct table *, const char *, long long, /*@out@*/struct cursor **, /*@out@*/const char **, /*@out@*/const char **, /*@out@*/size_t *);
 retvalue table_newduplicatepairedcursor(struct table *, const char *, /*@out@*/struct cursor **, /*@out@*/const char **, /*@out@*/const char **, /*@out@*/size_t *);
 retvalue table_newpairedcursor(struct table *, const char *, const char *, /*@out@*/struct cursor **, /*@out@*//*@null@*/const char **, /*@out@*//*@null@*/size_t *);
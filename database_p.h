@@ -7,6 +7,8 @@
 
 extern /*@null@*/ struct table *rdb_checksums, *rdb_contents;
 extern /*@null@*/ struct table *rdb_references;
+/* only set if references.db is in the compact format */
+extern /*@null@*/ struct table *rdb_referrers, *rdb_referrerids, *rdb_referrerfiles;
 
 retvalue database_listsubtables(const char *, /*@out@*/struct strlist *);
 retvalue database_dropsubtable(const char *, const char *);
@@ -125,10 +125,7 @@ static retvalue read_control_tar(char **control, const char *debfile, struct ar_
 
 	archive_read_support_format_tar(tar);
 	archive_read_support_format_gnutar(tar);
-	a = archive_read_open(tar, ar,
-			ar_archivemember_open,
-			ar_archivemember_read,
-			ar_archivemember_close);
+	a = ar_archivemember_openarchive(tar, ar);
 	if (a != ARCHIVE_OK) {
 		fprintf(stderr,
 "open control.tar.gz within '%s' failed: %d:%d:%s\n",
@@ -50,10 +50,7 @@ static retvalue read_data_tar(/*@out@*/char **list, /*@out@*/size_t *size, const
 
 	archive_read_support_format_tar(tar);
 	archive_read_support_format_gnutar(tar);
-	a = archive_read_open(tar, ar,
-			ar_archivemember_open,
-			ar_archivemember_read,
-			ar_archivemember_close);
+	a = ar_archivemember_openarchive(tar, ar);
 	if (a != ARCHIVE_OK) {
 		filelistcompressor_cancel(&c);
 		e = archive_errno(tar);
@@ -40,6 +40,9 @@
 #include "configparser.h"
 #include "byhandhook.h"
 #include "package.h"
+#include "reference.h"
+#include "trace.h"
+#include "workers.h"
 #include "distribution.h"
 
 static retvalue distribution_free(struct distribution *distribution) {
@@ -830,6 +833,7 @@ retvalue distribution_snapshot(struct distribution *distribution, const char *na
 	struct target *target;
 	retvalue result, r;
 	struct release *release;
+	struct strlist filekeys;
 	char *id;
 
 	assert (distribution != NULL);
@@ -862,6 +866,11 @@ retvalue distribution_snapshot(struct distribution *distribution, const char *na
 		result = release_prepare(release, distribution, false);
 		assert (result != RET_NOTHING);
 	}
+	if (!RET_WAS_ERROR(result)) {
+		retvalue signresult;
+
+		result = release_sign(&release, &signresult, 1);
+	}
 	if (RET_WAS_ERROR(result)) {
 		release_free(release);
 		return result;
@@ -872,18 +881,42 @@ retvalue distribution_snapshot(struct distribution *distribution, const char *na
 	id = mprintf("s=%s=%s", distribution->codename, name);
 	if (FAILEDTOALLOC(id))
 		return RET_ERROR_OOM;
+	strlist_init(&filekeys);
 	r = package_foreach(distribution,
 			atom_unknown, atom_unknown, atom_unknown,
-			package_referenceforsnapshot, NULL, id);
+			package_collectfilekeys, NULL, &filekeys);
+	if (!RET_WAS_ERROR(r))
+		r = references_add(id, &filekeys);
+	strlist_done(&filekeys);
 	free(id);
 	RET_UPDATE(result, r);
 	return result;
 }
 
-static retvalue export(struct distribution *distribution, bool onlyneeded) {
+static void exportfailed(struct distribution *distribution) {
 	struct target *target;
-	retvalue result, r;
-	struct release *release;
+	bool workleft = false;
+
+	fprintf(stderr, "ERROR: Could not finish exporting '%s'!\n",
+			distribution->codename);
+	for (target=distribution->targets; target != NULL ;
+	                                   target = target->next) {
+		workleft |= target->saved_wasmodified;
+	}
+	if (workleft) {
+		(void)fputs(
+"This means that from outside your repository will still look like before (and\n"
+"should still work if this old state worked), but the changes intended with this\n"
+"call will not be visible until you call export directly (via reprepro export)\n"
+"Changes will also get visible when something else changes the same file and\n"
+"thus creates a new export of that file, but even changes to other parts of the\n"
+"same distribution will not!\n",
+				stderr);
+	}
+}
+
+/* begin exporting, RET_NOTHING if the distribution is not exported */
+static retvalue export_start(struct distribution *distribution, bool onlyneeded, /*@out@*/struct release **release_p) {
 
 	if (verbose >= 15)
 		fprintf(stderr, "trace: export(distribution={codename: %s}, onlyneeded=%s)\n",
@@ -900,71 +933,403 @@ static retvalue export(struct distribution *distribution, bool onlyneeded) {
 		return RET_ERROR;
 	}
 
-	r = release_init(&release, distribution->codename, distribution->suite,
-			distribution->fakecomponentprefix);
-	if (RET_WAS_ERROR(r))
-		return r;
+	return release_init(release_p, distribution->codename,
+			distribution->suite, distribution->fakecomponentprefix);
+}
 
-	result = RET_NOTHING;
-	for (target=distribution->targets; target != NULL ;
-	                                   target = target->next) {
-		r = release_mkdir(release, target->relativedirectory);
-		RET_ENDUPDATE(result, r);
-		if (RET_WAS_ERROR(r))
-			break;
-		r = target_export(target, onlyneeded, false, release);
+/* The index files of all targets of all distributions to export are
+ * generated in worker processes. Once all targets of a distribution are
+ * done, the parent adds the generated files to its release and generates
+ * the Contents files and the Release file, while the workers continue
+ * with the targets of the other distributions. */
+
+struct exportjob {
+	bool onlyneeded, stoponerror;
+	/* to notice being in a worker process, see exportitem */
+	pid_t parent;
+	bool forked;
+	struct exportdistribution {
+		struct distribution *distribution;
+		struct release *release;
+		retvalue result;
+		size_t firstitem, itemcount, itemsleft;
+		bool forked;
+	} *distributions;
+	struct exportitem {
+		struct exportdistribution *distribution;
+		struct target *target;
+		/*@null@*/char *data;
+		size_t len;
+		/* to undo target_exported if not used after all */
+		bool wasmodified, saved_wasmodified;
+		unsigned long long fingerprint;
+	} *items;
+};
+
+struct exporttarget {
+	struct exportjob *job;
+	struct exportitem *item;
+};
+
+/* generate the files of one target, only the result is kept */
+static retvalue exporttarget(void *privdata, struct release *release) {
+	struct exporttarget *e = privdata;
+	struct distribution *distribution = e->item->distribution->distribution;
+	struct target *target = e->item->target;
+	retvalue result, r;
+
+	result = release_mkdir(release, target->relativedirectory);
+	if (RET_WAS_ERROR(result))
+		return result;
+	r = target_export(target, e->job->onlyneeded, false, release);
+	RET_UPDATE(result, r);
+	if (!RET_WAS_ERROR(r) && target->exportmode->release != NULL) {
+		r = release_directorydescription(release, distribution,
+				target, target->exportmode->release,
+				e->job->onlyneeded);
 		RET_UPDATE(result, r);
-		if (RET_WAS_ERROR(r))
-			break;
-		if (target->exportmode->release != NULL) {
-			r = release_directorydescription(release, distribution,
-					target, target->exportmode->release,
-					onlyneeded);
-			RET_UPDATE(result, r);
+	}
+	/* the interesting part is what was added to the release */
+	if (result == RET_NOTHING)
+		result = RET_OK;
+	return result;
+}
+
+static retvalue exportitem(void *privdata, size_t i, char **data_p, size_t *len_p) {
+	struct exporttarget e;
+	struct exportdistribution *d;
+	retvalue r;
+
+	e.job = privdata;
+	e.item = &e.job->items[i];
+	d = e.item->distribution;
+	/* a worker process may not use the database handles of the parent */
+	if (getpid() != e.job->parent) {
+		if (!e.job->forked) {
+			r = database_forked();
 			if (RET_WAS_ERROR(r))
-				break;
+				return r;
+			e.job->forked = true;
+		}
+		if (!d->forked) {
+			r = release_forked(d->release,
+					d->distribution->codename);
+			if (RET_WAS_ERROR(r))
+				return r;
+			d->forked = true;
 		}
 	}
+	return release_generatepart(d->release, exporttarget, &e,
+			data_p, len_p);
+}
+
+/* generate everything but the signatures of the Release file,
+ * once all files of the targets are generated */
+static void export_prepare(struct exportjob *job, struct exportdistribution *d) {
+	struct distribution *distribution = d->distribution;
+	struct exportitem *item;
+	retvalue result, r;
+	size_t i;
+
+	result = d->result;
+	for (i = 0 ; i < d->itemcount ; i++) {
+		item = &job->items[d->firstitem + i];
+		if (item->data == NULL)
+			continue;
+		/* even if failed, so release_free removes the new files */
+		r = release_addpart(d->release, item->data, item->len);
+		RET_UPDATE(result, r);
+		free(item->data);
+		item->data = NULL;
+	}
 	if (!RET_WAS_ERROR(result) && distribution->contents.flags.enabled) {
-		r = contents_generate(distribution, release, onlyneeded);
+		trace_begin("contents", distribution->codename);
+		r = contents_generate(distribution, d->release,
+				job->onlyneeded);
+		trace_end();
 	}
 	if (!RET_WAS_ERROR(result)) {
-		result = release_prepare(release, distribution, onlyneeded);
+		result = release_prepare(d->release, distribution,
+				job->onlyneeded);
 		if (result == RET_NOTHING) {
-			release_free(release);
-			return result;
+			release_free(d->release);
+			d->release = NULL;
 		}
 	}
 	if (RET_WAS_ERROR(result)) {
-		bool workleft = false;
-		release_free(release);
-		fprintf(stderr, "ERROR: Could not finish exporting '%s'!\n",
-				distribution->codename);
-		for (target=distribution->targets; target != NULL ;
-		                                   target = target->next) {
-			workleft |= target->saved_wasmodified;
+		release_free(d->release);
+		d->release = NULL;
+		exportfailed(distribution);
+	}
+	d->result = result;
+}
+
+static retvalue exporteditem(void *privdata, size_t i, retvalue r, const char *data, size_t len) {
+	struct exportjob *job = privdata;
+	struct exportitem *item = &job->items[i];
+	struct exportdistribution *d = item->distribution;
+	struct target *target = item->target;
+
+	if (RET_WAS_ERROR(r))
+		RET_UPDATE(d->result, r);
+	if (len > 0 && !RET_WAS_ERROR(d->result)) {
+		/* added in the order of the targets once all are done */
+		item->data = malloc(len);
+		if (FAILEDTOALLOC(item->data))
+			d->result = RET_ERROR_OOM;
+		else {
+			memcpy(item->data, data, len);
+			item->len = len;
 		}
-		if (workleft) {
-			(void)fputs(
-"This means that from outside your repository will still look like before (and\n"
-"should still work if this old state worked), but the changes intended with this\n"
-"call will not be visible until you call export directly (via reprepro export)\n"
-"Changes will also get visible when something else changes the same file and\n"
-"thus creates a new export of that file, but even changes to other parts of the\n"
-"same distribution will not!\n",
-					stderr);
+	}
+	if (len > 0 && item->data == NULL)
+		/* not used, but so release_free removes the new files */
+		(void)release_addpart(d->release, data, len);
+	if (!RET_WAS_ERROR(r))
+		/* what target_export did in the worker */
+		target_exported(target);
+	assert (d->itemsleft > 0);
+	if (--d->itemsleft == 0)
+		export_prepare(job, d);
+	if (job->stoponerror && RET_WAS_ERROR(d->result))
+		return d->result;
+	/* otherwise errors only stop this distribution, not the others */
+	return RET_OK;
+}
+
+/* the new files of a distribution are not used after all (because an
+ * earlier one failed), so it is left as if not exported at all */
+static void export_skip(struct exportjob *job, struct exportdistribution *d) {
+	size_t i;
+
+	for (i = 0 ; i < d->itemcount ; i++) {
+		struct exportitem *item = &job->items[d->firstitem + i];
+
+		item->target->wasmodified = item->wasmodified;
+		item->target->saved_wasmodified = item->saved_wasmodified;
+		item->target->fingerprint = item->fingerprint;
+	}
+	release_free(d->release);
+	d->release = NULL;
+	d->result = RET_NOTHING;
+}
+
+/* prepare the distributions of the job, the result of each tells if
+ * its release was prepared (RET_OK), there was nothing to do or an error.
+ * With stoponerror nothing after the first failed one is prepared. */
+static retvalue export_prepareall(struct exportjob *job, size_t count, struct distribution **distributions) {
+	struct exportdistribution *d;
+	struct target *target;
+	retvalue result, r;
+	size_t i, itemcount = 0, runcount, failed, before;
+
+	job->distributions = nzNEW(count, struct exportdistribution);
+	if (FAILEDTOALLOC(job->distributions))
+		return RET_ERROR_OOM;
+	for (i = 0 ; i < count ; i++) {
+		d = &job->distributions[i];
+		d->distribution = distributions[i];
+		d->result = export_start(d->distribution, job->onlyneeded,
+				&d->release);
+		if (!RET_IS_OK(d->result))
+			continue;
+		d->firstitem = itemcount;
+		for (target = d->distribution->targets ; target != NULL ;
+		                                 target = target->next)
+			d->itemcount++;
+		d->itemsleft = d->itemcount;
+		itemcount += d->itemcount;
+	}
+	job->items = nzNEW(itemcount + 1, struct exportitem);
+	if (FAILEDTOALLOC(job->items)) {
+		for (i = 0 ; i < count ; i++)
+			if (RET_IS_OK(job->distributions[i].result))
+				release_free(job->distributions[i].release);
+		free(job->distributions);
+		job->distributions = NULL;
+		return RET_ERROR_OOM;
+	}
+	result = RET_NOTHING;
+	/* the targets are handed to the workers in this order, so
+	 * only the targets before a failed distribution are needed */
+	runcount = itemcount;
+	failed = count;
+	before = 0;
+	for (i = 0 ; i < count ; i++) {
+		struct exportitem *item;
+
+		d = &job->distributions[i];
+		if (RET_IS_OK(d->result)) {
+			item = &job->items[d->firstitem];
+			for (target = d->distribution->targets ;
+			     target != NULL ; target = target->next) {
+				item->distribution = d;
+				item->target = target;
+				item->wasmodified = target->wasmodified;
+				item->saved_wasmodified =
+					target->saved_wasmodified;
+				item->fingerprint = target->fingerprint;
+				item++;
+			}
+			assert (item == &job->items[d->firstitem
+			                            + d->itemcount]);
+			if (d->itemcount == 0)
+				export_prepare(job, d);
 		}
-	} else {
-		r = release_finish(release, distribution);
-		RET_UPDATE(result, r);
+		if (job->stoponerror && failed == count &&
+				RET_WAS_ERROR(d->result)) {
+			failed = i;
+			runcount = before;
+		}
+		before += d->itemcount;
+	}
+	/* the workers read the database with handles of their own */
+	r = database_sync();
+	if (!RET_WAS_ERROR(r))
+		r = workers_run(runcount, exportitem, exporteditem, job);
+	if (RET_WAS_ERROR(r))
+		result = r;
+	if (job->stoponerror) {
+		/* the workers stop at the first failing distribution,
+		 * but that might be before an earlier one is done */
+		for (i = 0 ; i < failed ; i++)
+			if (RET_WAS_ERROR(job->distributions[i].result)) {
+				failed = i;
+				break;
+			}
+	}
+	for (i = 0 ; i < count ; i++) {
+		d = &job->distributions[i];
+		if (d->itemsleft > 0) {
+			size_t j;
+
+			/* aborted before all targets were done,
+			 * the release still needs to know the new files
+			 * of the finished targets to remove them */
+			for (j = 0 ; j < d->itemcount ; j++) {
+				struct exportitem *item;
+
+				item = &job->items[d->firstitem + j];
+				if (item->data == NULL)
+					continue;
+				(void)release_addpart(d->release,
+						item->data, item->len);
+				free(item->data);
+				item->data = NULL;
+			}
+			d->itemsleft = 0;
+			if (i > failed) {
+				export_skip(job, d);
+				continue;
+			}
+			release_free(d->release);
+			d->release = NULL;
+			if (!RET_WAS_ERROR(d->result))
+				d->result = RET_WAS_ERROR(r)?r:RET_ERROR;
+			exportfailed(d->distribution);
+		} else if (i > failed && RET_IS_OK(d->result))
+			export_skip(job, d);
+		RET_UPDATE(result, d->result);
 	}
-	if (RET_IS_OK(result))
+	return result;
+}
+
+/* move the new files of a prepared and signed release into place */
+static retvalue export_finish(struct distribution *distribution, /*@only@*/struct release *release) {
+	retvalue r;
+
+	r = release_finish(release, distribution);
+	if (RET_IS_OK(r))
 		distribution->status = RET_NOTHING;
+	return r;
+}
+
+/* export the given distributions, all Release files are signed together
+ * after the others are generated, as that might need some slow gpg or
+ * hook calls.
+ * With stoponerror nothing after the first failed one is exported
+ * (as when exporting one after the other). */
+static retvalue export(size_t count, struct distribution **distributions, bool onlyneeded, bool stoponerror, /*@out@*/retvalue *results) {
+	struct exportjob job;
+	struct exportdistribution **prepared, *d;
+	struct release **releases;
+	retvalue *signresults, result, r;
+	size_t i, n;
+	bool stop = false;
+
+	for (i = 0 ; i < count ; i++)
+		results[i] = RET_ERROR_OOM;
+	releases = nzNEW(count, struct release *);
+	prepared = nzNEW(count, struct exportdistribution *);
+	signresults = nzNEW(count, retvalue);
+	if (FAILEDTOALLOC(releases) || FAILEDTOALLOC(prepared)
+			|| FAILEDTOALLOC(signresults)) {
+		free(releases);
+		free(prepared);
+		free(signresults);
+		return RET_ERROR_OOM;
+	}
+	job.onlyneeded = onlyneeded;
+	job.stoponerror = stoponerror;
+	job.parent = getpid();
+	job.forked = false;
+	result = export_prepareall(&job, count, distributions);
+	if (job.distributions == NULL) {
+		free(releases);
+		free(prepared);
+		free(signresults);
+		return result;
+	}
+	n = 0;
+	for (i = 0 ; i < count ; i++) {
+		d = &job.distributions[i];
+		results[i] = d->result;
+		if (!RET_IS_OK(d->result))
+			continue;
+		releases[n] = d->release;
+		prepared[n] = d;
+		n++;
+	}
+	if (n > 0) {
+		r = release_sign(releases, signresults, n);
+		RET_UPDATE(result, r);
+	}
+	for (i = 0 ; i < n ; i++) {
+		d = prepared[i];
+		if (stop) {
+			/* not exported, as an earlier one failed */
+			export_skip(&job, d);
+			results[d - job.distributions] = RET_NOTHING;
+			continue;
+		}
+		d->release = NULL;
+		if (RET_WAS_ERROR(signresults[i])) {
+			release_free(releases[i]);
+			exportfailed(d->distribution);
+			results[d - job.distributions] = signresults[i];
+			stop = stoponerror;
+			continue;
+		}
+		r = export_finish(d->distribution, releases[i]);
+		results[d - job.distributions] = r;
+		RET_UPDATE(result, r);
+	}
+	free(releases);
+	free(prepared);
+	free(signresults);
+	free(job.items);
+	free(job.distributions);
 	return result;
 }
 
 retvalue distribution_fullexport(struct distribution *distribution) {
-	return export(distribution, false);
+	retvalue r;
+
+	return export(1, &distribution, false, false, &r);
+}
+
+retvalue distribution_fullexportlist(size_t count, struct distribution **distributions, bool stoponerror, retvalue *results) {
+	return export(count, distributions, false, stoponerror, results);
 }
 
 retvalue distribution_freelist(struct distribution *distributions) {
@@ -984,6 +1349,9 @@ retvalue distribution_exportlist(enum exportwhen when, struct distribution *dist
 	retvalue result, r;
 	bool todo = false;
 	struct distribution *d;
+	struct distribution **toexport;
+	retvalue *results;
+	size_t count;
 
 	if (verbose >= 15)
 		fprintf(stderr, "trace: distribution_exportlist() called.\n");
@@ -1016,6 +1384,18 @@ retvalue distribution_exportlist(enum exportwhen when, struct distribution *dist
 	if (verbose >= 0 && todo)
 		printf("Exporting indices...\n");
 
+	count = 0;
+	for (d = distributions ; d != NULL ; d = d->next)
+		count++;
+	toexport = nzNEW(count, struct distribution *);
+	results = nzNEW(count, retvalue);
+	if (FAILEDTOALLOC(toexport) || FAILEDTOALLOC(results)) {
+		free(toexport);
+		free(results);
+		return RET_ERROR_OOM;
+	}
+	count = 0;
+
 	result = RET_NOTHING;
 	for (d=distributions; d != NULL; d = d->next) {
 		if (verbose >= 20)
@@ -1057,8 +1437,7 @@ retvalue distribution_exportlist(enum exportwhen when, struct distribution *dist
 "Please report this and how you got this message as bugreport. Thanks.\n"
 "Doing a export despite --export=changed....\n",
 						d->codename);
-					r = export(d, true);
-					RET_UPDATE(result, r);
+					toexport[count++] = d;
 					break;
 				}
 			}
@@ -1067,10 +1446,15 @@ retvalue distribution_exportlist(enum exportwhen when, struct distribution *dist
 					(d->status == RET_NOTHING &&
 					  when != EXPORT_CHANGED) ||
 					when == EXPORT_FORCE);
-			r = export(d, true);
-			RET_UPDATE(result, r);
+			toexport[count++] = d;
 		}
 	}
+	if (count > 0) {
+		r = export(count, toexport, true, false, results);
+		RET_UPDATE(result, r);
+	}
+	free(toexport);
+	free(results);
 	return result;
 }
 
@@ -137,6 +137,9 @@ retvalue distribution_prepareforwriting(struct distribution *);
 /*@null@*//*@dependent@*/struct target *distribution_gettarget(const struct distribution *distribution, component_t, architecture_t, packagetype_t);
 
 retvalue distribution_fullexport(struct distribution *);
+/* export multiple distributions at once, results[i] is the result of the i-th,
+ * if stoponerror is true, nothing after the first failed one is exported */
+retvalue distribution_fullexportlist(size_t, struct distribution **, bool /*stoponerror*/, /*@out@*/retvalue *);
 
 
 retvalue distribution_snapshot(struct distribution *, const char */*name*/);
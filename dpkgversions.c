@@ -27,6 +27,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
 
 #include <ctype.h>
 #include "error.h"
@@ -38,47 +39,66 @@
 
 /* from dpkg-db.h.in: */
 
+/* (changed to point into the parsed string instead of copying it,
+ * as this is called for every comparison of the packagenames database) */
 struct versionrevision {
   unsigned long epoch;
-  const char *version;
-  const char *revision;
+  const char *version, *versionend;
+  const char *revision, *revisionend;
 };
 
 /* from parsehelp.c */
 
 static
-const char *parseversion(struct versionrevision *rversion, const char *string) {
-  char *hyphen, *colon, *eepochcolon;
-  const char *end, *ptr;
+const char *parseversion(struct versionrevision *rversion, const char *string, size_t len) {
+  const char *hyphen, *colon, *end, *ptr, *stop = string + len;
   unsigned long epoch;
 
-  if (!*string) return _("version string is empty");
+  if (string == stop) return _("version string is empty");
 
   /* trim leading and trailing space */
-  while (*string && (*string == ' ' || *string == '\t')) string++;
+  while (string < stop && (*string == ' ' || *string == '\t')) string++;
   /* string now points to the first non-whitespace char */
   end = string;
   /* find either the end of the string, or a whitespace char */
-  while (*end && *end != ' ' && *end != '\t') end++;
+  while (end < stop && *end != ' ' && *end != '\t') end++;
   /* check for extra chars after trailing space */
   ptr = end;
-  while (*ptr && (*ptr == ' ' || *ptr == '\t')) ptr++;
-  if (*ptr) return _("version string has embedded spaces");
+  while (ptr < stop && (*ptr == ' ' || *ptr == '\t')) ptr++;
+  if (ptr < stop) return _("version string has embedded spaces");
 
-  colon= strchr(string, ':');
+  colon= memchr(string, ':', end - string);
   if (colon) {
-    epoch= strtoul(string, &eepochcolon, 10);
-    if (colon != eepochcolon) return _("epoch in version is not number");
-    if (!*++colon) return _("nothing after colon in version number");
+    /* what strtoul would do, without needing a 0-terminated string */
+    bool negative= *string == '-', overflow= false;
+    epoch= 0;
+    ptr= string;
+    if (*ptr == '-' || *ptr == '+') ptr++;
+    if (!cisdigit(*ptr)) ptr= string;
+    for (; ptr < colon && cisdigit(*ptr) ; ptr++) {
+      if (epoch > (ULONG_MAX - (*ptr - '0')) / 10) overflow= true;
+      epoch= epoch * 10 + (*ptr - '0');
+    }
+    if (overflow) epoch= ULONG_MAX;
+    else if (negative) epoch= -epoch;
+    if (ptr != colon) return _("epoch in version is not number");
+    if (++colon == stop) return _("nothing after colon in version number");
     string= colon;
     rversion->epoch= epoch;
   } else {
     rversion->epoch= 0;
   }
-  rversion->version= strndup(string, end - string);
-  hyphen= strrchr(rversion->version,'-');
-  if (hyphen) *hyphen++= 0;
-  rversion->revision= hyphen ? hyphen : "";
+  rversion->version= string;
+  for (hyphen = end ; hyphen > string && hyphen[-1] != '-' ; hyphen--)
+    ;
+  if (hyphen > string) {
+    rversion->versionend= hyphen - 1;
+    rversion->revision= hyphen;
+  } else {
+    rversion->versionend= end;
+    rversion->revision= end;
+  }
+  rversion->revisionend= end;
 
   return NULL;
 }
@@ -91,28 +111,27 @@ const char *parseversion(struct versionrevision *rversion, const char *string) {
 		: !(x) ? 0 \
 		: cisalpha((x)) ? (x) \
 		: (x) + 256)
+/* the character at p, with the end of the span looking like a '\0' */
+#define at(p, end) ((p) < (end) ? *(p) : '\0')
 
-static int verrevcmp(const char *val, const char *ref) {
-  if (!val) val= "";
-  if (!ref) ref= "";
-
-  while (*val || *ref) {
+static int verrevcmp(const char *val, const char *valend, const char *ref, const char *refend) {
+  while (val < valend || ref < refend) {
     int first_diff= 0;
 
-    while ((*val && !cisdigit(*val)) || (*ref && !cisdigit(*ref))) {
-      int vc= order(*val), rc= order(*ref);
+    while ((val < valend && !cisdigit(*val)) || (ref < refend && !cisdigit(*ref))) {
+      int vc= order(at(val, valend)), rc= order(at(ref, refend));
       if (vc != rc) return vc - rc;
       val++; ref++;
     }
 
-    while (*val == '0') val++;
-    while (*ref == '0') ref++;
-    while (cisdigit(*val) && cisdigit(*ref)) {
+    while (val < valend && *val == '0') val++;
+    while (ref < refend && *ref == '0') ref++;
+    while (val < valend && ref < refend && cisdigit(*val) && cisdigit(*ref)) {
       if (!first_diff) first_diff= *val - *ref;
       val++; ref++;
     }
-    if (cisdigit(*val)) return 1;
-    if (cisdigit(*ref)) return -1;
+    if (val < valend && cisdigit(*val)) return 1;
+    if (ref < refend && cisdigit(*ref)) return -1;
     if (first_diff) return first_diff;
   }
   return 0;
@@ -125,26 +144,34 @@ int versioncompare(const struct versionrevision *version,
 
   if (version->epoch > refversion->epoch) return 1;
   if (version->epoch < refversion->epoch) return -1;
-  r= verrevcmp(version->version,refversion->version);  if (r) return r;
-  return verrevcmp(version->revision,refversion->revision);
+  r= verrevcmp(version->version, version->versionend,
+		  refversion->version, refversion->versionend);
+  if (r) return r;
+  return verrevcmp(version->revision, version->revisionend,
+		  refversion->revision, refversion->revisionend);
 }
 
 /* now own code */
 
-retvalue dpkgversions_cmp(const char *first,const char *second,int *result) {
-	struct versionrevision v1,v2;
+retvalue dpkgversions_cmp_l(const char *first, size_t firstlen, const char *second, size_t secondlen, int *result) {
+	struct versionrevision v1, v2;
 	const char *m;
 
-	if ((m = parseversion(&v1,first)) != NULL) {
-	   fprintf(stderr,"Error while parsing '%s' as version: %s\n",first,m);
+	if ((m = parseversion(&v1, first, firstlen)) != NULL) {
+	   fprintf(stderr, "Error while parsing '%.*s' as version: %s\n",
+			   (int)firstlen, first, m);
 	   return RET_ERROR;
 	}
-	if ((m = parseversion(&v2,second)) != NULL) {
-	   fprintf(stderr,"Error while parsing '%s' as version: %s\n",second,m);
+	if ((m = parseversion(&v2, second, secondlen)) != NULL) {
+	   fprintf(stderr, "Error while parsing '%.*s' as version: %s\n",
+			   (int)secondlen, second, m);
 	   return RET_ERROR;
 	}
-	*result = versioncompare(&v1,&v2);
-	free((char*)v1.version);
-	free((char*)v2.version);
+	*result = versioncompare(&v1, &v2);
 	return RET_OK;
 }
+
+retvalue dpkgversions_cmp(const char *first, const char *second, int *result) {
+	return dpkgversions_cmp_l(first, strlen(first),
+			second, strlen(second), result);
+}
@@ -9,5 +9,7 @@
 /* return error if those are not proper versions,
  * otherwise RET_OK and result is <0, ==0 or >0, if first is smaller, equal or larger */
 retvalue dpkgversions_cmp(const char *, const char *, /*@out@*/int *);
+/* the same for versions not 0-terminated (never allocates memory) */
+retvalue dpkgversions_cmp_l(const char *, size_t, const char *, size_t, /*@out@*/int *);
 
 #endif
@@ -38,6 +38,7 @@
 #include "filecntl.h"
 #include "hooks.h"
 #include "package.h"
+#include "trace.h"
 
 static const char *exportdescription(const struct exportmode *mode, char *buffer, size_t buffersize) {
 	char *result = buffer;
@@ -501,6 +502,7 @@ retvalue export_target(const char *relativedir, struct target *target,  const st
 				continue;
 			(void)release_writedata(file, iterator.current.control,
 					iterator.current.controllen);
+			trace_count(1, iterator.current.controllen);
 			(void)release_writestring(file, "\n");
 			if (iterator.current.control[iterator.current.controllen-1] != '\n')
 				(void)release_writestring(file, "\n");
@@ -511,7 +513,9 @@ retvalue export_target(const char *relativedir, struct target *target,  const st
 			free(relfilename);
 			return r;
 		}
+		trace_begin("finishfile", relfilename);
 		r = release_finishfile(release, file);
+		trace_end();
 		if (RET_WAS_ERROR(r)) {
 			free(relfilename);
 			return r;
@@ -529,7 +533,9 @@ retvalue export_target(const char *relativedir, struct target *target,  const st
 		for (i = 0 ; i < exportmode->hooks.count ; i++) {
 			const char *hook = exportmode->hooks.values[i];
 
+			trace_begin("exporthook", hook);
 			r = callexporthook(hook, relfilename, status, release);
+			trace_end();
 			if (RET_WAS_ERROR(r)) {
 				free(relfilename);
 				return r;
@@ -0,0 +1,154 @@
+/*  This file is part of "reprepro"
+ *  Copyright (C) 2026 agent
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02111-1301  USA
+ */
+#include <config.h>
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+#include "arena.h"
+#include "filekeyids.h"
+
+/* the filekeys, indexed by id (filekeys[0] is unused) */
+static const char **filekeys = NULL;
+static filekeyid_t count = 0, size = 0;
+/* open addressing hash table of ids, 0 marks a free slot,
+ * never more than half full */
+static filekeyid_t *buckets = NULL;
+static size_t bucketcount = 0;
+static struct arena strings;
+static bool strings_initialized = false;
+
+static inline size_t hash(const char *s, /*@out@*/size_t *len_p) {
+	const unsigned char *p = (const unsigned char *)s;
+	size_t h = 2166136261U;
+
+	while (*p != '\0') {
+		h ^= *(p++);
+		h *= 16777619U;
+	}
+	*len_p = p - (const unsigned char *)s;
+	return h;
+}
+
+static filekeyid_t *lookup(const char *filekey, /*@out@*/size_t *len_p) {
+	size_t i, mask = bucketcount - 1;
+
+	i = hash(filekey, len_p) & mask;
+	while (buckets[i] != filekeyid_none &&
+			strcmp(filekeys[buckets[i]], filekey) != 0)
+		i = (i + 1) & mask;
+	return &buckets[i];
+}
+
+static retvalue grow(void) {
+	filekeyid_t *n, id;
+	const char **f;
+	size_t newcount, i, mask, dummy;
+
+	if (size <= count + 1) {
+		size_t newsize = (size == 0)?1024:2 * size;
+
+		if (newsize > (filekeyid_t)-1)
+			return RET_ERROR_OOM;
+		f = realloc(filekeys, newsize * sizeof(const char *));
+		if (FAILEDTOALLOC(f))
+			return RET_ERROR_OOM;
+		filekeys = f;
+		size = newsize;
+	}
+	if (2 * (size_t)(count + 1) <= bucketcount)
+		return RET_OK;
+	newcount = (bucketcount == 0)?2048:2 * bucketcount;
+	n = calloc(newcount, sizeof(filekeyid_t));
+	if (FAILEDTOALLOC(n))
+		return RET_ERROR_OOM;
+	mask = newcount - 1;
+	for (id = 1 ; id <= count ; id++) {
+		i = hash(filekeys[id], &dummy) & mask;
+		while (n[i] != filekeyid_none)
+			i = (i + 1) & mask;
+		n[i] = id;
+	}
+	free(buckets);
+	buckets = n;
+	bucketcount = newcount;
+	return RET_OK;
+}
+
+retvalue filekeyids_intern(const char *filekey, filekeyid_t *id_p) {
+	filekeyid_t *bucket;
+	char *copy;
+	size_t len;
+	retvalue r;
+
+	r = grow();
+	if (RET_WAS_ERROR(r))
+		return r;
+	bucket = lookup(filekey, &len);
+	if (*bucket != filekeyid_none) {
+		*id_p = *bucket;
+		return RET_OK;
+	}
+	if (!strings_initialized) {
+		arena_init(&strings);
+		strings_initialized = true;
+	}
+	copy = arena_strndup(&strings, filekey, len);
+	if (FAILEDTOALLOC(copy))
+		return RET_ERROR_OOM;
+	filekeys[++count] = copy;
+	*bucket = count;
+	*id_p = count;
+	return RET_OK;
+}
+
+retvalue filekeyids_find(const char *filekey, filekeyid_t *id_p) {
+	filekeyid_t *bucket;
+	size_t len;
+
+	if (count == 0)
+		return RET_NOTHING;
+	bucket = lookup(filekey, &len);
+	if (*bucket == filekeyid_none)
+		return RET_NOTHING;
+	*id_p = *bucket;
+	return RET_OK;
+}
+
+const char *filekeyids_filekey(filekeyid_t id) {
+	assert (id != filekeyid_none && id <= count);
+	return filekeys[id];
+}
+
+filekeyid_t filekeyids_limit(void) {
+	return count + 1;
+}
+
+void filekeyids_free(void) {
+	free(buckets);
+	buckets = NULL;
+	bucketcount = 0;
+	free(filekeys);
+	filekeys = NULL;
+	count = 0;
+	size = 0;
+	if (strings_initialized) {
+		arena_done(&strings);
+		strings_initialized = false;
+	}
+}
@@ -0,0 +1,29 @@
+#ifndef REPREPRO_FILEKEYIDS_H
+#define REPREPRO_FILEKEYIDS_H
+
+#ifndef REPREPRO_ERROR_H
+#include "error.h"
+#warning "What's hapening here?"
+#endif
+
+/* A dictionary giving every filekey seen in this run a small integer,
+ * so that bookkeeping about files can use arrays indexed by that number
+ * instead of comparing and copying the filekey strings over and over.
+ * The numbers are only valid until filekeyids_free is called. */
+
+typedef unsigned int filekeyid_t;
+
+/* 0 is never handed out */
+#define filekeyid_none ((filekeyid_t)0)
+
+/* get the id of a filekey, assigning a new one if it was not seen before */
+retvalue filekeyids_intern(const char *, /*@out@*/filekeyid_t *);
+/* RET_NOTHING if filekey has no id yet */
+retvalue filekeyids_find(const char *, /*@out@*/filekeyid_t *);
+/* the filekey of an id (the string lives until filekeyids_free) */
+const char *filekeyids_filekey(filekeyid_t);
+/* all ids handed out are smaller than this */
+filekeyid_t filekeyids_limit(void);
+
+void filekeyids_free(void);
+#endif
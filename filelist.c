@@ -26,6 +26,7 @@
 #include "chunks.h"
 #include "package.h"
 #include "debfile.h"
+#include "workers.h"
 #include "filelist.h"
 
 struct filelist_package {
@@ -54,9 +55,23 @@ struct dirlist {
 	char name[];
 };
 
+/* Packages are not added at once but collected, so that their filelists
+ * can be read from the contents cache in the order they are stored
+ * there (and not in the random order of the packages database) */
+#define QUEUESIZE 4096
+struct queuedpackage {
+	/*@dependent@*/const struct filelist_package *package;
+	char *filekey;
+	/* a copy of the cached filelist, once read: */
+	/*@null@*/char *data;
+	size_t len;
+};
+
 struct filelist_list {
 	struct dirlist *root;
 	struct filelist_package *packages;
+	/*@null@*/struct queuedpackage *queue;
+	size_t queued;
 };
 
 retvalue filelist_init(struct filelist_list **list) {
@@ -100,6 +115,12 @@ void filelist_free(struct filelist_list *list) {
 		list->packages = package->next;
 		free(package);
 	}
+	while (list->queued > 0) {
+		struct queuedpackage *q = &list->queue[--list->queued];
+		free(q->filekey);
+		free(q->data);
+	}
+	free(list->queue);
 	free(list);
 };
 
@@ -429,12 +450,134 @@ static retvalue filelist_addfiles(struct filelist_list *list, const struct filel
 	return RET_OK;
 }
 
+static int compare_queued(const void *a, const void *b) {
+	const struct queuedpackage * const *qa = a, * const *qb = b;
+
+	return strcmp((*qa)->filekey, (*qb)->filekey);
+}
+
+/* how many records to step over before repositioning the cursor */
+#define MAXSKIP 16
+
+/* read the cached filelists of the sorted queued packages with one
+ * cursor, only jumping when the next one is not near */
+static retvalue readqueued(struct queuedpackage **sorted, size_t count) {
+	struct cursor *cursor = NULL;
+	const char *key = NULL, *data;
+	size_t i, len, skipped;
+	retvalue result = RET_OK, r;
+
+	for (i = 0 ; i < count ; i++) {
+		struct queuedpackage *q = sorted[i];
+
+		skipped = 0;
+		while (cursor != NULL && strcmp(key, q->filekey) < 0) {
+			if (skipped++ < MAXSKIP && cursor_nexttempdata(
+					rdb_contents, cursor,
+					&key, &data, &len))
+				continue;
+			r = cursor_close(rdb_contents, cursor);
+			cursor = NULL;
+			if (RET_WAS_ERROR(r))
+				return r;
+		}
+		if (cursor == NULL) {
+			r = table_newrangecursor(rdb_contents, q->filekey,
+					&cursor, &key, &data, &len);
+			if (RET_WAS_ERROR(r))
+				return r;
+			if (r == RET_NOTHING)
+				/* nothing left, all the others are missing */
+				return RET_OK;
+		}
+		if (strcmp(key, q->filekey) != 0)
+			continue;
+		q->data = malloc(len + 1);
+		if (FAILEDTOALLOC(q->data)) {
+			result = RET_ERROR_OOM;
+			break;
+		}
+		memcpy(q->data, data, len + 1);
+		q->len = len;
+	}
+	if (cursor != NULL) {
+		r = cursor_close(rdb_contents, cursor);
+		RET_ENDUPDATE(result, r);
+	}
+	return result;
+}
+
+/* read the filelists of all queued packages (from the cache, or from
+ * the .deb files where not yet cached) and add them */
+static retvalue flushqueue(struct filelist_list *list) {
+	struct queuedpackage **sorted;
+	struct strlist missing;
+	retvalue result, r;
+	size_t i;
+
+	if (list->queued == 0)
+		return RET_NOTHING;
+	sorted = nzNEW(list->queued, struct queuedpackage *);
+	if (FAILEDTOALLOC(sorted))
+		return RET_ERROR_OOM;
+	for (i = 0 ; i < list->queued ; i++)
+		sorted[i] = &list->queue[i];
+	qsort(sorted, list->queued, sizeof(struct queuedpackage *),
+			compare_queued);
+	result = readqueued(sorted, list->queued);
+	free(sorted);
+
+	/* read what is not yet in the cache (in parallel if possible) */
+	strlist_init(&missing);
+	for (i = 0 ; RET_IS_OK(result) && i < list->queued ; i++) {
+		if (list->queue[i].data == NULL)
+			result = strlist_add_dup(&missing,
+					list->queue[i].filekey);
+	}
+	if (RET_IS_OK(result))
+		result = filelists_cache(&missing, false);
+	strlist_done(&missing);
+	if (result == RET_NOTHING)
+		result = RET_OK;
+
+	for (i = 0 ; i < list->queued ; i++) {
+		struct queuedpackage *q = &list->queue[i];
+
+		if (RET_IS_OK(result) && q->data == NULL) {
+			const char *c;
+			size_t len;
+
+			r = table_gettemprecord(rdb_contents, q->filekey,
+					&c, &len);
+			if (RET_IS_OK(r)) {
+				q->data = malloc(len + 1);
+				if (FAILEDTOALLOC(q->data))
+					r = RET_ERROR_OOM;
+				else {
+					memcpy(q->data, c, len + 1);
+					q->len = len;
+				}
+			}
+			if (RET_WAS_ERROR(r))
+				result = r;
+		}
+		if (RET_IS_OK(result) && q->data != NULL) {
+			r = filelist_addfiles(list, q->package, q->filekey,
+					q->data, q->len + 1);
+			if (RET_WAS_ERROR(r))
+				result = r;
+		}
+		free(q->filekey);
+		free(q->data);
+	}
+	list->queued = 0;
+	return result;
+}
+
 retvalue filelist_addpackage(struct filelist_list *list, struct package *pkg) {
 	const struct filelist_package *package;
-	char *debfilename, *contents = NULL;
+	struct queuedpackage *q;
 	retvalue r;
-	const char *c;
-	size_t len;
 	char *section, *filekey;
 
 	r = chunk_getvalue(pkg->control, "Section", &section);
@@ -450,39 +593,90 @@ retvalue filelist_addpackage(struct filelist_list *list, struct package *pkg) {
 
 	r = filelist_newpackage(list, pkg->name, section, &package);
 	assert (r != RET_NOTHING);
+	free(section);
 	if (RET_WAS_ERROR(r)) {
 		free(filekey);
-		free(section);
 		return r;
 	}
 
-	r = table_gettemprecord(rdb_contents, filekey, &c, &len);
-	if (r == RET_NOTHING) {
-		if (verbose > 3)
-			printf("Reading filelist for %s\n", filekey);
-		debfilename = files_calcfullfilename(filekey);
-		if (FAILEDTOALLOC(debfilename)) {
+	if (list->queue == NULL) {
+		list->queue = nzNEW(QUEUESIZE, struct queuedpackage);
+		if (FAILEDTOALLOC(list->queue)) {
 			free(filekey);
-			free(section);
 			return RET_ERROR_OOM;
 		}
-		r = getfilelist(&contents, &len, debfilename);
-		len--;
-		free(debfilename);
-		c = contents;
 	}
+	q = &list->queue[list->queued++];
+	q->package = package;
+	q->filekey = filekey;
+	q->data = NULL;
+	q->len = 0;
+	if (list->queued < QUEUESIZE)
+		return RET_OK;
+	return flushqueue(list);
+}
+
+struct filelistcache {
+	const struct strlist *filekeys;
+	bool regenerate;
+	retvalue result;
+};
+
+/* called in the worker processes, so no database access here: */
+static retvalue readfilelist(void *data, size_t i, char **filelist, size_t *len) {
+	struct filelistcache *c = data;
+	char *debfilename;
+	retvalue r;
+
+	debfilename = files_calcfullfilename(c->filekeys->values[i]);
+	if (FAILEDTOALLOC(debfilename))
+		return RET_ERROR_OOM;
+	r = getfilelist(filelist, len, debfilename);
+	free(debfilename);
+	return r;
+}
+
+static retvalue storefilelist(void *data, size_t i, retvalue r, const char *filelist, size_t len) {
+	struct filelistcache *c = data;
+	const char *filekey = c->filekeys->values[i];
+
 	if (RET_IS_OK(r)) {
-		r = filelist_addfiles(list, package, filekey, c, len + 1);
-		if (contents != NULL)
-			r = table_adduniqsizedrecord(rdb_contents, filekey,
-					contents, len + 1, true, false);
+		if (c->regenerate && verbose > 0)
+			(void)puts(filekey);
+		if (c->regenerate && verbose > 6) {
+			const char *p = filelist;
+			while (*p != '\0') {
+				(void)putchar(' ');
+				(void)puts(p);
+				p += strlen(p)+1;
+			}
+		}
+		r = table_adduniqsizedrecord(rdb_contents, filekey,
+				filelist, len, true, false);
 	}
-	free(contents);
-	free(filekey);
-	free(section);
+	RET_UPDATE(c->result, r);
+	/* when regenerating, do not stop on broken files */
+	if (c->regenerate && r != RET_ERROR_INTERRUPTED && r != RET_ERROR_OOM)
+		return RET_NOTHING;
 	return r;
 }
 
+retvalue filelists_cache(const struct strlist *filekeys, bool regenerate) {
+	struct filelistcache c;
+	retvalue r;
+
+	if (filekeys->count == 0)
+		return RET_NOTHING;
+	if (verbose > 3 && !regenerate)
+		printf("Reading filelists of %d files...\n", filekeys->count);
+	c.filekeys = filekeys;
+	c.regenerate = regenerate;
+	c.result = RET_NOTHING;
+	r = workers_run(filekeys->count, readfilelist, storefilelist, &c);
+	RET_ENDUPDATE(c.result, r);
+	return c.result;
+}
+
 retvalue fakefilelist(const char *filekey) {
 	return table_adduniqsizedrecord(rdb_contents, filekey,
 			"", 1, true, false);
@@ -555,9 +749,13 @@ static retvalue filelist_writedirs(char **buffer_p, size_t *size_p, size_t ofs,
 
 retvalue filelist_write(struct filelist_list *list, struct filetorelease *file) {
 	size_t size = 1024;
-	char *buffer = malloc(size);
+	char *buffer;
 	retvalue r;
 
+	r = flushqueue(list);
+	if (RET_WAS_ERROR(r))
+		return r;
+	buffer = malloc(size);
 	if (FAILEDTOALLOC(buffer))
 		return RET_ERROR_OOM;
 
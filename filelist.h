@@ -10,8 +10,16 @@ struct package;
 
 retvalue filelist_init(struct filelist_list **list);
 
+/* the filelists are only read (in the order they are stored in the
+ * contents cache, missing ones with multiple processes if possible)
+ * once enough packages are collected or by filelist_write */
 retvalue filelist_addpackage(struct filelist_list *, struct package *);
 
+/* read the filelists of the given .deb files (with multiple processes if
+ * possible) and store them in the contents cache. With regenerate, list
+ * the files read and continue after errors. */
+retvalue filelists_cache(const struct strlist *, bool /*regenerate*/);
+
 retvalue filelist_write(struct filelist_list *list, struct filetorelease *file);
 
 void filelist_free(/*@only@*/struct filelist_list *);
@@ -34,8 +34,9 @@
 #include "files.h"
 #include "ignore.h"
 #include "filelist.h"
-#include "debfile.h"
 #include "pool.h"
+#include "workers.h"
+#include "trace.h"
 #include "database_p.h"
 
 static retvalue files_get_checksums(const char *filekey, /*@out@*/struct checksums **checksums_p) {
@@ -395,6 +396,7 @@ retvalue files_checkpool(bool fast) {
 			r = checksums_cheaptest(fullfilename, expected, true);
 		else
 			r = checkpoolfile(fullfilename, expected, &improveable);
+		trace_count(1, 0);
 		if (r == RET_NOTHING) {
 			fprintf(stderr, "Missing file '%s'!\n", fullfilename);
 			r = RET_ERROR_MISSING;
@@ -487,51 +489,34 @@ retvalue files_detect(const char *filekey) {
 	return r;
 }
 
-struct rfd { bool reread; };
+struct rfd { bool reread; struct strlist filekeys; };
 
 static retvalue regenerate_filelist(void *data, const char *filekey) {
-	bool reread = ((struct rfd*)data)->reread;
+	struct rfd *d = data;
 	size_t l = strlen(filekey);
-	char *debfilename;
-	char *filelist;
-	size_t fls;
-	retvalue r;
 
 	if (l <= 4 || memcmp(filekey+l-4, ".deb", 4) != 0)
 		return RET_NOTHING;
 
-	if (!reread && !table_recordexists(rdb_contents, filekey))
+	if (!d->reread && !table_recordexists(rdb_contents, filekey))
 		return RET_NOTHING;
 
-	debfilename = files_calcfullfilename(filekey);
-	if (FAILEDTOALLOC(debfilename))
-		return RET_ERROR_OOM;
-
-	r = getfilelist(&filelist, &fls, debfilename);
-	free(debfilename);
-	if (RET_IS_OK(r)) {
-		if (verbose > 0)
-			(void)puts(filekey);
-		if (verbose > 6) {
-			const char *p = filelist;
-			while (*p != '\0') {
-				(void)putchar(' ');
-				(void)puts(p);
-				p += strlen(p)+1;
-			}
-		}
-		r = table_adduniqsizedrecord(rdb_contents,
-				filekey, filelist, fls, true, true);
-		free(filelist);
-	}
-	return r;
+	return strlist_add_dup(&d->filekeys, filekey);
 }
 
 retvalue files_regenerate_filelist(bool reread) {
 	struct rfd d;
+	retvalue r;
 
 	d.reread = reread;
-	return files_foreach(regenerate_filelist, &d);
+	strlist_init(&d.filekeys);
+	/* first collect the files, so the actual reading can be done
+	 * in parallel */
+	r = files_foreach(regenerate_filelist, &d);
+	if (RET_IS_OK(r))
+		r = filelists_cache(&d.filekeys, true);
+	strlist_done(&d.filekeys);
+	return r;
 }
 
 /* Include a yet unknown file into the pool */
@@ -803,6 +788,142 @@ retvalue files_checkincludefile(const char *sourcedir, const char *basefilename,
 	return files_add_checksums(filekey, *checksums_p);
 }
 
+struct copyfiles {
+	const char * const *destinations;
+	const char * const *origins;
+	struct checksums **checksums;
+};
+
+/* called in the worker processes: */
+static retvalue copyfile(void *data, size_t i, char **result, size_t *len) {
+	struct copyfiles *d = data;
+	struct checksums *checksums;
+	const char *combined;
+	retvalue r;
+
+	(void)dirs_make_parent(d->destinations[i]);
+	r = checksums_copyfile(d->destinations[i], d->origins[i], true,
+			&checksums);
+	if (r == RET_NOTHING) {
+		fprintf(stderr, "Could not open '%s'!\n", d->origins[i]);
+		r = RET_ERROR_MISSING;
+	}
+	if (RET_WAS_ERROR(r))
+		return r;
+	r = checksums_getcombined(checksums, &combined, len);
+	if (RET_IS_OK(r)) {
+		*result = strndup(combined, *len);
+		(*len)++;
+		if (FAILEDTOALLOC(*result))
+			r = RET_ERROR_OOM;
+	}
+	checksums_free(checksums);
+	return r;
+}
+
+static retvalue copiedfile(void *data, size_t i, retvalue r, const char *combined, UNUSED(size_t len)) {
+	struct copyfiles *d = data;
+
+	if (RET_IS_OK(r))
+		r = checksums_parse(&d->checksums[i], combined);
+	return r;
+}
+
+retvalue files_copyfiles(int count, const char * const *destinations, const char * const *origins, struct checksums **checksums) {
+	struct copyfiles d;
+	int i;
+
+	for (i = 0 ; i < count ; i++)
+		checksums[i] = NULL;
+	d.destinations = destinations;
+	d.origins = origins;
+	d.checksums = checksums;
+	return workers_run(count, copyfile, copiedfile, &d);
+}
+
+retvalue files_checkincludefiles(const char *sourcedir, int count, const char * const *basefilenames, const char * const *filekeys, struct checksums ** const *checksums_p) {
+	const char **origins, **destinations;
+	struct checksums **checksums;
+	int *todo;
+	int i, n;
+	retvalue result, r;
+	bool improves;
+
+	/* files already known are checked here, the others collected
+	 * to be copied (and thus read) in parallel */
+	todo = nNEW(count, int);
+	origins = nzNEW(count, const char *);
+	destinations = nzNEW(count, const char *);
+	checksums = nNEW(count, struct checksums *);
+	if (FAILEDTOALLOC(todo) || FAILEDTOALLOC(origins) ||
+			FAILEDTOALLOC(destinations) ||
+			FAILEDTOALLOC(checksums)) {
+		free(todo); free(origins); free(destinations); free(checksums);
+		return RET_ERROR_OOM;
+	}
+	result = RET_NOTHING;
+	n = 0;
+	for (i = 0 ; i < count ; i++) {
+		assert (*checksums_p[i] != NULL);
+		if (table_recordexists(rdb_checksums, filekeys[i])) {
+			r = files_checkincludefile(sourcedir, basefilenames[i],
+					filekeys[i], checksums_p[i]);
+			RET_UPDATE(result, r);
+			if (RET_WAS_ERROR(r))
+				break;
+			continue;
+		}
+		origins[n] = calc_dirconcat(sourcedir, basefilenames[i]);
+		destinations[n] = files_calcfullfilename(filekeys[i]);
+		todo[n++] = i;
+		if (FAILEDTOALLOC(origins[n-1]) ||
+				FAILEDTOALLOC(destinations[n-1])) {
+			result = RET_ERROR_OOM;
+			break;
+		}
+	}
+	if (!RET_WAS_ERROR(result) && n > 0) {
+		r = files_copyfiles(n, destinations, origins, checksums);
+		RET_UPDATE(result, r);
+		/* even on errors add everything already copied, so
+		 * nothing is left in the pool unknown to the database */
+		for (i = 0 ; i < n ; i++) {
+			struct checksums **expected = checksums_p[todo[i]];
+
+			if (checksums[i] == NULL)
+				continue;
+			if (!checksums_check(*expected, checksums[i],
+						&improves)) {
+				deletefile(destinations[i]);
+				fprintf(stderr,
+"ERROR: Unexpected content of file '%s'!\n",
+						origins[i]);
+				checksums_printdifferences(stderr, *expected,
+						checksums[i]);
+				r = RET_ERROR_WRONG_MD5;
+			} else if (improves)
+				r = checksums_combine(expected, checksums[i],
+						NULL);
+			else
+				r = RET_OK;
+			checksums_free(checksums[i]);
+			if (RET_IS_OK(r))
+				r = files_add_checksums(filekeys[todo[i]],
+						*expected);
+			RET_UPDATE(result, r);
+		}
+	}
+	for (i = 0 ; i < n ; i++) {
+		free((char*)origins[i]);
+		free((char*)destinations[i]);
+	}
+	free(todo);
+	free(origins);
+	free(destinations);
+	free(checksums);
+	return result;
+}
+
 off_t files_getsize(const char *filekey) {
 	retvalue r;
 	off_t s;
@@ -50,6 +50,12 @@ retvalue files_checkorimprove(const struct strlist *, struct checksums **);
  */
 retvalue files_preinclude(const char *sourcefilename, const char *filekey, /*@null@*//*@out@*/struct checksums **);
 retvalue files_checkincludefile(const char *directory, const char *sourcefilename, const char *filekey, struct checksums **);
+/* the same for multiple files, copying them in parallel (if possible) */
+retvalue files_checkincludefiles(const char * /*directory*/, int, const char * const * /*sourcefilenames*/, const char * const * /*filekeys*/, struct checksums ** const *);
+
+/* copy (and checksum) multiple files (in parallel if possible),
+ * the checksums of files that could not be copied are set to NULL */
+retvalue files_copyfiles(int, const char * const * /*destinations*/, const char * const * /*origins*/, /*@out@*/struct checksums **);
 
 typedef retvalue per_file_action(void *data, const char *filekey);
 
@@ -80,8 +80,16 @@ extern struct global_config {
 	bool keepdirectories;
 	bool keeptemporaries;
 	bool onlysmalldeletes;
+	/* write packages.db records with a header of derived fields */
+	bool packageheaders;
 	/* verbosity of downloading statistics */
 	int showdownloadpercent;
+	/* number of child processes for parallel work, 0 = automatic */
+	int workers;
+	/* processes per --batch notifier and KiB of data waiting for
+	 * each of them before waiting for it, 0 = default */
+	int notifierprocesses;
+	int notifierbacklog;
 } global;
 
 enum compression { c_none, c_gzip, c_bzip2, c_lzma, c_xz, c_lunzip, c_zstd, c_COUNT };
@@ -27,7 +27,11 @@
 #include <signal.h>
 #include <dirent.h>
 #include <time.h>
+#include <poll.h>
 #include <sys/stat.h>
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
 #include "error.h"
 #include "ignore.h"
 #include "mprintf.h"
@@ -101,6 +105,8 @@ struct incoming {
 	struct strlist files;
 	bool *processed;
 	bool *delete;
+	/* copies of processed .changes files, loggers might still need them */
+	struct strlist changestempfiles;
 	bool permit[pmf_COUNT];
 	bool cleanup[cuf_COUNT];
 	bool options[iof_COUNT];
@@ -125,6 +131,7 @@ static void incoming_free(/*@only@*/ struct incoming *i) {
 	strlist_done(&i->files);
 	free(i->processed);
 	free(i->delete);
+	strlist_done(&i->changestempfiles);
 	free(i);
 }
 
@@ -432,7 +439,7 @@ static const struct configfield incomingconfigfields[] = {
 	CF("Logdir", incoming, logdir)
 };
 
-static retvalue incoming_init(struct distribution *distributions, const char *name, /*@out@*/struct incoming **result) {
+static retvalue incoming_parse(struct distribution *distributions, const char *name, /*@out@*/struct incoming **result) {
 	retvalue r;
 	struct read_incoming_data imports;
 
@@ -453,13 +460,23 @@ static retvalue incoming_init(struct distribution *distributions, const char *na
 				name, global.confdir);
 		return RET_ERROR_MISSING;
 	}
+	*result = imports.i;
+	return RET_OK;
+}
 
-	r = incoming_prepare(imports.i);
+static retvalue incoming_init(struct distribution *distributions, const char *name, /*@out@*/struct incoming **result) {
+	struct incoming *i;
+	retvalue r;
+
+	r = incoming_parse(distributions, name, &i);
+	if (RET_WAS_ERROR(r))
+		return r;
+	r = incoming_prepare(i);
 	if (RET_WAS_ERROR(r)) {
-		incoming_free(imports.i);
+		incoming_free(i);
 		return r;
 	}
-	*result = imports.i;
+	*result = i;
 	return r;
 }
 
@@ -876,18 +893,12 @@ static retvalue candidate_earlychecks(struct incoming *i, struct candidate *c) {
 	return RET_OK;
 }
 
-/* Is used before any other candidate fields are set */
-static retvalue candidate_usefile(const struct incoming *i, const struct candidate *c, struct candidate_file *file) {
+/* calculate where to get and put a file */
+static retvalue candidate_filenames(const struct incoming *i, const struct candidate *c, const struct candidate_file *file, /*@out@*/char **origfile_p, /*@out@*/char **tempfilename_p) {
 	const char *basefilename;
 	char *origfile, *tempfilename;
-	struct checksums *readchecksums;
-	retvalue r;
-	bool improves;
 	const char *p;
 
-	if (file->used && file->tempfilename != NULL)
-		return RET_OK;
-	assert(file->tempfilename == NULL);
 	basefilename = BASENAME(i, file->ofs);
 	for (p = basefilename; *p != '\0' ; p++) {
 		if ((0x80 & *(const unsigned char *)p) != 0) {
@@ -905,12 +916,16 @@ static retvalue candidate_usefile(const struct incoming *i, const struct candida
 		free(tempfilename);
 		return RET_ERROR_OOM;
 	}
-	r = checksums_copyfile(tempfilename, origfile, true, &readchecksums);
-	free(origfile);
-	if (RET_WAS_ERROR(r)) {
-		free(tempfilename);
-		return r;
-	}
+	*origfile_p = origfile;
+	*tempfilename_p = tempfilename;
+	return RET_OK;
+}
+
+/* check the checksums of a file copied to tempfilename */
+static retvalue candidate_copiedfile(const struct incoming *i, struct candidate_file *file, /*@only@*/char *tempfilename, /*@only@*/struct checksums *readchecksums) {
+	retvalue r;
+	bool improves;
+
 	if (file->checksums == NULL) {
 		file->checksums = readchecksums;
 		file->tempfilename = tempfilename;
@@ -920,7 +935,7 @@ static retvalue candidate_usefile(const struct incoming *i, const struct candida
 	if (!checksums_check(file->checksums, readchecksums, &improves)) {
 		fprintf(stderr,
 "ERROR: File '%s' does not match expectations:\n",
-				basefilename);
+				BASENAME(i, file->ofs));
 		checksums_printdifferences(stderr,
 				file->checksums, readchecksums);
 		checksums_free(readchecksums);
@@ -943,6 +958,93 @@ static retvalue candidate_usefile(const struct incoming *i, const struct candida
 	return RET_OK;
 }
 
+/* Is used before any other candidate fields are set */
+static retvalue candidate_usefile(const struct incoming *i, const struct candidate *c, struct candidate_file *file) {
+	char *origfile, *tempfilename;
+	struct checksums *readchecksums;
+	retvalue r;
+
+	if (file->used && file->tempfilename != NULL)
+		return RET_OK;
+	assert(file->tempfilename == NULL);
+	r = candidate_filenames(i, c, file, &origfile, &tempfilename);
+	if (RET_WAS_ERROR(r))
+		return r;
+	r = checksums_copyfile(tempfilename, origfile, true, &readchecksums);
+	free(origfile);
+	if (RET_WAS_ERROR(r)) {
+		free(tempfilename);
+		return r;
+	}
+	return candidate_copiedfile(i, file, tempfilename, readchecksums);
+}
+
+/* like candidate_usefile for all files of packages,
+ * but copying the files in parallel (if possible) */
+static retvalue candidate_usepackagefiles(const struct incoming *i, const struct candidate *c) {
+	struct candidate_file *file, **files;
+	char **origfiles, **tempfiles;
+	struct checksums **checksums;
+	int count, j;
+	retvalue result, r;
+
+	count = 0;
+	for (file = c->files ; file != NULL ; file = file->next) {
+		if (FE_PACKAGE(file->type))
+			count++;
+	}
+	if (count == 0)
+		return RET_NOTHING;
+	files = nNEW(count, struct candidate_file *);
+	origfiles = nzNEW(count, char *);
+	tempfiles = nzNEW(count, char *);
+	checksums = nNEW(count, struct checksums *);
+	if (FAILEDTOALLOC(files) || FAILEDTOALLOC(origfiles) ||
+			FAILEDTOALLOC(tempfiles) || FAILEDTOALLOC(checksums)) {
+		free(files); free(origfiles); free(tempfiles); free(checksums);
+		return RET_ERROR_OOM;
+	}
+	result = RET_OK;
+	count = 0;
+	for (file = c->files ; file != NULL ; file = file->next) {
+		if (!FE_PACKAGE(file->type))
+			continue;
+		if (file->used && file->tempfilename != NULL)
+			continue;
+		assert(file->tempfilename == NULL);
+		r = candidate_filenames(i, c, file,
+				&origfiles[count], &tempfiles[count]);
+		if (RET_WAS_ERROR(r)) {
+			result = r;
+			break;
+		}
+		files[count++] = file;
+	}
+	if (RET_IS_OK(result) && count > 0)
+		result = files_copyfiles(count,
+				(const char * const *)tempfiles,
+				(const char * const *)origfiles, checksums);
+	else
+		for (j = 0 ; j < count ; j++)
+			checksums[j] = NULL;
+	for (j = 0 ; j < count ; j++) {
+		free(origfiles[j]);
+		if (checksums[j] == NULL) {
+			free(tempfiles[j]);
+			continue;
+		}
+		/* this also records the copied file to be deleted later */
+		r = candidate_copiedfile(i, files[j], tempfiles[j],
+				checksums[j]);
+		RET_UPDATE(result, r);
+	}
+	free(files);
+	free(origfiles);
+	free(tempfiles);
+	free(checksums);
+	return result;
+}
+
 static inline retvalue getsectionprioritycomponent(const struct incoming *i, const struct candidate *c, const struct distribution *into, const struct candidate_file *file, const char *name, const struct overridedata *oinfo, /*@out@*/const char **section_p, /*@out@*/const char **priority_p, /*@out@*/component_t *component) {
 	retvalue r;
 	const char *section, *priority, *forcecomponent;
@@ -995,13 +1097,56 @@ static inline retvalue getsectionprioritycomponent(const struct incoming *i, con
 	return RET_OK;
 }
 
+/* get the control data of all binary packages (in parallel, if possible) */
+static retvalue candidate_extractcontrols(struct candidate *c) {
+	struct candidate_file *file, **files;
+	const char **filenames;
+	char **controls;
+	int count, j;
+	retvalue r;
+
+	count = 0;
+	for (file = c->files ; file != NULL ; file = file->next) {
+		if (FE_BINARY(file->type) && file->deb.control == NULL)
+			count++;
+	}
+	if (count <= 1)
+		return RET_NOTHING;
+	files = nNEW(count, struct candidate_file *);
+	filenames = nNEW(count, const char *);
+	controls = nNEW(count, char *);
+	if (FAILEDTOALLOC(files) || FAILEDTOALLOC(filenames) ||
+			FAILEDTOALLOC(controls)) {
+		free(files); free(filenames); free(controls);
+		return RET_ERROR_OOM;
+	}
+	count = 0;
+	for (file = c->files ; file != NULL ; file = file->next) {
+		if (!FE_BINARY(file->type) || file->deb.control != NULL)
+			continue;
+		assert (file->tempfilename != NULL);
+		files[count] = file;
+		filenames[count++] = file->tempfilename;
+	}
+	r = binaries_extractcontrols(count, filenames, controls);
+	for (j = 0 ; j < count ; j++)
+		files[j]->deb.control = controls[j];
+	free(files);
+	free(filenames);
+	free(controls);
+	return r;
+}
+
 static retvalue candidate_read_deb(struct incoming *i, struct candidate *c, struct candidate_file *file) {
 	retvalue r;
 	size_t l;
 	char *base;
 	const char *packagenametocheck;
 
-	r = binaries_readdeb(&file->deb, file->tempfilename);
+	if (file->deb.control != NULL)
+		r = binaries_parsedeb(&file->deb, file->tempfilename);
+	else
+		r = binaries_readdeb(&file->deb, file->tempfilename);
 	if (RET_WAS_ERROR(r))
 		return r;
 	if (strcmp(file->name, file->deb.name) != 0) {
@@ -1100,13 +1245,17 @@ static retvalue candidate_read_files(struct incoming *i, struct candidate *c) {
 	struct candidate_file *file;
 	retvalue r;
 
+	r = candidate_usepackagefiles(i, c);
+	if (RET_WAS_ERROR(r))
+		return r;
+	r = candidate_extractcontrols(c);
+	if (RET_WAS_ERROR(r))
+		return r;
+
 	for (file = c->files ; file != NULL ; file = file->next) {
 
 		if (!FE_PACKAGE(file->type))
 			continue;
-		r = candidate_usefile(i, c, file);
-		if (RET_WAS_ERROR(r))
-			return r;
 		assert(file->tempfilename != NULL);
 
 		if (FE_BINARY(file->type))
@@ -2517,7 +2666,16 @@ static retvalue process_changes(struct incoming *i, int ofs) {
 			}
 		}
 	}
-	logger_wait();
+	/* loggers get the copy of the .changes file, so only delete it
+	 * once they all ran (i.e. after the whole run): */
+	if (changesfile(c)->tempfilename != NULL) {
+		retvalue r2;
+
+		r2 = strlist_add(&i->changestempfiles,
+				changesfile(c)->tempfilename);
+		changesfile(c)->tempfilename = NULL;
+		RET_ENDUPDATE(r, r2);
+	}
 	candidate_free(c);
 	return r;
 }
@@ -2590,6 +2748,8 @@ retvalue process_incoming(struct distribution *distributions, const char *name,
 	}
 
 	logger_wait();
+	for (j = 0 ; j < i->changestempfiles.count ; j++)
+		deletefile(i->changestempfiles.values[j]);
 	if (i->morguedir == NULL)
 		morguedir = NULL;
 	else {
@@ -2641,3 +2801,162 @@ retvalue process_incoming(struct distribution *distributions, const char *name,
 	incoming_free(i);
 	return result;
 }
+
+/* processincoming --watch: wait for something to arrive */
+
+struct incomingwatch {
+	char *directory;
+#ifdef HAVE_SYS_INOTIFY_H
+	int fd;
+#else
+	struct stat lastseen;
+#endif
+};
+
+void incoming_unwatch(struct incomingwatch *w) {
+	if (w == NULL)
+		return;
+#ifdef HAVE_SYS_INOTIFY_H
+	if (w->fd >= 0)
+		(void)close(w->fd);
+#endif
+	free(w->directory);
+	free(w);
+}
+
+retvalue incoming_watch(struct distribution *distributions, const char *name, struct incomingwatch **result) {
+	struct incomingwatch *w;
+	struct incoming *i;
+	retvalue r;
+	int ret, e;
+
+	r = incoming_parse(distributions, name, &i);
+	if (RET_WAS_ERROR(r))
+		return r;
+	w = zNEW(struct incomingwatch);
+	if (FAILEDTOALLOC(w)) {
+		incoming_free(i);
+		return RET_ERROR_OOM;
+	}
+	w->directory = i->directory;
+	i->directory = NULL;
+	incoming_free(i);
+#ifdef HAVE_SYS_INOTIFY_H
+	w->fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+	if (w->fd < 0) {
+		e = errno;
+		fprintf(stderr, "Error %d initializing inotify: %s\n",
+				e, strerror(e));
+		incoming_unwatch(w);
+		return RET_ERRNO(e);
+	}
+	/* only complete files are of interest, so no IN_CREATE: */
+	ret = inotify_add_watch(w->fd, w->directory,
+			IN_CLOSE_WRITE|IN_MOVED_TO|IN_ONLYDIR);
+#else
+	ret = stat(w->directory, &w->lastseen);
+#endif
+	if (ret < 0) {
+		e = errno;
+		fprintf(stderr, "Cannot watch '%s': %s\n",
+				w->directory, strerror(e));
+		incoming_unwatch(w);
+		return RET_ERRNO(e);
+	}
+	*result = w;
+	return RET_OK;
+}
+
+/* RET_OK if something happened, RET_NOTHING if nothing did
+ * in <timeout> seconds (<0 means wait forever) */
+static retvalue watch_events(struct incomingwatch *w, int timeout) {
+#ifdef HAVE_SYS_INOTIFY_H
+	char buffer[4096]
+		__attribute__ ((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *event;
+	struct pollfd pfd;
+	ssize_t got;
+	char *p;
+	int ret, e;
+
+	pfd.fd = w->fd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	do {
+		if (interrupted())
+			return RET_ERROR_INTERRUPTED;
+		ret = poll(&pfd, 1, (timeout < 0)?-1:(1000 * timeout));
+	} while (ret < 0 && errno == EINTR);
+	if (ret < 0) {
+		e = errno;
+		fprintf(stderr, "Error %d waiting for changes in '%s': %s\n",
+				e, w->directory, strerror(e));
+		return RET_ERRNO(e);
+	}
+	if (ret == 0)
+		return RET_NOTHING;
+	/* the directory is scanned again anyway,
+	 * so only look if it is still there */
+	while ((got = read(w->fd, buffer, sizeof(buffer))) > 0) {
+		for (p = buffer ; p < buffer + got ;
+				p += sizeof(*event) + event->len) {
+			event = (const struct inotify_event *)p;
+			if ((event->mask & IN_IGNORED) != 0) {
+				fprintf(stderr,
+"'%s' vanished, no longer watching it!\n",
+						w->directory);
+				return RET_ERROR;
+			}
+		}
+	}
+	if (got < 0 && errno != EAGAIN && errno != EINTR) {
+		e = errno;
+		fprintf(stderr, "Error %d reading inotify events: %s\n",
+				e, strerror(e));
+		return RET_ERRNO(e);
+	}
+	return RET_OK;
+#else
+	struct stat s;
+	int e;
+
+	/* without inotify look at the directory's modification time
+	 * once a second (files still being written are not noticed) */
+	while (true) {
+		if (interrupted())
+			return RET_ERROR_INTERRUPTED;
+		if (stat(w->directory, &s) != 0) {
+			e = errno;
+			fprintf(stderr, "Cannot watch '%s': %s\n",
+					w->directory, strerror(e));
+			return RET_ERRNO(e);
+		}
+		if (s.st_mtime != w->lastseen.st_mtime ||
+				s.st_ino != w->lastseen.st_ino) {
+			w->lastseen = s;
+			return RET_OK;
+		}
+		if (timeout == 0)
+			return RET_NOTHING;
+		if (timeout > 0)
+			timeout--;
+		(void)sleep(1);
+	}
+#endif
+}
+
+retvalue incoming_waitforchanges(struct incomingwatch *w, unsigned int quiet) {
+	retvalue r;
+
+	r = watch_events(w, -1);
+	if (!RET_IS_OK(r))
+		return r;
+	/* many uploaders (and dupload) put the files there one after
+	 * the other, so wait till they are finished: */
+	do {
+		r = watch_events(w, quiet);
+	} while (r == RET_OK);
+	if (RET_WAS_ERROR(r))
+		return r;
+	return RET_OK;
+}
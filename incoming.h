@@ -7,4 +7,11 @@
 #endif
 
 retvalue process_incoming(struct distribution *distributions, const char *name, /*@null@*/const char *onlychangesfilename);
+
+/* for processincoming --watch: */
+struct incomingwatch;
+retvalue incoming_watch(struct distribution *, const char * /*name*/, /*@out@*/struct incomingwatch **);
+/* wait till something arrives and then nothing more for <quiet> seconds */
+retvalue incoming_waitforchanges(struct incomingwatch *, unsigned int /*quiet*/);
+void incoming_unwatch(/*@only@*/struct incomingwatch *);
 #endif
@@ -40,6 +40,25 @@ struct indexfile {
 	char *buffer;
 	int size, ofs, content;
 	bool failed;
+	/* when reading from an indexcache instead of the file: */
+	/*@null@*/const struct indexcache *cache;
+	size_t cachepos;
+};
+
+/* an index file read completely into memory, so that it can be given
+ * to multiple targets without reading and splitting it again: */
+struct indexcache_entry {
+	char *control;
+	char *packagename, *version;
+	/* NULL if there is no Architecture field */
+	/*@null@*/char *architecture;
+	int startlinenumber, linenumber;
+};
+
+struct indexcache {
+	char *filename;
+	size_t count, size;
+	struct indexcache_entry *entries;
 };
 
 retvalue indexfile_open(struct indexfile **file_p, const char *filename, enum compression compression) {
@@ -78,10 +97,30 @@ retvalue indexfile_open(struct indexfile **file_p, const char *filename, enum co
 	return RET_OK;
 }
 
+retvalue indexfile_opencache(struct indexfile **file_p, const struct indexcache *cache) {
+	struct indexfile *f = zNEW(struct indexfile);
+
+	if (FAILEDTOALLOC(f))
+		return RET_ERROR_OOM;
+	f->filename = strdup(cache->filename);
+	if (FAILEDTOALLOC(f->filename)) {
+		free(f);
+		return RET_ERROR_OOM;
+	}
+	f->status = RET_OK;
+	f->cache = cache;
+	f->cachepos = 0;
+	*file_p = f;
+	return RET_OK;
+}
+
 retvalue indexfile_close(struct indexfile *f) {
 	retvalue r;
 
-	r = uncompress_close(f->f);
+	if (f->cache != NULL)
+		r = RET_OK;
+	else
+		r = uncompress_close(f->f);
 
 	free(f->filename);
 	free(f->buffer);
@@ -185,6 +224,93 @@ static retvalue indexfile_get(struct indexfile *f) {
 	return RET_OK;
 }
 
+/* check if a package with the given architecture belongs into target,
+ * returns RET_NOTHING if the package is to be skipped */
+static retvalue checkarchitecture(struct indexfile *f, /*@null@*/const char *architecture, struct target *target, bool allowwrongarchitecture, bool ignorecruft, /*@out@*/architecture_t *atom_p) {
+
+	if (target->packagetype == pt_dsc) {
+		*atom_p = architecture_source;
+		return RET_OK;
+	}
+
+	/* check if architecture fits for target and error
+	    out if not ignorewrongarchitecture */
+	if (architecture == NULL) {
+		fprintf(stderr,
+"Error parsing %s line %d to %d: Chunk without 'Architecture:' field!\n",
+				f->filename,
+				f->startlinenumber, f->linenumber);
+		if (!ignorecruft)
+			return RET_ERROR_MISSING;
+		else
+			return RET_NOTHING;
+	} else if (strcmp(architecture, "all") == 0) {
+		*atom_p = architecture_all;
+		return RET_OK;
+	} else if (strcmp(architecture,
+			   atoms_architectures[
+				target->architecture
+				]) == 0) {
+		*atom_p = target->architecture;
+		return RET_OK;
+	} else if (!allowwrongarchitecture
+			&& !ignore[IGN_wrongarchitecture]) {
+		fprintf(stderr,
+"Warning: ignoring package because of wrong 'Architecture:' field '%s'"
+" (expected 'all' or '%s') in %s lines %d to %d!\n",
+				architecture,
+				atoms_architectures[
+				target->architecture],
+				f->filename,
+				f->startlinenumber,
+				f->linenumber);
+		if (ignored[IGN_wrongarchitecture] == 0) {
+			fprintf(stderr,
+"This either mean the repository you get packages from is of an extremely\n"
+"low quality, or something went wrong. Trying to ignore it now, though.\n"
+"To no longer get this message use '--ignore=wrongarchitecture'.\n");
+		}
+		ignored[IGN_wrongarchitecture]++;
+		return RET_NOTHING;
+	} else {
+		/* just ignore this because of wrong
+		 * architecture */
+		return RET_NOTHING;
+	}
+}
+
+static bool indexfile_getnextcached(struct indexfile *f, struct package *pkgout, struct target *target, bool allowwrongarchitecture) {
+	const struct indexcache_entry *e;
+	architecture_t atom;
+	retvalue r;
+
+	while (f->cachepos < f->cache->count) {
+		e = &f->cache->entries[f->cachepos++];
+		f->startlinenumber = e->startlinenumber;
+		f->linenumber = e->linenumber;
+
+		r = checkarchitecture(f, e->architecture, target,
+				allowwrongarchitecture, false, &atom);
+		if (r == RET_NOTHING)
+			continue;
+		if (RET_WAS_ERROR(r)) {
+			RET_UPDATE(f->status, r);
+			return false;
+		}
+		/* all strings belong to the cache,
+		 * so nothing is to be freed by package_done */
+		pkgout->target = target;
+		pkgout->control = e->control;
+		pkgout->pkgname = NULL;
+		pkgout->name = e->packagename;
+		pkgout->pkgversion = NULL;
+		pkgout->version = e->version;
+		pkgout->architecture = atom;
+		return true;
+	}
+	return false;
+}
+
 bool indexfile_getnext(struct indexfile *f, struct package *pkgout, struct target *target, bool allowwrongarchitecture) {
 	retvalue r;
 	bool ignorecruft = false; // TODO
@@ -192,6 +318,10 @@ bool indexfile_getnext(struct indexfile *f, struct package *pkgout, struct targe
 	const char *control;
 	architecture_t atom;
 
+	if (f->cache != NULL)
+		return indexfile_getnextcached(f, pkgout, target,
+				allowwrongarchitecture);
+
 	packagename = NULL; version = NULL;
 	do {
 		free(packagename); packagename = NULL;
@@ -239,52 +369,12 @@ bool indexfile_getnext(struct indexfile *f, struct package *pkgout, struct targe
 			if (r == RET_NOTHING)
 				architecture = NULL;
 
-			/* check if architecture fits for target and error
-			    out if not ignorewrongarchitecture */
-			if (architecture == NULL) {
-				fprintf(stderr,
-"Error parsing %s line %d to %d: Chunk without 'Architecture:' field!\n",
-						f->filename,
-						f->startlinenumber, f->linenumber);
-				if (!ignorecruft) {
-					r = RET_ERROR_MISSING;
-					break;
-				} else
-					continue;
-			} else if (strcmp(architecture, "all") == 0) {
-				atom = architecture_all;
-			} else if (strcmp(architecture,
-					   atoms_architectures[
-						target->architecture
-						]) == 0) {
-				atom = target->architecture;
-			} else if (!allowwrongarchitecture
-					&& !ignore[IGN_wrongarchitecture]) {
-				fprintf(stderr,
-"Warning: ignoring package because of wrong 'Architecture:' field '%s'"
-" (expected 'all' or '%s') in %s lines %d to %d!\n",
-						architecture,
-						atoms_architectures[
-						target->architecture],
-						f->filename,
-						f->startlinenumber,
-						f->linenumber);
-				if (ignored[IGN_wrongarchitecture] == 0) {
-					fprintf(stderr,
-"This either mean the repository you get packages from is of an extremely\n"
-"low quality, or something went wrong. Trying to ignore it now, though.\n"
-"To no longer get this message use '--ignore=wrongarchitecture'.\n");
-				}
-				ignored[IGN_wrongarchitecture]++;
-				free(architecture);
-				continue;
-			} else {
-				/* just ignore this because of wrong
-				 * architecture */
-				free(architecture);
-				continue;
-			}
+			r = checkarchitecture(f, architecture, target,
+					allowwrongarchitecture, ignorecruft,
+					&atom);
 			free(architecture);
+			if (r == RET_NOTHING)
+				continue;
 		}
 		if (RET_WAS_ERROR(r))
 			break;
@@ -302,3 +392,124 @@ bool indexfile_getnext(struct indexfile *f, struct package *pkgout, struct targe
 	RET_UPDATE(f->status, r);
 	return false;
 }
+
+void indexcache_free(struct indexcache *cache) {
+	size_t i;
+
+	if (cache == NULL)
+		return;
+	for (i = 0 ; i < cache->count ; i++) {
+		struct indexcache_entry *e = &cache->entries[i];
+
+		free(e->control);
+		free(e->packagename);
+		free(e->version);
+		free(e->architecture);
+	}
+	free(cache->entries);
+	free(cache->filename);
+	free(cache);
+}
+
+static retvalue indexcache_add(struct indexcache *cache, struct indexfile *f, char *packagename, char *version, char *architecture) {
+	struct indexcache_entry *e;
+
+	if (cache->count >= cache->size) {
+		size_t newsize = (cache->size == 0)?1024:2*cache->size;
+		struct indexcache_entry *n;
+
+		n = realloc(cache->entries,
+				newsize * sizeof(struct indexcache_entry));
+		if (FAILEDTOALLOC(n))
+			return RET_ERROR_OOM;
+		cache->entries = n;
+		cache->size = newsize;
+	}
+	e = &cache->entries[cache->count];
+	e->control = strdup(f->buffer);
+	if (FAILEDTOALLOC(e->control))
+		return RET_ERROR_OOM;
+	e->packagename = packagename;
+	e->version = version;
+	e->architecture = architecture;
+	e->startlinenumber = f->startlinenumber;
+	e->linenumber = f->linenumber;
+	cache->count++;
+	return RET_OK;
+}
+
+/* Read all chunks of an index file into memory.
+ * Returns RET_NOTHING if there is anything not to be cached (like
+ * chunks without Package or Version), so the caller can read the file
+ * directly to get the usual diagnostics */
+retvalue indexcache_read(struct indexcache **cache_p, const char *filename, enum compression compression) {
+	struct indexfile *f;
+	struct indexcache *cache;
+	retvalue result, r;
+
+	cache = zNEW(struct indexcache);
+	if (FAILEDTOALLOC(cache))
+		return RET_ERROR_OOM;
+	cache->filename = strdup(filename);
+	if (FAILEDTOALLOC(cache->filename)) {
+		free(cache);
+		return RET_ERROR_OOM;
+	}
+	r = indexfile_open(&f, filename, compression);
+	if (!RET_IS_OK(r)) {
+		indexcache_free(cache);
+		return r;
+	}
+	result = RET_OK;
+	while (true) {
+		char *packagename, *version, *architecture;
+
+		f->startlinenumber = f->linenumber + 1;
+		r = indexfile_get(f);
+		if (!RET_IS_OK(r)) {
+			RET_ENDUPDATE(result, r);
+			break;
+		}
+		r = chunk_getvalue(f->buffer, "Package", &packagename);
+		if (!RET_IS_OK(r)) {
+			result = r;
+			break;
+		}
+		r = chunk_getvalue(f->buffer, "Version", &version);
+		if (!RET_IS_OK(r)) {
+			free(packagename);
+			result = r;
+			break;
+		}
+		r = chunk_getvalue(f->buffer, "Architecture", &architecture);
+		if (RET_WAS_ERROR(r)) {
+			free(packagename);
+			free(version);
+			result = r;
+			break;
+		}
+		if (r == RET_NOTHING)
+			architecture = NULL;
+		r = indexcache_add(cache, f, packagename, version,
+				architecture);
+		if (RET_WAS_ERROR(r)) {
+			free(packagename);
+			free(version);
+			free(architecture);
+			result = r;
+			break;
+		}
+		if (interrupted()) {
+			result = RET_ERROR_INTERRUPTED;
+			break;
+		}
+	}
+	r = indexfile_close(f);
+	RET_ENDUPDATE(result, r);
+	if (!RET_IS_OK(result)) {
+		indexcache_free(cache);
+		return result;
+	}
+	*cache_p = cache;
+	return RET_OK;
+}
@@ -16,4 +16,11 @@ retvalue indexfile_open(/*@out@*/struct indexfile **, const char *, enum compres
 retvalue indexfile_close(/*@only@*/struct indexfile *);
 bool indexfile_getnext(struct indexfile *, /*@out@*/struct package *, struct target *, bool allowwrongarchitecture);
 
+/* an index file parsed once and kept in memory, to be read by multiple
+ * targets via indexfile_opencache (which must not outlive it) */
+struct indexcache;
+retvalue indexcache_read(/*@out@*/struct indexcache **, const char *, enum compression);
+void indexcache_free(/*@only@*/struct indexcache *);
+retvalue indexfile_opencache(/*@out@*/struct indexfile **, const struct indexcache *);
+
 #endif
@@ -40,6 +40,7 @@
 #include "configparser.h"
 #include "log.h"
 #include "filecntl.h"
+#include "trace.h"
 
 /*@null@*/ static /*@refcounted@*/ struct logfile {
 	/*@null@*/struct logfile *next;
@@ -215,7 +216,7 @@ struct notificator {
 	component_t component;
 	architecture_t architecture;
 	command_t command;
-	bool withcontrol, changesacceptrule;
+	bool withcontrol, changesacceptrule, batch;
 };
 
 static void notificator_done(/*@special@*/struct notificator *n) /*@releases n->scriptname, n->packagename, n->component, n->architecture@*/{
@@ -280,6 +281,12 @@ static retvalue notificator_parse(struct notificator *n, struct configiterator *
 					} else
 						error = true;
 					break;
+				case 7:
+					if (strcmp(word, "--batch") == 0)
+						n->batch = true;
+					else
+						error = true;
+					break;
 				case 9:
 					if (strcmp(word, "--changes") == 0)
 						n->changesacceptrule = true;
@@ -672,6 +679,281 @@ static retvalue startchild(void) {
 	return RET_OK;
 }
 
+/* notifiers with --batch get all their notifications via the standard
+ * input of one process per script instead of one process for each */
+
+/* how much not yet sent data to keep before waiting for the script,
+ * unless --notifier-backlog is given (in KiB) */
+#define BATCH_BACKLOG (256*1024)
+
+/*@null@*/ static struct notification_batch {
+	/*@null@*/struct notification_batch *next;
+	char *scriptname;
+	pid_t child;
+	int fd;
+	/* data not yet sent */
+	/*@null@*/char *data;
+	size_t datalen, datasent, datasize;
+} *batches = NULL;
+
+static void freearguments(/*@only@*/char **arguments, size_t count) {
+	size_t i;
+
+	for (i = 0 ; i < count ; i++)
+		free(arguments[i]);
+	free(arguments);
+}
+
+static void batch_free(/*@only@*/struct notification_batch *b) {
+	if (b->fd >= 0)
+		(void)close(b->fd);
+	free(b->scriptname);
+	free(b->data);
+	free(b);
+}
+
+static retvalue batch_start(const char *scriptname, /*@out@*/struct notification_batch **result) {
+	struct notification_batch *b;
+	int filedes[2];
+	pid_t child;
+	int e;
+
+	b = zNEW(struct notification_batch);
+	if (FAILEDTOALLOC(b))
+		return RET_ERROR_OOM;
+	b->fd = -1;
+	b->scriptname = strdup(scriptname);
+	if (FAILEDTOALLOC(b->scriptname)) {
+		batch_free(b);
+		return RET_ERROR_OOM;
+	}
+	if (pipe(filedes) < 0) {
+		e = errno;
+		fprintf(stderr, "Error creating pipe: %d=%s!\n",
+				e, strerror(e));
+		batch_free(b);
+		return RET_ERRNO(e);
+	}
+	child = fork();
+	if (child == 0) {
+		char *arguments[3];
+
+		dup2(filedes[0], 0);
+		if (filedes[0] != 0)
+			(void)close(filedes[0]);
+		(void)close(filedes[1]);
+		/* Try to close all open fd but 0,1,2 */
+		closefrom(3);
+		/* the rest is different for every notification */
+		sethookenvironment(NULL, NULL, NULL, NULL);
+		arguments[0] = b->scriptname;
+		arguments[1] = (char*)"--batch";
+		arguments[2] = NULL;
+		(void)execv(arguments[0], arguments);
+		fprintf(stderr, "Error executing '%s': %s\n", arguments[0],
+				strerror(errno));
+		_exit(255);
+	}
+	(void)close(filedes[0]);
+	if (child < 0) {
+		e = errno;
+		fprintf(stderr, "Error forking: %d=%s!\n", e, strerror(e));
+		(void)close(filedes[1]);
+		batch_free(b);
+		return RET_ERRNO(e);
+	}
+	b->child = child;
+	b->fd = filedes[1];
+	markcloseonexec(b->fd);
+	(void)fcntl(b->fd, F_SETFL, fcntl(b->fd, F_GETFL) | O_NONBLOCK);
+	b->next = batches;
+	batches = b;
+	*result = b;
+	return RET_OK;
+}
+
+/* send what can be sent without blocking, or everything if dowait */
+static retvalue batch_send(struct notification_batch *b, bool dowait) {
+	struct pollfd polldata;
+	ssize_t written;
+	int e;
+
+	while (b->fd >= 0 && b->datasent < b->datalen) {
+		written = write(b->fd, b->data + b->datasent,
+				b->datalen - b->datasent);
+		if (written >= 0) {
+			b->datasent += written;
+			continue;
+		}
+		e = errno;
+		if (e == EINTR)
+			continue;
+		if (e != EAGAIN) {
+			fprintf(stderr,
+"Error '%s' while sending data to '%s', no longer sending it any!\n",
+					strerror(e), b->scriptname);
+			(void)close(b->fd);
+			b->fd = -1;
+			break;
+		}
+		if (!dowait)
+			return RET_OK;
+		if (interrupted())
+			return RET_ERROR_INTERRUPTED;
+		polldata.fd = b->fd;
+		polldata.events = POLLOUT;
+		(void)poll(&polldata, 1, -1);
+	}
+	/* everything sent (or the script is gone): */
+	b->datalen = 0;
+	b->datasent = 0;
+	return RET_OK;
+}
+
+static retvalue batch_add(struct notification_batch *b, const char *record, size_t len) {
+	if (b->fd < 0)
+		/* already complained about */
+		return RET_NOTHING;
+	if (b->datasent > 0) {
+		memmove(b->data, b->data + b->datasent,
+				b->datalen - b->datasent);
+		b->datalen -= b->datasent;
+		b->datasent = 0;
+	}
+	if (b->datalen + len > b->datasize) {
+		size_t newsize = b->datalen + len + 4096;
+		char *n = realloc(b->data, newsize);
+
+		if (FAILEDTOALLOC(n))
+			return RET_ERROR_OOM;
+		b->data = n;
+		b->datasize = newsize;
+	}
+	memcpy(b->data + b->datalen, record, len);
+	b->datalen += len;
+	/* if the script does not keep up, wait for it: */
+	return batch_send(b, b->datalen > ((global.notifierbacklog > 0)
+				? (size_t)global.notifierbacklog * 1024
+				: (size_t)BATCH_BACKLOG));
+}
+
+static inline char *addfield(char *p, const char *prefix, const char *value) {
+	size_t l;
+
+	l = strlen(prefix);
+	memcpy(p, prefix, l);
+	p += l;
+	l = strlen(value) + 1;
+	memcpy(p, value, l);
+	return p + l;
+}
+
+/* Each notification is sent as NUL terminated fields: first those of
+ * REPREPRO_CAUSING_FILE, REPREPRO_CAUSING_RULE and REPREPRO_FROM that
+ * would be set, as NAME=value, then the arguments a script without
+ * --batch would get, then an empty field to end the record. */
+static retvalue batch_enqueue(const struct notificator *n, /*@only@*/char **arguments, size_t count, /*@null@*/const char *causing_file, /*@null@*/const char *causing_rule, /*@null@*/const char *suite_from) {
+	struct notification_batch *b = NULL, *c;
+	char *record, *p;
+	size_t i, len;
+	int running = 0;
+	retvalue r;
+
+	/* use the process of this script with the least data waiting */
+	for (c = batches ; c != NULL ; c = c->next) {
+		if (strcmp(c->scriptname, n->scriptname) != 0)
+			continue;
+		running++;
+		(void)batch_send(c, false);
+		if (b == NULL || c->datalen - c->datasent
+				< b->datalen - b->datasent)
+			b = c;
+	}
+	/* only start another one (up to --notifier-processes)
+	 * if all are still busy with earlier notifications */
+	if (b == NULL || (b->datasent < b->datalen &&
+				running < global.notifierprocesses)) {
+		r = batch_start(n->scriptname, &b);
+		if (RET_WAS_ERROR(r)) {
+			freearguments(arguments, count);
+			return r;
+		}
+	}
+	len = 1;
+	if (causing_file != NULL)
+		len += strlen("REPREPRO_CAUSING_FILE=")
+			+ strlen(causing_file) + 1;
+	if (causing_rule != NULL)
+		len += strlen("REPREPRO_CAUSING_RULE=")
+			+ strlen(causing_rule) + 1;
+	if (suite_from != NULL)
+		len += strlen("REPREPRO_FROM=") + strlen(suite_from) + 1;
+	/* the first argument is the script itself */
+	for (i = 1 ; i < count ; i++)
+		len += strlen(arguments[i]) + 1;
+	record = malloc(len);
+	if (FAILEDTOALLOC(record)) {
+		freearguments(arguments, count);
+		return RET_ERROR_OOM;
+	}
+	p = record;
+	if (causing_file != NULL)
+		p = addfield(p, "REPREPRO_CAUSING_FILE=", causing_file);
+	if (causing_rule != NULL)
+		p = addfield(p, "REPREPRO_CAUSING_RULE=", causing_rule);
+	if (suite_from != NULL)
+		p = addfield(p, "REPREPRO_FROM=", suite_from);
+	for (i = 1 ; i < count ; i++)
+		p = addfield(p, "", arguments[i]);
+	*(p++) = '\0';
+	assert ((size_t)(p - record) == len);
+	freearguments(arguments, count);
+	r = batch_add(b, record, len);
+	free(record);
+	return r;
+}
+
+/* tell all --batch scripts there is nothing more to come */
+static void batches_done(void) {
+	struct notification_batch *b;
+	pid_t child;
+	int status;
+
+	while ((b = batches) != NULL) {
+		(void)batch_send(b, true);
+		if (interrupted())
+			return;
+		batches = b->next;
+		if (b->fd >= 0) {
+			(void)close(b->fd);
+			b->fd = -1;
+		}
+		do {
+			child = waitpid(b->child, &status, 0);
+		} while (child < 0 && errno == EINTR && !interrupted());
+		if (child < 0) {
+			int e = errno;
+			fprintf(stderr,
+"Error calling waitpid on notification child: %d=%s\n",
+					e, strerror(e));
+		} else if (WIFSIGNALED(status)) {
+			fprintf(stderr,
+"Notification process '%s' killed with signal %d!\n",
+					b->scriptname, WTERMSIG(status));
+		} else if (!WIFEXITED(status)) {
+			fprintf(stderr,
+"Notification process '%s' failed!\n",
+					b->scriptname);
+		} else if (WEXITSTATUS(status) != 0) {
+			fprintf(stderr,
+"Notification process '%s' returned with exit code %d!\n",
+					b->scriptname,
+					(int)(WEXITSTATUS(status)));
+		}
+		batch_free(b);
+	}
+}
+
 static retvalue notificator_enqueuechanges(struct notificator *n, const char *codename, const char *name, const char *version, const char *safefilename, /*@null@*/const char *filekey) {
 	size_t count, i, j;
 	char **arguments;
@@ -708,6 +990,9 @@ static retvalue notificator_enqueuechanges(struct notificator *n, const char *co
 			free(arguments);
 			return RET_ERROR_OOM;
 		}
+	if (n->batch)
+		return batch_enqueue(n, arguments, count,
+				causingfile, NULL, NULL);
 	if (processes == NULL) {
 		p = NEW(struct notification_process);
 		processes = p;
@@ -843,6 +1128,9 @@ static retvalue notificator_enqueue(struct notificator *n, struct target *target
 			return RET_ERROR_OOM;
 		}
 	}
+	if (n->batch)
+		return batch_enqueue(n, arguments, count,
+				causingfile, causingrule, suitefrom);
 	if (processes == NULL) {
 		p = NEW(struct notification_process);
 		processes = p;
@@ -912,6 +1200,12 @@ static retvalue notificator_enqueue(struct notificator *n, struct target *target
 }
 
 void logger_wait(void) {
+	if (processes == NULL) {
+		if (!interrupted())
+			batches_done();
+		return;
+	}
+	trace_begin("notifiers", NULL);
 	while (processes != NULL) {
 		catchchildren();
 		if (interrupted())
@@ -925,10 +1219,24 @@ void logger_wait(void) {
 			select(0, NULL, NULL, NULL, &tv);
 		}
 	}
+	if (!interrupted())
+		batches_done();
+	trace_end();
 }
 
 void logger_warn_waiting(void) {
 	struct notification_process *p;
+	struct notification_batch *b;
+
+	while ((b = batches) != NULL) {
+		if (b->datasent < b->datalen)
+			fprintf(stderr,
+"WARNING: '%s' (a --batch notificator) did not get all notifications!\n"
+"(most likely due to receiving an interruption request)\n",
+				b->scriptname);
+		batches = b->next;
+		batch_free(b);
+	}
 
 	if (processes != NULL) {
 		(void)fputs(
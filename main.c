@@ -75,6 +75,10 @@
 #include "descriptions.h"
 #include "outhook.h"
 #include "package.h"
+#include "serve.h"
+#include "trace.h"
+#include "stats.h"
+#include "filekeyids.h"
 
 #ifndef STD_BASE_DIR
 #define STD_BASE_DIR "."
@@ -110,6 +114,9 @@ static char /*@only@*/ /*@null@*/
 static char /*@only@*/ /*@null@*/ *listformat = NULL;
 static char /*@only@*/ /*@null@*/ *endhook = NULL;
 static char /*@only@*/ /*@null@*/ *outhook = NULL;
+static char /*@only@*/ /*@null@*/ *socketname = NULL;
+static char /*@only@*/ /*@null@*/ *tracefilename = NULL;
+static char /*@only@*/ /*@null@*/ *statsfilename = NULL;
 static char /*@only@*/
 	*gunzip = NULL,
 	*bunzip2 = NULL,
@@ -129,6 +136,8 @@ static bool	askforpassphrase = false;
 static bool	guessgpgtty = true;
 static bool	skipold = true;
 static size_t   waitforlock = 0;
+/* seconds of quiet before processincoming --watch starts, -1 = no --watch */
+static int	watchquiet = -1;
 static enum exportwhen export = EXPORT_CHANGED;
 int		verbose = 0;
 static bool	fast = false;
@@ -143,7 +152,7 @@ static off_t reservedotherspace = 1024*1024;
  * to change something owned by lower owners. */
 enum config_option_owner config_state,
 #define O(x) owner_ ## x = CONFIG_OWNER_DEFAULT
-O(fast), O(x_morguedir), O(x_outdir), O(x_basedir), O(x_distdir), O(x_dbdir), O(x_listdir), O(x_confdir), O(x_logdir), O(x_methoddir), O(x_section), O(x_priority), O(x_component), O(x_architecture), O(x_packagetype), O(nothingiserror), O(nolistsdownload), O(keepunusednew), O(keepunreferenced), O(keeptemporaries), O(keepdirectories), O(askforpassphrase), O(skipold), O(export), O(waitforlock), O(spacecheckmode), O(reserveddbspace), O(reservedotherspace), O(guessgpgtty), O(verbosedatabase), O(gunzip), O(bunzip2), O(unlzma), O(unxz), O(lunzip), O(unzstd), O(gnupghome), O(listformat), O(listmax), O(listskip), O(onlysmalldeletes), O(endhook), O(outhook);
+O(fast), O(x_morguedir), O(x_outdir), O(x_basedir), O(x_distdir), O(x_dbdir), O(x_listdir), O(x_confdir), O(x_logdir), O(x_methoddir), O(x_section), O(x_priority), O(x_component), O(x_architecture), O(x_packagetype), O(nothingiserror), O(nolistsdownload), O(keepunusednew), O(keepunreferenced), O(keeptemporaries), O(keepdirectories), O(askforpassphrase), O(skipold), O(export), O(waitforlock), O(spacecheckmode), O(reserveddbspace), O(reservedotherspace), O(guessgpgtty), O(verbosedatabase), O(gunzip), O(bunzip2), O(unlzma), O(unxz), O(lunzip), O(unzstd), O(gnupghome), O(listformat), O(listmax), O(listskip), O(onlysmalldeletes), O(packageheaders), O(workers), O(notifierprocesses), O(notifierbacklog), O(endhook), O(outhook), O(socketname), O(watchquiet), O(tracefilename), O(statsfilename);
 #undef O
 
 #define CONFIGSET(variable, value) if (owner_ ## variable <= config_state) { \
@@ -530,6 +539,10 @@ ACTION_T(n, n, translatefilelists) {
 	return database_translate_filelists();
 }
 
+ACTION_T(n, n, compactreferences) {
+	return database_compactreferences();
+}
+
 ACTION_N(n, n, n, translatelegacychecksums) {
 
 	assert (argc == 1);
@@ -1604,7 +1617,9 @@ ACTION_F(n, n, n, n, listchecksums) {
 ACTION_B(n, n, n, dumpcontents) {
 	retvalue result, r;
 	struct table *packages;
-	const char *package, *chunk;
+	const char *record;
+	size_t recordlen;
+	struct package package;
 	struct cursor *cursor;
 
 	assert (argc == 2);
@@ -1619,8 +1634,15 @@ ACTION_B(n, n, n, dumpcontents) {
 		return r;
 	}
 	result = RET_NOTHING;
-	while (cursor_nexttempdata(packages, cursor, &package, &chunk, NULL)) {
-		printf("'%s' -> '%s'\n", package, chunk);
+	setzero(struct package, &package);
+	while (cursor_nexttempdata(packages, cursor, &package.name,
+				&record, &recordlen)) {
+		r = package_setrecord(&package, record, recordlen);
+		if (RET_WAS_ERROR(r)) {
+			result = r;
+			break;
+		}
+		printf("'%s' -> '%s'\n", package.name, package.control);
 		result = RET_OK;
 	}
 	r = cursor_close(packages, cursor);
@@ -1631,8 +1653,9 @@ ACTION_B(n, n, n, dumpcontents) {
 }
 
 ACTION_F(n, n, y, y, export) {
-	retvalue result, r;
-	struct distribution *d;
+	retvalue result, r, *results;
+	struct distribution *d, **toexport;
+	size_t count, i;
 
 	if (export == EXPORT_NEVER || export == EXPORT_SILENT_NEVER) {
 		fprintf(stderr,
@@ -1644,7 +1667,17 @@ ACTION_F(n, n, y, y, export) {
 	assert (result != RET_NOTHING);
 	if (RET_WAS_ERROR(result))
 		return result;
-	result = RET_NOTHING;
+	count = 0;
+	for (d = alldistributions ; d != NULL ; d = d->next)
+		count++;
+	toexport = nzNEW(count, struct distribution *);
+	results = nzNEW(count, retvalue);
+	if (FAILEDTOALLOC(toexport) || FAILEDTOALLOC(results)) {
+		free(toexport);
+		free(results);
+		return RET_ERROR_OOM;
+	}
+	count = 0;
 	for (d = alldistributions ; d != NULL ; d = d->next) {
 		if (!d->selected)
 			continue;
@@ -1660,20 +1693,56 @@ ACTION_F(n, n, y, y, export) {
 		if (verbose > 0) {
 			printf("Exporting %s...\n", d->codename);
 		}
-		r = distribution_fullexport(d);
-		if (RET_IS_OK(r))
-			/* avoid being exported again */
-			d->lookedat = false;
+		toexport[count++] = d;
+	}
+	/* all distributions are generated together, so the workers
+	 * can already work on the next while one is finished */
+	result = RET_NOTHING;
+	if (count > 0) {
+		r = distribution_fullexportlist(count, toexport,
+				export != EXPORT_FORCE, results);
 		RET_UPDATE(result, r);
-		if (RET_WAS_ERROR(r) && export != EXPORT_FORCE) {
-			return r;
-		}
 	}
+	for (i = 0 ; i < count ; i++) {
+		if (RET_IS_OK(results[i]))
+			/* avoid being exported again */
+			toexport[i]->lookedat = false;
+	}
+	free(toexport);
+	free(results);
 	return result;
 }
 
 /***********************update********************************/
 
+/* conf/updates and conf/pulls as read by the server (see serve below),
+ * given to the next command like conf/distributions */
+static bool served_haveupdates = false, served_havepulls = false;
+static /*@null@*/ struct update_pattern *served_updates = NULL;
+static /*@null@*/ struct pull_rule *served_pulls = NULL;
+
+static retvalue getpatterns(struct update_pattern **patterns) {
+	if (served_haveupdates) {
+		/* already read by the server */
+		*patterns = served_updates;
+		served_updates = NULL;
+		served_haveupdates = false;
+		return RET_OK;
+	}
+	return updates_getpatterns(patterns);
+}
+
+static retvalue getpullrules(struct pull_rule **rules) {
+	if (served_havepulls) {
+		/* already read by the server */
+		*rules = served_pulls;
+		served_pulls = NULL;
+		served_havepulls = false;
+		return RET_OK;
+	}
+	return pull_getrules(rules);
+}
+
 ACTION_D(y, n, y, update) {
 	retvalue result;
 	struct update_pattern *patterns;
@@ -1689,7 +1758,7 @@ ACTION_D(y, n, y, update) {
 	if (RET_WAS_ERROR(result))
 		return result;
 
-	result = updates_getpatterns(&patterns);
+	result = getpatterns(&patterns);
 	if (RET_WAS_ERROR(result))
 		return result;
 	assert (RET_IS_OK(result));
@@ -1737,7 +1806,7 @@ ACTION_D(y, n, y, predelete) {
 	if (RET_WAS_ERROR(result))
 		return result;
 
-	result = updates_getpatterns(&patterns);
+	result = getpatterns(&patterns);
 	if (RET_WAS_ERROR(result)) {
 		return result;
 	}
@@ -1784,7 +1853,7 @@ ACTION_B(y, n, y, checkupdate) {
 	if (RET_WAS_ERROR(result))
 		return result;
 
-	result = updates_getpatterns(&patterns);
+	result = getpatterns(&patterns);
 	if (RET_WAS_ERROR(result)) {
 		return result;
 	}
@@ -1830,7 +1899,7 @@ ACTION_B(y, n, y, dumpupdate) {
 	if (RET_WAS_ERROR(result))
 		return result;
 
-	result = updates_getpatterns(&patterns);
+	result = getpatterns(&patterns);
 	if (RET_WAS_ERROR(result)) {
 		return result;
 	}
@@ -1870,7 +1939,7 @@ ACTION_L(n, n, n, n, cleanlists) {
 	if (!isdirectory(global.listdir))
 		return RET_NOTHING;
 
-	result = updates_getpatterns(&patterns);
+	result = getpatterns(&patterns);
 	if (RET_WAS_ERROR(result))
 		return result;
 
@@ -1892,7 +1961,7 @@ ACTION_D(y, n, y, pull) {
 	if (RET_WAS_ERROR(result))
 		return result;
 
-	result = pull_getrules(&rules);
+	result = getpullrules(&rules);
 	if (RET_WAS_ERROR(result)) {
 		return result;
 	}
@@ -1922,7 +1991,7 @@ ACTION_B(y, n, y, checkpull) {
 	if (RET_WAS_ERROR(result))
 		return result;
 
-	result = pull_getrules(&rules);
+	result = getpullrules(&rules);
 	if (RET_WAS_ERROR(result)) {
 		return result;
 	}
@@ -1953,7 +2022,7 @@ ACTION_B(y, n, y, dumppull) {
 	if (RET_WAS_ERROR(result))
 		return result;
 
-	result = pull_getrules(&rules);
+	result = getpullrules(&rules);
 	if (RET_WAS_ERROR(result)) {
 		return result;
 	}
@@ -3926,6 +3995,147 @@ ACTION_B(n, n, y, reportcruft) {
 		return r;
 	return reportcruft(alldistributions);
 }
+/*********************** serve *********************************/
+
+/* config read once by the server, given to the next command */
+static /*@null@*/ struct distribution *served_distributions = NULL;
+
+/* needs the option parsing, so defined later: */
+static serve_commandfunction servedcommand;
+
+static void servedfreerules(void) {
+	if (served_updates != NULL) {
+		updates_freepatterns(served_updates);
+		served_updates = NULL;
+	}
+	served_haveupdates = false;
+	if (served_pulls != NULL) {
+		pull_freerules(served_pulls);
+		served_pulls = NULL;
+	}
+	served_havepulls = false;
+}
+
+static void servedfree(void) {
+	servedfreerules();
+	if (served_distributions != NULL) {
+		(void)distribution_freelist(served_distributions);
+		served_distributions = NULL;
+	}
+}
+
+static retvalue servedreload(void) {
+	struct distribution *d;
+	retvalue r;
+
+	servedfreerules();
+	if (served_distributions != NULL) {
+		r = distribution_freelist(served_distributions);
+		served_distributions = NULL;
+		if (RET_WAS_ERROR(r))
+			return r;
+	}
+	r = distribution_readall(&served_distributions);
+	if (RET_WAS_ERROR(r)) {
+		served_distributions = NULL;
+		return r;
+	}
+	for (d = served_distributions ; d != NULL ; d = d->next) {
+		r = distribution_loadalloverrides(d);
+		if (!RET_WAS_ERROR(r))
+			r = distribution_loaduploaders(d);
+		if (RET_WAS_ERROR(r)) {
+			(void)distribution_freelist(served_distributions);
+			served_distributions = NULL;
+			return r;
+		}
+	}
+	r = updates_getpatterns(&served_updates);
+	if (RET_WAS_ERROR(r)) {
+		servedfree();
+		return r;
+	}
+	served_haveupdates = true;
+	r = pull_getrules(&served_pulls);
+	if (RET_WAS_ERROR(r)) {
+		servedfree();
+		return r;
+	}
+	served_havepulls = true;
+	return RET_OK;
+}
+
+static bool makeabsolute(char **path_p) {
+	char *cwd, *path;
+
+	if (*path_p == NULL || (*path_p)[0] == '/')
+		return true;
+	cwd = getcwd(NULL, 0);
+	if (cwd == NULL) {
+		int e = errno;
+		fprintf(stderr,
+"Error %d getting the current directory: %s\n", e, strerror(e));
+		return false;
+	}
+	path = calc_dirconcat(cwd, *path_p);
+	free(cwd);
+	if (FAILEDTOALLOC(path))
+		return false;
+	free(*path_p);
+	*path_p = path;
+	return true;
+}
+
+ACTION_N(n, n, y, serve) {
+	const char *name;
+	retvalue r;
+
+	if (argc > 1)
+		name = argv[1];
+	else if (socketname != NULL)
+		name = socketname;
+	else {
+		fprintf(stderr,
+"Error: serve needs a socket, either as argument or by --socket!\n");
+		return RET_ERROR;
+	}
+
+	/* commands run in the working directory of the client: */
+	if (!makeabsolute(&x_basedir) || !makeabsolute(&x_outdir) ||
+			!makeabsolute(&x_distdir) || !makeabsolute(&x_dbdir) ||
+			!makeabsolute(&x_listdir) || !makeabsolute(&x_confdir) ||
+			!makeabsolute(&x_logdir) || !makeabsolute(&x_morguedir) ||
+			!makeabsolute(&x_methoddir) ||
+			!makeabsolute(&endhook) || !makeabsolute(&outhook) ||
+			!makeabsolute(&gnupghome))
+		return RET_ERROR;
+	global.basedir = x_basedir;
+	global.dbdir = x_dbdir;
+	global.outdir = x_outdir;
+	global.confdir = x_confdir;
+	global.distdir = x_distdir;
+	global.logdir = x_logdir;
+	global.methoddir = x_methoddir;
+	global.listdir = x_listdir;
+	global.morguedir = x_morguedir;
+	signature_setcachedir(global.dbdir);
+	if (gnupghome != NULL && setenv("GNUPGHOME", gnupghome, 1) != 0) {
+		int e = errno;
+
+		fprintf(stderr, "Error %d setting GNUPGHOME to '%s': %s\n",
+				e, gnupghome, strerror(e));
+		return RET_ERRNO(e);
+	}
+	/* each command creates its own context */
+	signatures_done();
+
+	r = servedreload();
+	if (RET_WAS_ERROR(r))
+		return r;
+	r = serve_run(name, servedcommand, servedreload);
+	servedfree();
+	return r;
+}
 
 /*********************/
 /* argument handling */
@@ -4133,6 +4343,8 @@ static const struct action {
 		0, 1, "generatefilelists [reread]"},
 	{"translatefilelists",	A__T(translatefilelists),
 		0, 0, "translatefilelists"},
+	{"compactreferences",	A__T(compactreferences),
+		0, 0, "compactreferences"},
 	{"translatelegacychecksums",	A_N(translatelegacychecksums),
 		0, 0, "translatelegacychecksums"},
 	{"_listconfidentifiers",	A_C(listconfidentifiers),
@@ -4163,6 +4375,8 @@ static const struct action {
 		0, -1, "sourcemissing [<codenames>]"},
 	{"reportcruft",		A_B(reportcruft),
 		0, -1, "reportcruft [<codenames>]"},
+	{"serve",		A_N(serve),
+		0, 1, "[--socket=<socket>] serve [<socket>]"},
 	{NULL, NULL , 0, 0, 0, NULL}
 };
 #undef A_N
@@ -4175,6 +4389,19 @@ static const struct action {
 #undef A_F
 #undef A__T
 
+/* let the outhook know about the --stats-json file, with what was done
+ * so far (it is written again with the final numbers when exiting) */
+static retvalue sendstats(retvalue result) {
+	retvalue r;
+
+	if (statsfilename == NULL)
+		return RET_NOTHING;
+	r = stats_write(statsfilename, result);
+	if (RET_IS_OK(r))
+		outhook_send("STATS", statsfilename, NULL, NULL);
+	return r;
+}
+
 static retvalue callaction(command_t command, const struct action *action, int argc, const char *argv[]) {
 	retvalue result, r;
 	struct distribution *alldistributions = NULL;
@@ -4248,7 +4475,11 @@ static retvalue callaction(command_t command, const struct action *action, int a
 
 	if (ISSET(needs, NEED_DATABASE))
 		needs |= NEED_CONFIG;
-	if (ISSET(needs, NEED_CONFIG)) {
+	if (ISSET(needs, NEED_CONFIG) && served_distributions != NULL) {
+		/* already read by the server */
+		alldistributions = served_distributions;
+		served_distributions = NULL;
+	} else if (ISSET(needs, NEED_CONFIG)) {
 		r = distribution_readall(&alldistributions);
 		if (RET_WAS_ERROR(r))
 			return r;
@@ -4426,8 +4657,13 @@ static retvalue callaction(command_t command, const struct action *action, int a
 				if (outhook != NULL) {
 					if (interrupted())
 						r = RET_ERROR_INTERRUPTED;
-					else
+					else {
+						/* the outhook is needed even
+						 * without the statistics */
+						r = sendstats(result);
+						RET_ENDUPDATE(result, r);
 						r = outhook_call(outhook);
+					}
 					RET_ENDUPDATE(result, r);
 				}
 			}
@@ -4449,6 +4685,54 @@ static retvalue callaction(command_t command, const struct action *action, int a
 	return result;
 }
 
+/* processincoming --watch: process what is there and then again
+ * every time something new arrived. Each batch is a run of its own,
+ * so the database is not locked and the configuration is read again. */
+static retvalue watchincoming(command_t command, const struct action *action, int argc, const char *argv[]) {
+	struct distribution *alldistributions = NULL;
+	struct incomingwatch *w;
+	retvalue result, r;
+
+	if (strcmp(action->name, "processincoming") != 0) {
+		fprintf(stderr,
+"Error: --watch is only possible with processincoming!\n");
+		return RET_ERROR;
+	}
+	if (argc < 2)
+		/* let it complain about the missing rule name */
+		return callaction(command, action, argc, argv);
+	if (argc > 2) {
+		fprintf(stderr,
+"Error: processincoming --watch cannot be limited to a single .changes file!\n");
+		return RET_ERROR;
+	}
+	r = distribution_readall(&alldistributions);
+	if (RET_WAS_ERROR(r))
+		return r;
+	/* start watching before the first run, to not miss anything */
+	r = incoming_watch(alldistributions, argv[1], &w);
+	(void)distribution_freelist(alldistributions);
+	if (RET_WAS_ERROR(r))
+		return r;
+	result = RET_NOTHING;
+	do {
+		/* a broken upload is no reason to stop */
+		r = callaction(command, action, argc, argv);
+		RET_UPDATE(result, r);
+		pool_free();
+		filekeyids_free();
+		if (interrupted())
+			break;
+		(void)fflush(stdout);
+		r = incoming_waitforchanges(w, watchquiet);
+		RET_ENDUPDATE(result, r);
+	} while (!RET_WAS_ERROR(r));
+	incoming_unwatch(w);
+	if (interrupted())
+		RET_ENDUPDATE(result, RET_ERROR_INTERRUPTED);
+	return result;
+}
+
 enum { LO_DELETE=1,
 LO_KEEPUNREFERENCED,
 LO_KEEPUNUSEDNEW,
@@ -4459,6 +4743,7 @@ LO_ASKPASSPHRASE,
 LO_ONLYSMALLDELETES,
 LO_KEEPDIRECTORIES,
 LO_KEEPTEMPORARIES,
+LO_PACKAGEHEADERS,
 LO_FAST,
 LO_SKIPOLD,
 LO_GUESSGPGTTY,
@@ -4472,6 +4757,7 @@ LO_NOASKPASSPHRASE,
 LO_NOONLYSMALLDELETES,
 LO_NOKEEPDIRECTORIES,
 LO_NOKEEPTEMPORARIES,
+LO_NOPACKAGEHEADERS,
 LO_NOFAST,
 LO_NOSKIPOLD,
 LO_NOGUESSGPGTTY,
@@ -4501,6 +4787,9 @@ LO_GNUPGHOME,
 LO_LISTFORMAT,
 LO_LISTSKIP,
 LO_LISTMAX,
+LO_WORKERS,
+LO_NOTIFIERPROCESSES,
+LO_NOTIFIERBACKLOG,
 LO_MORGUEDIR,
 LO_SHOWPERCENT,
 LO_RESTRICT_BIN,
@@ -4509,6 +4798,10 @@ LO_RESTRICT_FILE_BIN,
 LO_RESTRICT_FILE_SRC,
 LO_ENDHOOK,
 LO_OUTHOOK,
+LO_SOCKET,
+LO_WATCH,
+LO_TRACEFILE,
+LO_STATSJSON,
 LO_UNIGNORE};
 static int longoption = 0;
 const char *programname;
@@ -4674,6 +4967,12 @@ static void handle_option(int c, const char *argument) {
 				case LO_NOKEEPDIRECTORIES:
 					CONFIGGSET(keepdirectories, false);
 					break;
+				case LO_PACKAGEHEADERS:
+					CONFIGGSET(packageheaders, true);
+					break;
+				case LO_NOPACKAGEHEADERS:
+					CONFIGGSET(packageheaders, false);
+					break;
 				case LO_NOTHINGISERROR:
 					CONFIGSET(nothingiserror, true);
 					break;
@@ -4801,6 +5100,23 @@ static void handle_option(int c, const char *argument) {
 				case LO_OUTHOOK:
 					CONFIGDUP(outhook, argument);
 					break;
+				case LO_SOCKET:
+					CONFIGDUP(socketname, argument);
+					break;
+				case LO_TRACEFILE:
+					CONFIGDUP(tracefilename, argument);
+					break;
+				case LO_STATSJSON:
+					CONFIGDUP(statsfilename, argument);
+					break;
+				case LO_WATCH:
+					if (argument == NULL)
+						i = 5;
+					else
+						i = parse_number("--watch",
+							argument, 3600);
+					CONFIGSET(watchquiet, i);
+					break;
 				case LO_LISTMAX:
 					i = parse_number("--list-max",
 							argument, INT_MAX);
@@ -4813,6 +5129,21 @@ static void handle_option(int c, const char *argument) {
 							argument, INT_MAX);
 					CONFIGSET(listskip, i);
 					break;
+				case LO_WORKERS:
+					i = parse_number("--workers",
+							argument, 1024);
+					CONFIGGSET(workers, i);
+					break;
+				case LO_NOTIFIERPROCESSES:
+					i = parse_number("--notifier-processes",
+							argument, 1024);
+					CONFIGGSET(notifierprocesses, i);
+					break;
+				case LO_NOTIFIERBACKLOG:
+					i = parse_number("--notifier-backlog",
+							argument, 1024*1024);
+					CONFIGGSET(notifierbacklog, i);
+					break;
 				case LO_LISTFORMAT:
 					if (strcmp(argument, "NONE") == 0) {
 						CONFIGSET(listformat, NULL);
@@ -4965,7 +5296,12 @@ static void myexit(int status) {
 	free(gnupghome);
 	free(endhook);
 	free(outhook);
+	free(socketname);
+	free(tracefilename);
+	free(statsfilename);
+	stats_done();
 	pool_free();
+	filekeyids_free();
 	exit(status);
 }
 
@@ -5043,6 +5379,166 @@ static inline int callendhook(int status, char *argv[]) {
 	return EXIT_RET(RET_ERROR);
 }
 
+static void setgpgtty(void) {
+	static char terminalname[1024];
+	ssize_t len;
+
+	if (!isatty(0))
+		return;
+	len = readlink("/proc/self/fd/0", terminalname, 1023);
+	if (len > 0 && len < 1024) {
+		terminalname[len] = '\0';
+		setenv("GPG_TTY", terminalname, 1);
+	} else if (verbose > 10) {
+		fprintf(stderr,
+"Could not readlink /proc/self/fd/0 (error was %s), not setting GPG_TTY.\n",
+				strerror(errno));
+	}
+}
+
+static void NORETURN runaction(int argc, char *argv[]) {
+	const struct action *a;
+	retvalue r;
+
+	a = all_actions;
+	while (a->name != NULL) {
+		if (strcasecmp(a->name, argv[optind]) == 0) {
+			signature_init(askforpassphrase);
+			stats_start(a->name);
+			if (tracefilename != NULL) {
+				r = trace_start(tracefilename, a->name);
+				if (RET_WAS_ERROR(r))
+					myexit(EXIT_RET(r));
+			}
+			if (watchquiet >= 0)
+				r = watchincoming(1 + (a - all_actions), a,
+					argc-optind, (const char**)argv+optind);
+			else
+				r = callaction(1 + (a - all_actions), a,
+					argc-optind, (const char**)argv+optind);
+			/* yeah, freeing all this stuff before exiting is
+			 * stupid, but it makes valgrind logs easier
+			 * readable */
+			signatures_done();
+			free_known_keys();
+			RET_ENDUPDATE(r, trace_done());
+			if (statsfilename != NULL)
+				RET_ENDUPDATE(r, stats_write(statsfilename, r));
+			if (RET_WAS_ERROR(r)) {
+				if (r == RET_ERROR_OOM)
+					(void)fputs("Out of Memory!\n", stderr);
+				else if (verbose >= 0)
+					(void)fputs(
+"There have been errors!\n",
+						stderr);
+			}
+			if (endhook != NULL) {
+				assert (optind > 0);
+				/* only returns upon error: */
+				r = callendhook(EXIT_RET(r), argv + optind - 1);
+			}
+			myexit(EXIT_RET(r));
+		} else
+			a++;
+	}
+
+	fprintf(stderr,
+"Unknown action '%s'. (see --help for available options and actions)\n",
+			argv[optind]);
+	signatures_done();
+	myexit(EXIT_FAILURE);
+}
+
+/* the options of the server, for commands sent to it */
+static const struct option *servedlongopts;
+
+static void handle_servedoption(int c, const char *argument) {
+	char *dir, *requested;
+	bool same;
+
+	if (c == 'b') {
+		dir = realpath(x_basedir, NULL);
+		requested = realpath(argument, NULL);
+		same = dir != NULL && requested != NULL &&
+			strcmp(dir, requested) == 0;
+		free(dir);
+		free(requested);
+		if (!same) {
+			fprintf(stderr,
+"Error: --basedir '%s' is not the basedir of the server (%s)!\n",
+					argument, x_basedir);
+			exit(EXIT_FAILURE);
+		}
+		return;
+	}
+	if (c == 0) switch (longoption) {
+		case LO_OUTDIR:
+		case LO_DISTDIR:
+		case LO_DBDIR:
+		case LO_LOGDIR:
+		case LO_LISTDIR:
+		case LO_CONFDIR:
+		case LO_METHODDIR:
+		case LO_MORGUEDIR:
+		case LO_GNUPGHOME:
+		case LO_ENDHOOK:
+		case LO_OUTHOOK:
+		case LO_GUNZIP:
+		case LO_BUNZIP2:
+		case LO_UNLZMA:
+		case LO_UNXZ:
+		case LO_LZIP:
+		case LO_UNZSTD:
+			fprintf(stderr,
+"Error: Directories, hooks and helper programs can only be given to the server!\n");
+			exit(EXIT_FAILURE);
+		case LO_WATCH:
+			fprintf(stderr,
+"Error: --watch cannot be sent to a server!\n");
+			exit(EXIT_FAILURE);
+		case LO_TRACEFILE:
+		case LO_STATSJSON:
+			fprintf(stderr,
+"Error: --trace-file and --stats-json cannot be sent to a server!\n");
+			exit(EXIT_FAILURE);
+	}
+	handle_option(c, argument);
+}
+
+/* called in a child of the server with the command line of a client */
+static int servedcommand(int argc, char *argv[]) {
+	int c;
+
+	config_state = CONFIG_OWNER_CMDLINE;
+	longoption = 0;
+	/* the server's own command line was already parsed */
+	optind = 0;
+	/* the server's trace and stats files are only written by the
+	 * server itself */
+	free(tracefilename);
+	tracefilename = NULL;
+	free(statsfilename);
+	statsfilename = NULL;
+	while ((c = getopt_long(argc, argv, "+fVvshb:P:i:A:C:S:T:",
+					servedlongopts, NULL)) != -1) {
+		handle_servedoption(c, optarg);
+	}
+	if (optind >= argc) {
+		fputs(
+"No action given. (see --help for available options and actions)\n", stderr);
+		return EXIT_FAILURE;
+	}
+	if (strcasecmp(argv[optind], "serve") == 0) {
+		fputs("Error: A server cannot start another server!\n", stderr);
+		return EXIT_FAILURE;
+	}
+	if (delete < D_COPY)
+		delete = D_COPY;
+	if (guessgpgtty)
+		setgpgtty();
+	runaction(argc, argv);
+}
+
 int main(int argc, char *argv[]) {
 	static struct option longopts[] = {
 		{"delete", no_argument, &longoption, LO_DELETE},
@@ -5075,6 +5571,7 @@ int main(int argc, char *argv[]) {
 		{"onlysmalldeletes", no_argument, &longoption, LO_ONLYSMALLDELETES},
 		{"keepdirectories", no_argument, &longoption, LO_KEEPDIRECTORIES},
 		{"keeptemporaries", no_argument, &longoption, LO_KEEPTEMPORARIES},
+		{"packageheaders", no_argument, &longoption, LO_PACKAGEHEADERS},
 		{"ask-passphrase", no_argument, &longoption, LO_ASKPASSPHRASE},
 		{"nonothingiserror", no_argument, &longoption, LO_NONOTHINGISERROR},
 		{"nonolistsdownload", no_argument, &longoption, LO_LISTDOWNLOAD},
@@ -5085,6 +5582,7 @@ int main(int argc, char *argv[]) {
 		{"noonlysmalldeletes", no_argument, &longoption, LO_NOONLYSMALLDELETES},
 		{"nokeepdirectories", no_argument, &longoption, LO_NOKEEPDIRECTORIES},
 		{"nokeeptemporaries", no_argument, &longoption, LO_NOKEEPTEMPORARIES},
+		{"nopackageheaders", no_argument, &longoption, LO_NOPACKAGEHEADERS},
 		{"noask-passphrase", no_argument, &longoption, LO_NOASKPASSPHRASE},
 		{"guessgpgtty", no_argument, &longoption, LO_GUESSGPGTTY},
 		{"noguessgpgtty", no_argument, &longoption, LO_NOGUESSGPGTTY},
@@ -5115,6 +5613,9 @@ int main(int argc, char *argv[]) {
 		{"list-format", required_argument, &longoption, LO_LISTFORMAT},
 		{"list-skip", required_argument, &longoption, LO_LISTSKIP},
 		{"list-max", required_argument, &longoption, LO_LISTMAX},
+		{"workers", required_argument, &longoption, LO_WORKERS},
+		{"notifier-processes", required_argument, &longoption, LO_NOTIFIERPROCESSES},
+		{"notifier-backlog", required_argument, &longoption, LO_NOTIFIERBACKLOG},
 		{"morguedir", required_argument, &longoption, LO_MORGUEDIR},
 		{"show-percent", no_argument, &longoption, LO_SHOWPERCENT},
 		{"restrict", required_argument, &longoption, LO_RESTRICT_SRC},
@@ -5127,6 +5628,10 @@ int main(int argc, char *argv[]) {
 		{"restrict-file-binary", required_argument, &longoption, LO_RESTRICT_FILE_BIN},
 		{"endhook", required_argument, &longoption, LO_ENDHOOK},
 		{"outhook", required_argument, &longoption, LO_OUTHOOK},
+		{"socket", required_argument, &longoption, LO_SOCKET},
+		{"watch", optional_argument, &longoption, LO_WATCH},
+		{"trace-file", required_argument, &longoption, LO_TRACEFILE},
+		{"stats-json", required_argument, &longoption, LO_STATSJSON},
 		{NULL, 0, NULL, 0}
 	};
 	const struct action *a;
@@ -5238,21 +5743,28 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
-	if (guessgpgtty && (getenv("GPG_TTY")==NULL) && isatty(0)) {
-		static char terminalname[1024];
-		ssize_t len;
+	if (socketname != NULL) {
+		socketname = expand_plus_prefix(socketname, "socket", "boc",
+				true);
+		if (strcasecmp(argv[optind], "serve") != 0) {
+			int status;
 
-		len = readlink("/proc/self/fd/0", terminalname, 1023);
-		if (len > 0 && len < 1024) {
-			terminalname[len] = '\0';
-			setenv("GPG_TTY", terminalname, 0);
-		} else if (verbose > 10) {
-			fprintf(stderr,
-"Could not readlink /proc/self/fd/0 (error was %s), not setting GPG_TTY.\n",
-					strerror(errno));
+			r = serve_forward(socketname, argc, argv, &status);
+			if (RET_IS_OK(r))
+				myexit(status);
+			if (RET_WAS_ERROR(r))
+				myexit(EXIT_RET(r));
+			/* no server running, so do it here */
+			if (verbose > 5)
+				fprintf(stderr,
+"No server listening on '%s', running command directly.\n",
+						socketname);
 		}
 	}
 
+	if (guessgpgtty && (getenv("GPG_TTY")==NULL))
+		setgpgtty();
+
 	if (delete < D_COPY)
 		delete = D_COPY;
 	if (interrupted())
@@ -5266,6 +5778,7 @@ int main(int argc, char *argv[]) {
 	global.methoddir = x_methoddir;
 	global.listdir = x_listdir;
 	global.morguedir = x_morguedir;
+	signature_setcachedir(global.dbdir);
 
 	if (gunzip != NULL && gunzip[0] == '+')
 		gunzip = expand_plus_prefix(gunzip, "gunzip", "boc", true);
@@ -5286,6 +5799,7 @@ int main(int argc, char *argv[]) {
 	free(unxz);
 	free(lunzip);
 	free(unzstd);
+	gunzip = bunzip2 = unlzma = unxz = lunzip = unzstd = NULL;
 
 	a = all_actions;
 	while (a->name != NULL) {
@@ -5313,43 +5827,6 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
-	a = all_actions;
-	while (a->name != NULL) {
-		if (strcasecmp(a->name, argv[optind]) == 0) {
-			signature_init(askforpassphrase);
-			r = callaction(1 + (a - all_actions), a,
-					argc-optind, (const char**)argv+optind);
-			/* yeah, freeing all this stuff before exiting is
-			 * stupid, but it makes valgrind logs easier
-			 * readable */
-			signatures_done();
-			free_known_keys();
-			if (RET_WAS_ERROR(r)) {
-				if (r == RET_ERROR_OOM)
-					(void)fputs("Out of Memory!\n", stderr);
-				else if (verbose >= 0)
-					(void)fputs(
-"There have been errors!\n",
-						stderr);
-			}
-			if (endhook != NULL) {
-				assert (optind > 0);
-				/* only returns upon error: */
-				r = callendhook(EXIT_RET(r), argv + optind - 1);
-			}
-			myexit(EXIT_RET(r));
-		} else
-			a++;
-	}
-
-	fprintf(stderr,
-"Unknown action '%s'. (see --help for available options and actions)\n",
-			argv[optind]);
-	signatures_done();
-	myexit(EXIT_FAILURE);
-}
-
-retvalue package_newcontrol_by_cursor(struct package_cursor *cursor, const char *newcontrol, size_t newcontrollen) {
-	return cursor_replace(cursor->target->packages, cursor->cursor,
-			newcontrol, newcontrollen);
+	servedlongopts = longopts;
+	runaction(argc, argv);
 }
@@ -0,0 +1,611 @@
+/*  This file is part of "reprepro"
+ *  Copyright (C) 2026 agent
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02111-1301  USA
+ */
+#include <config.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include "error.h"
+#include "globals.h"
+#include "mprintf.h"
+#include "strlist.h"
+#include "atoms.h"
+#include "chunks.h"
+#include "checksums.h"
+#include "uncompression.h"
+#include "dpkgversions.h"
+#include "globmatch.h"
+#include "indexfile.h"
+#include "terms.h"
+#include "termdecide.h"
+#include "filelist.h"
+#include "package.h"
+#include "target.h"
+
+/* microbenchmarks of the parsing primitives everything else is built on,
+ * run over the contents of real Packages, Sources and Contents files.
+ *
+ * Allocations are counted by having the linker redirect malloc and
+ * friends to the __wrap_ functions below (see microbench_LDFLAGS in
+ * Makefile.am), allocations done within the C library itself (like those
+ * of vasprintf) are not seen. */
+
+/* the things the modules expect from main.c: */
+struct global_config global;
+int verbose = 0;
+bool interrupted(void) {
+	return false;
+}
+
+static unsigned long long allocations = 0;
+
+void *__real_malloc(size_t);
+void *__real_calloc(size_t, size_t);
+void *__real_realloc(void *, size_t);
+char *__real_strdup(const char *);
+char *__real_strndup(const char *, size_t);
+void *__wrap_malloc(size_t);
+void *__wrap_calloc(size_t, size_t);
+void *__wrap_realloc(void *, size_t);
+char *__wrap_strdup(const char *);
+char *__wrap_strndup(const char *, size_t);
+
+void *__wrap_malloc(size_t size) {
+	allocations++;
+	return __real_malloc(size);
+}
+void *__wrap_calloc(size_t count, size_t size) {
+	allocations++;
+	return __real_calloc(count, size);
+}
+void *__wrap_realloc(void *p, size_t size) {
+	allocations++;
+	return __real_realloc(p, size);
+}
+char *__wrap_strdup(const char *s) {
+	allocations++;
+	return __real_strdup(s);
+}
+char *__wrap_strndup(const char *s, size_t len) {
+	allocations++;
+	return __real_strndup(s, len);
+}
+
+static const struct option options[] = {
+	{"version", no_argument, NULL, 'V'},
+	{"help", no_argument, NULL, 'h'},
+	{"time", required_argument, NULL, 't'},
+	{"contents", required_argument, NULL, 'c'},
+	{"formula", required_argument, NULL, 'f'},
+	{"pattern", required_argument, NULL, 'p'},
+	{NULL, 0, NULL, 0}
+};
+
+static void usage(FILE *f) {
+	fputs(
+"microbench: time the parsing primitives of reprepro\n"
+"Syntax:\n"
+"	microbench [options] <Packages or Sources file>...\n"
+"Options:\n"
+"	--time <milliseconds>: how long to run each benchmark (default 500)\n"
+"	--contents <file>: uncompressed Contents file for filelistcompressor\n"
+"	                   (default: the Filename: fields of the index files)\n"
+"	--formula <formula>: formula for term_decidepackage\n"
+"	--pattern <glob>: pattern for globmatch (can be given multiple times)\n"
+"Reports the time and the number of allocations per operation.\n", f);
+}
+
+/* everything the benchmarks run over */
+static struct corpus {
+	/* the index files and the target to read each with */
+	struct strlist files;
+	struct index {
+		enum compression compression;
+		struct target target;
+	} *indices;
+	/* one string for each chunk read */
+	struct strlist chunks, names, versions, checksums, paths;
+} corpus;
+
+static term *formula;
+static struct strlist patterns;
+
+/* something to store results in, so nothing is optimized away */
+static volatile unsigned long sink;
+
+static retvalue addfield(struct strlist *list, const char *chunk, const char *field) {
+	char *value;
+	retvalue r;
+
+	r = chunk_getvalue(chunk, field, &value);
+	if (!RET_IS_OK(r))
+		return r;
+	return strlist_add(list, value);
+}
+
+/* the combined form checksums are stored in, ":1:sha1 :2:sha256 md5 size" */
+static retvalue addchecksums(const char *chunk) {
+	char *md5, *sha1 = NULL, *sha256 = NULL, *size = NULL, *combined;
+	retvalue r;
+
+	r = chunk_getvalue(chunk, "MD5sum", &md5);
+	if (!RET_IS_OK(r))
+		return r;
+	r = chunk_getvalue(chunk, "SHA1", &sha1);
+	if (RET_IS_OK(r))
+		r = chunk_getvalue(chunk, "SHA256", &sha256);
+	if (RET_IS_OK(r))
+		r = chunk_getvalue(chunk, "Size", &size);
+	if (RET_IS_OK(r)) {
+		combined = mprintf(":1:%s :2:%s %s %s",
+				sha1, sha256, md5, size);
+		if (FAILEDTOALLOC(combined))
+			r = RET_ERROR_OOM;
+		else
+			r = strlist_add(&corpus.checksums, combined);
+	}
+	free(md5);
+	free(sha1);
+	free(sha256);
+	free(size);
+	return r;
+}
+
+static retvalue readindex(const char *filename, struct index *index) {
+	struct target target;
+	struct indexfile *i;
+	struct package package;
+	char *architecture;
+	const char *basename;
+	size_t len;
+	retvalue r;
+
+	basename = strrchr(filename, '/');
+	basename = (basename == NULL)?filename:basename + 1;
+	len = strlen(basename);
+	index->compression = compression_by_suffix(basename, &len);
+	if (!uncompression_supported(index->compression)) {
+		fprintf(stderr,
+"Cannot uncompress '%s' as no uncompressor was found!\n", filename);
+		return RET_ERROR;
+	}
+	/* Sources files are read like reprepro reads them,
+	 * for Packages files the architecture is the first one found
+	 * other than 'all', only the initial read ignores architectures */
+	memset(&index->target, 0, sizeof(index->target));
+	index->target.packagetype = (strstr(basename, "Sources") != NULL)?
+		pt_dsc:pt_deb;
+	index->target.architecture = architecture_all;
+	memset(&target, 0, sizeof(target));
+	target.packagetype = pt_dsc;
+
+	r = indexfile_open(&i, filename, index->compression);
+	if (!RET_IS_OK(r))
+		return r;
+	setzero(struct package, &package);
+	while (indexfile_getnext(i, &package, &target, true)) {
+		r = strlist_add_dup(&corpus.chunks, package.control);
+		if (!RET_WAS_ERROR(r))
+			r = strlist_add_dup(&corpus.names, package.name);
+		if (!RET_WAS_ERROR(r))
+			r = strlist_add_dup(&corpus.versions, package.version);
+		if (!RET_WAS_ERROR(r))
+			r = addchecksums(package.control);
+		if (!RET_WAS_ERROR(r))
+			r = addfield(&corpus.paths, package.control,
+					"Filename");
+		if (!RET_WAS_ERROR(r) && index->target.packagetype == pt_deb
+				&& index->target.architecture
+				== architecture_all) {
+			r = chunk_getvalue(package.control, "Architecture",
+					&architecture);
+			if (RET_IS_OK(r)) {
+				if (strcmp(architecture, "all") != 0)
+					r = architecture_intern(architecture,
+						&index->target.architecture);
+				free(architecture);
+			}
+		}
+		package_done(&package);
+		if (RET_WAS_ERROR(r))
+			break;
+	}
+	if (RET_WAS_ERROR(r)) {
+		(void)indexfile_close(i);
+		return r;
+	}
+	return indexfile_close(i);
+}
+
+static retvalue readcontents(const char *filename) {
+	char buffer[4096];
+	FILE *f;
+	size_t len;
+	retvalue r;
+
+	/* the Filename fields are only used if there is no Contents file */
+	strlist_done(&corpus.paths);
+	strlist_init(&corpus.paths);
+	f = fopen(filename, "r");
+	if (f == NULL) {
+		int e = errno;
+		fprintf(stderr, "Error %d opening '%s': %s\n",
+				e, filename, strerror(e));
+		return RET_ERRNO(e);
+	}
+	while (fgets(buffer, sizeof(buffer), f) != NULL) {
+		char *path;
+
+		/* <path><whitespace><section/package,...>, take the path */
+		len = strlen(buffer);
+		while (len > 0 && buffer[len-1] != ' ' && buffer[len-1] != '\t')
+			len--;
+		while (len > 0 && (buffer[len-1] == ' '
+					|| buffer[len-1] == '\t'))
+			len--;
+		if (len == 0)
+			continue;
+		path = strndup(buffer, len);
+		if (FAILEDTOALLOC(path))
+			r = RET_ERROR_OOM;
+		else
+			r = strlist_add(&corpus.paths, path);
+		if (RET_WAS_ERROR(r)) {
+			(void)fclose(f);
+			return r;
+		}
+	}
+	if (ferror(f)) {
+		fprintf(stderr, "Error reading '%s'!\n", filename);
+		(void)fclose(f);
+		return RET_ERROR;
+	}
+	(void)fclose(f);
+	return RET_OK;
+}
+
+/* each benchmark does one pass over its corpus,
+ * returning the number of operations done */
+
+static unsigned long bench_getvalue(void) {
+	static const char * const fields[] = {
+		"Package", "Version", "Architecture", "Filename", "Size",
+		"SHA256", "Description", "Nonexistent"
+	};
+	unsigned long ops = 0;
+	char *value;
+	int i, f;
+	retvalue r;
+
+	for (i = 0 ; i < corpus.chunks.count ; i++) {
+		for (f = 0 ; f < (int)ARRAYCOUNT(fields) ; f++) {
+			r = chunk_getvalue(corpus.chunks.values[i],
+					fields[f], &value);
+			if (RET_IS_OK(r)) {
+				sink += value[0];
+				free(value);
+			}
+			ops++;
+		}
+	}
+	return ops;
+}
+
+static unsigned long bench_checkfield(void) {
+	static const char * const fields[] = {
+		"Package", "Filename", "Description", "Nonexistent"
+	};
+	unsigned long ops = 0;
+	int i, f;
+
+	/* only looks for the field (chunk_getfield) without copying it */
+	for (i = 0 ; i < corpus.chunks.count ; i++) {
+		for (f = 0 ; f < (int)ARRAYCOUNT(fields) ; f++) {
+			sink += chunk_checkfield(corpus.chunks.values[i],
+					fields[f]);
+			ops++;
+		}
+	}
+	return ops;
+}
+
+static unsigned long bench_indexfile(void) {
+	struct indexfile *i;
+	struct package package;
+	unsigned long ops = 0;
+	int n;
+	retvalue r;
+
+	for (n = 0 ; n < corpus.files.count ; n++) {
+		r = indexfile_open(&i, corpus.files.values[n],
+				corpus.indices[n].compression);
+		if (!RET_IS_OK(r))
+			continue;
+		setzero(struct package, &package);
+		while (indexfile_getnext(i, &package,
+					&corpus.indices[n].target, true)) {
+			sink += package.name[0];
+			package_done(&package);
+			ops++;
+		}
+		(void)indexfile_close(i);
+	}
+	return ops;
+}
+
+static unsigned long bench_versions(void) {
+	unsigned long ops = 0;
+	int i, result;
+	retvalue r;
+
+	/* compare each version with the one of the next chunk,
+	 * and with itself (the common case when updating) */
+	for (i = 0 ; i + 1 < corpus.versions.count ; i++) {
+		r = dpkgversions_cmp(corpus.versions.values[i],
+				corpus.versions.values[i+1], &result);
+		if (RET_IS_OK(r))
+			sink += result;
+		r = dpkgversions_cmp(corpus.versions.values[i],
+				corpus.versions.values[i], &result);
+		if (RET_IS_OK(r))
+			sink += result;
+		ops += 2;
+	}
+	return ops;
+}
+
+static unsigned long bench_globmatch(void) {
+	unsigned long ops = 0;
+	int i, p;
+
+	for (i = 0 ; i < corpus.names.count ; i++) {
+		for (p = 0 ; p < patterns.count ; p++) {
+			sink += globmatch(corpus.names.values[i],
+					patterns.values[p]);
+			ops++;
+		}
+	}
+	return ops;
+}
+
+static unsigned long bench_checksums(void) {
+	struct checksums *checksums;
+	unsigned long ops = 0;
+	int i;
+	retvalue r;
+
+	for (i = 0 ; i < corpus.checksums.count ; i++) {
+		r = checksums_parse(&checksums, corpus.checksums.values[i]);
+		if (RET_IS_OK(r)) {
+			sink += checksums_getfilesize(checksums);
+			checksums_free(checksums);
+		}
+		ops++;
+	}
+	return ops;
+}
+
+static unsigned long bench_termdecide(void) {
+	struct target target;
+	struct package package;
+	unsigned long ops = 0;
+	int i;
+
+	memset(&target, 0, sizeof(target));
+	target.packagetype = pt_deb;
+	setzero(struct package, &package);
+	for (i = 0 ; i < corpus.chunks.count ; i++) {
+		package.target = &target;
+		package.control = corpus.chunks.values[i];
+		package.name = corpus.names.values[i];
+		package.version = corpus.versions.values[i];
+		sink += term_decidepackage(formula, &package, &target);
+		ops++;
+	}
+	return ops;
+}
+
+static unsigned long bench_filelist(void) {
+	struct filelistcompressor c;
+	unsigned long ops = 0;
+	char *list;
+	size_t size;
+	int i;
+	retvalue r;
+
+	/* make lists of 1000 files, that is about a big package */
+	for (i = 0 ; i < corpus.paths.count ; i++) {
+		if (i % 1000 == 0) {
+			if (i > 0) {
+				r = filelistcompressor_finish(&c,
+						&list, &size);
+				if (RET_IS_OK(r)) {
+					sink += size;
+					free(list);
+				}
+			}
+			r = filelistcompressor_setup(&c);
+			if (RET_WAS_ERROR(r))
+				return ops;
+		}
+		(void)filelistcompressor_add(&c, corpus.paths.values[i],
+				strlen(corpus.paths.values[i]));
+		ops++;
+	}
+	if (i > 0) {
+		r = filelistcompressor_finish(&c, &list, &size);
+		if (RET_IS_OK(r)) {
+			sink += size;
+			free(list);
+		}
+	}
+	return ops;
+}
+
+static const struct benchmark {
+	const char *name;
+	unsigned long (*run)(void);
+} benchmarks[] = {
+	{"chunk_getvalue", bench_getvalue},
+	{"chunk_checkfield", bench_checkfield},
+	{"indexfile_getnext", bench_indexfile},
+	{"dpkgversions_cmp", bench_versions},
+	{"globmatch", bench_globmatch},
+	{"checksums_parse", bench_checksums},
+	{"term_decidepackage", bench_termdecide},
+	{"filelistcompressor_add", bench_filelist}
+};
+
+static inline double now(void) {
+	struct timespec t;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &t) != 0)
+		return 0;
+	return t.tv_sec + t.tv_nsec / 1000000000.0;
+}
+
+static void runbenchmark(const struct benchmark *b, double mintime) {
+	unsigned long long ops = 0, allocs;
+	unsigned long passes = 0;
+	double start, elapsed;
+
+	/* one pass to warm up the caches */
+	(void)b->run();
+	allocs = allocations;
+	start = now();
+	do {
+		ops += b->run();
+		passes++;
+		elapsed = now() - start;
+	} while (elapsed < mintime);
+	allocs = allocations - allocs;
+	if (ops == 0) {
+		printf("%-24s %12s %12s %12s\n", b->name, "-", "-", "-");
+		return;
+	}
+	printf("%-24s %12llu %12.1f %12.2f\n", b->name, ops,
+			elapsed * 1000000000.0 / ops,
+			(double)allocs / ops);
+}
+
+int main(int argc, char *argv[]) {
+	const char *contents = NULL;
+	const char *formulatext =
+"Section (% *libs), Priority (== optional) | Package (% lib*)";
+	double mintime = 0.5;
+	size_t b;
+	int i;
+	retvalue r;
+
+	strlist_init(&patterns);
+	while ((i = getopt_long(argc, argv, "+hVt:c:f:p:", options, NULL)) != -1) {
+		switch (i) {
+			case 'h':
+				usage(stdout);
+				return EXIT_SUCCESS;
+			case 'V':
+				printf(
+"microbench from " PACKAGE_NAME " version " PACKAGE_VERSION "\n");
+				return EXIT_SUCCESS;
+			case 't':
+				mintime = atoi(optarg) / 1000.0;
+				break;
+			case 'c':
+				contents = optarg;
+				break;
+			case 'f':
+				formulatext = optarg;
+				break;
+			case 'p':
+				r = strlist_add_dup(&patterns, optarg);
+				if (RET_WAS_ERROR(r))
+					return EXIT_FAILURE;
+				break;
+			case '?':
+			default:
+				return EXIT_FAILURE;
+		}
+	}
+	if (optind >= argc) {
+		usage(stderr);
+		return EXIT_FAILURE;
+	}
+	if (patterns.count == 0) {
+		r = strlist_add_dup(&patterns, "lib*");
+		if (!RET_WAS_ERROR(r))
+			r = strlist_add_dup(&patterns, "*-dev");
+		if (!RET_WAS_ERROR(r))
+			r = strlist_add_dup(&patterns, "python3-?*");
+		if (!RET_WAS_ERROR(r))
+			r = strlist_add_dup(&patterns, "*e*n*");
+		if (RET_WAS_ERROR(r))
+			return EXIT_FAILURE;
+	}
+
+	r = atoms_init(0);
+	if (RET_WAS_ERROR(r))
+		return EXIT_FAILURE;
+	uncompressions_check(NULL, NULL, NULL, NULL, NULL, NULL);
+	r = term_compilefortargetdecision(&formula, formulatext);
+	if (RET_WAS_ERROR(r))
+		return EXIT_FAILURE;
+
+	strlist_init(&corpus.files);
+	strlist_init(&corpus.chunks);
+	strlist_init(&corpus.names);
+	strlist_init(&corpus.versions);
+	strlist_init(&corpus.checksums);
+	strlist_init(&corpus.paths);
+	corpus.indices = nzNEW(argc - optind, struct index);
+	if (FAILEDTOALLOC(corpus.indices))
+		return EXIT_FAILURE;
+	for (i = optind ; i < argc ; i++) {
+		r = strlist_add_dup(&corpus.files, argv[i]);
+		if (!RET_WAS_ERROR(r))
+			r = readindex(argv[i],
+					&corpus.indices[corpus.files.count - 1]);
+		if (RET_WAS_ERROR(r))
+			return EXIT_FAILURE;
+	}
+	if (contents != NULL) {
+		r = readcontents(contents);
+		if (RET_WAS_ERROR(r))
+			return EXIT_FAILURE;
+	}
+	printf("corpus: %d chunks, %d checksums, %d paths\n",
+			corpus.chunks.count, corpus.checksums.count,
+			corpus.paths.count);
+
+	printf("%-24s %12s %12s %12s\n", "benchmark", "ops", "ns/op",
+			"allocs/op");
+	for (b = 0 ; b < ARRAYCOUNT(benchmarks) ; b++)
+		runbenchmark(&benchmarks[b], mintime);
+
+	term_free(formula);
+	strlist_done(&patterns);
+	strlist_done(&corpus.files);
+	strlist_done(&corpus.chunks);
+	strlist_done(&corpus.names);
+	strlist_done(&corpus.versions);
+	strlist_done(&corpus.checksums);
+	strlist_done(&corpus.paths);
+	free(corpus.indices);
+	return EXIT_SUCCESS;
+}
@@ -37,6 +37,9 @@ retvalue package_remove_each(struct distribution *, const struct atomlist *, con
 
 
 retvalue package_get(struct target *, const char * /*name*/, /*@null@*/ const char */*version*/, /*@out@*/ struct package *);
+/* set control, controllen (and if there is such a header version,
+ * source, sourceversion and architecture) from a packages.db record */
+retvalue package_setrecord(struct package *, const char * /*record*/, size_t);
 
 static inline void package_done(struct package *pkg) {
 	free(pkg->pkgname);
@@ -69,6 +72,8 @@ struct package_cursor {
 	struct cursor *cursor;
 	struct package current;
 	bool close_database;
+	/* errors found in records while iterating */
+	retvalue r;
 };
 
 retvalue package_openiterator(struct target *, bool /*readonly*/, bool /*duplicate*/, /*@out@*/struct package_cursor *);
@@ -81,7 +86,7 @@ retvalue package_remove_by_cursor(struct package_cursor *, /*@null@*/struct logg
 retvalue package_newcontrol_by_cursor(struct package_cursor *, const char *, size_t);
 
 retvalue package_check(struct package *, void *);
-retvalue package_referenceforsnapshot(struct package *, void *);
+retvalue package_collectfilekeys(struct package *, void *);
 retvalue package_rerunnotifiers(struct package *, void *);
 
 #endif
@@ -24,7 +24,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <search.h>
 #include <unistd.h>
 #include "error.h"
 #include "ignore.h"
@@ -37,13 +36,15 @@
 #include "files.h"
 #include "sources.h"
 #include "outhook.h"
+#include "stats.h"
+#include "filekeyids.h"
 
 /* for now save them only in memory. In later times some way to store
  * them on disk would be nice */
 
-static component_t reserved_components = 0;
-static void **file_changes_per_component = NULL;
-static void *legacy_file_changes = NULL;
+/* what happened to each file, indexed by its filekeyid */
+static unsigned char *file_changes = NULL;
+static filekeyid_t file_changes_size = 0;
 bool pool_havedereferenced = false;
 bool pool_havedeleted = false;
 
@@ -51,30 +52,23 @@ bool pool_havedeleted = false;
 #define pl_UNREFERENCED 2
 #define pl_DELETED 4
 
-static int legacy_compare(const void *a, const void *b) {
-	const char *v1 = a, *v2 = b;
-	v1++;
-	v2++;
-	return strcmp(v1, v2);
-}
-
-struct source_node {
-	void *file_changes;
-	char sourcename[];
+/* a file with changes, split into the parts it is sorted by */
+struct changed_file {
+	const char *filekey;
+	unsigned char *changes;
+	/* atom_unknown for filekeys not looking like pool/c/x/source/name */
+	component_t component;
+	const char *sourcename;
+	size_t sourcename_len;
+	const char *basename;
 };
 
-static int source_node_compare(const void *a, const void *b) {
-	const struct source_node *v1 = a, *v2 = b;
-	return strcmp(v1->sourcename, v2->sourcename);
-}
-
-static retvalue split_filekey(const char *filekey, /*@out@*/component_t *component_p, /*@out@*/struct source_node **node_p, /*@out@*/const char **basename_p) {
+static bool split_filekey(const char *filekey, /*@out@*/component_t *component_p, /*@out@*/const char **source_p, /*@out@*/size_t *source_len_p, /*@out@*/const char **basename_p) {
 	const char *p, *lastp, *source;
-	struct source_node *node;
 	component_t c;
 
 	if (unlikely(memcmp(filekey, "pool/", 5) != 0))
-		return RET_NOTHING;
+		return false;
 	lastp = filekey + 4;
 	filekey = lastp + 1;
 	/* components can include slashes, so look for the first valid component
@@ -85,7 +79,7 @@ static retvalue split_filekey(const char *filekey, /*@out@*/component_t *compone
 	while (true) {
 		p = strchr(lastp + 1, '/');
 		if (unlikely(p == NULL))
-			return RET_NOTHING;
+			return false;
 		lastp = p;
 		c = component_find_l(filekey, (size_t)(p - filekey));
 		if (unlikely(!atom_defined(c)))
@@ -107,81 +101,40 @@ static retvalue split_filekey(const char *filekey, /*@out@*/component_t *compone
 	}
 	p = strchr(source, '/');
 	if (unlikely(p == NULL))
-		return RET_NOTHING;
-	node = malloc(sizeof(struct source_node) + (p - source) + 1);
-	if (FAILEDTOALLOC(node))
-		return RET_ERROR_OOM;
-	node->file_changes = NULL;
-	memcpy(node->sourcename, source, p - source);
-	node->sourcename[p - source] = '\0';
-	p++;
-	*basename_p = p;
-	*node_p = node;
+		return false;
+	*source_p = source;
+	*source_len_p = p - source;
+	*basename_p = p + 1;
 	*component_p = c;
-	return RET_OK;
-}
-
-/* name can be either basename (in a source directory) or a full
- * filekey (in legacy fallback mode) */
-static retvalue remember_name(void **root_p, const char *name, char mode, char mode_and) {
-	char **p;
-
-	p = tsearch(name - 1, root_p, legacy_compare);
-	if (FAILEDTOALLOC(p))
-		return RET_ERROR_OOM;
-	if (*p == name - 1) {
-		size_t l = strlen(name);
-		*p = malloc(l + 2);
-		if (FAILEDTOALLOC(*p))
-			return RET_ERROR_OOM;
-		**p = mode;
-		memcpy((*p) + 1, name, l + 1);
-	} else {
-		**p &= mode_and;
-		**p |= mode;
-	}
-	return RET_OK;
+	return true;
 }
 
 static retvalue remember_filekey(const char *filekey, char mode, char mode_and) {
 	retvalue r;
+	filekeyid_t id;
 	component_t c;
-	struct source_node *node, **found;
-	const char *basefilename;
+	const char *source, *basefilename;
+	size_t source_len;
 
-	r = split_filekey(filekey, &c, &node, &basefilename);
+	if (!split_filekey(filekey, &c, &source, &source_len, &basefilename))
+		fprintf(stderr, "Warning: strange filekey '%s'!\n", filekey);
+	r = filekeyids_intern(filekey, &id);
 	if (RET_WAS_ERROR(r))
 		return r;
-	if (r == RET_OK) {
-		assert (atom_defined(c));
-		if (c > reserved_components) {
-			void ** h;
-
-			assert (c <= components_count());
-
-			h = realloc(file_changes_per_component,
-					sizeof(void*) * (c + 1));
-			if (FAILEDTOALLOC(h))
-				return RET_ERROR_OOM;
-			file_changes_per_component = h;
-			while (reserved_components < c) {
-				h[++reserved_components] = NULL;
-			}
-		}
-		assert (file_changes_per_component != NULL);
-		found = tsearch(node, &file_changes_per_component[c],
-				source_node_compare);
-		if (FAILEDTOALLOC(found))
+	if (id >= file_changes_size) {
+		filekeyid_t newsize = 2 * filekeyids_limit();
+		unsigned char *n;
+
+		n = realloc(file_changes, newsize);
+		if (FAILEDTOALLOC(n))
 			return RET_ERROR_OOM;
-		if (*found != node) {
-			free(node);
-			node = *found;
-		}
-		return remember_name(&node->file_changes, basefilename,
-				mode, mode_and);
+		memset(n + file_changes_size, 0, newsize - file_changes_size);
+		file_changes = n;
+		file_changes_size = newsize;
 	}
-	fprintf(stderr, "Warning: strange filekey '%s'!\n", filekey);
-	return remember_name(&legacy_file_changes, filekey, mode, mode_and);
+	file_changes[id] &= mode_and;
+	file_changes[id] |= mode;
+	return RET_OK;
 }
 
 retvalue pool_dereferenced(const char *filekey) {
@@ -193,6 +146,69 @@ retvalue pool_markadded(const char *filekey) {
 	return remember_filekey(filekey, pl_ADDED, ~pl_DELETED);
 };
 
+/* sort by component, then by source name and then the rest.
+ * Files not in the usual pool layout come last. */
+static int changed_file_compare(const void *a, const void *b) {
+	const struct changed_file *f1 = a, *f2 = b;
+	size_t l;
+	int c;
+
+	if (f1->component != f2->component) {
+		if (!atom_defined(f1->component))
+			return 1;
+		if (!atom_defined(f2->component))
+			return -1;
+		return (f1->component < f2->component)?-1:1;
+	}
+	if (!atom_defined(f1->component))
+		return strcmp(f1->filekey, f2->filekey);
+	l = (f1->sourcename_len < f2->sourcename_len)?
+		f1->sourcename_len : f2->sourcename_len;
+	c = memcmp(f1->sourcename, f2->sourcename, l);
+	if (c != 0)
+		return c;
+	if (f1->sourcename_len != f2->sourcename_len)
+		return (f1->sourcename_len < f2->sourcename_len)?-1:1;
+	return strcmp(f1->basename, f2->basename);
+}
+
+/* get all files with changes matching mask, in the order to process them */
+static retvalue changed_files(unsigned char mask, /*@out@*/struct changed_file **files_p, /*@out@*/size_t *count_p) {
+	struct changed_file *files;
+	filekeyid_t id;
+	size_t count = 0;
+
+	*files_p = NULL;
+	*count_p = 0;
+	for (id = 1 ; id < file_changes_size ; id++) {
+		if ((file_changes[id] & mask) != 0)
+			count++;
+	}
+	if (count == 0)
+		return RET_NOTHING;
+	files = nNEW(count, struct changed_file);
+	if (FAILEDTOALLOC(files))
+		return RET_ERROR_OOM;
+	count = 0;
+	for (id = 1 ; id < file_changes_size ; id++) {
+		struct changed_file *f;
+
+		if ((file_changes[id] & mask) == 0)
+			continue;
+		f = &files[count++];
+		f->filekey = filekeyids_filekey(id);
+		f->changes = &file_changes[id];
+		if (!split_filekey(f->filekey, &f->component,
+					&f->sourcename, &f->sourcename_len,
+					&f->basename))
+			f->component = atom_unknown;
+	}
+	qsort(files, count, sizeof(struct changed_file), changed_file_compare);
+	*files_p = files;
+	*count_p = count;
+	return RET_OK;
+}
+
 /* so much code, just for the case the morguedir is on another partition than
  * the pool dir... */
 
@@ -452,6 +468,9 @@ static retvalue deletepoolfile(const char *filekey, bool new) {
 		free(filename);
 		return r;
 	}
+	stats.pooldeleted++;
+	if (!new && global.morguedir != NULL)
+		stats.poolmorgue++;
 	if (!global.keepdirectories) {
 		/* try to delete parent directories, until one gives
 		 * errors (hopefully because it still contains files) */
@@ -516,132 +535,70 @@ retvalue pool_markdeleted(const char *filekey) {
 	return remember_filekey(filekey, pl_DELETED, ~pl_UNREFERENCED);
 };
 
-/* libc's twalk misses a callback_data pointer, so we need some temporary
- * global variables: */
-static retvalue result;
-static bool first, onlycount;
-static long woulddelete_count;
-static component_t current_component;
-static const char *sourcename = NULL;
+/* look at a single file (with changes matching the mask of the caller),
+ * tell if it will be deleted and delete it if delete is true */
+static retvalue removeifunreferenced(const struct changed_file *file, bool delete, bool new, bool *first, const char *announcement) {
+	const char *filekey = file->filekey;
+	retvalue r, result;
 
-static void removeifunreferenced(const void *nodep, const VISIT which, UNUSED(const int depth)) {
-	char *node; const char *filekey;
-	retvalue r;
-
-	if (which != leaf && which != postorder)
-		return;
-
-	if (interrupted())
-		return;
-
-	node = *(char **)nodep;
-	filekey = node + 1;
-	if ((*node & pl_UNREFERENCED) == 0)
-		return;
 	r = references_isused(filekey);
 	if (r != RET_NOTHING)
-		return;
-
-	if (onlycount) {
-		woulddelete_count++;
-		return;
-	}
-
-	if (verbose >= 0 && first) {
-		printf("Deleting files no longer referenced...\n");
-		first = false;
-	}
-	if (verbose >= 1)
-		printf("deleting and forgetting %s\n", filekey);
-	r = deletepoolfile(filekey, (*node & pl_ADDED) != 0);
-	RET_UPDATE(result, r);
-	if (!RET_WAS_ERROR(r)) {
-		r = files_removesilent(filekey);
-		RET_UPDATE(result, r);
-		if (!RET_WAS_ERROR(r))
-			*node &= ~pl_UNREFERENCED;
-		if (RET_IS_OK(r))
-			*node |= pl_DELETED;
-	}
-}
-
-
-static void removeifunreferenced2(const void *nodep, const VISIT which, UNUSED(const int depth)) {
-	char *node;
-	char *filekey;
-	retvalue r;
-
-	if (which != leaf && which != postorder)
-		return;
+		return RET_NOTHING;
 
-	if (interrupted())
-		return;
+	if (!delete)
+		return RET_OK;
 
-	node = *(char **)nodep;
-	if ((*node & pl_UNREFERENCED) == 0)
-		return;
-	filekey = calc_filekey(current_component, sourcename, node + 1);
-	r = references_isused(filekey);
-	if (r != RET_NOTHING) {
-		free(filekey);
-		return;
-	}
-	if (onlycount) {
-		woulddelete_count++;
-		free(filekey);
-		return;
-	}
-	if (verbose >= 0 && first) {
-		printf("Deleting files no longer referenced...\n");
-		first = false;
+	if (verbose >= 0 && *first) {
+		printf("%s", announcement);
+		*first = false;
 	}
 	if (verbose >= 1)
 		printf("deleting and forgetting %s\n", filekey);
-	r = deletepoolfile(filekey, (*node & pl_ADDED) != 0);
-	RET_UPDATE(result, r);
+	r = deletepoolfile(filekey, new);
+	result = r;
 	if (!RET_WAS_ERROR(r)) {
 		r = files_removesilent(filekey);
 		RET_UPDATE(result, r);
+		/* pl_ADDED is never removed here, otherwise the hook
+		 * script will be told to remove something not added */
 		if (!RET_WAS_ERROR(r))
-			*node &= ~pl_UNREFERENCED;
+			*file->changes &= ~pl_UNREFERENCED;
 		if (RET_IS_OK(r))
-			*node |= pl_DELETED;
+			*file->changes |= pl_DELETED;
 	}
-	RET_UPDATE(result, r);
-	free(filekey);
-}
-
-static void removeunreferenced_from_component(const void *nodep, const VISIT which, UNUSED(const int depth)) {
-	struct source_node *node;
-
-	if (which != leaf && which != postorder)
-		return;
-
-	if (interrupted())
-		return;
-
-	node = *(struct source_node **)nodep;
-	sourcename = node->sourcename;
-	twalk(node->file_changes, removeifunreferenced2);
+	return result;
 }
 
 retvalue pool_removeunreferenced(bool delete) {
-	component_t c;
+	struct changed_file *files;
+	size_t count, i;
+	long woulddelete_count = 0;
+	bool first = true;
+	retvalue result, r;
 
 	if (!delete && verbose <= 0)
 		return RET_NOTHING;
 
+	r = changed_files(pl_UNREFERENCED, &files, &count);
+	if (!RET_IS_OK(r))
+		return r;
 	result = RET_NOTHING;
-	first = true;
-	onlycount = !delete;
-	woulddelete_count = 0;
-	for (c = 1 ; c <= reserved_components ; c++) {
-		assert (file_changes_per_component != NULL);
-		current_component = c;
-		twalk(file_changes_per_component[c],
-				removeunreferenced_from_component);
+	for (i = 0 ; i < count ; i++) {
+		if (interrupted())
+			break;
+		/* might have been deleted by an earlier one */
+		if ((*files[i].changes & pl_UNREFERENCED) == 0)
+			continue;
+		r = removeifunreferenced(&files[i], delete,
+				(*files[i].changes & pl_ADDED) != 0, &first,
+				"Deleting files no longer referenced...\n");
+		if (!delete) {
+			if (RET_IS_OK(r))
+				woulddelete_count++;
+		} else
+			RET_UPDATE(result, r);
 	}
-	twalk(legacy_file_changes, removeifunreferenced);
+	free(files);
 	if (interrupted())
 		result = RET_ERROR_INTERRUPTED;
 	if (!delete && woulddelete_count > 0) {
@@ -653,135 +610,32 @@ retvalue pool_removeunreferenced(bool delete) {
 	return result;
 }
 
-static void removeunusednew(const void *nodep, const VISIT which, UNUSED(const int depth)) {
-	char *node; const char *filekey;
-	retvalue r;
-
-	if (which != leaf && which != postorder)
-		return;
-
-	if (interrupted())
-		return;
-
-	node = *(char **)nodep;
-	filekey = node + 1;
-	/* only look at newly added and not already deleted */
-	if ((*node & (pl_ADDED|pl_DELETED)) != pl_ADDED)
-		return;
-	r = references_isused(filekey);
-	if (r != RET_NOTHING)
-		return;
-
-	if (onlycount) {
-		woulddelete_count++;
-		return;
-	}
-
-	if (verbose >= 0 && first) {
-		printf(
-"Deleting files just added to the pool but not used.\n"
-"(to avoid use --keepunusednewfiles next time)\n");
-		first = false;
-	}
-	if (verbose >= 1)
-		printf("deleting and forgetting %s\n", filekey);
-	r = deletepoolfile(filekey, true);
-	RET_UPDATE(result, r);
-	if (!RET_WAS_ERROR(r)) {
-		r = files_removesilent(filekey);
-		RET_UPDATE(result, r);
-		/* don't remove pl_ADDED here, otherwise the hook
-		 * script will be told to remove something not added */
-		if (!RET_WAS_ERROR(r))
-			*node &= ~pl_UNREFERENCED;
-		if (RET_IS_OK(r))
-			*node |= pl_DELETED;
-	}
-}
-
-
-static void removeunusednew2(const void *nodep, const VISIT which, UNUSED(const int depth)) {
-	char *node;
-	char *filekey;
+void pool_tidyadded(bool delete) {
+	struct changed_file *files;
+	size_t count, i;
+	long woulddelete_count = 0;
+	bool first = true;
 	retvalue r;
 
-	if (which != leaf && which != postorder)
-		return;
-
-	if (interrupted())
+	if (!delete && verbose < 0)
 		return;
 
-	node = *(char **)nodep;
-	/* only look at newly added and not already deleted */
-	if ((*node & (pl_ADDED|pl_DELETED)) != pl_ADDED)
+	r = changed_files(pl_ADDED, &files, &count);
+	if (!RET_IS_OK(r))
 		return;
-	filekey = calc_filekey(current_component, sourcename, node + 1);
-	r = references_isused(filekey);
-	if (r != RET_NOTHING) {
-		free(filekey);
-		return;
-	}
-	if (onlycount) {
-		woulddelete_count++;
-		free(filekey);
-		return;
-	}
-	if (verbose >= 0 && first) {
-		printf(
+	for (i = 0 ; i < count ; i++) {
+		if (interrupted())
+			break;
+		/* only look at newly added and not already deleted */
+		if ((*files[i].changes & (pl_ADDED|pl_DELETED)) != pl_ADDED)
+			continue;
+		r = removeifunreferenced(&files[i], delete, true, &first,
 "Deleting files just added to the pool but not used.\n"
 "(to avoid use --keepunusednewfiles next time)\n");
-		first = false;
-	}
-	if (verbose >= 1)
-		printf("deleting and forgetting %s\n", filekey);
-	r = deletepoolfile(filekey, true);
-	RET_UPDATE(result, r);
-	if (!RET_WAS_ERROR(r)) {
-		r = files_removesilent(filekey);
-		RET_UPDATE(result, r);
-		/* don't remove pl_ADDED here, otherwise the hook
-		 * script will be told to remove something not added */
-		if (!RET_WAS_ERROR(r))
-			*node &= ~pl_UNREFERENCED;
-		if (RET_IS_OK(r))
-			*node |= pl_DELETED;
+		if (!delete && RET_IS_OK(r))
+			woulddelete_count++;
 	}
-	RET_UPDATE(result, r);
-	free(filekey);
-}
-
-static void removeunusednew_from_component(const void *nodep, const VISIT which, UNUSED(const int depth)) {
-	struct source_node *node;
-
-	if (which != leaf && which != postorder)
-		return;
-
-	if (interrupted())
-		return;
-
-	node = *(struct source_node **)nodep;
-	sourcename = node->sourcename;
-	twalk(node->file_changes, removeunusednew2);
-}
-
-void pool_tidyadded(bool delete) {
-	component_t c;
-
-	if (!delete && verbose < 0)
-		return;
-
-	result = RET_NOTHING;
-	first = true;
-	onlycount = !delete;
-	woulddelete_count = 0;
-	for (c = 1 ; c <= reserved_components ; c++) {
-		assert (file_changes_per_component != NULL);
-		current_component = c;
-		twalk(file_changes_per_component[c],
-				removeunusednew_from_component);
-	}
-	// this should not really happen at all, but better safe then sorry:
-	twalk(legacy_file_changes, removeunusednew);
+	free(files);
 	if (!delete && woulddelete_count > 0) {
 		printf(
 "%lu files were added but not used.\n"
@@ -792,78 +646,27 @@ void pool_tidyadded(bool delete) {
 
 }
 
-static void reportnewlegacyfiles(const void *nodep, const VISIT which, UNUSED(const int depth)) {
-	char *node;
-
-	if (which != leaf && which != postorder)
-		return;
-
-	node = *(char **)nodep;
-	/* only look at newly added and not already deleted */
-	if ((*node & (pl_ADDED|pl_DELETED)) != pl_ADDED)
-		return;
-	outhook_sendpool(atom_unknown, NULL, node + 1);
-}
-
-
-static void reportnewproperfiles(const void *nodep, const VISIT which, UNUSED(const int depth)) {
-	char *node;
-
-	if (which != leaf && which != postorder)
-		return;
-
-	node = *(char **)nodep;
-	/* only look at newly added and not already deleted */
-	if ((*node & (pl_ADDED|pl_DELETED)) != pl_ADDED)
-		return;
-	outhook_sendpool(current_component, sourcename, node + 1);
-}
-
-static void reportnewfiles(const void *nodep, const VISIT which, UNUSED(const int depth)) {
-	struct source_node *node;
-
-	if (which != leaf && which != postorder)
-		return;
-
-	node = *(struct source_node **)nodep;
-	sourcename = node->sourcename;
-	twalk(node->file_changes, reportnewproperfiles);
-}
-
 void pool_sendnewfiles(void) {
-	component_t c;
+	struct changed_file *files;
+	size_t count, i;
+	retvalue r;
 
-	for (c = 1 ; c <= reserved_components ; c++) {
-		assert (file_changes_per_component != NULL);
-		current_component = c;
-		twalk(file_changes_per_component[c],
-				reportnewfiles);
+	r = changed_files(pl_ADDED, &files, &count);
+	if (!RET_IS_OK(r))
+		return;
+	for (i = 0 ; i < count ; i++) {
+		/* only look at newly added and not already deleted */
+		if ((*files[i].changes & (pl_ADDED|pl_DELETED)) != pl_ADDED)
+			continue;
+		outhook_sendpool(atom_unknown, NULL, files[i].filekey);
 	}
-	twalk(legacy_file_changes, reportnewlegacyfiles);
+	free(files);
 	return;
 
 }
 
-#ifdef HAVE_TDESTROY
-static void sourcename_free(void *n) {
-	struct source_node *node = n;
-
-	tdestroy(node->file_changes, free);
-	free(node);
-}
-#endif
-
 void pool_free(void) {
-#ifdef HAVE_TDESTROY
-	component_t c;
-
-	for (c = 1 ; c <= reserved_components ; c++) {
-		tdestroy(file_changes_per_component[c], sourcename_free);
-	}
-	reserved_components = 0;
-	free(file_changes_per_component);
-	file_changes_per_component = NULL;
-	tdestroy(legacy_file_changes, free);
-	legacy_file_changes = NULL;
-#endif
+	free(file_changes);
+	file_changes = NULL;
+	file_changes_size = 0;
 }
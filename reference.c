@@ -31,6 +31,557 @@
 #include "pool.h"
 #include "reference.h"
 
+/* In the compact format (see compactreferences) references.db has only
+ * one record per filekey. It lists the numbers of everything referencing
+ * it as "<id>[:<count>] ..." sorted by number, <count> telling how often
+ * it is referenced by that if more than once.
+ * The referrers table maps identifiers to those numbers (and the empty
+ * key to the last number given out), the referrerids table back.
+ * The referrerfiles table lists the filekeys for each number, so that
+ * removing all references of something only touches its own records.
+ * The non-compact format has one duplicate record per reference. */
+#define COMPACT (rdb_referrers != NULL)
+
+struct referrerlist {
+	struct referrer {
+		unsigned long id, count;
+	} *referrers;
+	int count, size;
+};
+
+/* the last identifier looked up, as most calls are for the same */
+static /*@null@*/ char *cached_referrer = NULL;
+static unsigned long cached_id;
+
+static inline void referrerlist_done(struct referrerlist *list) {
+	free(list->referrers);
+	list->referrers = NULL;
+	list->count = 0;
+	list->size = 0;
+}
+
+static retvalue referrerlist_insert(struct referrerlist *list, int ofs, unsigned long id, unsigned long count) {
+	if (list->count >= list->size) {
+		int newsize = (list->size == 0)?8:2 * list->size;
+		struct referrer *n;
+
+		n = realloc(list->referrers, newsize * sizeof(struct referrer));
+		if (FAILEDTOALLOC(n))
+			return RET_ERROR_OOM;
+		list->referrers = n;
+		list->size = newsize;
+	}
+	memmove(list->referrers + ofs + 1, list->referrers + ofs,
+			(list->count - ofs) * sizeof(struct referrer));
+	list->referrers[ofs].id = id;
+	list->referrers[ofs].count = count;
+	list->count++;
+	return RET_OK;
+}
+
+static inline void referrerlist_removeat(struct referrerlist *list, int ofs) {
+	list->count--;
+	memmove(list->referrers + ofs, list->referrers + ofs + 1,
+			(list->count - ofs) * sizeof(struct referrer));
+}
+
+/* returns the position or (-1 - where it would need to be inserted) */
+static int referrerlist_find(const struct referrerlist *list, unsigned long id) {
+	int low = 0, high = list->count;
+
+	while (low < high) {
+		int middle = (low + high) / 2;
+
+		if (list->referrers[middle].id < id)
+			low = middle + 1;
+		else if (list->referrers[middle].id > id)
+			high = middle;
+		else
+			return middle;
+	}
+	return -1 - low;
+}
+
+static retvalue referrerlist_parse(const char *filekey, const char *data, /*@out@*/struct referrerlist *list) {
+	retvalue r;
+
+	list->referrers = NULL;
+	list->count = 0;
+	list->size = 0;
+	while (*data != '\0') {
+		unsigned long id, count = 1;
+		char *e;
+
+		id = strtoul(data, &e, 10);
+		if (e != data && *e == ':') {
+			data = e + 1;
+			count = strtoul(data, &e, 10);
+		}
+		if (e == data || id == 0 || count == 0 ||
+				(*e != ' ' && *e != '\0') ||
+				(list->count > 0 &&
+				 list->referrers[list->count - 1].id >= id)) {
+			fprintf(stderr,
+"Corrupted entry for '%s' in references.db!\n",
+					filekey);
+			referrerlist_done(list);
+			return RET_ERROR;
+		}
+		r = referrerlist_insert(list, list->count, id, count);
+		if (RET_WAS_ERROR(r)) {
+			referrerlist_done(list);
+			return r;
+		}
+		data = (*e == ' ')?e + 1:e;
+	}
+	return RET_OK;
+}
+
+/* RET_NOTHING (and an empty list) if there are no references */
+static retvalue referrerlist_get(const char *filekey, /*@out@*/struct referrerlist *list) {
+	const char *data;
+	retvalue r;
+
+	r = table_gettemprecord(rdb_references, filekey, &data, NULL);
+	if (!RET_IS_OK(r)) {
+		list->referrers = NULL;
+		list->count = 0;
+		list->size = 0;
+		return r;
+	}
+	return referrerlist_parse(filekey, data, list);
+}
+
+static retvalue referrerlist_format(const struct referrerlist *list, /*@out@*/char **data_p, /*@out@*/size_t *len_p) {
+	char *data, *p;
+	int i;
+
+	/* two numbers with up to 20 digits, a colon and a space each */
+	data = malloc(list->count * 43 + 1);
+	if (FAILEDTOALLOC(data))
+		return RET_ERROR_OOM;
+	p = data;
+	for (i = 0 ; i < list->count ; i++) {
+		if (i > 0)
+			*(p++) = ' ';
+		if (list->referrers[i].count == 1)
+			p += sprintf(p, "%lu", list->referrers[i].id);
+		else
+			p += sprintf(p, "%lu:%lu", list->referrers[i].id,
+					list->referrers[i].count);
+	}
+	*p = '\0';
+	*data_p = data;
+	*len_p = p - data;
+	return RET_OK;
+}
+
+static retvalue referrerlist_put(const char *filekey, const struct referrerlist *list) {
+	char *data;
+	size_t len;
+	retvalue r;
+
+	if (list->count == 0)
+		return table_deleterecord(rdb_references, filekey, true);
+	r = referrerlist_format(list, &data, &len);
+	if (RET_WAS_ERROR(r))
+		return r;
+	r = table_adduniqsizedrecord(rdb_references, filekey,
+			data, len + 1, true, false);
+	free(data);
+	return r;
+}
+
+static retvalue parseid(const char *identifier, const char *data, /*@out@*/unsigned long *id_p) {
+	unsigned long id;
+	char *e;
+
+	id = strtoul(data, &e, 10);
+	if (e == data || *e != '\0' || id == 0) {
+		fprintf(stderr,
+"Corrupted referrer number for '%s' in references.db!\n",
+				identifier);
+		return RET_ERROR;
+	}
+	*id_p = id;
+	return RET_OK;
+}
+
+static retvalue newreferrer(const char *identifier, /*@out@*/unsigned long *id_p) {
+	char buffer[24];
+	const char *data;
+	unsigned long id = 0;
+	retvalue r;
+
+	r = table_gettemprecord(rdb_referrers, "", &data, NULL);
+	if (RET_WAS_ERROR(r))
+		return r;
+	if (RET_IS_OK(r)) {
+		r = parseid("", data, &id);
+		if (RET_WAS_ERROR(r))
+			return r;
+	}
+	id++;
+	snprintf(buffer, sizeof(buffer), "%lu", id);
+	r = table_adduniqsizedrecord(rdb_referrers, "",
+			buffer, strlen(buffer) + 1, true, false);
+	if (RET_WAS_ERROR(r))
+		return r;
+	r = table_adduniqrecord(rdb_referrers, identifier, buffer);
+	if (RET_WAS_ERROR(r))
+		return r;
+	r = table_adduniqrecord(rdb_referrerids, buffer, identifier);
+	if (RET_WAS_ERROR(r))
+		return r;
+	*id_p = id;
+	return RET_OK;
+}
+
+/* the numbers are only valid for the references.db they were read from */
+void references_forgetcache(void) {
+	free(cached_referrer);
+	cached_referrer = NULL;
+}
+
+/* get the number of an identifier, RET_NOTHING if it has none yet
+ * (unless create is true) */
+static retvalue referrer_id(const char *identifier, bool create, /*@out@*/unsigned long *id_p) {
+	const char *data;
+	unsigned long id;
+	retvalue r;
+
+	if (cached_referrer != NULL && strcmp(cached_referrer, identifier) == 0) {
+		*id_p = cached_id;
+		return RET_OK;
+	}
+	r = table_gettemprecord(rdb_referrers, identifier, &data, NULL);
+	if (RET_IS_OK(r))
+		r = parseid(identifier, data, &id);
+	else if (r == RET_NOTHING && create)
+		r = newreferrer(identifier, &id);
+	if (!RET_IS_OK(r))
+		return r;
+	free(cached_referrer);
+	/* if there is no memory, just do not cache it */
+	cached_referrer = strdup(identifier);
+	cached_id = id;
+	*id_p = id;
+	return RET_OK;
+}
+
+/* the referrerfiles table has every filekey for each referrer number */
+static inline retvalue index_add(unsigned long id, const char *filekey) {
+	char buffer[24];
+
+	snprintf(buffer, sizeof(buffer), "%lu", id);
+	return table_addrecord(rdb_referrerfiles, buffer,
+			filekey, strlen(filekey), true);
+}
+
+static inline retvalue index_remove(unsigned long id, const char *filekey) {
+	char buffer[24];
+
+	snprintf(buffer, sizeof(buffer), "%lu", id);
+	return table_removerecord(rdb_referrerfiles, buffer, filekey);
+}
+
+static retvalue index_addlist(const char *filekey, const struct referrerlist *list) {
+	retvalue r;
+	int i;
+
+	for (i = 0 ; i < list->count ; i++) {
+		r = index_add(list->referrers[i].id, filekey);
+		if (RET_WAS_ERROR(r))
+			return r;
+	}
+	return RET_OK;
+}
+
+/* add a reference by number, if onlynew is set only if there is none yet */
+static retvalue compact_incrementid(const char *needed, unsigned long id, bool onlynew) {
+	struct referrerlist list;
+	retvalue r;
+	int i;
+
+	r = referrerlist_get(needed, &list);
+	if (RET_WAS_ERROR(r))
+		return r;
+	i = referrerlist_find(&list, id);
+	if (i >= 0) {
+		if (onlynew) {
+			referrerlist_done(&list);
+			return RET_NOTHING;
+		}
+		list.referrers[i].count++;
+		r = RET_OK;
+	} else
+		r = referrerlist_insert(&list, -1 - i, id, 1);
+	if (RET_IS_OK(r))
+		r = referrerlist_put(needed, &list);
+	referrerlist_done(&list);
+	if (RET_IS_OK(r) && i < 0)
+		r = index_add(id, needed);
+	return r;
+}
+
+static retvalue compact_increment(const char *needed, const char *neededby) {
+	unsigned long id;
+	retvalue r;
+
+	r = referrer_id(neededby, true, &id);
+	assert (r != RET_NOTHING);
+	if (RET_WAS_ERROR(r))
+		return r;
+	return compact_incrementid(needed, id, false);
+}
+
+static retvalue compact_decrement(const char *needed, const char *neededby) {
+	struct referrerlist list;
+	unsigned long id;
+	retvalue r;
+	int i;
+	bool gone;
+
+	r = referrer_id(neededby, false, &id);
+	if (!RET_IS_OK(r))
+		return r;
+	r = referrerlist_get(needed, &list);
+	if (!RET_IS_OK(r))
+		return r;
+	i = referrerlist_find(&list, id);
+	if (i < 0) {
+		referrerlist_done(&list);
+		return RET_NOTHING;
+	}
+	gone = --list.referrers[i].count == 0;
+	if (gone)
+		referrerlist_removeat(&list, i);
+	r = referrerlist_put(needed, &list);
+	referrerlist_done(&list);
+	if (RET_IS_OK(r) && gone) {
+		retvalue r2 = index_remove(id, needed);
+		if (RET_WAS_ERROR(r2))
+			r = r2;
+	}
+	return r;
+}
+
+static retvalue compact_check(const char *filekey, const char *referee) {
+	struct referrerlist list;
+	unsigned long id;
+	retvalue r;
+
+	r = referrer_id(referee, false, &id);
+	if (!RET_IS_OK(r))
+		return r;
+	r = referrerlist_get(filekey, &list);
+	if (!RET_IS_OK(r))
+		return r;
+	if (referrerlist_find(&list, id) < 0)
+		r = RET_NOTHING;
+	referrerlist_done(&list);
+	return r;
+}
+
+static inline bool matches(const char *found_by, size_t datalen, const char *neededby, size_t l) {
+	return datalen >= l && strncmp(found_by, neededby, l) == 0 &&
+		(found_by[l] == '\0' || found_by[l] == ' ');
+}
+
+/* remove all references of one referrer number, using the index */
+static retvalue compact_removeid(const char *identifier, const char *idstring, unsigned long id) {
+	struct cursor *cursor;
+	struct strlist filekeys;
+	struct referrerlist list;
+	const char *key, *filekey;
+	retvalue result, r;
+	int i, j;
+
+	strlist_init(&filekeys);
+	r = table_newduplicatecursor(rdb_referrerfiles, idstring, 0,
+			&cursor, &key, &filekey, NULL);
+	if (RET_WAS_ERROR(r))
+		return r;
+	if (RET_IS_OK(r)) {
+		do {
+			r = strlist_add_dup(&filekeys, filekey);
+			if (RET_WAS_ERROR(r))
+				break;
+		} while (cursor_nexttempdata(rdb_referrerfiles, cursor,
+					&key, &filekey, NULL));
+		result = cursor_close(rdb_referrerfiles, cursor);
+		RET_ENDUPDATE(result, r);
+		if (RET_WAS_ERROR(result)) {
+			strlist_done(&filekeys);
+			return result;
+		}
+	}
+
+	result = RET_NOTHING;
+	for (i = 0 ; i < filekeys.count ; i++) {
+		filekey = filekeys.values[i];
+
+		r = referrerlist_get(filekey, &list);
+		if (RET_WAS_ERROR(r)) {
+			result = r;
+			break;
+		}
+		j = referrerlist_find(&list, id);
+		if (j < 0) {
+			/* index out of date, nothing to do */
+			referrerlist_done(&list);
+			continue;
+		}
+		if (verbose > 8)
+			fprintf(stderr, "Removing reference to '%s' by '%s'\n",
+					filekey, identifier);
+		referrerlist_removeat(&list, j);
+		r = referrerlist_put(filekey, &list);
+		referrerlist_done(&list);
+		RET_UPDATE(result, r);
+		if (RET_WAS_ERROR(r))
+			break;
+		r = pool_dereferenced(filekey);
+		RET_ENDUPDATE(result, r);
+		if (interrupted()) {
+			RET_UPDATE(result, RET_ERROR_INTERRUPTED);
+			break;
+		}
+	}
+	strlist_done(&filekeys);
+	if (RET_WAS_ERROR(result))
+		return result;
+
+	r = table_deleterecord(rdb_referrerfiles, idstring, true);
+	RET_ENDUPDATE(result, r);
+	r = table_deleterecord(rdb_referrerids, idstring, true);
+	RET_ENDUPDATE(result, r);
+	r = table_deleterecord(rdb_referrers, identifier, true);
+	RET_ENDUPDATE(result, r);
+	return result;
+}
+
+static retvalue compact_remove(const char *neededby) {
+	struct cursor *cursor;
+	struct strlist identifiers;
+	const char *key, *data;
+	size_t l;
+	unsigned long id;
+	retvalue result, r;
+	int i;
+
+	/* all identifiers starting with neededby are next to each other */
+	l = strlen(neededby);
+	strlist_init(&identifiers);
+	r = table_newrangecursor(rdb_referrers, neededby, &cursor,
+			&key, &data, NULL);
+	if (!RET_IS_OK(r))
+		return r;
+	do {
+		if (strncmp(key, neededby, l) != 0)
+			break;
+		if (!matches(key, strlen(key), neededby, l))
+			continue;
+		r = strlist_add_dup(&identifiers, key);
+		if (RET_WAS_ERROR(r))
+			break;
+		r = strlist_add_dup(&identifiers, data);
+		if (RET_WAS_ERROR(r))
+			break;
+	} while (cursor_nexttempdata(rdb_referrers, cursor,
+				&key, &data, NULL));
+	result = cursor_close(rdb_referrers, cursor);
+	RET_ENDUPDATE(result, r);
+	if (RET_WAS_ERROR(result)) {
+		strlist_done(&identifiers);
+		return result;
+	}
+	references_forgetcache();
+
+	result = RET_NOTHING;
+	for (i = 0 ; i + 1 < identifiers.count ; i += 2) {
+		r = parseid(identifiers.values[i],
+				identifiers.values[i + 1], &id);
+		if (RET_IS_OK(r))
+			r = compact_removeid(identifiers.values[i],
+					identifiers.values[i + 1], id);
+		RET_UPDATE(result, r);
+		if (RET_WAS_ERROR(r))
+			break;
+	}
+	strlist_done(&identifiers);
+	return result;
+}
+
+/* put the references from an old style table into the compact format */
+retvalue references_translate(struct table *oldtable) {
+	struct cursor *cursor;
+	struct referrerlist list;
+	char *filekey = NULL;
+	const char *found_to, *found_by;
+	unsigned long id;
+	retvalue result, r;
+	int i;
+
+	assert (COMPACT);
+
+	r = table_newglobalcursor(oldtable, true, &cursor);
+	if (!RET_IS_OK(r))
+		return r;
+	list.referrers = NULL;
+	list.count = 0;
+	list.size = 0;
+	result = RET_NOTHING;
+	while (cursor_nexttempdata(oldtable, cursor,
+				&found_to, &found_by, NULL)) {
+		if (filekey == NULL || strcmp(filekey, found_to) != 0) {
+			if (filekey != NULL) {
+				r = referrerlist_put(filekey, &list);
+				if (RET_IS_OK(r))
+					r = index_addlist(filekey, &list);
+				RET_UPDATE(result, r);
+				if (RET_WAS_ERROR(r))
+					break;
+				free(filekey);
+				filekey = NULL;
+			}
+			list.count = 0;
+			filekey = strdup(found_to);
+			if (FAILEDTOALLOC(filekey)) {
+				result = RET_ERROR_OOM;
+				break;
+			}
+		}
+		r = referrer_id(found_by, true, &id);
+		if (RET_IS_OK(r)) {
+			i = referrerlist_find(&list, id);
+			if (i >= 0)
+				list.referrers[i].count++;
+			else
+				r = referrerlist_insert(&list, -1 - i, id, 1);
+		}
+		if (RET_WAS_ERROR(r)) {
+			RET_UPDATE(result, r);
+			break;
+		}
+		if (interrupted()) {
+			result = RET_ERROR_INTERRUPTED;
+			break;
+		}
+	}
+	if (filekey != NULL && !RET_WAS_ERROR(result)) {
+		r = referrerlist_put(filekey, &list);
+		if (RET_IS_OK(r))
+			r = index_addlist(filekey, &list);
+		RET_UPDATE(result, r);
+	}
+	free(filekey);
+	referrerlist_done(&list);
+	r = cursor_close(oldtable, cursor);
+	RET_ENDUPDATE(result, r);
+	return result;
+}
+
 retvalue references_isused( const char *what) {
 	return table_gettemprecord(rdb_references, what, NULL, NULL);
 }
@@ -41,8 +592,11 @@ retvalue references_check(const char *referee, const struct strlist *filekeys) {
 
 	result = RET_NOTHING;
 	for (i = 0 ; i < filekeys->count ; i++) {
-		r = table_checkrecord(rdb_references,
-				filekeys->values[i], referee);
+		if (COMPACT)
+			r = compact_check(filekeys->values[i], referee);
+		else
+			r = table_checkrecord(rdb_references,
+					filekeys->values[i], referee);
 		if (r == RET_NOTHING) {
 			fprintf(stderr, "Missing reference to '%s' by '%s'\n",
 					filekeys->values[i], referee);
@@ -61,8 +615,11 @@ retvalue references_increment(const char *needed, const char *neededby) {
 		fprintf(stderr, "trace: references_insert(needed=%s, neededby=%s) called.\n",
 		        needed, neededby);
 
-	r = table_addrecord(rdb_references, needed,
-			neededby, strlen(neededby), false);
+	if (COMPACT)
+		r = compact_increment(needed, neededby);
+	else
+		r = table_addrecord(rdb_references, needed,
+				neededby, strlen(neededby), false);
 	if (RET_IS_OK(r) && verbose > 8)
 		printf("Adding reference to '%s' by '%s'\n", needed, neededby);
 	return r;
@@ -72,7 +629,10 @@ retvalue references_increment(const char *needed, const char *neededby) {
 retvalue references_decrement(const char *needed, const char *neededby) {
 	retvalue r;
 
-	r = table_removerecord(rdb_references, needed, neededby);
+	if (COMPACT)
+		r = compact_decrement(needed, neededby);
+	else
+		r = table_removerecord(rdb_references, needed, neededby);
 	if (r == RET_NOTHING)
 		return r;
 	if (RET_WAS_ERROR(r)) {
@@ -126,19 +686,51 @@ retvalue references_insert(const char *identifier,
 	return result;
 }
 
-/* add possible already existing references */
+static int filekey_compare(const void *a, const void *b) {
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/* add possible already existing references, all at once:
+ * in the order of the table and looking up the number only once */
 retvalue references_add(const char *identifier, const struct strlist *files) {
+	char **sorted;
+	unsigned long id = 0;
 	int i;
 	retvalue r;
 
-	for (i = 0 ; i < files->count ; i++) {
-		const char *filekey = files->values[i];
-		r = table_addrecord(rdb_references, filekey,
-				identifier, strlen(identifier), true);
+	if (files->count == 0)
+		return RET_OK;
+	if (COMPACT) {
+		r = referrer_id(identifier, true, &id);
+		assert (r != RET_NOTHING);
 		if (RET_WAS_ERROR(r))
 			return r;
 	}
-	return RET_OK;
+	sorted = nzNEW(files->count, char *);
+	if (FAILEDTOALLOC(sorted))
+		return RET_ERROR_OOM;
+	memcpy(sorted, files->values, files->count * sizeof(char *));
+	qsort(sorted, files->count, sizeof(char *), filekey_compare);
+	r = RET_OK;
+	for (i = 0 ; i < files->count ; i++) {
+		const char *filekey = sorted[i];
+
+		if (i > 0 && strcmp(sorted[i - 1], filekey) == 0)
+			continue;
+		if (COMPACT)
+			r = compact_incrementid(filekey, id, true);
+		else
+			r = table_addrecord(rdb_references, filekey,
+					identifier, strlen(identifier), true);
+		if (RET_WAS_ERROR(r))
+			break;
+		if (interrupted()) {
+			r = RET_ERROR_INTERRUPTED;
+			break;
+		}
+	}
+	free(sorted);
+	return RET_WAS_ERROR(r)?r:RET_OK;
 }
 
 /* Remove reference by <identifier> for the given <oldfiles>,
@@ -170,6 +762,9 @@ retvalue references_remove(const char *neededby) {
 	const char *found_to, *found_by;
 	size_t datalen, l;
 
+	if (COMPACT)
+		return compact_remove(neededby);
+
 	r = table_newglobalcursor(rdb_references, true, &cursor);
 	if (!RET_IS_OK(r))
 		return r;
@@ -180,8 +775,7 @@ retvalue references_remove(const char *neededby) {
 	while (cursor_nexttempdata(rdb_references, cursor,
 				&found_to, &found_by, &datalen)) {
 
-		if (datalen >= l && strncmp(found_by, neededby, l) == 0 &&
-		    (found_by[l] == '\0' || found_by[l] == ' ')) {
+		if (matches(found_by, datalen, neededby, l)) {
 			if (verbose > 8)
 				fprintf(stderr,
 "Removing reference to '%s' by '%s'\n",
@@ -200,19 +794,178 @@ retvalue references_remove(const char *neededby) {
 	return result;
 }
 
+struct references_cursor {
+	struct cursor *cursor;
+	retvalue r;
+	/* only for the compact format: */
+	struct referrername {
+		unsigned long id;
+		char *name;
+	} *names;
+	int namecount;
+	const char *filekey;
+	struct referrerlist list;
+	int current;
+	unsigned long left;
+};
+
+static int referrername_compare(const void *a, const void *b) {
+	const struct referrername *n1 = a, *n2 = b;
+
+	if (n1->id < n2->id)
+		return -1;
+	return (n1->id > n2->id)?1:0;
+}
+
+static void references_freenames(struct references_cursor *c) {
+	int i;
+
+	for (i = 0 ; i < c->namecount ; i++)
+		free(c->names[i].name);
+	free(c->names);
+}
+
+static retvalue references_loadnames(struct references_cursor *c) {
+	struct cursor *cursor;
+	const char *key, *data;
+	int size = 0;
+	retvalue result, r;
+
+	r = table_newglobalcursor(rdb_referrerids, true, &cursor);
+	if (!RET_IS_OK(r))
+		return r;
+	result = RET_OK;
+	while (cursor_nexttempdata(rdb_referrerids, cursor,
+				&key, &data, NULL)) {
+		struct referrername *n;
+
+		if (c->namecount >= size) {
+			size = (size == 0)?256:2 * size;
+			n = realloc(c->names, size * sizeof(*n));
+			if (FAILEDTOALLOC(n)) {
+				result = RET_ERROR_OOM;
+				break;
+			}
+			c->names = n;
+		}
+		n = &c->names[c->namecount];
+		r = parseid(data, key, &n->id);
+		if (RET_WAS_ERROR(r)) {
+			result = r;
+			break;
+		}
+		n->name = strdup(data);
+		if (FAILEDTOALLOC(n->name)) {
+			result = RET_ERROR_OOM;
+			break;
+		}
+		c->namecount++;
+	}
+	r = cursor_close(rdb_referrerids, cursor);
+	RET_ENDUPDATE(result, r);
+	if (c->namecount > 0)
+		qsort(c->names, c->namecount, sizeof(struct referrername),
+				referrername_compare);
+	return result;
+}
+
+/* iterate over all (filekey, referrer) pairs sorted by filekey,
+ * each pair as often as that reference was added */
+retvalue references_newcursor(struct references_cursor **c_p) {
+	struct references_cursor *c;
+	retvalue r;
+
+	c = zNEW(struct references_cursor);
+	if (FAILEDTOALLOC(c))
+		return RET_ERROR_OOM;
+	c->r = RET_OK;
+	if (COMPACT) {
+		r = references_loadnames(c);
+		if (RET_WAS_ERROR(r)) {
+			references_freenames(c);
+			free(c);
+			return r;
+		}
+	}
+	r = table_newglobalcursor(rdb_references, true, &c->cursor);
+	if (!RET_IS_OK(r)) {
+		references_freenames(c);
+		free(c);
+		return r;
+	}
+	*c_p = c;
+	return RET_OK;
+}
+
+bool references_nextpair(struct references_cursor *c, const char **filekey_p, const char **referrer_p, size_t *len_p) {
+	const struct referrername *n;
+	struct referrername key;
+	const char *data;
+	retvalue r;
+
+	if (!COMPACT)
+		return cursor_nexttempdata(rdb_references, c->cursor,
+				filekey_p, referrer_p, len_p);
+	if (RET_WAS_ERROR(c->r))
+		return false;
+	while (c->left == 0) {
+		if (c->current + 1 < c->list.count) {
+			c->current++;
+			c->left = c->list.referrers[c->current].count;
+			continue;
+		}
+		referrerlist_done(&c->list);
+		if (!cursor_nexttempdata(rdb_references, c->cursor,
+					&c->filekey, &data, NULL))
+			return false;
+		r = referrerlist_parse(c->filekey, data, &c->list);
+		if (RET_WAS_ERROR(r)) {
+			c->r = r;
+			return false;
+		}
+		c->current = -1;
+	}
+	key.id = c->list.referrers[c->current].id;
+	n = bsearch(&key, c->names, c->namecount,
+			sizeof(struct referrername), referrername_compare);
+	if (n == NULL) {
+		fprintf(stderr,
+"Corrupted entry for '%s' in references.db (unknown referrer %lu)!\n",
+				c->filekey, key.id);
+		c->r = RET_ERROR;
+		return false;
+	}
+	c->left--;
+	*filekey_p = c->filekey;
+	*referrer_p = n->name;
+	if (len_p != NULL)
+		*len_p = strlen(n->name);
+	return true;
+}
+
+retvalue references_closecursor(struct references_cursor *c) {
+	retvalue r;
+
+	r = cursor_close(rdb_references, c->cursor);
+	RET_UPDATE(r, c->r);
+	referrerlist_done(&c->list);
+	references_freenames(c);
+	free(c);
+	return r;
+}
+
 /* dump all references to stdout */
 retvalue references_dump(void) {
-	struct cursor *cursor;
+	struct references_cursor *cursor;
 	retvalue result, r;
 	const char *found_to, *found_by;
 
-	r = table_newglobalcursor(rdb_references, true, &cursor);
+	r = references_newcursor(&cursor);
 	if (!RET_IS_OK(r))
 		return r;
 
 	result = RET_OK;
-	while (cursor_nexttempdata(rdb_references, cursor,
-	                               &found_to, &found_by, NULL)) {
+	while (references_nextpair(cursor, &found_to, &found_by, NULL)) {
 		if (fputs(found_by, stdout) == EOF ||
 		    putchar(' ') == EOF ||
 		    puts(found_to) == EOF) {
@@ -225,7 +978,7 @@ retvalue references_dump(void) {
 			break;
 		}
 	}
-	r = cursor_close(rdb_references, cursor);
+	r = references_closecursor(cursor);
 	RET_ENDUPDATE(result, r);
 	return result;
 }
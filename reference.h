@@ -47,4 +47,16 @@ retvalue references_check(const char * /*referee*/, const struct strlist */*what
 /* output all references to stdout */
 retvalue references_dump(void);
 
+/* iterate over all pairs of filekey and referrer */
+struct references_cursor;
+retvalue references_newcursor(/*@out@*/struct references_cursor **);
+bool references_nextpair(struct references_cursor *, /*@out@*/const char ** /*filekey*/, /*@out@*/const char ** /*referrer*/, /*@out@*/size_t *);
+retvalue references_closecursor(/*@only@*/struct references_cursor *);
+
+/* to be called when references.db is opened or closed */
+void references_forgetcache(void);
+
+/* copy the references of an old style references.db into the compact one */
+retvalue references_translate(struct table *);
+
 #endif
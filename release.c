@@ -48,7 +48,9 @@
 #include "signature.h"
 #include "distribution.h"
 #include "outhook.h"
+#include "trace.h"
 #include "release.h"
+#include "stats.h"
 
 #define INPUT_BUFFER_SIZE 1024
 #define GZBUFSIZE 40960
@@ -85,6 +87,8 @@ struct release {
 	/* the Release file in preperation
 	 * (only valid between _prepare and _finish) */
 	struct signedfile *signedfile;
+	/* the InRelease and Release.gpg to be signed by release_sign */
+	struct release_entry *signedentry, *detachedentry;
 	/* the cache database for old files */
 	struct table *cachedb;
 };
@@ -170,6 +174,169 @@ static retvalue newreleaseentry(struct release *release, /*@only@*/ char *relati
 	return RET_OK;
 }
 
+/* Generating the files of a release can be split into parts run in
+ * worker processes: release_generatepart runs the given function with
+ * the entries added so far hidden, and returns what it added as a block
+ * of data (leaving the files in place), which release_addpart adds to
+ * the release in the process that later writes the Release file. */
+
+enum { pe_checksums = 1, pe_final = 2, pe_temporary = 4, pe_symlink = 8 };
+
+static size_t partentrysize(const struct release_entry *e) {
+	size_t len = 2 + strlen(e->relativefilename);
+	const char *combined;
+	size_t combinedlen;
+
+	if (e->checksums != NULL) {
+		(void)checksums_getcombined(e->checksums,
+				&combined, &combinedlen);
+		len += strlen(combined) + 1;
+	}
+	if (e->fullfinalfilename != NULL)
+		len += strlen(e->fullfinalfilename) + 1;
+	if (e->fulltemporaryfilename != NULL)
+		len += strlen(e->fulltemporaryfilename) + 1;
+	if (e->symlinktarget != NULL)
+		len += strlen(e->symlinktarget) + 1;
+	return len;
+}
+
+static char *addpartstring(char *p, const char *s) {
+	size_t l = strlen(s) + 1;
+
+	memcpy(p, s, l);
+	return p + l;
+}
+
+static retvalue serializepart(const struct release *release, /*@out@*/char **data_p, /*@out@*/size_t *len_p) {
+	const struct release_entry *e;
+	const char *combined;
+	size_t len = 1, combinedlen;
+	char *data, *p;
+
+	for (e = release->files ; e != NULL ; e = e->next)
+		len += partentrysize(e);
+	data = malloc(len);
+	if (FAILEDTOALLOC(data))
+		return RET_ERROR_OOM;
+	p = data;
+	*(p++) = release->new?'n':'o';
+	for (e = release->files ; e != NULL ; e = e->next) {
+		*(p++) = (e->checksums != NULL ? pe_checksums : 0) |
+			(e->fullfinalfilename != NULL ? pe_final : 0) |
+			(e->fulltemporaryfilename != NULL ? pe_temporary : 0) |
+			(e->symlinktarget != NULL ? pe_symlink : 0);
+		p = addpartstring(p, e->relativefilename);
+		if (e->checksums != NULL) {
+			(void)checksums_getcombined(e->checksums,
+					&combined, &combinedlen);
+			p = addpartstring(p, combined);
+		}
+		if (e->fullfinalfilename != NULL)
+			p = addpartstring(p, e->fullfinalfilename);
+		if (e->fulltemporaryfilename != NULL)
+			p = addpartstring(p, e->fulltemporaryfilename);
+		if (e->symlinktarget != NULL)
+			p = addpartstring(p, e->symlinktarget);
+	}
+	assert ((size_t)(p - data) == len);
+	*data_p = data;
+	*len_p = len;
+	return RET_OK;
+}
+
+retvalue release_generatepart(struct release *release, release_partfunction *function, void *privdata, char **data_p, size_t *len_p) {
+	struct release_entry *oldfiles = release->files, *e;
+	bool oldnew = release->new;
+	retvalue r, r2;
+
+	release->files = NULL;
+	release->new = false;
+	r = function(privdata, release);
+	if (!RET_WAS_ERROR(r)) {
+		r2 = serializepart(release, data_p, len_p);
+		if (RET_WAS_ERROR(r2))
+			r = r2;
+	}
+	while ((e = release->files) != NULL) {
+		release->files = e->next;
+		/* the other process takes care of the files now */
+		if (!RET_WAS_ERROR(r)) {
+			free(e->fulltemporaryfilename);
+			e->fulltemporaryfilename = NULL;
+		}
+		release_freeentry(e);
+	}
+	release->files = oldfiles;
+	release->new = oldnew;
+	return r;
+}
+
+static retvalue getpartstring(const char **p, const char *end, /*@out@*/char **s_p) {
+	const char *nul = memchr(*p, '\0', end - *p);
+
+	if (nul == NULL) {
+		fputs("Internal error: malformed release part!\n", stderr);
+		return RET_ERROR;
+	}
+	*s_p = strdup(*p);
+	if (FAILEDTOALLOC(*s_p))
+		return RET_ERROR_OOM;
+	*p = nul + 1;
+	return RET_OK;
+}
+
+/* in a forked child the cache has to be opened again (see database_forked) */
+retvalue release_forked(struct release *release, const char *codename) {
+	retvalue r;
+
+	release->cachedb = NULL;
+	r = database_openreleasecache(codename, &release->cachedb);
+	assert (r != RET_NOTHING);
+	if (RET_WAS_ERROR(r))
+		release->cachedb = NULL;
+	return r;
+}
+
+retvalue release_addpart(struct release *release, const char *data, size_t len) {
+	const char *p = data, *end = data + len;
+	retvalue r;
+
+	if (len == 0)
+		return RET_NOTHING;
+	if (*(p++) == 'n')
+		release->new = true;
+	while (p < end) {
+		char *strings[5] = { NULL, NULL, NULL, NULL, NULL };
+		struct checksums *checksums = NULL;
+		int flags = *(p++), i;
+
+		r = getpartstring(&p, end, &strings[0]);
+		for (i = 0 ; i < 4 ; i++) {
+			if (RET_WAS_ERROR(r))
+				break;
+			if ((flags & (1 << i)) != 0)
+				r = getpartstring(&p, end, &strings[i + 1]);
+		}
+		if (RET_IS_OK(r) && strings[1] != NULL) {
+			r = checksums_parse(&checksums, strings[1]);
+			assert (r != RET_NOTHING);
+		}
+		free(strings[1]);
+		if (RET_WAS_ERROR(r)) {
+			for (i = 0 ; i < 5 ; i++)
+				if (i != 1)
+					free(strings[i]);
+			return r;
+		}
+		r = newreleaseentry(release, strings[0], checksums,
+				strings[2], strings[3], strings[4]);
+		if (RET_WAS_ERROR(r))
+			return r;
+	}
+	return RET_OK;
+}
+
 retvalue release_init(struct release **release, const char *codename, const char *suite, const char *fakecomponentprefix) {
 	struct release *n;
 	size_t len, suitelen, codenamelen;
@@ -519,6 +686,8 @@ struct filetorelease {
 		char *fullfinalfilename;
 		char *fulltemporaryfilename;
 		char *symlinkas;
+		/* for --stats-json */
+		unsigned long long bytes;
 	} f[ic_count];
 	/* input buffer, to checksum/compress data at once */
 	unsigned char *buffer; size_t waiting_bytes;
@@ -610,6 +779,7 @@ static retvalue openfile(const char *dirofdist, struct openfile *f) {
 static retvalue writetofile(struct openfile *file, const unsigned char *data, size_t len) {
 
 	checksumscontext_update(&file->context, data, len);
+	file->bytes += len;
 
 	if (file->fd < 0)
 		return RET_NOTHING;
@@ -1342,6 +1512,16 @@ retvalue release_finishfile(struct release *release, struct filetorelease *file)
 	release->new = true;
 	result = RET_OK;
 
+	for (i = ic_uncompressed + 1 ; i < ic_count ; i++) {
+		struct stats_compression *c;
+
+		if (file->f[i].relativefilename == NULL)
+			continue;
+		c = stats_compression(ics[i]);
+		c->files++;
+		c->bytesin += file->f[ic_uncompressed].bytes;
+		c->bytesout += file->f[i].bytes;
+	}
 	for (i = ic_uncompressed ; i < ic_count ; i++) {
 		r = releasefile(release, &file->f[i]);
 		if (RET_WAS_ERROR(r)) {
@@ -1712,21 +1892,57 @@ retvalue release_prepare(struct release *release, struct distribution *distribut
 			writechar('\n');
 		}
 	}
-	r = signedfile_create(release->signedfile,
+	r = signedfile_prepare(release->signedfile,
 			plainentry->fulltemporaryfilename,
 			&signedentry->fulltemporaryfilename,
 			&detachedentry->fulltemporaryfilename,
-			&distribution->signwith, !global.keeptemporaries);
+			&distribution->signwith);
 	if (RET_WAS_ERROR(r)) {
 		signedfile_free(release->signedfile);
 		release->signedfile = NULL;
 		return r;
 	}
-	omitunusedspecialreleaseentry(release, signedentry);
-	omitunusedspecialreleaseentry(release, detachedentry);
+	release->signedentry = signedentry;
+	release->detachedentry = detachedentry;
 	return RET_OK;
 }
 
+/* Sign the Release files of all those prepared releases at once,
+ * results tells which of those can be finished */
+retvalue release_sign(struct release **releases, retvalue *results, size_t count) {
+	struct signedfile **files;
+	retvalue result, r;
+	size_t i;
+
+	files = nzNEW(count, struct signedfile *);
+	if (FAILEDTOALLOC(files))
+		return RET_ERROR_OOM;
+	for (i = 0 ; i < count ; i++) {
+		assert (releases[i]->signedfile != NULL);
+		files[i] = releases[i]->signedfile;
+	}
+	trace_begin("sign", NULL);
+	result = signedfile_sign(files, results, count,
+			!global.keeptemporaries);
+	trace_end();
+	free(files);
+	for (i = 0 ; i < count ; i++) {
+		struct release *release = releases[i];
+
+		r = results[i];
+		if (RET_WAS_ERROR(r)) {
+			RET_UPDATE(result, r);
+			continue;
+		}
+		results[i] = RET_OK;
+		omitunusedspecialreleaseentry(release, release->signedentry);
+		omitunusedspecialreleaseentry(release, release->detachedentry);
+		release->signedentry = NULL;
+		release->detachedentry = NULL;
+	}
+	return result;
+}
+
 static inline void release_toouthook(struct release *release, struct distribution *distribution) {
 	struct release_entry *file;
 	char *reldir;
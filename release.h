@@ -62,7 +62,14 @@ struct target;
 retvalue release_directorydescription(struct release *, const struct distribution *, const struct target *, const char * /*filename*/, bool /*onlyifneeded*/);
 
 void release_free(/*@only@*/struct release *);
+
+/* run a function adding files in a worker and add its results in the parent */
+typedef retvalue release_partfunction(void *, struct release *);
+retvalue release_generatepart(struct release *, release_partfunction *, void *, /*@out@*/char **, /*@out@*/size_t *);
+retvalue release_addpart(struct release *, const char *, size_t);
+retvalue release_forked(struct release *, const char * /*codename*/);
 retvalue release_prepare(struct release *, struct distribution *, bool /*onlyneeded*/);
+retvalue release_sign(struct release **, /*@out@*/retvalue *, size_t);
 retvalue release_finish(/*@only@*/struct release *, struct distribution *);
 
 #endif
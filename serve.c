@@ -0,0 +1,551 @@
+/*  This file is part of "reprepro"
+ *  Copyright (C) 2026 agent
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02111-1301  USA
+ */
+#include <config.h>
+
+#include <errno.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "error.h"
+#include "filecntl.h"
+#include "serve.h"
+
+/* A client sends a struct serverequest (with its stdin, stdout and stderr
+ * attached), followed by its working directory and argc arguments, each
+ * terminated by a '\0'. The server answers with the exit code as int. */
+
+struct serverequest {
+	size_t argc;
+	size_t len;
+};
+
+/* more than any sane command line */
+#define MAXREQUESTLEN (16*1024*1024)
+
+static volatile bool reload_requested = false;
+
+static void hup_signaled(int) /*__attribute__((signal))*/;
+static void hup_signaled(UNUSED(int s)) {
+	reload_requested = true;
+}
+
+static bool writeall(int fd, const void *data, size_t len) {
+	const char *p = data;
+
+	while (len > 0) {
+		ssize_t written = write(fd, p, len);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written <= 0)
+			return false;
+		p += written;
+		len -= written;
+	}
+	return true;
+}
+
+/* returns RET_NOTHING on immediate end of file */
+static retvalue readall(int fd, void *data, size_t len) {
+	char *p = data;
+	size_t got = 0;
+
+	while (got < len) {
+		ssize_t r = read(fd, p + got, len - got);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r < 0) {
+			int e = errno;
+			return RET_ERRNO(e);
+		}
+		if (r == 0)
+			return (got == 0)?RET_NOTHING:RET_ERROR;
+		got += r;
+	}
+	return RET_OK;
+}
+
+static retvalue setaddress(/*@out@*/struct sockaddr_un *address, const char *socketname) {
+	size_t len = strlen(socketname);
+
+	memset(address, 0, sizeof(*address));
+	if (len >= sizeof(address->sun_path)) {
+		fprintf(stderr, "Socket name '%s' is too long!\n", socketname);
+		return RET_ERROR;
+	}
+	address->sun_family = AF_UNIX;
+	memcpy(address->sun_path, socketname, len + 1);
+	return RET_OK;
+}
+
+/* RET_NOTHING if there is no socket or nobody listening on it */
+static retvalue connectto(const char *socketname, /*@out@*/int *fd_p) {
+	struct sockaddr_un address;
+	retvalue r;
+	int fd, e;
+
+	r = setaddress(&address, socketname);
+	if (RET_WAS_ERROR(r))
+		return r;
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		e = errno;
+		fprintf(stderr, "Error %d creating socket: %s\n",
+				e, strerror(e));
+		return RET_ERRNO(e);
+	}
+	if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+		e = errno;
+		(void)close(fd);
+		if (e == ENOENT || e == ECONNREFUSED)
+			return RET_NOTHING;
+		fprintf(stderr, "Error %d connecting to '%s': %s\n",
+				e, socketname, strerror(e));
+		return RET_ERRNO(e);
+	}
+	*fd_p = fd;
+	return RET_OK;
+}
+
+retvalue serve_forward(const char *socketname, int argc, char * const *argv, int *status_p) {
+	struct serverequest request;
+	struct msghdr msg;
+	struct iovec iov;
+	union {
+		struct cmsghdr align;
+		char buffer[CMSG_SPACE(3 * sizeof(int))];
+	} control;
+	struct cmsghdr *cmsg;
+	const int fds[3] = {0, 1, 2};
+	char *cwd, *data, *p;
+	ssize_t sent;
+	retvalue r;
+	int fd, i, status;
+
+	cwd = getcwd(NULL, 0);
+	if (cwd == NULL) {
+		int e = errno;
+		fprintf(stderr,
+"Error %d getting the current directory: %s\n", e, strerror(e));
+		return RET_ERRNO(e);
+	}
+	request.argc = argc;
+	request.len = strlen(cwd) + 1;
+	for (i = 0 ; i < argc ; i++)
+		request.len += strlen(argv[i]) + 1;
+	if (request.len > MAXREQUESTLEN) {
+		free(cwd);
+		fprintf(stderr, "Command line too long to send to a server!\n");
+		return RET_ERROR;
+	}
+	data = malloc(request.len);
+	if (FAILEDTOALLOC(data)) {
+		free(cwd);
+		return RET_ERROR_OOM;
+	}
+	p = stpcpy(data, cwd) + 1;
+	free(cwd);
+	for (i = 0 ; i < argc ; i++)
+		p = stpcpy(p, argv[i]) + 1;
+	assert ((size_t)(p - data) == request.len);
+
+	r = connectto(socketname, &fd);
+	if (!RET_IS_OK(r)) {
+		free(data);
+		return r;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = &request;
+	iov.iov_len = sizeof(request);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buffer;
+	msg.msg_controllen = sizeof(control.buffer);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+	do {
+		sent = sendmsg(fd, &msg, 0);
+	} while (sent < 0 && errno == EINTR);
+	if (sent != (ssize_t)sizeof(request)
+			|| !writeall(fd, data, request.len)) {
+		int e = errno;
+		free(data);
+		(void)close(fd);
+		fprintf(stderr, "Error %d sending command to '%s': %s\n",
+				e, socketname, strerror(e));
+		return RET_ERRNO(e);
+	}
+	free(data);
+	/* the server answers when the command is finished */
+	r = readall(fd, &status, sizeof(status));
+	(void)close(fd);
+	if (!RET_IS_OK(r)) {
+		fprintf(stderr,
+"Server at '%s' closed the connection without sending a result!\n",
+				socketname);
+		return RET_WAS_ERROR(r)?r:RET_ERROR;
+	}
+	*status_p = status;
+	return RET_OK;
+}
+
+static retvalue createsocket(const char *socketname, /*@out@*/int *fd_p) {
+	struct sockaddr_un address;
+	struct stat s;
+	mode_t mask;
+	retvalue r;
+	int fd, e, i;
+
+	/* do not steal the socket of a running server,
+	 * but remove one left over by a dead one */
+	r = connectto(socketname, &fd);
+	if (RET_IS_OK(r)) {
+		(void)close(fd);
+		fprintf(stderr,
+"Error: There is already a server listening on '%s'!\n", socketname);
+		return RET_ERROR;
+	}
+	if (RET_WAS_ERROR(r))
+		return r;
+	if (lstat(socketname, &s) == 0) {
+		if (!S_ISSOCK(s.st_mode)) {
+			fprintf(stderr,
+"Error: '%s' already exists and is not a socket!\n", socketname);
+			return RET_ERROR;
+		}
+		(void)unlink(socketname);
+	}
+
+	r = setaddress(&address, socketname);
+	if (RET_WAS_ERROR(r))
+		return r;
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		e = errno;
+		fprintf(stderr, "Error %d creating socket: %s\n",
+				e, strerror(e));
+		return RET_ERRNO(e);
+	}
+	/* only the user running the server may send commands */
+	mask = umask(S_IRWXG|S_IRWXO);
+	i = bind(fd, (struct sockaddr *)&address, sizeof(address));
+	e = errno;
+	(void)umask(mask);
+	if (i != 0) {
+		(void)close(fd);
+		fprintf(stderr, "Error %d binding socket to '%s': %s\n",
+				e, socketname, strerror(e));
+		return RET_ERRNO(e);
+	}
+	if (chmod(socketname, S_IRUSR|S_IWUSR) != 0) {
+		e = errno;
+		(void)close(fd);
+		(void)unlink(socketname);
+		fprintf(stderr, "Error %d changing mode of '%s': %s\n",
+				e, socketname, strerror(e));
+		return RET_ERRNO(e);
+	}
+	if (listen(fd, SOMAXCONN) != 0) {
+		e = errno;
+		(void)close(fd);
+		(void)unlink(socketname);
+		fprintf(stderr, "Error %d listening on '%s': %s\n",
+				e, socketname, strerror(e));
+		return RET_ERRNO(e);
+	}
+	markcloseonexec(fd);
+	*fd_p = fd;
+	return RET_OK;
+}
+
+struct command {
+	int fds[3];
+	/* working directory, then the arguments: */
+	char *data;
+	int argc;
+	char **argv;
+};
+
+static void command_done(struct command *c) {
+	int i;
+
+	for (i = 0 ; i < 3 ; i++) {
+		if (c->fds[i] >= 0)
+			(void)close(c->fds[i]);
+	}
+	free(c->argv);
+	free(c->data);
+}
+
+static retvalue readcommand(int connection, /*@out@*/struct command *c) {
+	struct serverequest request;
+	struct msghdr msg;
+	struct iovec iov;
+	union {
+		struct cmsghdr align;
+		char buffer[CMSG_SPACE(3 * sizeof(int))];
+	} control;
+	struct cmsghdr *cmsg;
+	ssize_t got;
+	size_t i, count;
+	retvalue r;
+
+	c->fds[0] = c->fds[1] = c->fds[2] = -1;
+	c->data = NULL;
+	c->argv = NULL;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = &request;
+	iov.iov_len = sizeof(request);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buffer;
+	msg.msg_controllen = sizeof(control.buffer);
+	do {
+		got = recvmsg(connection, &msg, 0);
+	} while (got < 0 && errno == EINTR);
+	if (got == 0)
+		return RET_NOTHING;
+	if (got < 0) {
+		int e = errno;
+		fprintf(stderr, "Error %d receiving command: %s\n",
+				e, strerror(e));
+		return RET_ERRNO(e);
+	}
+	for (cmsg = CMSG_FIRSTHDR(&msg) ; cmsg != NULL ;
+			cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET ||
+				cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+		count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		for (i = 0 ; i < count ; i++) {
+			int fd;
+
+			memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int),
+					sizeof(int));
+			if (i < 3 && c->fds[i] < 0)
+				c->fds[i] = fd;
+			else
+				(void)close(fd);
+		}
+	}
+	if (got != (ssize_t)sizeof(request) || (msg.msg_flags & MSG_CTRUNC)
+			|| c->fds[2] < 0 || request.len > MAXREQUESTLEN
+			|| request.argc >= request.len) {
+		fprintf(stderr, "Received malformed command, ignoring it.\n");
+		command_done(c);
+		return RET_ERROR;
+	}
+	c->data = malloc(request.len + 1);
+	c->argv = nzNEW(request.argc + 1, char *);
+	if (FAILEDTOALLOC(c->data) || FAILEDTOALLOC(c->argv)) {
+		command_done(c);
+		return RET_ERROR_OOM;
+	}
+	r = readall(connection, c->data, request.len);
+	if (!RET_IS_OK(r)) {
+		fprintf(stderr, "Client closed connection prematurely.\n");
+		command_done(c);
+		return RET_WAS_ERROR(r)?r:RET_ERROR;
+	}
+	c->data[request.len] = '\0';
+	c->argc = request.argc;
+	/* skip the directory, then split into the arguments */
+	i = strlen(c->data) + 1;
+	for (count = 0 ; count < request.argc && i < request.len ; count++) {
+		c->argv[count] = c->data + i;
+		i += strlen(c->data + i) + 1;
+	}
+	if (count != request.argc || i != request.len || count == 0) {
+		fprintf(stderr, "Received malformed command, ignoring it.\n");
+		command_done(c);
+		return RET_ERROR;
+	}
+	return RET_OK;
+}
+
+static void NORETURN commandchild(int listenfd, int connection, struct command *c, serve_commandfunction *command) {
+	int i, fd;
+
+	(void)close(listenfd);
+	(void)close(connection);
+	/* move them out of the way first, they might already be 0, 1 or 2 */
+	for (i = 0 ; i < 3 ; i++) {
+		fd = fcntl(c->fds[i], F_DUPFD, 3);
+		if (fd < 0)
+			_exit(EXIT_FAILURE);
+		(void)close(c->fds[i]);
+		c->fds[i] = fd;
+	}
+	for (i = 0 ; i < 3 ; i++) {
+		if (dup2(c->fds[i], i) < 0)
+			_exit(EXIT_FAILURE);
+		(void)close(c->fds[i]);
+	}
+	if (chdir(c->data) != 0) {
+		int e = errno;
+		fprintf(stderr, "Error %d changing to directory '%s': %s\n",
+				e, c->data, strerror(e));
+		exit(EXIT_FAILURE);
+	}
+	(void)signal(SIGHUP, SIG_DFL);
+	exit(command(c->argc, c->argv));
+}
+
+/* the socket's mode should already ensure that, but do not rely on it */
+static retvalue checkpeer(int connection) {
+#ifdef SO_PEERCRED
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+
+	if (getsockopt(connection, SOL_SOCKET, SO_PEERCRED,
+				&cred, &len) != 0) {
+		int e = errno;
+		fprintf(stderr, "Error %d getting peer credentials: %s\n",
+				e, strerror(e));
+		return RET_ERRNO(e);
+	}
+	if (cred.uid != geteuid()) {
+		fprintf(stderr,
+"Refusing command from process %d of user %d (not the server's user)!\n",
+				(int)cred.pid, (int)cred.uid);
+		return RET_ERROR;
+	}
+#endif
+	return RET_OK;
+}
+
+static retvalue runcommand(int listenfd, int connection, serve_commandfunction *command) {
+	struct command c;
+	retvalue r;
+	pid_t child, pid;
+	int status, i;
+
+	r = checkpeer(connection);
+	if (RET_WAS_ERROR(r))
+		return r;
+	r = readcommand(connection, &c);
+	if (!RET_IS_OK(r))
+		return r;
+	if (verbose > 1) {
+		printf("Running command:");
+		for (i = 0 ; i < c.argc ; i++)
+			printf(" %s", c.argv[i]);
+		putchar('\n');
+	}
+	(void)fflush(stdout);
+	(void)fflush(stderr);
+	child = fork();
+	if (child < 0) {
+		int e = errno;
+		command_done(&c);
+		fprintf(stderr, "Error %d forking: %s\n", e, strerror(e));
+		return RET_ERRNO(e);
+	}
+	if (child == 0)
+		commandchild(listenfd, connection, &c, command);
+	command_done(&c);
+	do {
+		pid = waitpid(child, &status, 0);
+	} while (pid < 0 && errno == EINTR);
+	if (pid < 0) {
+		int e = errno;
+		fprintf(stderr, "Error %d waiting for child %d: %s\n",
+				e, (int)child, strerror(e));
+		return RET_ERRNO(e);
+	}
+	if (WIFEXITED(status))
+		status = WEXITSTATUS(status);
+	else if (WIFSIGNALED(status))
+		status = 128 + WTERMSIG(status);
+	else
+		status = EXIT_FAILURE;
+	if (verbose > 1)
+		printf("Command finished with exit code %d.\n", status);
+	/* if the client is no longer interested, so be it... */
+	(void)writeall(connection, &status, sizeof(status));
+	return RET_OK;
+}
+
+retvalue serve_run(const char *socketname, serve_commandfunction *command, serve_reloadfunction *reload) {
+	struct sigaction sa;
+	retvalue result = RET_OK, r;
+	int listenfd;
+
+	r = createsocket(socketname, &listenfd);
+	if (RET_WAS_ERROR(r))
+		return r;
+
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = 0;
+	sa.sa_handler = hup_signaled;
+	(void)sigaction(SIGHUP, &sa, NULL);
+
+	if (verbose > 0)
+		printf("Waiting for commands on '%s'...\n", socketname);
+	(void)fflush(stdout);
+	while (!interrupted()) {
+		int connection;
+
+		if (reload_requested) {
+			reload_requested = false;
+			if (verbose > 0)
+				printf("Reloading configuration...\n");
+			r = reload();
+			if (RET_WAS_ERROR(r))
+				fprintf(stderr,
+"Reloading configuration failed, commands will read it themselves.\n");
+		}
+		connection = accept(listenfd, NULL, NULL);
+		if (connection < 0) {
+			int e = errno;
+
+			if (e == EINTR || e == ECONNABORTED)
+				continue;
+			fprintf(stderr,
+"Error %d accepting connection on '%s': %s\n",
+					e, socketname, strerror(e));
+			result = RET_ERRNO(e);
+			break;
+		}
+		markcloseonexec(connection);
+		r = runcommand(listenfd, connection, command);
+		(void)close(connection);
+		if (r == RET_ERROR_OOM) {
+			result = r;
+			break;
+		}
+	}
+	(void)signal(SIGHUP, SIG_DFL);
+	(void)close(listenfd);
+	(void)unlink(socketname);
+	if (verbose > 0)
+		printf("Stopped listening on '%s'.\n", socketname);
+	return result;
+}
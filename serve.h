@@ -0,0 +1,25 @@
+#ifndef REPREPRO_SERVE_H
+#define REPREPRO_SERVE_H
+
+#ifndef REPREPRO_ERROR_H
+#include "error.h"
+#warning "What's hapening here?"
+#endif
+
+/* A server accepts one command at a time on a unix socket. Every command
+ * is run in a forked child having the standard input, output and error
+ * and the working directory of the client, the exit code of that child is
+ * sent back to the client. Commands arriving while another one is
+ * running wait in the socket's queue. */
+
+/* called in the child, argv[0] is the program name */
+typedef int serve_commandfunction(int /*argc*/, char ** /*argv*/);
+/* called in the server after SIGHUP was received */
+typedef retvalue serve_reloadfunction(void);
+
+retvalue serve_run(const char * /*socketname*/, serve_commandfunction *, serve_reloadfunction *);
+
+/* hand the command line to a server, RET_NOTHING if none is listening */
+retvalue serve_forward(const char * /*socketname*/, int /*argc*/, char * const * /*argv*/, /*@out@*/int * /*status_p*/);
+
+#endif
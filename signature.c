@@ -35,6 +35,7 @@
 
 #ifdef HAVE_LIBGPGME
 gpgme_ctx_t context = NULL;
+bool asksforpassphrase = false;
 
 retvalue gpgerror(gpg_error_t err) {
 	if (err != 0) {
@@ -94,9 +95,11 @@ retvalue signature_init(bool allowpassphrase){
 	err = gpgme_set_protocol(context, GPGME_PROTOCOL_OpenPGP);
 	if (err != 0)
 		return gpgerror(err);
-	if (allowpassphrase)
+	if (allowpassphrase) {
 		gpgme_set_passphrase_cb(context, signature_getpassphrase,
 				NULL);
+		asksforpassphrase = true;
+	}
 	gpgme_set_armor(context, 1);
 #endif /* HAVE_LIBGPGME */
 	return RET_OK;
@@ -104,9 +107,11 @@ retvalue signature_init(bool allowpassphrase){
 
 void signatures_done(void) {
 #ifdef HAVE_LIBGPGME
+	sigcache_done();
 	if (context != NULL) {
 		gpgme_release(context);
 		context = NULL;
+		asksforpassphrase = false;
 	}
 #endif /* HAVE_LIBGPGME */
 }
@@ -116,39 +121,29 @@ void signatures_done(void) {
  * which are mentioned in the signature (all). set broken if all signatures
  * was broken (hints to a broken file, as opposed to expired or whatever
  * else may make a signature invalid)). */
-static retvalue checksigs(const char *filename, struct signatures **signatures_p, bool *broken) {
-	gpgme_verify_result_t result;
-	gpgme_signature_t s;
+static retvalue checksigs(const char *filename, const struct verification *v, struct signatures **signatures_p, bool *broken) {
+	const struct verified_signature *s;
 	bool had_valid = false, had_broken = false;
-	size_t count;
 	struct signatures *signatures;
 	struct signature *sig;
+	int i;
 
-	result = gpgme_op_verify_result(context);
-	if (result == NULL) {
-		fprintf(stderr,
-"Internal error communicating with libgpgme: no result record!\n\n");
-		return RET_ERROR_GPGME;
-	}
 	if (signatures_p != NULL) {
-		count = 0;
-		for (s = result->signatures ; s != NULL ; s = s->next) {
-			count++;
-		}
 		signatures = calloc(1, sizeof(struct signatures) +
-				count * sizeof(struct signature));
+				v->count * sizeof(struct signature));
 		if (FAILEDTOALLOC(signatures))
 			return RET_ERROR_OOM;
-		signatures->count = count;
+		signatures->count = v->count;
 		signatures->validcount = 0;
 		sig = signatures->signatures;
 	} else {
 		signatures = NULL;
 		sig = NULL;
 	}
-	for (s = result->signatures ; s != NULL ; s = s->next) {
+	for (i = 0 ; i < v->count ; i++) {
 		enum signature_state state = sist_error;
 
+		s = &v->signatures[i];
 		if (signatures_p != NULL) {
 			sig->keyid = strdup(s->fpr);
 			if (FAILEDTOALLOC(sig->keyid)) {
@@ -156,7 +151,7 @@ static retvalue checksigs(const char *filename, struct signatures **signatures_p
 				return RET_ERROR_OOM;
 			}
 		}
-		switch (gpg_err_code(s->status)) {
+		switch (s->status) {
 			case GPG_ERR_NO_ERROR:
 				had_valid = true;
 				state = sist_valid;
@@ -233,7 +228,7 @@ static retvalue checksigs(const char *filename, struct signatures **signatures_p
 			fprintf(stderr,
 "Error checking signature (gpgme returned unexpected value %d)!\n"
 "Please file a bug report, so reprepro can handle this in the future.\n",
-				gpg_err_code(s->status));
+				s->status);
 			signatures_free(signatures);
 			return RET_ERROR_GPGME;
 		}
@@ -249,56 +244,39 @@ static retvalue checksigs(const char *filename, struct signatures **signatures_p
 	return RET_OK;
 }
 
-static retvalue check_primary_keys(struct signatures *signatures) {
+static retvalue check_primary_keys(const struct verification *v, struct signatures *signatures) {
 	/* Get the primary keys belonging to each signing key.
 	   This might also invalidate a signature previously believed
 	   valid if the primary key is expired */
 	int i;
 
+	assert (signatures->count == v->count);
 	for (i = 0 ; i < signatures->count ; i++) {
-		gpg_error_t err;
-		gpgme_key_t gpgme_key = NULL;
-		gpgme_subkey_t subkey;
+		const struct verified_signature *s = &v->signatures[i];
 		struct signature *sig = &signatures->signatures[i];
 
-		if (sig->state == sist_error || sig->state == sist_missing) {
+		if (sig->state == sist_error || sig->state == sist_missing
+				|| s->primary_fpr == NULL) {
 			sig->primary_keyid = strdup(sig->keyid);
 			if (FAILEDTOALLOC(sig->primary_keyid))
 				return RET_ERROR_OOM;
 			continue;
 		}
-
-		err = gpgme_get_key(context, sig->keyid, &gpgme_key, 0);
-		if (err != 0) {
-			fprintf(stderr,
-"gpgme error %s:%d retrieving key '%s': %s\n",
-					gpg_strsource(err),
-					(int)gpg_err_code(err),
-					sig->keyid, gpg_strerror(err));
-			if (gpg_err_code(err) == GPG_ERR_ENOMEM)
-				return RET_ERROR_OOM;
-			else
-				return RET_ERROR_GPGME;
-		}
-		assert (gpgme_key != NULL);
-		/* the first "sub"key is the primary key */
-		subkey = gpgme_key->subkeys;
-		if (subkey->revoked) {
+		if (s->primary_revoked) {
 			sig->revoced_key = true;
 			if (sig->state == sist_valid) {
 				sig->state = sist_mostly;
 				signatures->validcount--;
 			}
 		}
-		if (subkey->expired) {
+		if (s->primary_expired) {
 			sig->expired_key = true;
 			if (sig->state == sist_valid) {
 				sig->state = sist_mostly;
 				signatures->validcount--;
 			}
 		}
-		sig->primary_keyid = strdup(subkey->keyid);
-		gpgme_key_unref(gpgme_key);
+		sig->primary_keyid = strdup(s->primary_fpr);
 		if (FAILEDTOALLOC(sig->primary_keyid))
 			return RET_ERROR_OOM;
 	}
@@ -320,15 +298,65 @@ void signatures_free(struct signatures *signatures) {
 }
 
 #ifdef HAVE_LIBGPGME
+static retvalue signatures_from(const char *filenametoshow, const struct verification *v, /*@null@*/ /*@out@*/struct signatures **signatures_p, bool *brokensignature) {
+	struct signatures *signatures = NULL;
+	bool foundbroken = false;
+	retvalue r;
+
+	r = checksigs(filenametoshow, v,
+			(signatures_p!=NULL)?&signatures:NULL,
+			(brokensignature!=NULL)?&foundbroken:NULL);
+	if (RET_WAS_ERROR(r))
+		return r;
+	if (signatures != NULL) {
+		r = check_primary_keys(v, signatures);
+		if (RET_WAS_ERROR(r)) {
+			signatures_free(signatures);
+			return r;
+		}
+	}
+	if (signatures_p != NULL)
+		*signatures_p = signatures;
+	if (brokensignature != NULL)
+		*brokensignature = foundbroken;
+	return RET_OK;
+}
+
 static retvalue extract_signed_data(const char *buffer, size_t bufferlen, const char *filenametoshow, char **chunkread, /*@null@*/ /*@out@*/struct signatures **signatures_p, bool *brokensignature) {
-	char *chunk;
+	char *chunk = NULL;
 	gpg_error_t err;
 	gpgme_data_t dh, dh_gpg;
 	size_t plain_len;
 	char *plain_data;
 	retvalue r;
-	struct signatures *signatures = NULL;
-	bool foundbroken = false;
+	struct verification *verification = NULL;
+	const struct verification *cached;
+	char cachekey[SIGCACHE_KEYLEN];
+	bool wantsignatures;
+
+	wantsignatures = signatures_p != NULL || brokensignature != NULL;
+	if (wantsignatures) {
+		sigcache_key(cachekey, buffer, bufferlen, NULL, 0);
+		cached = sigcache_lookup(cachekey);
+		if (cached != NULL) {
+			r = sigcache_extract(buffer, bufferlen, cached, &chunk);
+			if (RET_WAS_ERROR(r))
+				return r;
+		}
+		if (cached != NULL && RET_IS_OK(r)) {
+			if (verbose > 10)
+				printf(
+"Using remembered signature check of '%s'.\n", filenametoshow);
+			r = signatures_from(filenametoshow, cached,
+					signatures_p, brokensignature);
+			if (RET_WAS_ERROR(r)) {
+				free(chunk);
+				return r;
+			}
+			*chunkread = chunk;
+			return RET_OK;
+		}
+	}
 
 	r = signature_init(false);
 	if (RET_WAS_ERROR(r))
@@ -357,10 +385,8 @@ static retvalue extract_signed_data(const char *buffer, size_t bufferlen, const
 			gpgme_data_release(dh);
 			return gpgerror(err);
 		}
-		if (signatures_p != NULL || brokensignature != NULL) {
-			r = checksigs(filenametoshow,
-				(signatures_p!=NULL)?&signatures:NULL,
-				(brokensignature!=NULL)?&foundbroken:NULL);
+		if (wantsignatures) {
+			r = verification_get(&verification);
 			if (RET_WAS_ERROR(r)) {
 				gpgme_data_release(dh_gpg);
 				gpgme_data_release(dh);
@@ -378,16 +404,9 @@ static retvalue extract_signed_data(const char *buffer, size_t bufferlen, const
 "To check this please try running gpg --verify '%s' manually.\n"
 "Continuing extracting it ignoring all signatures...",
 					filenametoshow, filenametoshow);
-			signatures_free(signatures);
+			verification_free(verification);
 			return RET_NOTHING;
 		}
-		if (signatures != NULL) {
-			r = check_primary_keys(signatures);
-			if (RET_WAS_ERROR(r)) {
-				signatures_free(signatures);
-				return r;
-			}
-		}
 	}
 
 	if (FAILEDTOALLOC(plain_data))
@@ -416,22 +435,25 @@ static retvalue extract_signed_data(const char *buffer, size_t bufferlen, const
 					filenametoshow);
 			free(chunk);
 			r = RET_ERROR;
-		} else
+		} else {
 			*chunkread = chunk;
+			if (verification != NULL)
+				verification_setdata(verification, chunk, len);
+		}
 	}
 #ifdef HAVE_GPGPME_FREE
 	gpgme_free(plain_data);
 #else
 	free(plain_data);
 #endif
-	if (RET_IS_OK(r)) {
-		if (signatures_p != NULL)
-			*signatures_p = signatures;
-		if (brokensignature != NULL)
-			*brokensignature = foundbroken;
-	} else {
-		signatures_free(signatures);
-	}
+	if (RET_IS_OK(r) && verification != NULL) {
+		cached = sigcache_add(cachekey, verification);
+		r = signatures_from(filenametoshow, cached,
+				signatures_p, brokensignature);
+		if (RET_WAS_ERROR(r))
+			free(*chunkread);
+	} else
+		verification_free(verification);
 	return r;
 }
 #endif /* HAVE_LIBGPGME */
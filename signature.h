@@ -58,9 +58,13 @@ struct strlist;
 
 retvalue signature_startsignedfile(/*@out@*/struct signedfile **);
 void signedfile_write(struct signedfile *, const void *, size_t);
-/* generate signature in temporary file */
-retvalue signedfile_create(struct signedfile *, const char *, char **, char **, const struct strlist *, bool /*willcleanup*/);
+/* write plain file and note where to put signatures */
+retvalue signedfile_prepare(struct signedfile *, const char *, char **, char **, /*@null@*/const struct strlist *);
+/* generate signatures of all those files in temporary files */
+retvalue signedfile_sign(struct signedfile **, /*@out@*/retvalue *, size_t, bool /*willcleanup*/);
 void signedfile_free(/*@only@*/struct signedfile *);
 
 void signatures_done(void);
+/* where to remember results of signature checks (NULL for nowhere) */
+void signature_setcachedir(/*@null@*/const char *);
 #endif
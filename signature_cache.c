@@ -0,0 +1,737 @@
+/*  This file is part of "reprepro"
+ *  Copyright (C) 2026 agent
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02111-1301  USA
+ */
+#include <config.h>
+
+#include <errno.h>
+#include <ctype.h>
+#include <assert.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "signature_p.h"
+#include "mprintf.h"
+#include "names.h"
+#include "chunks.h"
+#include "sha256.h"
+
+/* Verifying a signature means starting gpg, which is slow. So remember
+ * what gpg said about every signed file (identified by its sha256 sum)
+ * in a file in the database directory.
+ * All of it is forgotten once the keyring or the trustdb change, and
+ * every single result once a key or signature involved expires. */
+
+static /*@null@*/const char *cachedir = NULL;
+
+void signature_setcachedir(const char *dir) {
+	cachedir = dir;
+}
+
+#ifdef HAVE_LIBGPGME
+
+#define CACHEFILE "signatures.cache"
+#define CACHEHEADER "reprepro signature cache 1"
+/* results not used for that long are dropped */
+#define KEEPUNUSED (30*24*60*60)
+
+static struct sigcache_entry {
+	/*@null@*/struct sigcache_entry *next;
+	/* NULL if not to be stored */
+	/*@null@*/char *key;
+	time_t lastused;
+	struct verification *verification;
+} *entries = NULL;
+static bool loaded = false, changed = false;
+static /*@null@*/char *keyringstate = NULL;
+
+void verification_free(struct verification *v) {
+	int i;
+
+	if (v == NULL)
+		return;
+	for (i = 0 ; i < v->count ; i++) {
+		free(v->signatures[i].fpr);
+		free(v->signatures[i].primary_fpr);
+	}
+	free(v);
+}
+
+static inline void limitvalidity(struct verification *v, unsigned long t) {
+	if (t == 0)
+		return;
+	if (v->validuntil == 0 || (time_t)t < v->validuntil)
+		v->validuntil = t;
+}
+
+/* find the key of a signature, to get its primary key and
+ * when either of them expire */
+static retvalue lookup_signingkey(struct verification *v, struct verified_signature *sig) {
+	gpg_error_t err;
+	gpgme_key_t gpgme_key = NULL;
+	gpgme_subkey_t subkey;
+	size_t l = strlen(sig->fpr);
+
+	err = gpgme_get_key(context, sig->fpr, &gpgme_key, 0);
+	if (err != 0) {
+		fprintf(stderr,
+"gpgme error %s:%d retrieving key '%s': %s\n",
+				gpg_strsource(err),
+				(int)gpg_err_code(err),
+				sig->fpr, gpg_strerror(err));
+		if (gpg_err_code(err) == GPG_ERR_ENOMEM)
+			return RET_ERROR_OOM;
+		else
+			return RET_ERROR_GPGME;
+	}
+	assert (gpgme_key != NULL);
+	/* the first "sub"key is the primary key */
+	subkey = gpgme_key->subkeys;
+	sig->primary_revoked = subkey->revoked;
+	sig->primary_expired = subkey->expired;
+	limitvalidity(v, subkey->expires);
+	sig->primary_fpr = strdup(subkey->keyid);
+	for (; subkey != NULL ; subkey = subkey->next) {
+		size_t kl;
+
+		if (subkey->fpr != NULL && strcasecmp(subkey->fpr,
+					sig->fpr) == 0) {
+			limitvalidity(v, subkey->expires);
+			continue;
+		}
+		kl = strlen(subkey->keyid);
+		if (kl <= l && strcasecmp(subkey->keyid,
+					sig->fpr + (l - kl)) == 0)
+			limitvalidity(v, subkey->expires);
+	}
+	gpgme_key_unref(gpgme_key);
+	if (FAILEDTOALLOC(sig->primary_fpr))
+		return RET_ERROR_OOM;
+	return RET_OK;
+}
+
+/* what gpgme found in the last gpgme_op_verify call */
+retvalue verification_get(struct verification **v_p) {
+	gpgme_verify_result_t result;
+	gpgme_signature_t s;
+	struct verification *v;
+	int count;
+	retvalue r;
+
+	result = gpgme_op_verify_result(context);
+	if (result == NULL) {
+		fprintf(stderr,
+"Internal error communicating with libgpgme: no result record!\n\n");
+		return RET_ERROR_GPGME;
+	}
+	count = 0;
+	for (s = result->signatures ; s != NULL ; s = s->next)
+		count++;
+	v = calloc(1, sizeof(struct verification) +
+			count * sizeof(struct verified_signature));
+	if (FAILEDTOALLOC(v))
+		return RET_ERROR_OOM;
+	v->cacheable = true;
+	for (s = result->signatures ; s != NULL ; s = s->next) {
+		struct verified_signature *sig = &v->signatures[v->count];
+
+		sig->fpr = strdup(s->fpr);
+		if (FAILEDTOALLOC(sig->fpr)) {
+			verification_free(v);
+			return RET_ERROR_OOM;
+		}
+		v->count++;
+		sig->status = gpg_err_code(s->status);
+		sig->timestamp = s->timestamp;
+		sig->exp_timestamp = s->exp_timestamp;
+		limitvalidity(v, s->exp_timestamp);
+		switch (sig->status) {
+			case GPG_ERR_NO_ERROR:
+			case GPG_ERR_KEY_EXPIRED:
+			case GPG_ERR_CERT_REVOKED:
+			case GPG_ERR_SIG_EXPIRED:
+			case GPG_ERR_BAD_SIGNATURE:
+				r = lookup_signingkey(v, sig);
+				if (RET_WAS_ERROR(r)) {
+					verification_free(v);
+					return r;
+				}
+				break;
+			case GPG_ERR_NO_PUBKEY:
+				break;
+			default:
+				/* something went wrong, better ask again */
+				v->cacheable = false;
+				break;
+		}
+	}
+	*v_p = v;
+	return RET_OK;
+}
+
+static void datahash(/*@out@*/char *hash, const char *data, size_t len) {
+	struct SHA256_Context sha256;
+	uint8_t digest[SHA256_DIGEST_SIZE];
+	static const char tab[16] = "0123456789abcdef";
+	int i;
+
+	/* gpg might or might not add a final newline */
+	while (len > 0 && data[len - 1] == '\n')
+		len--;
+	SHA256Init(&sha256);
+	SHA256Update(&sha256, (const uint8_t*)data, len);
+	SHA256Final(&sha256, digest);
+	for (i = 0 ; i < SHA256_DIGEST_SIZE ; i++) {
+		*(hash++) = tab[digest[i] >> 4];
+		*(hash++) = tab[digest[i] & 0xF];
+	}
+	*hash = '\0';
+}
+
+void verification_setdata(struct verification *v, const char *chunk, size_t len) {
+	datahash(v->datahash, chunk, len);
+}
+
+/* the key for a signed file, or a detached signature and its data */
+void sigcache_key(char *key, const char *data, size_t len, const char *data2, size_t len2) {
+	struct SHA256_Context sha256;
+	uint8_t digest[SHA256_DIGEST_SIZE];
+	static const char tab[16] = "0123456789abcdef";
+	uint64_t l = len;
+	int i;
+
+	SHA256Init(&sha256);
+	if (data2 != NULL) {
+		/* so no bytes can be moved from the one to the other */
+		SHA256Update(&sha256, (const uint8_t*)&l, sizeof(l));
+	}
+	SHA256Update(&sha256, (const uint8_t*)data, len);
+	if (data2 != NULL)
+		SHA256Update(&sha256, (const uint8_t*)data2, len2);
+	SHA256Final(&sha256, digest);
+	for (i = 0 ; i < SHA256_DIGEST_SIZE ; i++) {
+		*(key++) = tab[digest[i] >> 4];
+		*(key++) = tab[digest[i] & 0xF];
+	}
+	*key = '\0';
+}
+
+/* add name:inode:size:mtime of a file to the state,
+ * returns NULL (and frees state) if that cannot be determined */
+static /*@null@*/char *addfilestate(/*@only@*/char *state, const char *name, const char *fullfilename) {
+	struct stat s;
+	char *n;
+
+	if (stat(fullfilename, &s) != 0) {
+		int e = errno;
+
+		if (e != ENOENT && e != ENOTDIR) {
+			if (verbose > 5)
+				fprintf(stderr,
+"Cannot stat '%s' (%s), not using the signature cache.\n",
+					fullfilename, strerror(e));
+			free(state);
+			return NULL;
+		}
+		n = mprintf("%s %s:-", state, name);
+	} else
+		n = mprintf("%s %s:%llu:%llu:%lld.%09ld",
+				state, name,
+				(unsigned long long)s.st_ino,
+				(unsigned long long)s.st_size,
+				(long long)s.st_mtim.tv_sec,
+				(long)s.st_mtim.tv_nsec);
+	free(state);
+	return n;
+}
+
+/* add all keyrings and trustdbs named in gpg.conf to the state */
+static /*@null@*/char *addconfiguredfiles(/*@only@*/char *state, const char *homedir) {
+	static const char * const options[] = {
+		"keyring", "primary-keyring", "trustdb-name"
+	};
+	char *conffile, buffer[1000];
+	FILE *f;
+
+	conffile = calc_dirconcat(homedir, "gpg.conf");
+	if (FAILEDTOALLOC(conffile)) {
+		free(state);
+		return NULL;
+	}
+	state = addfilestate(state, "gpg.conf", conffile);
+	if (state == NULL) {
+		free(conffile);
+		return NULL;
+	}
+	f = fopen(conffile, "r");
+	if (f == NULL) {
+		int e = errno;
+
+		free(conffile);
+		if (e == ENOENT || e == ENOTDIR)
+			return state;
+		free(state);
+		return NULL;
+	}
+	while (state != NULL && fgets(buffer, sizeof(buffer), f) != NULL) {
+		char *p = buffer, *name, *fullfilename;
+		size_t i, l = strlen(buffer);
+
+		if (l > 0 && buffer[l - 1] != '\n' && !feof(f)) {
+			/* overlong line, cannot know what is in there */
+			free(state);
+			state = NULL;
+			break;
+		}
+		while (l > 0 && xisspace(buffer[l - 1]))
+			buffer[--l] = '\0';
+		while (xisspace(*p))
+			p++;
+		for (i = 0 ; i < ARRAYCOUNT(options) ; i++) {
+			size_t ol = strlen(options[i]);
+
+			if (strncmp(p, options[i], ol) == 0 &&
+					xisspace(p[ol]))
+				break;
+		}
+		if (i >= ARRAYCOUNT(options))
+			continue;
+		name = p + strlen(options[i]);
+		while (xisspace(*name))
+			name++;
+		/* like gpg: names without slash are in the homedir */
+		if (name[0] == '~' && name[1] == '/') {
+			const char *home = getenv("HOME");
+
+			if (home == NULL) {
+				free(state);
+				state = NULL;
+				break;
+			}
+			fullfilename = calc_dirconcat(home, name + 2);
+		} else if (strchr(name, '/') == NULL)
+			fullfilename = calc_dirconcat(homedir, name);
+		else
+			fullfilename = strdup(name);
+		if (FAILEDTOALLOC(fullfilename)) {
+			free(state);
+			state = NULL;
+			break;
+		}
+		state = addfilestate(state, fullfilename, fullfilename);
+		free(fullfilename);
+	}
+	if (ferror(f) != 0) {
+		free(state);
+		state = NULL;
+	}
+	(void)fclose(f);
+	free(conffile);
+	return state;
+}
+
+/* Something that changes with every change of keyring or trustdb,
+ * NULL if that cannot be determined (then no cache is used) */
+static char *calc_keyringstate(void) {
+	static const char * const files[] = {
+		"pubring.kbx", "pubring.gpg", "trustdb.gpg",
+		/* keyboxd (GnuPG 2.4 and later) */
+		"public-keys.d/pubring.db", "public-keys.d/pubring.db-wal"
+	};
+	const char *home = getenv("GNUPGHOME");
+	char *homedir, *state;
+	size_t i;
+
+	if (home != NULL)
+		homedir = strdup(home);
+	else {
+		home = getenv("HOME");
+		if (home == NULL)
+			return NULL;
+		homedir = calc_dirconcat(home, ".gnupg");
+	}
+	if (FAILEDTOALLOC(homedir))
+		return NULL;
+	state = strdup(homedir);
+	for (i = 0 ; state != NULL && i < ARRAYCOUNT(files) ; i++) {
+		char *fullfilename = calc_dirconcat(homedir, files[i]);
+
+		if (FAILEDTOALLOC(fullfilename)) {
+			free(state);
+			state = NULL;
+			break;
+		}
+		state = addfilestate(state, files[i], fullfilename);
+		free(fullfilename);
+	}
+	if (state != NULL)
+		state = addconfiguredfiles(state, homedir);
+	free(homedir);
+	if (state != NULL) {
+		/* keep the line in the cache file short */
+		char *hash = malloc(2*SHA256_DIGEST_SIZE+1);
+
+		if (!FAILEDTOALLOC(hash))
+			datahash(hash, state, strlen(state));
+		free(state);
+		state = hash;
+	}
+	return state;
+}
+
+static void entry_free(/*@only@*/struct sigcache_entry *e) {
+	free(e->key);
+	verification_free(e->verification);
+	free(e);
+}
+
+/* parse "<key> <datahash> <validuntil> <lastused> <count>" followed by
+ * <count> lines " <fpr> <primary> <status> <timestamp> <exp> <flags>" */
+static retvalue parse_entry(char *line, FILE *f, /*@out@*/struct sigcache_entry **e_p) {
+	char key[2*SHA256_DIGEST_SIZE+2], hash[2*SHA256_DIGEST_SIZE+2];
+	char fpr[200], primary[200], flags[4], buffer[500];
+	long long validuntil, lastused;
+	unsigned long timestamp, exp_timestamp;
+	unsigned int status;
+	struct sigcache_entry *e;
+	struct verification *v;
+	int count, i;
+
+	if (sscanf(line, "%65s %65s %lld %lld %d", key, hash,
+				&validuntil, &lastused, &count) != 5
+			|| count < 0 || count > 1000)
+		return RET_ERROR;
+	v = calloc(1, sizeof(struct verification) +
+			count * sizeof(struct verified_signature));
+	if (FAILEDTOALLOC(v))
+		return RET_ERROR_OOM;
+	v->cacheable = true;
+	v->validuntil = validuntil;
+	if (strcmp(hash, "-") != 0) {
+		if (strlen(hash) != 2*SHA256_DIGEST_SIZE) {
+			verification_free(v);
+			return RET_ERROR;
+		}
+		memcpy(v->datahash, hash, sizeof(v->datahash));
+	}
+	for (i = 0 ; i < count ; i++) {
+		struct verified_signature *sig = &v->signatures[i];
+
+		if (fgets(buffer, sizeof(buffer), f) == NULL ||
+				sscanf(buffer, " %199s %199s %u %lu %lu %3s",
+					fpr, primary, &status, &timestamp,
+					&exp_timestamp, flags) != 6) {
+			verification_free(v);
+			return RET_ERROR;
+		}
+		sig->fpr = strdup(fpr);
+		if (strcmp(primary, "-") != 0)
+			sig->primary_fpr = strdup(primary);
+		v->count++;
+		if (FAILEDTOALLOC(sig->fpr) || (sig->primary_fpr == NULL &&
+					strcmp(primary, "-") != 0)) {
+			verification_free(v);
+			return RET_ERROR_OOM;
+		}
+		sig->status = status;
+		sig->timestamp = timestamp;
+		sig->exp_timestamp = exp_timestamp;
+		sig->primary_revoked = strchr(flags, 'r') != NULL;
+		sig->primary_expired = strchr(flags, 'e') != NULL;
+	}
+	e = zNEW(struct sigcache_entry);
+	if (FAILEDTOALLOC(e)) {
+		verification_free(v);
+		return RET_ERROR_OOM;
+	}
+	e->key = strdup(key);
+	e->lastused = lastused;
+	e->verification = v;
+	if (FAILEDTOALLOC(e->key)) {
+		entry_free(e);
+		return RET_ERROR_OOM;
+	}
+	*e_p = e;
+	return RET_OK;
+}
+
+static void sigcache_load(void) {
+	char *filename, line[500];
+	struct sigcache_entry *e, **last = &entries;
+	size_t l;
+	FILE *f;
+	retvalue r;
+
+	loaded = true;
+	if (cachedir == NULL)
+		return;
+	keyringstate = calc_keyringstate();
+	if (keyringstate == NULL)
+		return;
+	filename = calc_dirconcat(cachedir, CACHEFILE);
+	if (FAILEDTOALLOC(filename))
+		return;
+	f = fopen(filename, "r");
+	free(filename);
+	if (f == NULL)
+		return;
+	if (fgets(line, sizeof(line), f) == NULL ||
+			strcmp(line, CACHEHEADER "\n") != 0) {
+		(void)fclose(f);
+		changed = true;
+		return;
+	}
+	/* anything changed in the keyring makes everything unusable */
+	if (fgets(line, sizeof(line), f) == NULL ||
+			strncmp(line, "keyring ", 8) != 0 ||
+			(l = strlen(line)) < 9 || line[l-1] != '\n' ||
+			strlen(keyringstate) != l - 9 ||
+			memcmp(line + 8, keyringstate, l - 9) != 0) {
+		if (verbose > 5)
+			printf(
+"Keyring changed, forgetting all remembered signature checks.\n");
+		(void)fclose(f);
+		changed = true;
+		return;
+	}
+	while (fgets(line, sizeof(line), f) != NULL) {
+		r = parse_entry(line, f, &e);
+		if (RET_WAS_ERROR(r)) {
+			if (verbose > 0)
+				fprintf(stderr,
+"Ignoring unparseable part of '%s/%s'\n", cachedir, CACHEFILE);
+			changed = true;
+			break;
+		}
+		*last = e;
+		last = &e->next;
+	}
+	(void)fclose(f);
+}
+
+const struct verification *sigcache_lookup(const char *key) {
+	struct sigcache_entry *e;
+	time_t now;
+
+	if (!loaded)
+		sigcache_load();
+	for (e = entries ; e != NULL ; e = e->next) {
+		if (e->key != NULL && strcmp(e->key, key) == 0)
+			break;
+	}
+	if (e == NULL)
+		return NULL;
+	now = time(NULL);
+	if (e->verification->validuntil != 0 &&
+			e->verification->validuntil <= now) {
+		/* something expired, let gpg decide anew */
+		free(e->key);
+		e->key = NULL;
+		changed = true;
+		return NULL;
+	}
+	/* only update once in a while, to not write the file every time */
+	if (now - e->lastused > 24*60*60) {
+		e->lastused = now;
+		changed = true;
+	}
+	return e->verification;
+}
+
+/* remember a result, returns it as it now belongs to the cache */
+const struct verification *sigcache_add(const char *key, struct verification *v) {
+	struct sigcache_entry *e;
+
+	if (!loaded)
+		sigcache_load();
+	/* replace an older result no longer deemed usable */
+	for (e = entries ; e != NULL ; e = e->next) {
+		if (e->key != NULL && strcmp(e->key, key) == 0) {
+			free(e->key);
+			e->key = NULL;
+		}
+	}
+	e = zNEW(struct sigcache_entry);
+	if (FAILEDTOALLOC(e)) {
+		/* unlikely, but better leak than fail */
+		return v;
+	}
+	e->verification = v;
+	e->lastused = time(NULL);
+	if (v->cacheable) {
+		e->key = strdup(key);
+		changed = true;
+	}
+	e->next = entries;
+	entries = e;
+	return v;
+}
+
+static void write_entry(FILE *f, const struct sigcache_entry *e) {
+	const struct verification *v = e->verification;
+	int i;
+
+	fprintf(f, "%s %s %lld %lld %d\n", e->key,
+			(v->datahash[0] == '\0')?"-":v->datahash,
+			(long long)v->validuntil, (long long)e->lastused,
+			v->count);
+	for (i = 0 ; i < v->count ; i++) {
+		const struct verified_signature *sig = &v->signatures[i];
+
+		fprintf(f, " %s %s %u %lu %lu %s%s-\n", sig->fpr,
+			(sig->primary_fpr == NULL)?"-":sig->primary_fpr,
+			(unsigned int)sig->status,
+			sig->timestamp, sig->exp_timestamp,
+			sig->primary_revoked?"r":"",
+			sig->primary_expired?"e":"");
+	}
+}
+
+static void sigcache_write(void) {
+	struct sigcache_entry *e;
+	char *filename, *tempfilename;
+	time_t now = time(NULL);
+	FILE *f;
+	int fd, e1, e2;
+
+	filename = calc_dirconcat(cachedir, CACHEFILE);
+	if (FAILEDTOALLOC(filename))
+		return;
+	/* other processes might write it at the same time,
+	 * so every one gets their own file to rename */
+	tempfilename = mprintf("%s.XXXXXX", filename);
+	if (FAILEDTOALLOC(tempfilename)) {
+		free(filename);
+		return;
+	}
+	fd = mkstemp(tempfilename);
+	if (fd < 0) {
+		/* no database directory yet or not writeable,
+		 * that only means no caching */
+		if (verbose > 5)
+			fprintf(stderr, "Cannot create '%s': %s\n",
+					tempfilename, strerror(errno));
+		free(tempfilename);
+		free(filename);
+		return;
+	}
+	f = fdopen(fd, "w");
+	if (f == NULL) {
+		(void)close(fd);
+		(void)unlink(tempfilename);
+		free(tempfilename);
+		free(filename);
+		return;
+	}
+	fprintf(f, CACHEHEADER "\nkeyring %s\n", keyringstate);
+	for (e = entries ; e != NULL ; e = e->next) {
+		if (e->key == NULL)
+			continue;
+		if (now - e->lastused > KEEPUNUSED)
+			continue;
+		write_entry(f, e);
+	}
+	e1 = ferror(f);
+	e2 = fclose(f);
+	if (e1 != 0 || e2 != 0 || rename(tempfilename, filename) != 0) {
+		if (verbose > 0)
+			fprintf(stderr,
+"Could not write '%s', signature checks will not be remembered.\n",
+					filename);
+		(void)unlink(tempfilename);
+	}
+	free(tempfilename);
+	free(filename);
+}
+
+void sigcache_done(void) {
+	if (loaded && changed && cachedir != NULL && keyringstate != NULL)
+		sigcache_write();
+	while (entries != NULL) {
+		struct sigcache_entry *e = entries;
+
+		entries = e->next;
+		entry_free(e);
+	}
+	free(keyringstate);
+	keyringstate = NULL;
+	loaded = false;
+	changed = false;
+}
+
+/* Extract the data of a clearsigned file without gpg, only if that is
+ * exactly what gpg extracted when the signatures were checked */
+retvalue sigcache_extract(const char *buffer, size_t bufferlen, const struct verification *v, char **chunk_p) {
+	const char *s, *e, *end = buffer + bufferlen;
+	const char *afterchunk;
+	char *data, *p, hash[2*SHA256_DIGEST_SIZE+1];
+	size_t len;
+	bool found = false;
+
+	if (v->datahash[0] == '\0')
+		return RET_NOTHING;
+	s = chunk_getstart(buffer, bufferlen, false);
+	if ((size_t)(end - s) < 34 || memcmp(s,
+				"-----BEGIN PGP SIGNED MESSAGE-----", 34) != 0)
+		return RET_NOTHING;
+	/* skip the armor headers */
+	s = chunk_over(s);
+	data = malloc(bufferlen + 1);
+	if (FAILEDTOALLOC(data))
+		return RET_ERROR_OOM;
+	p = data;
+	while (s < end) {
+		e = memchr(s, '\n', end - s);
+		if (e == NULL)
+			e = end;
+		if ((size_t)(e - s) >= 29 && memcmp(s,
+				"-----BEGIN PGP SIGNATURE-----", 29) == 0) {
+			found = true;
+			break;
+		}
+		/* undo dash escaping */
+		if (e - s >= 2 && s[0] == '-' && s[1] == ' ')
+			s += 2;
+		memcpy(p, s, e - s);
+		p += e - s;
+		*(p++) = '\n';
+		s = e + 1;
+	}
+	*p = '\0';
+	if (!found) {
+		free(data);
+		return RET_NOTHING;
+	}
+	len = chunk_extract(data, data, p - data, false, &afterchunk);
+	if (len == 0 || *afterchunk != '\0') {
+		free(data);
+		return RET_NOTHING;
+	}
+	datahash(hash, data, len);
+	if (strcmp(hash, v->datahash) != 0) {
+		free(data);
+		return RET_NOTHING;
+	}
+	*chunk_p = realloc(data, len + 1);
+	if (FAILEDTOALLOC(*chunk_p))
+		*chunk_p = data;
+	return RET_OK;
+}
+#endif /* HAVE_LIBGPGME */
@@ -305,11 +305,12 @@ void signature_requirements_free(struct signature_requirement *list) {
 	}
 }
 
-static bool key_good(const struct requested_key *req, const gpgme_signature_t signatures) {
+static bool key_good(const struct requested_key *req, const struct verification *v) {
 	const struct known_key *k = req->key;
-	gpgme_signature_t sig;
+	int j;
 
-	for (sig = signatures ; sig != NULL ; sig = sig->next) {
+	for (j = 0 ; j < v->count ; j++) {
+		const struct verified_signature *sig = &v->signatures[j];
 		const char *fpr = sig->fpr;
 		size_t l = strlen(sig->fpr);
 		int i;
@@ -346,7 +347,7 @@ static bool key_good(const struct requested_key *req, const gpgme_signature_t si
 		/* only accept perfectly good signatures and silently
 		   ignore everything else. Those are warned about or
 		   even accepted in the run with key_good_enough */
-		if (gpg_err_code(sig->status) == GPG_ERR_NO_ERROR
+		if (sig->status == GPG_ERR_NO_ERROR
 				&& !key_expired)
 			return true;
 		/* we have to continue otherwise,
@@ -357,11 +358,12 @@ static bool key_good(const struct requested_key *req, const gpgme_signature_t si
 	return false;
 }
 
-static bool key_good_enough(const struct requested_key *req, const gpgme_signature_t signatures, const char *releasegpg, const char *release) {
+static bool key_good_enough(const struct requested_key *req, const struct verification *v, const char *releasegpg, const char *release) {
 	const struct known_key *k = req->key;
-	gpgme_signature_t sig;
+	int j;
 
-	for (sig = signatures ; sig != NULL ; sig = sig->next) {
+	for (j = 0 ; j < v->count ; j++) {
+		const struct verified_signature *sig = &v->signatures[j];
 		const char *fpr = sig->fpr;
 		size_t l = strlen(sig->fpr);
 		int i;
@@ -396,7 +398,7 @@ static bool key_good_enough(const struct requested_key *req, const gpgme_signatu
 		   if it is not acceptable, we still have to look at the other
 		   signatures, as a signature with another subkey is following
 		 */
-		switch (gpg_err_code(sig->status)) {
+		switch (sig->status) {
 			case GPG_ERR_NO_ERROR:
 				if (! key_expired)
 					return true;
@@ -487,7 +489,7 @@ static bool key_good_enough(const struct requested_key *req, const gpgme_signatu
 		fprintf(stderr,
 "Error checking signature (gpgme returned unexpected value %d)!\n"
 "Please file a bug report, so reprepro can handle this in the future.\n",
-			gpg_err_code(sig->status));
+			sig->status);
 		return false;
 	}
 	return false;
@@ -561,12 +563,13 @@ retvalue signature_requirement_add(struct signature_requirement **list_p, const
 	return RET_OK;
 }
 
-static void print_signatures(FILE *f, gpgme_signature_t s, const char *releasegpg) {
+static void print_signatures(FILE *f, const struct verification *v, const char *releasegpg) {
 	char timebuffer[20];
 	struct tm *tm;
 	time_t t;
+	int i;
 
-	if (s == NULL) {
+	if (v->count == 0) {
 		fprintf(f, "gpgme reported no signatures in '%s':\n"
 "Either there are really none or something else is strange.\n"
 "One known reason for this effect is forgeting -b when signing.\n",
@@ -575,11 +578,13 @@ static void print_signatures(FILE *f, gpgme_signature_t s, const char *releasegp
 	}
 
 	fprintf(f, "Signatures in '%s':\n", releasegpg);
-	for (; s != NULL ; s = s->next) {
+	for (i = 0 ; i < v->count ; i++) {
+		const struct verified_signature *s = &v->signatures[i];
+
 		t = s->timestamp; tm = localtime(&t);
 		strftime(timebuffer, 19, "%Y-%m-%d", tm);
 		fprintf(f, "'%s' (signed %s): ", s->fpr, timebuffer);
-		switch (gpg_err_code(s->status)) {
+		switch (s->status) {
 			case GPG_ERR_NO_ERROR:
 				fprintf(f, "valid\n");
 				continue;
@@ -608,18 +613,10 @@ static void print_signatures(FILE *f, gpgme_signature_t s, const char *releasegp
 	}
 }
 
-static inline retvalue verify_signature(const struct signature_requirement *requirements, const char *releasegpg, const char *releasename) {
-	gpgme_verify_result_t result;
+static retvalue verify_signature(const struct signature_requirement *requirements, const struct verification *v, const char *releasegpg, const char *releasename) {
 	int i;
 	const struct signature_requirement *req;
 
-	result = gpgme_op_verify_result(context);
-	if (result == NULL) {
-		fprintf(stderr,
-"Internal error communicating with libgpgme: no result record!\n\n");
-		return RET_ERROR_GPGME;
-	}
-
 	for (req = requirements ; req != NULL ; req = req->next) {
 		bool fulfilled = false;
 
@@ -629,14 +626,14 @@ static inline retvalue verify_signature(const struct signature_requirement *requ
 
 		for (i = 0 ; (size_t)i < req->num_keys ; i++) {
 
-			if (key_good(&req->keys[i], result->signatures)) {
+			if (key_good(&req->keys[i], v)) {
 				fulfilled = true;
 				break;
 			}
 		}
 		for (i = 0 ; !fulfilled && (size_t)i < req->num_keys ; i++) {
 
-			if (key_good_enough(&req->keys[i], result->signatures,
+			if (key_good_enough(&req->keys[i], v,
 						releasegpg, releasename)) {
 				fulfilled = true;
 				break;
@@ -646,7 +643,7 @@ static inline retvalue verify_signature(const struct signature_requirement *requ
 			fprintf(stderr,
 "ERROR: Condition '%s' not fulfilled for '%s'.\n",
 					req->condition, releasegpg);
-			print_signatures(stderr, result->signatures,
+			print_signatures(stderr, v,
 					releasegpg);
 			return RET_ERROR_BADSIG;
 		}
@@ -656,14 +653,62 @@ static inline retvalue verify_signature(const struct signature_requirement *requ
 		}
 	}
 	if (verbose > 20)
-		print_signatures(stdout, result->signatures, releasegpg);
+		print_signatures(stdout, v, releasegpg);
+	return RET_OK;
+}
+
+/* read a file that might contain anything */
+static retvalue readwholefile(const char *filename, /*@out@*/char **data_p, /*@out@*/size_t *len_p) {
+	char *data = NULL, *h;
+	size_t len = 0, size = 0;
+	ssize_t got;
+	int fd, e;
+
+	fd = open(filename, O_RDONLY|O_NOCTTY);
+	if (fd < 0) {
+		e = errno;
+		fprintf(stderr, "Error opening '%s': %s\n",
+				filename, strerror(e));
+		return RET_ERRNO(e);
+	}
+	do {
+		if (len == size) {
+			size = (size == 0)?8192:2*size;
+			h = realloc(data, size);
+			if (FAILEDTOALLOC(h)) {
+				(void)close(fd);
+				free(data);
+				return RET_ERROR_OOM;
+			}
+			data = h;
+		}
+		got = read(fd, data + len, size - len);
+		if (got < 0 && errno == EINTR)
+			continue;
+		if (got < 0) {
+			e = errno;
+			fprintf(stderr, "Error reading '%s': %s\n",
+					filename, strerror(e));
+			(void)close(fd);
+			free(data);
+			return RET_ERRNO(e);
+		}
+		len += got;
+	} while (got != 0);
+	(void)close(fd);
+	*data_p = data;
+	*len_p = len;
 	return RET_OK;
 }
 
 retvalue signature_check(const struct signature_requirement *requirements, const char *releasegpg, const char *releasename, const char *releasedata, size_t releaselen) {
 	gpg_error_t err;
-	int gpgfd;
 	gpgme_data_t dh, dh_gpg;
+	char *gpgdata, cachekey[SIGCACHE_KEYLEN];
+	size_t gpglen;
+	const struct verification *v;
+	struct verification *verification;
+	retvalue r;
 
 	assert (requirements != NULL);
 
@@ -673,22 +718,32 @@ retvalue signature_check(const struct signature_requirement *requirements, const
 	assert (context != NULL);
 
 	/* Read the file and its signature into memory: */
-	gpgfd = open(releasegpg, O_RDONLY|O_NOCTTY);
-	if (gpgfd < 0) {
-		int e = errno;
-		fprintf(stderr, "Error opening '%s': %s\n",
-				releasegpg, strerror(e));
-		return RET_ERRNO(e);
+	r = readwholefile(releasegpg, &gpgdata, &gpglen);
+	if (RET_WAS_ERROR(r))
+		return r;
+
+	/* Perhaps exactly this was already checked before: */
+	sigcache_key(cachekey, gpgdata, gpglen, releasedata, releaselen);
+	v = sigcache_lookup(cachekey);
+	if (v != NULL) {
+		free(gpgdata);
+		if (verbose > 10)
+			printf("Using remembered signature check of '%s'.\n",
+					releasegpg);
+		return verify_signature(requirements, v,
+				releasegpg, releasename);
 	}
-	err = gpgme_data_new_from_fd(&dh_gpg, gpgfd);
+
+	err = gpgme_data_new_from_mem(&dh_gpg, gpgdata, gpglen, 0);
 	if (err != 0) {
-		(void)close(gpgfd);
+		free(gpgdata);
 		fprintf(stderr, "Error reading '%s':\n", releasegpg);
 		return gpgerror(err);
 	}
 	err = gpgme_data_new_from_mem(&dh, releasedata, releaselen, 0);
 	if (err != 0) {
 		gpgme_data_release(dh_gpg);
+		free(gpgdata);
 		return gpgerror(err);
 	}
 
@@ -697,48 +752,77 @@ retvalue signature_check(const struct signature_requirement *requirements, const
 	err = gpgme_op_verify(context, dh_gpg, dh, NULL);
 	gpgme_data_release(dh_gpg);
 	gpgme_data_release(dh);
-	close(gpgfd);
+	free(gpgdata);
 	if (err != 0) {
 		fprintf(stderr, "Error verifying '%s':\n", releasegpg);
 		return gpgerror(err);
 	}
+	r = verification_get(&verification);
+	if (RET_WAS_ERROR(r))
+		return r;
+	v = sigcache_add(cachekey, verification);
 
-	return verify_signature(requirements, releasegpg, releasename);
+	return verify_signature(requirements, v, releasegpg, releasename);
 }
 
 retvalue signature_check_inline(const struct signature_requirement *requirements, const char *filename, char **chunk_p) {
 	gpg_error_t err;
 	gpgme_data_t dh, dh_gpg;
-	int fd;
+	char *data, cachekey[SIGCACHE_KEYLEN];
+	size_t datalen;
+	const struct verification *v;
+	retvalue r;
 
-	fd = open(filename, O_RDONLY|O_NOCTTY);
-	if (fd < 0) {
-		int e = errno;
-		fprintf(stderr, "Error opening '%s': %s\n",
-				filename, strerror(e));
-		return RET_ERRNO(e);
+	r = readwholefile(filename, &data, &datalen);
+	if (RET_WAS_ERROR(r))
+		return r;
+
+	/* if exactly this file was checked before, the result can be
+	 * reused, if the data can be extracted the same way gpg does */
+	sigcache_key(cachekey, data, datalen, NULL, 0);
+	v = sigcache_lookup(cachekey);
+	if (v != NULL) {
+		char *chunk;
+
+		r = sigcache_extract(data, datalen, v, &chunk);
+		if (RET_WAS_ERROR(r)) {
+			free(data);
+			return r;
+		}
+		if (RET_IS_OK(r)) {
+			free(data);
+			if (verbose > 10)
+				printf(
+"Using remembered signature check of '%s'.\n", filename);
+			r = verify_signature(requirements, v, filename, NULL);
+			if (RET_IS_OK(r))
+				*chunk_p = chunk;
+			else
+				free(chunk);
+			return r;
+		}
 	}
-	err = gpgme_data_new_from_fd(&dh_gpg, fd);
+
+	err = gpgme_data_new_from_mem(&dh_gpg, data, datalen, 0);
 	if (err != 0) {
-		(void)close(fd);
+		free(data);
 		return gpgerror(err);
 	}
 
 	err = gpgme_data_new(&dh);
 	if (err != 0) {
-		(void)close(fd);
 		gpgme_data_release(dh_gpg);
+		free(data);
 		return gpgerror(err);
 	}
 	err = gpgme_op_verify(context, dh_gpg, NULL, dh);
-	(void)close(fd);
 	if (gpg_err_code(err) == GPG_ERR_NO_DATA) {
 		char *chunk; const char *n;
 		size_t len;
-		retvalue r;
 
 		gpgme_data_release(dh);
 		gpgme_data_release(dh_gpg);
+		free(data);
 
 		r = readtextfile(filename, filename, &chunk, &len);
 		assert (r != RET_NOTHING);
@@ -770,14 +854,21 @@ retvalue signature_check_inline(const struct signature_requirement *requirements
 		char *plain_data, *chunk;
 		const char *n;
 		size_t plain_len, len;
-		retvalue r;
+		struct verification *verification;
 
 		if (err != 0) {
 			gpgme_data_release(dh_gpg);
 			gpgme_data_release(dh);
+			free(data);
 			return gpgerror(err);
 		}
 		gpgme_data_release(dh_gpg);
+		free(data);
+		r = verification_get(&verification);
+		if (RET_WAS_ERROR(r)) {
+			gpgme_data_release(dh);
+			return r;
+		}
 		plain_data = gpgme_data_release_and_get_mem(dh, &plain_len);
 		if (plain_data == NULL) {
 			fprintf(stderr,
@@ -788,11 +879,14 @@ retvalue signature_check_inline(const struct signature_requirement *requirements
 "To check this please try running gpg --verify '%s' manually.\n"
 "Continuing extracting it ignoring all signatures...",
 					filename, filename);
+			verification_free(verification);
 			return RET_ERROR;
 		}
 		chunk = malloc(plain_len+1);
-		if (FAILEDTOALLOC(chunk))
+		if (FAILEDTOALLOC(chunk)) {
+			verification_free(verification);
 			return RET_ERROR_OOM;
+		}
 		len = chunk_extract(chunk, plain_data, plain_len, false, &n);
 #ifdef HAVE_GPGPME_FREE
 		gpgme_free(plain_data);
@@ -804,9 +898,13 @@ retvalue signature_check_inline(const struct signature_requirement *requirements
 			fprintf(stderr,
 "Cannot parse '%s': extraced signed data looks malformed.\n",
 				filename);
+			verification_free(verification);
 			r = RET_ERROR;
-		} else
-			r = verify_signature(requirements, filename, NULL);
+		} else {
+			verification_setdata(verification, chunk, len);
+			v = sigcache_add(cachekey, verification);
+			r = verify_signature(requirements, v, filename, NULL);
+		}
 		if (RET_IS_OK(r)) {
 			*chunk_p = realloc(chunk, len+1);
 			if (FAILEDTOALLOC(*chunk_p))
@@ -14,5 +14,39 @@ extern gpgme_ctx_t context;
 
 #ifdef HAVE_LIBGPGME
 retvalue gpgerror(gpg_error_t err);
+/* the context might ask the user for a passphrase */
+extern bool asksforpassphrase;
+
+/* what gpg said about some signed data, see signature_cache.c */
+struct verification {
+	/* sha256 of the extracted data, empty for detached signatures */
+	char datahash[65];
+	/* if not to be remembered, e.g. because of errors */
+	bool cacheable;
+	/* something expires then, 0 if never */
+	time_t validuntil;
+	int count;
+	struct verified_signature {
+		char *fpr;
+		/* NULL if key not available */
+		/*@null@*/char *primary_fpr;
+		gpg_err_code_t status;
+		unsigned long timestamp, exp_timestamp;
+		bool primary_revoked, primary_expired;
+	} signatures[];
+};
+retvalue verification_get(/*@out@*/struct verification **);
+void verification_setdata(struct verification *, const char *, size_t);
+void verification_free(/*@only@*//*@null@*/struct verification *);
+
+#define SIGCACHE_KEYLEN 65
+/* sha256 of data (and of data2 if not NULL) */
+void sigcache_key(/*@out@*/char *, const char *, size_t, /*@null@*/const char *, size_t);
+/* NULL if not known */
+/*@null@*/const struct verification *sigcache_lookup(const char *);
+/* the cache takes ownership */
+const struct verification *sigcache_add(const char *, /*@only@*/struct verification *);
+retvalue sigcache_extract(const char *, size_t, const struct verification *, /*@out@*/char **);
+void sigcache_done(void);
 #endif
 #endif
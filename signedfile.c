@@ -37,6 +37,7 @@
 #include "release.h"
 #include "filecntl.h"
 #include "hooks.h"
+#include "workers.h"
 
 #ifdef HAVE_LIBGPGME
 static retvalue check_signature_created(bool clearsign, bool willcleanup, /*@null@*/const struct strlist *options, const char *filename, const char *signaturename) {
@@ -163,11 +164,12 @@ static retvalue create_signature(bool clearsign, gpgme_data_t dh, /*@null@*/cons
 	return signature_to_file(dh_gpg, signaturename);
 }
 
-static retvalue signature_sign(const struct strlist *options, const char *filename, void *data, size_t datalen, const char *signaturename, const char *clearsignfilename, bool willcleanup) {
+/* tell gpgme which keys to use, options is set to NULL for the default key */
+static retvalue signature_setsigners(const struct strlist **options_p) {
+	const struct strlist *options = *options_p;
 	retvalue r;
 	int i;
 	gpg_error_t err;
-	gpgme_data_t dh;
 
 	assert (options != NULL && options->count > 0);
 	assert (options->values[0][0] != '!');
@@ -181,7 +183,7 @@ static retvalue signature_sign(const struct strlist *options, const char *filena
 			(strcasecmp(options->values[0], "yes") == 0 ||
 			  strcasecmp(options->values[0], "default") == 0)) {
 		/* use default options */
-		options = NULL;
+		*options_p = NULL;
 	} else for (i = 0 ; i < options->count ; i++) {
 		const char *option = options->values[i];
 		gpgme_key_t key;
@@ -203,6 +205,15 @@ static retvalue signature_sign(const struct strlist *options, const char *filena
 		}
 		gpgme_op_keylist_end(context);
 	}
+	return RET_OK;
+}
+
+/* options as returned by signature_setsigners, only for messages */
+static retvalue signature_sign(/*@null@*/const struct strlist *options, const char *filename, void *data, size_t datalen, const char *signaturename, const char *clearsignfilename, bool willcleanup) {
+	retvalue r;
+	int i;
+	gpg_error_t err;
+	gpgme_data_t dh;
 
 	err = gpgme_data_new_from_mem(&dh, data, datalen, 0);
 	if (err != 0) {
@@ -346,6 +357,10 @@ struct signedfile {
 #define DATABUFFERUNITS (128ul * 1024ul)
 	size_t bufferlen, buffersize;
 	char *buffer;
+	/* set by signedfile_prepare: */
+	char *plainfilename;
+	char **signedfilename_p, **detachedfilename_p;
+	/*@null@*/const struct strlist *options;
 };
 
 retvalue signature_startsignedfile(struct signedfile **out) {
@@ -368,6 +383,7 @@ retvalue signature_startsignedfile(struct signedfile **out) {
 void signedfile_free(struct signedfile *f) {
 	if (f == NULL)
 		return;
+	free(f->plainfilename);
 	free(f->buffer);
 	free(f);
 	return;
@@ -404,7 +420,9 @@ void signedfile_write(struct signedfile *f, const void *data, size_t len) {
 	assert (f->bufferlen <= f->buffersize);
 }
 
-retvalue signedfile_create(struct signedfile *f, const char *newplainfilename, char **newsignedfilename_p, char **newdetachedsignature_p, const struct strlist *options, bool willcleanup) {
+/* write the content to the plain file and remember where the
+ * signatures shall go, signedfile_sign creates them */
+retvalue signedfile_prepare(struct signedfile *f, const char *newplainfilename, char **newsignedfilename_p, char **newdetachedsignature_p, const struct strlist *options) {
 	size_t len, ofs;
 	int fd, ret;
 
@@ -452,51 +470,213 @@ retvalue signedfile_create(struct signedfile *f, const char *newplainfilename, c
 				strerror(e));
 		return RET_ERRNO(e);
 	}
-	/* now do the actual signing */
-	if (options != NULL && options->count > 0) {
-		retvalue r;
-		const char *newsigned = *newsignedfilename_p;
-		const char *newdetached = *newdetachedsignature_p;
-
-		/* make sure the new files do not already exist: */
-		if (unlink(newdetached) != 0 && errno != ENOENT) {
-			fprintf(stderr,
-"Could not remove '%s' to prepare replacement: %s\n",
-					newdetached, strerror(errno));
-			return RET_ERROR;
-		}
-		if (unlink(newsigned) != 0 && errno != ENOENT) {
-			fprintf(stderr,
-"Could not remove '%s' to prepare replacement: %s\n",
-					newsigned, strerror(errno));
-			return RET_ERROR;
-		}
-		/* if an hook is given, use that instead */
-		if (options->values[0][0] == '!')
-			r = signature_with_extern(options, newplainfilename,
-					newsigned, newdetachedsignature_p);
-		else
-#ifdef HAVE_LIBGPGME
-			r = signature_sign(options,
-				newplainfilename,
-				f->buffer, f->bufferlen,
-				newdetached, newsigned,
-				willcleanup);
-#else /* HAVE_LIBGPGME */
-			fputs(
-"ERROR: Cannot creature signatures as this reprepro binary is not compiled\n"
-"with support for libgpgme. (Only external signing using 'Signwith: !hook'\n"
-"is supported.\n", stderr);
-			return RET_ERROR_GPGME;
-#endif
-		if (RET_WAS_ERROR(r))
-			return r;
-	} else {
+	if (options == NULL || options->count <= 0) {
 		/* no signatures requested */
 		free(*newsignedfilename_p);
 		*newsignedfilename_p = NULL;
 		free(*newdetachedsignature_p);
 		*newdetachedsignature_p = NULL;
+		f->options = NULL;
+		return RET_OK;
+	}
+#ifndef HAVE_LIBGPGME
+	if (options->values[0][0] != '!') {
+		fputs(
+"ERROR: Cannot creature signatures as this reprepro binary is not compiled\n"
+"with support for libgpgme. (Only external signing using 'Signwith: !hook'\n"
+"is supported.\n", stderr);
+		return RET_ERROR_GPGME;
+	}
+#endif
+	/* make sure the new files do not already exist: */
+	if (unlink(*newdetachedsignature_p) != 0 && errno != ENOENT) {
+		fprintf(stderr,
+"Could not remove '%s' to prepare replacement: %s\n",
+				*newdetachedsignature_p, strerror(errno));
+		return RET_ERROR;
+	}
+	if (unlink(*newsignedfilename_p) != 0 && errno != ENOENT) {
+		fprintf(stderr,
+"Could not remove '%s' to prepare replacement: %s\n",
+				*newsignedfilename_p, strerror(errno));
+		return RET_ERROR;
 	}
+	f->plainfilename = strdup(newplainfilename);
+	if (FAILEDTOALLOC(f->plainfilename))
+		return RET_ERROR_OOM;
+	f->signedfilename_p = newsignedfilename_p;
+	f->detachedfilename_p = newdetachedsignature_p;
+	f->options = options;
 	return RET_OK;
 }
+
+/* Signing every Release file on its own means asking gpg (or the hook)
+ * again and again, which can be slow (especially with a gpg-agent asking
+ * some remote hardware). So all files are signed in one go: the keys
+ * are looked up once for each set of SignWith options and signatures
+ * (or hooks) for different files are run in parallel. */
+
+struct signing {
+	struct signedfile **files;
+	/* indices into files of what is currently signed */
+	size_t *todo;
+	/* the options as to be given to signature_sign */
+	/*@null@*/const struct strlist *gpgmeoptions;
+	bool willcleanup;
+};
+
+static bool sameoptions(const struct strlist *a, const struct strlist *b) {
+	int i;
+
+	if (a == b)
+		return true;
+	if (a->count != b->count)
+		return false;
+	for (i = 0 ; i < a->count ; i++) {
+		if (strcmp(a->values[i], b->values[i]) != 0)
+			return false;
+	}
+	return true;
+}
+
+static inline bool usehook(const struct signedfile *f) {
+	return f->options->values[0][0] == '!';
+}
+
+/* might be called in a child, the only thing to tell the parent is
+ * if the hook did not create a detached signature */
+static retvalue signfile(void *privdata, size_t item, char **data_p, size_t *len_p) {
+	struct signing *s = privdata;
+	struct signedfile *f = s->files[s->todo[item]];
+	retvalue r;
+
+	if (interrupted())
+		return RET_ERROR_INTERRUPTED;
+	if (usehook(f))
+		r = signature_with_extern(f->options, f->plainfilename,
+				*f->signedfilename_p, f->detachedfilename_p);
+	else
+#ifdef HAVE_LIBGPGME
+		r = signature_sign(s->gpgmeoptions, f->plainfilename,
+				f->buffer, f->bufferlen,
+				*f->detachedfilename_p, *f->signedfilename_p,
+				s->willcleanup);
+#else
+		r = RET_ERROR_GPGME;
+#endif
+	if (RET_IS_OK(r) && *f->detachedfilename_p == NULL) {
+		*data_p = strdup("-");
+		if (FAILEDTOALLOC(*data_p))
+			return RET_ERROR_OOM;
+		*len_p = 1;
+	}
+	return r;
+}
+
+static retvalue filesigned(void *privdata, size_t item, retvalue r, const char *data, size_t len) {
+	struct signing *s = privdata;
+	struct signedfile *f = s->files[s->todo[item]];
+
+	f->result = r;
+	if (RET_WAS_ERROR(r))
+		return r;
+	if (len > 0 && *f->detachedfilename_p != NULL) {
+		assert (data[0] == '-');
+		free(*f->detachedfilename_p);
+		*f->detachedfilename_p = NULL;
+	}
+	return r;
+}
+
+static retvalue signtodo(struct signing *s, size_t count, bool parallel) {
+	retvalue result = RET_NOTHING, r;
+	size_t i;
+
+	if (parallel)
+		return workers_run(count, signfile, filesigned, s);
+	for (i = 0 ; i < count ; i++) {
+		char *data = NULL;
+		size_t len = 0;
+
+		r = signfile(s, i, &data, &len);
+		r = filesigned(s, i, r, data, len);
+		free(data);
+		RET_UPDATE(result, r);
+	}
+	return result;
+}
+
+/* Create the signatures of all files given to signedfile_prepare,
+ * results gets what happened to each of them */
+retvalue signedfile_sign(struct signedfile **files, retvalue *results, size_t count, bool willcleanup) {
+	struct signing s;
+	retvalue result = RET_NOTHING, r;
+	size_t i, j, todocount;
+	bool *done;
+
+	s.files = files;
+	s.willcleanup = willcleanup;
+	s.gpgmeoptions = NULL;
+	s.todo = nzNEW(count, size_t);
+	if (FAILEDTOALLOC(s.todo))
+		return RET_ERROR_OOM;
+	done = nzNEW(count, bool);
+	if (FAILEDTOALLOC(done)) {
+		free(s.todo);
+		return RET_ERROR_OOM;
+	}
+	/* first all the hooks, they can all run at the same time */
+	todocount = 0;
+	for (i = 0 ; i < count ; i++) {
+		if (files[i]->options == NULL
+				|| RET_WAS_ERROR(files[i]->result)) {
+			done[i] = true;
+			continue;
+		}
+		/* until it is known to have succeeded: */
+		files[i]->result = RET_ERROR;
+		if (usehook(files[i])) {
+			s.todo[todocount++] = i;
+			done[i] = true;
+		}
+	}
+	if (todocount > 0) {
+		r = signtodo(&s, todocount, true);
+		RET_UPDATE(result, r);
+	}
+	/* then everything using the same keys */
+	for (i = 0 ; i < count && !interrupted() ; i++) {
+		if (done[i])
+			continue;
+		todocount = 0;
+		for (j = i ; j < count ; j++) {
+			if (done[j] || !sameoptions(files[i]->options,
+						files[j]->options))
+				continue;
+			s.todo[todocount++] = j;
+			done[j] = true;
+		}
+#ifdef HAVE_LIBGPGME
+		s.gpgmeoptions = files[i]->options;
+		r = signature_setsigners(&s.gpgmeoptions);
+		if (RET_WAS_ERROR(r)) {
+			for (j = 0 ; j < todocount ; j++)
+				files[s.todo[j]]->result = r;
+			RET_UPDATE(result, r);
+			continue;
+		}
+		/* a passphrase can only be asked for one at a time */
+		r = signtodo(&s, todocount, !asksforpassphrase);
+#else
+		r = signtodo(&s, todocount, false);
+#endif
+		RET_UPDATE(result, r);
+	}
+	if (interrupted())
+		RET_UPDATE(result, RET_ERROR_INTERRUPTED);
+	for (i = 0 ; i < count ; i++)
+		results[i] = files[i]->result;
+	free(done);
+	free(s.todo);
+	return result;
+}
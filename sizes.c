@@ -26,7 +26,7 @@
 #include "strlist.h"
 #include "distribution.h"
 #include "database.h"
-#include "database_p.h"
+#include "reference.h"
 #include "files.h"
 #include "sizes.h"
 
@@ -64,7 +64,7 @@ static bool fromdist(struct distribution_sizes *dist, const char *data, size_t l
 	return memcmp(data, dist->codename, dist->codename_len) == 0;
 }
 
-static retvalue count_sizes(struct cursor *cursor, bool specific, struct distribution_sizes *ds, unsigned long long *all_p, unsigned long long *onlyall_p) {
+static retvalue count_sizes(struct references_cursor *cursor, bool specific, struct distribution_sizes *ds, unsigned long long *all_p, unsigned long long *onlyall_p) {
 	const char *key, *data;
 	size_t len;
 	char *last_file = NULL;
@@ -75,8 +75,7 @@ static retvalue count_sizes(struct cursor *cursor, bool specific, struct distrib
 	bool snapshot;
 	unsigned long long all = 0, onlyall = 0;
 
-	while (cursor_nexttempdata(rdb_references, cursor,
-				&key, &data, &len)) {
+	while (references_nextpair(cursor, &key, &data, &len)) {
 		if (last_file == NULL || strcmp(last_file, key) != 0) {
 			if (last_file != NULL) {
 				free(last_file);
@@ -204,7 +203,7 @@ static retvalue count_sizes(struct cursor *cursor, bool specific, struct distrib
 }
 
 retvalue sizes_distributions(struct distribution *alldistributions, bool specific) {
-	struct cursor *cursor;
+	struct references_cursor *cursor;
 	retvalue result, r;
 	struct distribution_sizes *ds = NULL, **lds = &ds, *s;
 	struct distribution *d;
@@ -225,13 +224,13 @@ retvalue sizes_distributions(struct distribution *alldistributions, bool specifi
 	}
 	if (ds == NULL)
 		return RET_NOTHING;
-	r = table_newglobalcursor(rdb_references, true, &cursor);
+	r = references_newcursor(&cursor);
 	if (!RET_IS_OK(r)) {
 		distribution_sizes_freelist(ds);
 		return r;
 	}
 	result = count_sizes(cursor, specific, ds, &all, &onlyall);
-	r = cursor_close(rdb_references, cursor);
+	r = references_closecursor(cursor);
 	RET_ENDUPDATE(result, r);
 	if (RET_IS_OK(result)) {
 		printf("%-15s %13s %13s %13s %13s\n",
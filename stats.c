@@ -0,0 +1,259 @@
+/*  This file is part of "reprepro"
+ *  Copyright (C) 2026 agent
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02111-1301  USA
+ */
+#include <config.h>
+
+#include <errno.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "error.h"
+#include "names.h"
+#include "checksums.h"
+#include "stats.h"
+
+struct stats_counters stats;
+
+enum statskind { sk_table, sk_compression, sk_origin, sk_COUNT };
+static const char * const kind_name[sk_COUNT] = {
+	"databases", "compression", "downloads"
+};
+
+/* everything looked up by name, in order of first use */
+static struct namedstats {
+	struct namedstats *next;
+	enum statskind kind;
+	char *name;
+	union {
+		struct stats_table table;
+		struct stats_compression compression;
+		struct stats_origin origin;
+	} u;
+} *namedstats = NULL, *lastnamedstats = NULL;
+
+/* what is counted if there is no memory to count separately */
+static struct namedstats dummy;
+
+static char *command = NULL;
+static struct timespec starttime;
+static time_t startwalltime;
+
+void stats_add(struct stats_counters *to, const struct stats_counters *after, const struct stats_counters *before) {
+	enum checksumtype cs;
+
+	for (cs = cs_md5sum ; cs < cs_hashCOUNT ; cs++)
+		to->hashed[cs] += after->hashed[cs] - before->hashed[cs];
+	to->linked += after->linked - before->linked;
+	to->copied += after->copied - before->copied;
+	to->copiedbytes += after->copiedbytes - before->copiedbytes;
+	to->pooldeleted += after->pooldeleted - before->pooldeleted;
+	to->poolmorgue += after->poolmorgue - before->poolmorgue;
+}
+
+static struct namedstats *lookup(enum statskind kind, const char *name) {
+	struct namedstats *n;
+
+	for (n = namedstats ; n != NULL ; n = n->next) {
+		if (n->kind == kind && strcmp(n->name, name) == 0)
+			return n;
+	}
+	n = zNEW(struct namedstats);
+	if (FAILEDTOALLOC(n))
+		return &dummy;
+	n->kind = kind;
+	n->name = strdup(name);
+	if (FAILEDTOALLOC(n->name)) {
+		free(n);
+		return &dummy;
+	}
+	if (lastnamedstats == NULL)
+		namedstats = n;
+	else
+		lastnamedstats->next = n;
+	lastnamedstats = n;
+	return n;
+}
+
+struct stats_table *stats_table(const char *name) {
+	return &lookup(sk_table, name)->u.table;
+}
+
+struct stats_compression *stats_compression(const char *suffix) {
+	return &lookup(sk_compression, suffix)->u.compression;
+}
+
+struct stats_origin *stats_origin(const char *baseuri) {
+	return &lookup(sk_origin, baseuri)->u.origin;
+}
+
+void stats_start(const char *name) {
+	free(command);
+	command = strdup(name);
+	if (clock_gettime(CLOCK_MONOTONIC, &starttime) != 0)
+		memset(&starttime, 0, sizeof(starttime));
+	startwalltime = time(NULL);
+}
+
+/* also used for the trace file (see trace.c) */
+void stats_writestring(FILE *f, const char *s) {
+	putc('"', f);
+	for (; *s != '\0' ; s++) {
+		unsigned char c = *s;
+
+		if (c == '"' || c == '\\')
+			fprintf(f, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(f, "\\u%04x", c);
+		else
+			putc(c, f);
+	}
+	putc('"', f);
+}
+
+static void writenamed(FILE *f, const struct namedstats *n) {
+	switch (n->kind) {
+		case sk_table:
+			fprintf(f,
+"{\"gets\": %llu, \"puts\": %llu, \"deletes\": %llu, \"cursorsteps\": %llu}",
+				n->u.table.gets, n->u.table.puts,
+				n->u.table.deletes, n->u.table.cursorsteps);
+			break;
+		case sk_compression:
+			fprintf(f,
+"{\"files\": %llu, \"bytesin\": %llu, \"bytesout\": %llu}",
+				n->u.compression.files,
+				n->u.compression.bytesin,
+				n->u.compression.bytesout);
+			break;
+		case sk_origin:
+			fprintf(f,
+"{\"requests\": %llu, \"failed\": %llu, \"bytes\": %llu}",
+				n->u.origin.requests, n->u.origin.failed,
+				n->u.origin.bytes);
+			break;
+		case sk_COUNT:
+			assert (n->kind != sk_COUNT);
+	}
+}
+
+static void writestats(FILE *f, retvalue result) {
+	static const char * const hash_names[cs_hashCOUNT] =
+		{ "md5", "sha1", "sha256" };
+	struct timespec now;
+	double seconds = 0;
+	const struct namedstats *n;
+	enum checksumtype cs;
+	enum statskind sk;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &now) == 0)
+		seconds = (now.tv_sec - starttime.tv_sec)
+			+ (now.tv_nsec - starttime.tv_nsec) / 1000000000.0;
+
+	fputs("{\n  \"command\": ", f);
+	stats_writestring(f, (command == NULL)?"":command);
+	fprintf(f, ",\n  \"result\": \"%s\",\n"
+			"  \"start\": %lld,\n  \"seconds\": %.3f,\n",
+			RET_WAS_ERROR(result)?"error":
+				(result == RET_NOTHING)?"nothing":"ok",
+			(long long)startwalltime, seconds);
+	fputs("  \"hashed\": {", f);
+	for (cs = cs_md5sum ; cs < cs_hashCOUNT ; cs++)
+		fprintf(f, "%s\"%s\": %llu", (cs == cs_md5sum)?"":", ",
+				hash_names[cs], stats.hashed[cs]);
+	fprintf(f, "},\n"
+"  \"files\": {\"linked\": %llu, \"copied\": %llu, \"copiedbytes\": %llu},\n"
+"  \"pool\": {\"deleted\": %llu, \"morgue\": %llu}",
+			stats.linked, stats.copied, stats.copiedbytes,
+			stats.pooldeleted, stats.poolmorgue);
+	for (sk = sk_table ; sk < sk_COUNT ; sk++) {
+		bool first = true;
+
+		fprintf(f, ",\n  \"%s\": {", kind_name[sk]);
+		for (n = namedstats ; n != NULL ; n = n->next) {
+			if (n->kind != sk)
+				continue;
+			fputs(first?"\n    ":",\n    ", f);
+			first = false;
+			stats_writestring(f, n->name);
+			fputs(": ", f);
+			writenamed(f, n);
+		}
+		fputs(first?"}":"\n  }", f);
+	}
+	fputs("\n}\n", f);
+}
+
+retvalue stats_write(const char *filename, retvalue result) {
+	char *tempfilename;
+	FILE *f;
+	int e;
+
+	/* write to a new file and rename it, so that whatever reads
+	 * it regularly never sees a half written file */
+	tempfilename = calc_addsuffix(filename, "new");
+	if (FAILEDTOALLOC(tempfilename))
+		return RET_ERROR_OOM;
+	f = fopen(tempfilename, "w");
+	if (f == NULL) {
+		e = errno;
+		fprintf(stderr, "Error %d creating '%s': %s\n",
+				e, tempfilename, strerror(e));
+		free(tempfilename);
+		return RET_ERRNO(e);
+	}
+	writestats(f, result);
+	if (ferror(f) != 0) {
+		(void)fclose(f);
+		fprintf(stderr, "Error writing '%s'!\n", tempfilename);
+		(void)unlink(tempfilename);
+		free(tempfilename);
+		return RET_ERROR;
+	}
+	if (fclose(f) != 0) {
+		e = errno;
+		fprintf(stderr, "Error %d writing '%s': %s\n",
+				e, tempfilename, strerror(e));
+		(void)unlink(tempfilename);
+		free(tempfilename);
+		return RET_ERRNO(e);
+	}
+	if (rename(tempfilename, filename) != 0) {
+		e = errno;
+		fprintf(stderr, "Error %d moving '%s' to '%s': %s\n",
+				e, tempfilename, filename, strerror(e));
+		(void)unlink(tempfilename);
+		free(tempfilename);
+		return RET_ERRNO(e);
+	}
+	free(tempfilename);
+	return RET_OK;
+}
+
+void stats_done(void) {
+	while (namedstats != NULL) {
+		struct namedstats *n = namedstats;
+
+		namedstats = n->next;
+		free(n->name);
+		free(n);
+	}
+	lastnamedstats = NULL;
+	free(command);
+	command = NULL;
+}
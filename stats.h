@@ -0,0 +1,54 @@
+#ifndef REPREPRO_STATS_H
+#define REPREPRO_STATS_H
+
+#ifndef REPREPRO_ERROR_H
+#include "error.h"
+#warning "What's hapening here?"
+#endif
+#ifndef REPREPRO_CHECKSUMS_H
+#include "checksums.h"
+#endif
+
+/* counters of what was done in this run, for --stats-json */
+
+/* simple counters, those are also collected from worker processes
+ * (see workers.c), so they only may be increased */
+struct stats_counters {
+	/* bytes hashed with each hash (all are always computed together) */
+	unsigned long long hashed[cs_hashCOUNT];
+	/* files put into the pool by checksums_linkorcopyfile */
+	unsigned long long linked, copied, copiedbytes;
+	/* files removed from the pool, and those first put into the morgue */
+	unsigned long long pooldeleted, poolmorgue;
+};
+extern struct stats_counters stats;
+
+/* add to (the difference between after and before) */
+void stats_add(struct stats_counters * /*to*/, const struct stats_counters * /*after*/, const struct stats_counters * /*before*/);
+
+/* those are looked up by name, the returned pointer stays valid until
+ * stats_done (or points to some dummy if out of memory) */
+struct stats_table {
+	unsigned long long gets, puts, deletes, cursorsteps;
+};
+struct stats_table *stats_table(const char * /*database file*/);
+
+struct stats_compression {
+	unsigned long long files, bytesin, bytesout;
+};
+struct stats_compression *stats_compression(const char * /*suffix*/);
+
+struct stats_origin {
+	unsigned long long requests, failed, bytes;
+};
+struct stats_origin *stats_origin(const char * /*baseuri*/);
+
+/* write a string as JSON string (with quotes) */
+void stats_writestring(FILE *, const char *);
+
+void stats_start(const char * /*command*/);
+/* write everything counted so far as JSON object into the file */
+retvalue stats_write(const char * /*filename*/, retvalue /*result so far*/);
+void stats_done(void);
+
+#endif
@@ -42,6 +42,7 @@
 #include "files.h"
 #include "descriptions.h"
 #include "package.h"
+#include "trace.h"
 #include "target.h"
 
 static char *calc_identifier(const char *codename, component_t component, architecture_t architecture, packagetype_t packagetype) {
@@ -193,7 +194,7 @@ retvalue target_free(struct target *target) {
 		result = target_closepackagesdb(target);
 	} else
 		result = RET_OK;
-	if (target->wasmodified && !target->noexport) {
+	if (target_changed(target) && !target->noexport) {
 		fprintf(stderr,
 "Warning: database '%s' was modified but no index file was exported.\n"
 "Changes will only be visible after the next 'export'!\n",
@@ -246,6 +247,27 @@ retvalue target_closepackagesdb(struct target *target) {
 	return r;
 }
 
+/* Add (or remove, which is the same) a package to the fingerprint
+ * of the target. As the hashes are combined with xor, removing
+ * and adding the same package again cancel each other out. */
+static void fingerprint(struct target *target, const char *name, /*@null@*/const char *version, const char *control, size_t controllen) {
+	unsigned long long h = 14695981039346656037ULL;
+	const unsigned char *p;
+	size_t i;
+
+	for (p = (const unsigned char *)name ; *p != '\0' ; p++)
+		h = (h ^ *p) * 1099511628211ULL;
+	h = (h ^ '|') * 1099511628211ULL;
+	if (version != NULL)
+		for (p = (const unsigned char *)version ; *p != '\0' ; p++)
+			h = (h ^ *p) * 1099511628211ULL;
+	h = (h ^ '|') * 1099511628211ULL;
+	p = (const unsigned char *)control;
+	for (i = 0 ; i < controllen ; i++)
+		h = (h ^ p[i]) * 1099511628211ULL;
+	target->fingerprint ^= h;
+}
+
 /* Remove a package from the given target. */
 retvalue package_remove(struct package *old, struct logger *logger, struct trackingdata *trackingdata) {
 	struct strlist files;
@@ -273,6 +295,8 @@ retvalue package_remove(struct package *old, struct logger *logger, struct track
 	free(key);
 	if (RET_IS_OK(result)) {
 		old->target->wasmodified = true;
+		fingerprint(old->target, old->name, old->version,
+				old->control, old->controllen);
 		if (trackingdata != NULL && old->source != NULL
 				&& old->sourceversion != NULL) {
 			r = trackingdata_remove(trackingdata,
@@ -336,9 +360,8 @@ retvalue package_remove_by_cursor(struct package_cursor *tc, struct logger *logg
 	assert (target != NULL && target->packages != NULL);
 	assert (target == old->target);
 
-	if (logger != NULL || verbose > 0) {
-		(void)package_getversion(old);
-	}
+	/* also needed for the fingerprint */
+	(void)package_getversion(old);
 	r = old->target->getfilekeys(old->control, &files);
 	if (RET_WAS_ERROR(r)) {
 		return r;
@@ -352,6 +375,8 @@ retvalue package_remove_by_cursor(struct package_cursor *tc, struct logger *logg
 	result = cursor_delete(target->packages, tc->cursor, old->name, old->version);
 	if (RET_IS_OK(result)) {
 		old->target->wasmodified = true;
+		fingerprint(target, old->name, old->version,
+				old->control, old->controllen);
 		if (trackingdata != NULL && old->source != NULL
 				&& old->sourceversion != NULL) {
 			r = trackingdata_remove(trackingdata,
@@ -453,10 +478,66 @@ static retvalue archive_package(struct target *target, const struct package *pac
 	return RET_OK;
 }
 
+/* With --packageheaders the records in packages.db start with what is
+ * otherwise extracted from the control chunk again and again:
+ * a '\0' (no control chunk can start with that), the format version,
+ * then version, source name, source version and architecture, each
+ * 0-terminated, and then the control chunk itself. */
+#define PACKAGEHEADER_FORMAT '1'
+#define PACKAGEHEADER_FIELDS 4
+
+static retvalue package_makerecord(const struct target *target, const char *name, const char *version, architecture_t architecture, const char *control, size_t controllen, /*@out@*/char **record_p, /*@out@*/size_t *len_p) {
+	const char *fields[PACKAGEHEADER_FIELDS];
+	char *source, *sourceversion, *record, *p;
+	size_t lens[PACKAGEHEADER_FIELDS], len;
+	retvalue r;
+	int i;
+
+	if (!global.packageheaders)
+		return RET_NOTHING;
+	/* older versions would see an empty control chunk */
+	r = database_requireversion(VERSION);
+	if (RET_WAS_ERROR(r))
+		return r;
+	r = target->getsourceandversion(control, name, &source, &sourceversion);
+	if (!RET_IS_OK(r))
+		return r;
+	fields[0] = version;
+	fields[1] = source;
+	fields[2] = sourceversion;
+	fields[3] = atoms_architectures[architecture];
+	len = 2 + controllen;
+	for (i = 0 ; i < PACKAGEHEADER_FIELDS ; i++) {
+		lens[i] = strlen(fields[i]);
+		len += lens[i] + 1;
+	}
+	record = malloc(len + 1);
+	if (FAILEDTOALLOC(record)) {
+		free(source);
+		free(sourceversion);
+		return RET_ERROR_OOM;
+	}
+	p = record;
+	*(p++) = '\0';
+	*(p++) = PACKAGEHEADER_FORMAT;
+	for (i = 0 ; i < PACKAGEHEADER_FIELDS ; i++) {
+		memcpy(p, fields[i], lens[i] + 1);
+		p += lens[i] + 1;
+	}
+	memcpy(p, control, controllen);
+	p[controllen] = '\0';
+	free(source);
+	free(sourceversion);
+	*record_p = record;
+	*len_p = len;
+	return RET_OK;
+}
+
 static retvalue addpackages(struct target *target, const char *packagename, const char *controlchunk, const char *version, const struct strlist *files, /*@null@*/const struct package *old, /*@null@*/const struct strlist *oldfiles, /*@null@*/struct logger *logger, /*@null@*/struct trackingdata *trackingdata, architecture_t architecture, /*@null@*/const char *causingrule, /*@null@*/const char *suitefrom) {
 
 	retvalue result = RET_OK, r;
-	char *key;
+	char *key, *record;
+	size_t recordlen;
 	struct table *table = target->packages;
 	enum filetype filetype;
 
@@ -488,16 +569,30 @@ static retvalue addpackages(struct target *target, const char *packagename, cons
 		if (RET_IS_OK(r)) {
 			r = table_deleterecord(table, key, false);
 			RET_UPDATE(result, r);
+			if (RET_IS_OK(r))
+				fingerprint(target, old->name, old->version,
+						old->control, old->controllen);
 		}
 		free(key);
 	}
 
 	key = package_primarykey(packagename, version);
-	r = table_adduniqrecord(table, key, controlchunk);
+	if (FAILEDTOALLOC(key))
+		return RET_ERROR_OOM;
+	r = package_makerecord(target, packagename, version, architecture,
+			controlchunk, strlen(controlchunk), &record, &recordlen);
+	if (RET_IS_OK(r)) {
+		r = table_adduniqsizedrecord(table, key, record, recordlen + 1,
+				false, false);
+		free(record);
+	} else if (r == RET_NOTHING)
+		r = table_adduniqrecord(table, key, controlchunk);
 	free(key);
 
 	if (RET_WAS_ERROR(r))
 		return r;
+	fingerprint(target, packagename, version,
+			controlchunk, strlen(controlchunk));
 
 	if (logger != NULL) {
 		logger_log(logger, target, packagename,
@@ -828,21 +923,29 @@ retvalue target_rereference(struct target *target) {
 	return result;
 }
 
-retvalue package_referenceforsnapshot(struct package *package, void *data) {
-	const char *identifier = data;
+/* collect the filekeys of all packages, so that gensnapshot can add
+ * the references to them all at once */
+retvalue package_collectfilekeys(struct package *package, void *data) {
+	struct strlist *collected = data;
 	struct strlist filekeys;
 	retvalue r;
+	int i;
 
 	r = package->target->getfilekeys(package->control, &filekeys);
 	if (RET_WAS_ERROR(r))
 		return r;
 	if (verbose > 15) {
-		fprintf(stderr, "adding references to '%s' for '%s': ",
-				identifier, package->name);
+		fprintf(stderr, "adding references for '%s': ",
+				package->name);
 		(void)strlist_fprint(stderr, &filekeys);
 		(void)putc('\n', stderr);
 	}
-	r = references_add(identifier, &filekeys);
+	for (i = 0 ; i < filekeys.count ; i++) {
+		r = strlist_add(collected, filekeys.values[i]);
+		if (RET_WAS_ERROR(r))
+			break;
+		filekeys.values[i] = NULL;
+	}
 	strlist_done(&filekeys);
 	return r;
 }
@@ -1038,16 +1141,15 @@ retvalue target_export(struct target *target, bool onlyneeded, bool snapshot, st
 	}
 
 	/* not exporting if file is already there? */
-	onlymissing = onlyneeded && !target->wasmodified;
+	onlymissing = onlyneeded && !target_changed(target);
 
+	trace_begin("export", target->identifier);
 	result = export_target(target->relativedirectory, target,
 			target->exportmode, release, onlymissing, snapshot);
+	trace_end();
 
-	if (!RET_WAS_ERROR(result) && !snapshot) {
-		target->saved_wasmodified =
-			target->saved_wasmodified || target->wasmodified;
-		target->wasmodified = false;
-	}
+	if (!RET_WAS_ERROR(result) && !snapshot)
+		target_exported(target);
 	return result;
 }
 
@@ -1079,6 +1181,43 @@ retvalue package_rerunnotifiers(struct package *package, UNUSED(void *data)) {
 	return r;
 }
 
+/* set control (and whatever the header has) from a packages.db record */
+retvalue package_setrecord(struct package *package, const char *record, size_t len) {
+	const char *fields[PACKAGEHEADER_FIELDS];
+	const char *p, *e, *end = record + len;
+	int i;
+
+	if (len == 0 || record[0] != '\0') {
+		package->control = record;
+		package->controllen = len;
+		return RET_OK;
+	}
+	p = record + 2;
+	for (i = 0 ; i < PACKAGEHEADER_FIELDS && len >= 2
+			&& record[1] == PACKAGEHEADER_FORMAT ; i++) {
+		e = memchr(p, '\0', end - p);
+		if (e == NULL)
+			break;
+		fields[i] = p;
+		p = e + 1;
+	}
+	if (i < PACKAGEHEADER_FIELDS) {
+		fprintf(stderr,
+"Unsupported or corrupted record for '%s' in packages.db(%s)!\n",
+				package->name,
+				(package->target != NULL)?
+				package->target->identifier:"?");
+		return RET_ERROR;
+	}
+	package->version = fields[0];
+	package->source = fields[1];
+	package->sourceversion = fields[2];
+	package->architecture = architecture_find(fields[3]);
+	package->control = p;
+	package->controllen = end - p;
+	return RET_OK;
+}
+
 retvalue package_get(struct target *target, const char *name, const char *version, struct package *pkg) {
 	retvalue result, r;
 	bool database_closed;
@@ -1109,7 +1248,10 @@ retvalue package_get(struct target *target, const char *name, const char *versio
 	if (RET_IS_OK(result)) {
 		pkg->target = target;
 		pkg->name = name;
-		pkg->control = pkg->pkgchunk;
+		result = package_setrecord(pkg, pkg->pkgchunk,
+				pkg->controllen);
+		if (RET_WAS_ERROR(result))
+			package_done(pkg);
 	}
 	if (database_closed) {
 		r = target_closepackagesdb(target);
@@ -1143,6 +1285,7 @@ retvalue package_openiterator(struct target *t, bool readonly, bool duplicate, /
 	}
 	tc->target = t;
 	tc->cursor = c;
+	tc->r = RET_OK;
 	memset(&tc->current, 0, sizeof(tc->current));
 	return RET_OK;
 }
@@ -1150,6 +1293,8 @@ retvalue package_openiterator(struct target *t, bool readonly, bool duplicate, /
 retvalue package_openduplicateiterator(struct target *t, const char *name, long long skip, /*@out@*/struct package_cursor *tc) {
 	retvalue r, r2;
 	struct cursor *c;
+	const char *record;
+	size_t recordlen;
 
 	tc->close_database = t->packages == NULL;
 	if (tc->close_database) {
@@ -1161,7 +1306,13 @@ retvalue package_openduplicateiterator(struct target *t, const char *name, long
 
 	memset(&tc->current, 0, sizeof(tc->current));
 	r = table_newduplicatecursor(t->packages, name, skip, &c, &tc->current.name,
-	                             &tc->current.control, &tc->current.controllen);
+	                             &record, &recordlen);
+	if (RET_IS_OK(r)) {
+		tc->current.target = t;
+		r = package_setrecord(&tc->current, record, recordlen);
+		if (RET_WAS_ERROR(r))
+			(void)cursor_close(t->packages, c);
+	}
 	if (!RET_IS_OK(r)) {
 		if (tc->close_database) {
 			r2 = target_closepackagesdb(t);
@@ -1169,26 +1320,34 @@ retvalue package_openduplicateiterator(struct target *t, const char *name, long
 		}
 		return r;
 	}
-	tc->current.target = t;
 	tc->target = t;
 	tc->cursor = c;
+	tc->r = RET_OK;
 	return RET_OK;
 }
 
 bool package_next(struct package_cursor *tc) {
+	const char *record;
+	size_t recordlen;
 	bool success;
+	retvalue r;
 
 	if (verbose >= 15)
 		fprintf(stderr, "trace: package_next(tc={current: {name: %s, version: %s}}) called.\n", tc->current.name, tc->current.version);
 
 	package_done(&tc->current);
 	success = cursor_nexttempdata(tc->target->packages, tc->cursor,
-			&tc->current.name, &tc->current.control,
-			&tc->current.controllen);
+			&tc->current.name, &record, &recordlen);
+	if (success) {
+		tc->current.target = tc->target;
+		r = package_setrecord(&tc->current, record, recordlen);
+		if (RET_WAS_ERROR(r)) {
+			tc->r = r;
+			success = false;
+		}
+	}
 	if (!success)
 		memset(&tc->current, 0, sizeof(tc->current));
-	else
-		tc->current.target = tc->target;
 	return success;
 }
 
@@ -1197,6 +1356,7 @@ retvalue package_closeiterator(struct package_cursor *tc) {
 
 	package_done(&tc->current);
 	result = cursor_close(tc->target->packages, tc->cursor);
+	RET_UPDATE(result, tc->r);
 	if (tc->close_database) {
 		r = target_closepackagesdb(tc->target);
 		RET_UPDATE(result, r);
@@ -1206,6 +1366,50 @@ retvalue package_closeiterator(struct package_cursor *tc) {
 	return result;
 }
 
+static retvalue replacecontrol(struct package_cursor *cursor, const char *newcontrol, size_t newcontrollen) {
+	struct package *current = &cursor->current;
+	char *record;
+	size_t recordlen;
+	retvalue r;
+
+	if (!global.packageheaders)
+		return cursor_replace(cursor->target->packages, cursor->cursor,
+				newcontrol, newcontrollen);
+	r = package_getversion(current);
+	if (RET_IS_OK(r))
+		r = package_getarchitecture(current);
+	if (RET_IS_OK(r))
+		r = package_makerecord(cursor->target, current->name,
+				current->version, current->architecture,
+				newcontrol, newcontrollen,
+				&record, &recordlen);
+	if (RET_WAS_ERROR(r))
+		return r;
+	if (r == RET_NOTHING)
+		return cursor_replace(cursor->target->packages, cursor->cursor,
+				newcontrol, newcontrollen);
+	r = cursor_replace(cursor->target->packages, cursor->cursor,
+			record, recordlen);
+	free(record);
+	return r;
+}
+
+retvalue package_newcontrol_by_cursor(struct package_cursor *cursor, const char *newcontrol, size_t newcontrollen) {
+	struct package *current = &cursor->current;
+	retvalue r;
+
+	(void)package_getversion(current);
+	/* the old data might no longer be readable after replacing it */
+	fingerprint(cursor->target, current->name, current->version,
+			current->control, current->controllen);
+	r = replacecontrol(cursor, newcontrol, newcontrollen);
+	/* (if that failed, it stays off and the target counts as changed) */
+	if (RET_IS_OK(r))
+		fingerprint(cursor->target, current->name, current->version,
+				newcontrol, newcontrollen);
+	return r;
+}
+
 retvalue package_getversion(struct package *package) {
 	retvalue r;
 
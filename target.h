@@ -61,6 +61,9 @@ struct target {
 	do_retrack *doretrack;
 	complete_checksums *completechecksums;
 	bool wasmodified, saved_wasmodified;
+	/* xor of hashes of all package records added or removed since
+	 * the last export (see target_changed) */
+	unsigned long long fingerprint;
 	/* set when existed at startup time, only valid in --nofast mode */
 	bool existed;
 	/* the next one in the list of targets of a distribution */
@@ -110,6 +113,19 @@ static inline bool target_matches(const struct target *t, const struct atomlist
 	return true;
 }
 
+/* if the packages differ from the last exported index files,
+ * i.e. not everything changed was put back unchanged */
+static inline bool target_changed(const struct target *t) {
+	return t->wasmodified && t->fingerprint != 0;
+}
+
+/* the index files of the target were just exported */
+static inline void target_exported(struct target *t) {
+	t->saved_wasmodified = t->saved_wasmodified || target_changed(t);
+	t->wasmodified = false;
+	t->fingerprint = 0;
+}
+
 static inline char *package_primarykey(const char *packagename, const char *version) {
 	char *key;
 
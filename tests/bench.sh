@@ -0,0 +1,135 @@
+#!/bin/bash
+# Time the important commands of reprepro on a synthetic repository
+# (generated by genrepo.sh) and write the results as JSON.
+#
+# Usage: bench.sh [--srcdir <dir>] [--workdir <dir>] [--output <file>]
+# The size of the repository is controlled by the environment variables
+# described in genrepo.sh; REPREPRO selects the binary to test and
+# BENCHOPTIONS gives additional options to all reprepro calls.
+# The generated packages are kept in the work directory and reused as
+# long as the size does not change, so only the first run pays for them.
+set -e -u
+
+export LC_ALL=C
+
+SRCDIR="$(readlink -e "$(dirname "$0")/..")"
+WORKDIR="$(pwd)/benchdir"
+OUTPUT="$(pwd)/bench-results.json"
+
+while [ $# -gt 0 ] ; do
+	case "$1" in
+		--srcdir)
+			SRCDIR="$(readlink -e "$2")"
+			shift 2
+			;;
+		--workdir)
+			WORKDIR="$(readlink -m "$2")"
+			shift 2
+			;;
+		--output)
+			OUTPUT="$(readlink -m "$2")"
+			shift 2
+			;;
+		*)
+			echo "Unsupported option $1" >&2
+			exit 1
+			;;
+	esac
+done
+
+REPREPRO="${REPREPRO:-$SRCDIR/reprepro}"
+BENCHOPTIONS="${BENCHOPTIONS:-}"
+export PACKAGES="${PACKAGES:-500}"
+export ARCHITECTURES="${ARCHITECTURES:-amd64 arm64}"
+export VERSIONS="${VERSIONS:-2}"
+export FILES="${FILES:-20}"
+
+if ! [ -x "$REPREPRO" ] ; then
+	echo "Could not find $REPREPRO! (Set REPREPRO or use --srcdir)" >&2
+	exit 1
+fi
+
+mkdir -p "$WORKDIR"
+parameters="packages=$PACKAGES architectures=$ARCHITECTURES versions=$VERSIONS files=$FILES"
+if ! [ -d "$WORKDIR/debs" ] || [ "$(cat "$WORKDIR/debs.parameters" 2>/dev/null)" != "$parameters" ] ; then
+	echo "Generating packages ($parameters)..."
+	rm -rf "$WORKDIR/debs" "$WORKDIR/debs.parameters"
+	"$SRCDIR/tests/genrepo.sh" "$WORKDIR/debs"
+	echo "$parameters" > "$WORKDIR/debs.parameters"
+fi
+
+# the repository packages are included into, the one a copy is made
+# into and one updating from the first one with a file: method
+REPO="$WORKDIR/repo"
+MIRROR="$WORKDIR/mirror"
+rm -rf "$REPO" "$MIRROR" "$WORKDIR/stats" "$WORKDIR/log"
+mkdir -p "$REPO/conf" "$MIRROR/conf" "$WORKDIR/stats"
+cat > "$REPO/conf/distributions" <<EOF
+Codename: bench
+Architectures: $ARCHITECTURES
+Components: main
+
+Codename: copy
+Architectures: $ARCHITECTURES
+Components: main
+Contents: percomponent .gz .xz
+EOF
+cat > "$MIRROR/conf/distributions" <<EOF
+Codename: mirror
+Architectures: $ARCHITECTURES
+Components: main
+Update: bench
+EOF
+cat > "$MIRROR/conf/updates" <<EOF
+Name: bench
+Method: file:$REPO
+Suite: bench
+IgnoreRelease: Yes
+EOF
+
+steps=""
+
+# step <name> <basedir> <reprepro arguments...>
+step() {
+	local name="$1" basedir="$2" start end
+	shift 2
+
+	echo "Running $name..."
+	start="$(date +%s.%N)"
+	if ! "$REPREPRO" -b "$basedir" $BENCHOPTIONS \
+			--stats-json="$WORKDIR/stats/$name.json" \
+			"$@" >> "$WORKDIR/log" 2>&1 ; then
+		echo "reprepro $* failed, see $WORKDIR/log!" >&2
+		exit 1
+	fi
+	end="$(date +%s.%N)"
+	steps="$steps${steps:+,}
+    {\"name\": \"$name\", \"seconds\": $(echo "$start $end" | awk '{printf "%.3f", $2 - $1}'),
+     \"stats\": $(sed -e '2,$s/^/     /' "$WORKDIR/stats/$name.json")}"
+}
+
+step includedeb "$REPO" --export=never includedeb bench "$WORKDIR"/debs/1/*.deb
+for (( v = 2 ; v <= VERSIONS ; v++ )) ; do
+	# keep the old files, so deleteunreferenced has something to do
+	step includedeb-newversion-$v "$REPO" --export=never \
+		--keepunreferencedfiles includedeb bench "$WORKDIR"/debs/$v/*.deb
+done
+step export "$REPO" export bench
+step copyfilter "$REPO" --export=never copyfilter copy bench 'Package (% bench*)'
+# most of this is generating the Contents files:
+step contents "$REPO" export copy
+step update "$MIRROR" update
+step checkpool "$REPO" checkpool
+step rereference "$REPO" rereference
+step deleteunreferenced "$REPO" deleteunreferenced
+
+cat > "$OUTPUT" <<EOF
+{
+  "reprepro": "$("$REPREPRO" --version 2>&1 | head -n 1)",
+  "date": "$(date -u +%Y-%m-%dT%H:%M:%SZ)",
+  "parameters": {"packages": $PACKAGES, "architectures": "$ARCHITECTURES", "versions": $VERSIONS, "files": $FILES, "options": "$BENCHOPTIONS"},
+  "steps": [$steps
+  ]
+}
+EOF
+echo "Results written to $OUTPUT"
@@ -0,0 +1,82 @@
+#!/bin/bash
+# Generate .deb files for a synthetic repository to run benchmarks on.
+#
+# Usage: genrepo.sh <outputdir>
+# The size is controlled by the following environment variables:
+#  PACKAGES:      number of source packages (default 500),
+#                 every fifth of them builds an Architecture: all package
+#  ARCHITECTURES: architectures to build for (default "amd64 arm64")
+#  VERSIONS:      number of versions of each package (default 2)
+#  FILES:         additional files in each package (default 20)
+# The packages of version n are put into <outputdir>/<n>/.
+set -e -u
+
+if [ $# -ne 1 ] ; then
+	echo "Syntax: $0 <outputdir>" >&2
+	exit 1
+fi
+OUTPUT="$1"
+PACKAGES="${PACKAGES:-500}"
+ARCHITECTURES="${ARCHITECTURES:-amd64 arm64}"
+VERSIONS="${VERSIONS:-2}"
+FILES="${FILES:-20}"
+
+SECTIONS=(admin devel doc libs net python science text utils web)
+
+tmp="$(mktemp -d)"
+trap 'rm -rf "$tmp"' EXIT
+
+mkdir -p "$OUTPUT"
+OUTPUT="$(readlink -e "$OUTPUT")"
+
+# genpackage <outdir> <name> <version> <architecture> <section>
+genpackage() {
+	local out="$1" name="$2" version="$3" arch="$4" section="$5"
+	local dir="$tmp/$name" i
+
+	rm -rf "$dir"
+	mkdir -p "$dir/DEBIAN" "$dir/usr/bin" "$dir/usr/share/doc/$name" \
+		"$dir/usr/share/man/man1" "$dir/usr/share/$name"
+	cat > "$dir/DEBIAN/control" <<EOF
+Package: $name
+Version: $version
+Architecture: $arch
+Section: $section
+Priority: optional
+Maintainer: Benchmark <bench@example.org>
+Installed-Size: $((FILES + 4))
+Depends: libc6 (>= 2.36)
+Description: synthetic package $name for benchmarks
+ This package was generated by genrepo.sh and only contains
+ empty files with realistic names for the Contents files.
+EOF
+	: > "$dir/usr/bin/$name"
+	: > "$dir/usr/share/doc/$name/copyright"
+	: > "$dir/usr/share/doc/$name/changelog.Debian.gz"
+	: > "$dir/usr/share/man/man1/$name.1.gz"
+	if [ "$arch" != all ] ; then
+		mkdir -p "$dir/usr/lib/$arch-linux-gnu"
+		: > "$dir/usr/lib/$arch-linux-gnu/lib$name.so.${version%%.*}"
+	fi
+	for (( i = 0 ; i < FILES ; i++ )) ; do
+		: > "$dir/usr/share/$name/data$i"
+	done
+	dpkg-deb -Zgzip -z1 --build "$dir" \
+		"$out/${name}_${version}_${arch}.deb" > /dev/null
+}
+
+for (( v = 1 ; v <= VERSIONS ; v++ )) ; do
+	mkdir -p "$OUTPUT/$v"
+	for (( p = 0 ; p < PACKAGES ; p++ )) ; do
+		name="bench$p"
+		section="${SECTIONS[$(( p % ${#SECTIONS[@]} ))]}"
+		if [ $(( p % 5 )) -eq 4 ] ; then
+			genpackage "$OUTPUT/$v" "$name" "$v.0-1" all "$section"
+		else
+			for arch in $ARCHITECTURES ; do
+				genpackage "$OUTPUT/$v" "$name" "$v.0-1" \
+					"$arch" "$section"
+			done
+		fi
+	done
+done
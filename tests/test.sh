@@ -245,6 +245,7 @@ else
 	runtest exporthooks
 	runtest updatecorners
 	runtest packagediff
+	runtest packageheaders
 	runtest includeextra
 	runtest atoms
 	runtest trackingcorruption
@@ -252,6 +253,7 @@ else
 	runtest layeredupdate2
 	runtest uncompress
 	runtest check
+	runtest compactreferences
 	runtest flat
 	runtest subcomponents
 	runtest snapshotcopyrestore
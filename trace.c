@@ -0,0 +1,172 @@
+/*  This file is part of "reprepro"
+ *  Copyright (C) 2026 agent
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02111-1301  USA
+ */
+#include <config.h>
+
+#include <errno.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "error.h"
+#include "checksums.h"
+#include "stats.h"
+#include "trace.h"
+
+/* Events are written as they happen (so a crashed run still leaves
+ * something to look at, the format allows the final ']' to be missing).
+ * Only the process calling trace_start writes anything and nothing is
+ * left in the buffer, so forked children (workers, hooks) do not mess
+ * up the file. */
+
+static FILE *tracefile = NULL;
+static char *tracefilename = NULL;
+static pid_t tracepid;
+static bool traceerror = false;
+
+#define MAXDEPTH 64
+static int depth = 0;
+static struct span {
+	const char *name;
+	unsigned long long records, bytes;
+} spans[MAXDEPTH];
+
+static inline bool tracing(void) {
+	return tracefile != NULL && getpid() == tracepid;
+}
+
+static double now(void) {
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		return 0;
+	return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+static void writeevent(char phase, const char *name) {
+	fprintf(tracefile, ",\n{\"ph\":\"%c\",\"pid\":%ld,\"tid\":%ld,"
+			"\"ts\":%.3f,\"name\":",
+			phase, (long)tracepid, (long)tracepid, now());
+	stats_writestring(tracefile, name);
+}
+
+retvalue trace_start(const char *filename, const char *command) {
+	assert (tracefile == NULL);
+
+	tracefilename = strdup(filename);
+	if (FAILEDTOALLOC(tracefilename))
+		return RET_ERROR_OOM;
+	tracefile = fopen(filename, "w");
+	if (tracefile == NULL) {
+		int e = errno;
+		fprintf(stderr, "Error %d creating trace file '%s': %s\n",
+				e, filename, strerror(e));
+		free(tracefilename);
+		tracefilename = NULL;
+		return RET_ERRNO(e);
+	}
+	tracepid = getpid();
+	depth = 0;
+	traceerror = false;
+	fprintf(tracefile, "[\n{\"ph\":\"M\",\"pid\":%ld,\"tid\":%ld,"
+			"\"name\":\"process_name\",\"args\":{\"name\":",
+			(long)tracepid, (long)tracepid);
+	stats_writestring(tracefile, command);
+	fputs("}}", tracefile);
+	/* everything is within a span of the command itself */
+	trace_begin(command, NULL);
+	return RET_OK;
+}
+
+void trace_begin(const char *name, const char *detail) {
+	if (!tracing())
+		return;
+	if (depth < MAXDEPTH) {
+		spans[depth].name = name;
+		spans[depth].records = 0;
+		spans[depth].bytes = 0;
+	}
+	depth++;
+	writeevent('B', name);
+	if (detail != NULL) {
+		fputs(",\"args\":{\"detail\":", tracefile);
+		stats_writestring(tracefile, detail);
+		putc('}', tracefile);
+	}
+	putc('}', tracefile);
+	if (fflush(tracefile) != 0)
+		traceerror = true;
+}
+
+void trace_count(unsigned long long records, unsigned long long bytes) {
+	if (!tracing() || depth <= 0 || depth > MAXDEPTH)
+		return;
+	spans[depth - 1].records += records;
+	spans[depth - 1].bytes += bytes;
+}
+
+void trace_end(void) {
+	const struct span *s;
+
+	if (!tracing())
+		return;
+	assert (depth > 0);
+	if (depth <= 0)
+		return;
+	depth--;
+	if (depth >= MAXDEPTH)
+		writeevent('E', "");
+	else {
+		s = &spans[depth];
+		writeevent('E', s->name);
+		if (s->records != 0 || s->bytes != 0)
+			fprintf(tracefile,
+",\"args\":{\"records\":%llu,\"bytes\":%llu}",
+					s->records, s->bytes);
+	}
+	putc('}', tracefile);
+	if (fflush(tracefile) != 0)
+		traceerror = true;
+}
+
+retvalue trace_done(void) {
+	retvalue r = RET_OK;
+
+	if (!tracing())
+		return RET_NOTHING;
+	/* close what was left open by errors */
+	while (depth > 0)
+		trace_end();
+	fputs("\n]\n", tracefile);
+	if (ferror(tracefile) || traceerror) {
+		fprintf(stderr, "Error writing trace file '%s'!\n",
+				tracefilename);
+		r = RET_ERROR;
+	}
+	if (fclose(tracefile) != 0 && RET_IS_OK(r)) {
+		int e = errno;
+		fprintf(stderr, "Error %d writing trace file '%s': %s\n",
+				e, tracefilename, strerror(e));
+		r = RET_ERRNO(e);
+	}
+	tracefile = NULL;
+	free(tracefilename);
+	tracefilename = NULL;
+	return r;
+}
@@ -0,0 +1,22 @@
+#ifndef REPREPRO_TRACE_H
+#define REPREPRO_TRACE_H
+
+#ifndef REPREPRO_ERROR_H
+#include "error.h"
+#warning "What's hapening here?"
+#endif
+
+/* --trace-file: record how long the major parts of a command take as
+ * nested spans, written in the trace event format of chrome://tracing
+ * (which can also be loaded into https://ui.perfetto.dev) */
+
+retvalue trace_start(const char * /*filename*/, const char * /*command*/);
+/* start a span, detail (e.g. the target) is shown as argument */
+void trace_begin(const char * /*name*/, /*@null@*/const char * /*detail*/);
+/* add to the counters of the innermost span */
+void trace_count(unsigned long long /*records*/, unsigned long long /*bytes*/);
+/* end the innermost span */
+void trace_end(void);
+retvalue trace_done(void);
+
+#endif
@@ -34,6 +34,9 @@
 #ifdef HAVE_LIBLZMA
 #include <lzma.h>
 #endif
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
 
 #include "globals.h"
 #include "error.h"
@@ -550,6 +553,15 @@ struct compressedfile {
 #endif
 #ifdef HAVE_LIBLZMA
 				lzma_stream lzma;
+#endif
+#ifdef HAVE_LIBZSTD
+				struct {
+					ZSTD_DStream *stream;
+					ZSTD_inBuffer in;
+					/* last return of ZSTD_decompressStream,
+					 * 0 if a frame was completed */
+					size_t hint;
+				} zstd;
 #endif
 			};
 			enum uncompression_error {
@@ -712,7 +724,23 @@ static inline retvalue start_xz(struct compressedfile *f, int *errno_p, const ch
 	f->uncompress.lzma.next_in = f->uncompress.buffer;
 	f->uncompress.lzma.avail_in = f->uncompress.available;
 
-	ret = lzma_stream_decoder(&f->uncompress.lzma, UINT64_MAX, LZMA_CONCATENATED);
+#ifdef HAVE_LZMA_STREAM_DECODER_MT
+	/* files compressed with xz -T have multiple blocks that can be
+	 * decoded in parallel (others are simply decoded by one thread) */
+	if (lzma_cputhreads() > 1) {
+		lzma_mt mt;
+
+		memset(&mt, 0, sizeof(mt));
+		mt.flags = LZMA_CONCATENATED;
+		mt.threads = lzma_cputhreads();
+		/* fall back to one thread instead of using too much memory */
+		mt.memlimit_threading = lzma_physmem() / 4;
+		mt.memlimit_stop = UINT64_MAX;
+		ret = lzma_stream_decoder_mt(&f->uncompress.lzma, &mt);
+	} else
+#endif
+		ret = lzma_stream_decoder(&f->uncompress.lzma, UINT64_MAX,
+				LZMA_CONCATENATED);
 	if (ret != LZMA_OK) {
 		if (ret == LZMA_MEM_ERROR) {
 			*errno_p = ENOMEM;
@@ -727,6 +755,34 @@ static inline retvalue start_xz(struct compressedfile *f, int *errno_p, const ch
 }
 #endif
 
+#ifdef HAVE_LIBZSTD
+static inline retvalue start_zstd(struct compressedfile *f, int *errno_p, const char **msg_p) {
+	size_t ret;
+
+	memset(&f->uncompress.zstd, 0, sizeof(f->uncompress.zstd));
+	f->uncompress.zstd.stream = ZSTD_createDStream();
+	if (f->uncompress.zstd.stream == NULL) {
+		*errno_p = ENOMEM;
+		*msg_p = "Out of Memory";
+		return RET_ERROR_OOM;
+	}
+	ret = ZSTD_initDStream(f->uncompress.zstd.stream);
+	if (ZSTD_isError(ret)) {
+		(void)ZSTD_freeDStream(f->uncompress.zstd.stream);
+		f->uncompress.zstd.stream = NULL;
+		*errno_p = -EINVAL;
+		*msg_p = "libzstd not working";
+		return RET_ERROR;
+	}
+	f->uncompress.zstd.in.src = f->uncompress.buffer;
+	f->uncompress.zstd.in.size = f->uncompress.available;
+	f->uncompress.zstd.in.pos = 0;
+	/* no frame completed yet */
+	f->uncompress.zstd.hint = 1;
+	return RET_OK;
+}
+#endif
+
 static retvalue start_builtin(struct compressedfile *f, int *errno_p, const char **msg_p) {
 	retvalue r;
 
@@ -759,6 +815,10 @@ static retvalue start_builtin(struct compressedfile *f, int *errno_p, const char
 			return start_lzma(f, errno_p, msg_p);
 		case c_xz:
 			return start_xz(f, errno_p, msg_p);
+#endif
+#ifdef HAVE_LIBZSTD
+		case c_zstd:
+			return start_zstd(f, errno_p, msg_p);
 #endif
 		default:
 			assert (false);
@@ -1369,6 +1429,76 @@ static inline int read_lzma(struct compressedfile *f, void *buffer, int size) {
 }
 #endif
 
+#ifdef HAVE_LIBZSTD
+static inline bool step_zstd(struct compressedfile *f, ZSTD_outBuffer *out) {
+	size_t ret;
+
+	/* (a new frame is started automatically after the
+	 *  end of the previous one, so concatenated files
+	 *  are supported) */
+	ret = ZSTD_decompressStream(f->uncompress.zstd.stream,
+			out, &f->uncompress.zstd.in);
+	if (ZSTD_isError(ret)) {
+		fprintf(stderr, "Error decompressing zstd data: %s\n",
+				ZSTD_getErrorName(ret));
+		f->uncompress.error = ue_UNCOMPRESSION_ERROR;
+		return false;
+	}
+	f->uncompress.zstd.hint = ret;
+	return true;
+}
+
+static inline int read_zstd(struct compressedfile *f, void *buffer, int size) {
+	ZSTD_outBuffer out;
+	retvalue r;
+
+	assert (f->compression == c_zstd);
+	assert (size >= 0);
+
+	if (size == 0)
+		return 0;
+
+	out.dst = buffer;
+	out.size = size;
+	out.pos = 0;
+	do {
+		if (f->uncompress.zstd.in.pos >= f->uncompress.zstd.in.size) {
+			/* if the output was full last time, zstd might
+			 * still have some without needing more input */
+			if (f->uncompress.zstd.hint != 0) {
+				if (!step_zstd(f, &out))
+					return -1;
+				if (out.pos > 0)
+					break;
+			}
+			f->uncompress.available = 0;
+			r = uncompression_read_internal_buffer(f);
+			if (RET_WAS_ERROR(r)) {
+				f->error = errno;
+				return -1;
+			}
+			f->uncompress.zstd.in.src = f->uncompress.buffer;
+			f->uncompress.zstd.in.size = f->uncompress.available;
+			f->uncompress.zstd.in.pos = 0;
+			if (f->uncompress.available == 0) {
+				/* end of file, but within a frame? */
+				if (f->uncompress.zstd.hint != 0 ||
+						f->len > 0) {
+					f->uncompress.error = ue_WRONG_LENGTH;
+					return -1;
+				}
+				f->uncompress.hadeos = true;
+				return out.pos;
+			}
+		}
+		if (!step_zstd(f, &out))
+			return -1;
+		/* repeat if no output was produced: */
+	} while (out.pos == 0);
+	return out.pos;
+}
+#endif
+
 int uncompress_read(struct compressedfile *file, void *buffer, int size) {
 	ssize_t s;
 
@@ -1415,6 +1545,10 @@ int uncompress_read(struct compressedfile *file, void *buffer, int size) {
 		case c_xz:
 		case c_lzma:
 			return read_lzma(file, buffer, size);
+#endif
+#ifdef HAVE_LIBZSTD
+		case c_zstd:
+			return read_zstd(file, buffer, size);
 #endif
 		default:
 			assert (false);
@@ -1548,6 +1682,14 @@ static retvalue uncompress_commonclose(struct compressedfile *file, int *errno_p
 			if (RET_WAS_ERROR(result))
 				return result;
 			return RET_OK;
+#endif
+#ifdef HAVE_LIBZSTD
+		case c_zstd:
+			(void)ZSTD_freeDStream(file->uncompress.zstd.stream);
+			file->uncompress.zstd.stream = NULL;
+			if (RET_WAS_ERROR(result))
+				return result;
+			return RET_OK;
 #endif
 		default:
 			assert (file->external);
@@ -1688,6 +1830,14 @@ void uncompress_abort(struct compressedfile *file) {
 				memset(&file->uncompress.lzma, 0,
 						sizeof(file->uncompress.lzma));
 				break;
+#endif
+#ifdef HAVE_LIBZSTD
+			case c_zstd:
+				(void)ZSTD_freeDStream(
+						file->uncompress.zstd.stream);
+				memset(&file->uncompress.zstd, 0,
+						sizeof(file->uncompress.zstd));
+				break;
 #endif
 			default:
 				assert (file->external);
@@ -12,19 +12,25 @@ extern const char * const uncompression_config[c_COUNT];
  * or uncompress (possibly multiple files) on the filesystem,
  * controled by aptmethods */
 
+#ifdef HAVE_LIBBZ2
+#define uncompression_builtin_bz2(c) ((c) == c_bzip2)
+#else
+#define uncompression_builtin_bz2(c) false
+#endif
 #ifdef HAVE_LIBLZMA
-# ifdef HAVE_LIBBZ2
-#define uncompression_builtin(c) ((c) == c_xz || (c) == c_lzma || (c) == c_bzip2 || (c) == c_gzip)
-# else
-#define uncompression_builtin(c) ((c) == c_xz || (c) == c_lzma || (c) == c_gzip)
-# endif
+#define uncompression_builtin_lzma(c) ((c) == c_xz || (c) == c_lzma)
+#else
+#define uncompression_builtin_lzma(c) false
+#endif
+#ifdef HAVE_LIBZSTD
+#define uncompression_builtin_zstd(c) ((c) == c_zstd)
 #else
-# ifdef HAVE_LIBBZ2
-#define uncompression_builtin(c) ((c) == c_bzip2 || (c) == c_gzip)
-# else
-#define uncompression_builtin(c) ((c) == c_gzip)
-# endif
+#define uncompression_builtin_zstd(c) false
 #endif
+#define uncompression_builtin(c) ((c) == c_gzip || \
+		uncompression_builtin_bz2(c) || \
+		uncompression_builtin_lzma(c) || \
+		uncompression_builtin_zstd(c))
 #define uncompression_supported(c) ((c) == c_none || \
 		uncompression_builtin(c) || \
 		extern_uncompressors[c] != NULL)
@@ -82,7 +82,9 @@
 #include "filecntl.h"
 #include "remoterepository.h"
 #include "uncompression.h"
+#include "indexfile.h"
 #include "package.h"
+#include "trace.h"
 
 /* The data structures of this one: ("u_" is short for "update_")
 
@@ -208,6 +210,20 @@ struct update_origin {
 	bool failed;
 };
 
+/* a remote index file read by multiple targets (e.g. because multiple
+ * distributions update from the same upstream), so it is only parsed once */
+struct update_sharedindex {
+	/*@dependent@*/struct remote_index *remote;
+	/* number of connectors pointing here */
+	int refcount;
+	/* number of targets that still have to read it */
+	int readers;
+	/* the parsed content, while readers are left */
+	/*@null@*/struct indexcache *cache;
+	/* reading into cache failed, read the file directly */
+	bool uncacheable;
+};
+
 struct update_index_connector {
 	struct update_index_connector *next;
 
@@ -216,6 +232,7 @@ struct update_index_connector {
 	/*@null@*/ struct update_origin *origin;
 
 	/*@null@*/char *afterhookfilename;
+	/*@null@*//*@dependent@*/struct update_sharedindex *shared;
 
 	/* ignore wrong architecture packages (arch1>arch2 or flat) */
 	bool ignorewrongarchitecture;
@@ -296,6 +313,18 @@ static void updates_freeorigins(/*@only@*/struct update_origin *o) {
 	}
 }
 
+static void updates_releaseshared(struct update_index_connector *ui) {
+	struct update_sharedindex *shared = ui->shared;
+
+	if (shared == NULL)
+		return;
+	ui->shared = NULL;
+	if (--shared->refcount > 0)
+		return;
+	indexcache_free(shared->cache);
+	free(shared);
+}
+
 static void updates_freetargets(/*@only@*/struct update_target *t) {
 	while (t != NULL) {
 		struct update_target *ut;
@@ -307,6 +336,7 @@ static void updates_freetargets(/*@only@*/struct update_target *t) {
 
 			ui = ut->indices;
 			ut->indices = ui->next;
+			updates_releaseshared(ui);
 			free(ui->afterhookfilename);
 			free(ui);
 		}
@@ -1782,6 +1812,86 @@ static upgrade_decision ud_decide_by_pattern(void *privdata, struct target *targ
 }
 
 
+static struct update_sharedindex *findshared(struct update_distribution *distributions, const struct remote_index *remote) {
+	struct update_distribution *d;
+	struct update_target *ut;
+	struct update_index_connector *ui;
+
+	for (d = distributions ; d != NULL ; d = d->next) {
+		for (ut = d->targets ; ut != NULL ; ut = ut->next) {
+			for (ui = ut->indices ; ui != NULL ; ui = ui->next) {
+				if (ui->shared != NULL &&
+						ui->shared->remote == remote)
+					return ui->shared;
+			}
+		}
+	}
+	return NULL;
+}
+
+/* Count how many targets will read each index file, so that those
+ * read multiple times only have to be parsed once. */
+static retvalue updates_shareindices(struct update_distribution *distributions) {
+	struct update_distribution *d;
+	struct update_target *ut;
+	struct update_index_connector *ui;
+	struct update_sharedindex *shared;
+
+	for (d = distributions ; d != NULL ; d = d->next) {
+		for (ut = d->targets ; ut != NULL ; ut = ut->next) {
+			if (ut->nothingnew)
+				continue;
+			for (ui = ut->indices ; ui != NULL ; ui = ui->next) {
+				/* files modified by listhooks are specific
+				 * to a target, so cannot be shared */
+				if (ui->remote == NULL || ui->failed
+						|| ui->origin->failed
+						|| ui->afterhookfilename != NULL)
+					continue;
+				assert (ui->shared == NULL);
+				shared = findshared(distributions, ui->remote);
+				if (shared == NULL) {
+					shared = zNEW(struct update_sharedindex);
+					if (FAILEDTOALLOC(shared))
+						return RET_ERROR_OOM;
+					shared->remote = ui->remote;
+				}
+				shared->refcount++;
+				shared->readers++;
+				ui->shared = shared;
+			}
+		}
+	}
+	return RET_OK;
+}
+
+static retvalue readindex(struct update_target *u, struct update_index_connector *uindex, const char *filename) {
+	struct update_sharedindex *shared = uindex->shared;
+	retvalue r;
+
+	if (shared != NULL && shared->readers > 1 && shared->cache == NULL
+			&& !shared->uncacheable) {
+		r = indexcache_read(&shared->cache, filename, c_none);
+		/* if anything is wrong with it, reading it directly will
+		 * give the proper error messages */
+		if (!RET_IS_OK(r)) {
+			shared->cache = NULL;
+			shared->uncacheable = true;
+		}
+	}
+	r = upgradelist_update(u->upgradelist, uindex,
+			filename,
+			(shared != NULL)?shared->cache:NULL,
+			ud_decide_by_pattern,
+			(void*)uindex->origin->pattern,
+			uindex->ignorewrongarchitecture);
+	if (shared != NULL && --shared->readers <= 0) {
+		indexcache_free(shared->cache);
+		shared->cache = NULL;
+	}
+	return r;
+}
+
 static inline retvalue searchformissing(/*@null@*/FILE *out, struct update_target *u) {
 	struct update_index_connector *uindex;
 	retvalue result, r;
@@ -1839,11 +1949,7 @@ static inline retvalue searchformissing(/*@null@*/FILE *out, struct update_targe
 
 		if (verbose > 4 && out != NULL)
 			fprintf(out, "  reading '%s'\n", filename);
-		r = upgradelist_update(u->upgradelist, uindex,
-				filename,
-				ud_decide_by_pattern,
-				(void*)uindex->origin->pattern,
-				uindex->ignorewrongarchitecture);
+		r = readindex(u, uindex, filename);
 		if (RET_WAS_ERROR(r)) {
 			u->incomplete = true;
 			u->ignoredelete = true;
@@ -1862,7 +1968,9 @@ static retvalue updates_readindices(/*@null@*/FILE *out, struct update_distribut
 
 	result = RET_NOTHING;
 	for (u=d->targets ; u != NULL ; u=u->next) {
+		trace_begin("searchformissing", u->target->identifier);
 		r = searchformissing(out, u);
+		trace_end();
 		if (RET_WAS_ERROR(r))
 			u->incomplete = true;
 		RET_UPDATE(result, r);
@@ -2100,8 +2208,10 @@ static retvalue updates_prepare(struct update_distribution *distributions, bool
 		return result;
 	}
 
+	trace_begin("getindices", NULL);
 	r = updates_preparelists(run, distributions, nolistsdownload, skipold,
 			&anythingtodo);
+	trace_end();
 	RET_UPDATE(result, r);
 	if (RET_WAS_ERROR(result)) {
 		aptmethod_shutdown(run);
@@ -2124,13 +2234,21 @@ static retvalue updates_prepare(struct update_distribution *distributions, bool
 	/* Call ListHooks (if given) on the downloaded index files.
 	 * (This is done even when nolistsdownload is given, as otherwise
 	 *  the filename to look in is not calculated) */
+	trace_begin("listhooks", NULL);
 	r = updates_calllisthooks(distributions);
+	trace_end();
 	RET_UPDATE(result, r);
 	if (RET_WAS_ERROR(result)) {
 		aptmethod_shutdown(run);
 		return result;
 	}
 
+	r = updates_shareindices(distributions);
+	if (RET_WAS_ERROR(r)) {
+		aptmethod_shutdown(run);
+		return r;
+	}
+
 	*run_p = run;
 	return RET_OK;
 }
@@ -2218,7 +2336,9 @@ retvalue updates_update(struct update_distribution *distributions, bool nolistsd
 	}
 	if (verbose >= 0)
 		printf("Getting packages...\n");
+	trace_begin("download", NULL);
 	r = aptmethod_download(run);
+	trace_end();
 	RET_UPDATE(result, r);
 	r = downloadcache_free(cache);
 	RET_ENDUPDATE(result, r);
@@ -2243,7 +2363,9 @@ retvalue updates_update(struct update_distribution *distributions, bool nolistsd
 	for (d=distributions ; d != NULL ; d=d->next) {
 		if (d->distribution->omitted)
 			continue;
+		trace_begin("install", d->distribution->codename);
 		r = updates_install(d);
+		trace_end();
 		RET_UPDATE(result, r);
 		if (RET_WAS_ERROR(r))
 			break;
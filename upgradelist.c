@@ -24,6 +24,7 @@
 #include "error.h"
 #include "ignore.h"
 #include "strlist.h"
+#include "arena.h"
 #include "indexfile.h"
 #include "dpkgversions.h"
 #include "target.h"
@@ -32,13 +33,15 @@
 #include "package.h"
 #include "upgradelist.h"
 
+/* those, their name and version_in_use are allocated from the
+ * upgradelist's arena, as they all live as long as the upgradelist */
 struct package_data {
 	struct package_data *next;
 	/* the name of the package: */
-	char *name;
+	/*@dependent@*/char *name;
 	/* the version in our repository:
 	 * NULL means not yet in the archive */
-	char *version_in_use;
+	/*@dependent@*//*@null@*/char *version_in_use;
 	/* the most recent version we found
 	 * (either is version_in_use or version_new)*/
 	/*@dependent@*/const char *version;
@@ -72,19 +75,18 @@ struct upgradelist {
 	 * (NULL=before start of list) */
 	/*@null@*//*@dependent@*/struct package_data *last;
 	/* internal...*/
+	struct arena arena;
 };
 
-static void package_data_free(/*@only@*/struct package_data *data){
+/* the rest is freed with the arena */
+static void package_data_free(/*@dependent@*/struct package_data *data){
 	if (data == NULL)
 		return;
-	free(data->name);
-	free(data->version_in_use);
 	free(data->new_version);
 	//free(data->new_from);
 	free(data->new_control);
 	strlist_done(&data->new_filekeys);
 	checksumsarray_done(&data->new_origfiles);
-	free(data);
 }
 
 /* This is called before any package lists are read.
@@ -103,22 +105,17 @@ static retvalue save_package_version(struct upgradelist *upgrade, struct package
 		fprintf(stderr, "trace: save_package_version(upgrade.target={identifier: %s}, pkg={name: %s, version: %s, pkgname: %s}) called.\n",
 		        upgrade->target == NULL ? NULL : upgrade->target->identifier, pkg->name, pkg->version, pkg->pkgname);
 
-	package = zNEW(struct package_data);
+	package = arena_zNEW(&upgrade->arena, struct package_data);
 	if (FAILEDTOALLOC(package))
 		return RET_ERROR_OOM;
 
 	package->privdata = NULL;
-	package->name = strdup(pkg->name);
-	if (FAILEDTOALLOC(package->name)) {
-		free(package);
+	package->name = arena_strdup(&upgrade->arena, pkg->name);
+	if (FAILEDTOALLOC(package->name))
 		return RET_ERROR_OOM;
-	}
-	package->version_in_use = package_dupversion(pkg);
-	if (FAILEDTOALLOC(package->version_in_use)) {
-		free(package->name);
-		free(package);
+	package->version_in_use = arena_strdup(&upgrade->arena, pkg->version);
+	if (FAILEDTOALLOC(package->version_in_use))
 		return RET_ERROR_OOM;
-	}
 	package->version = package->version_in_use;
 
 	if (upgrade->list == NULL) {
@@ -156,6 +153,7 @@ retvalue upgradelist_initialize(struct upgradelist **ul, struct target *t) {
 		return RET_ERROR_OOM;
 
 	upgrade->target = t;
+	arena_init(&upgrade->arena);
 
 	/* Beginn with the packages currently in the archive */
 
@@ -196,6 +194,7 @@ void upgradelist_free(struct upgradelist *upgrade) {
 		package_data_free(l);
 		l = n;
 	}
+	arena_done(&upgrade->arena);
 
 	free(upgrade);
 	return;
@@ -305,17 +304,16 @@ static retvalue upgradelist_trypackage(struct upgradelist *upgrade, void *privda
 			return (decision==UD_ERROR)?RET_ERROR:RET_NOTHING;
 		}
 
-		new = zNEW(struct package_data);
+		new = arena_zNEW(&upgrade->arena, struct package_data);
 		if (FAILEDTOALLOC(new)) {
 			free(version);
 			return RET_ERROR_OOM;
 		}
 		new->deleted = false; //to be sure...
 		new->privdata = privdata;
-		new->name = strdup(package->name);
+		new->name = arena_strdup(&upgrade->arena, package->name);
 		if (FAILEDTOALLOC(new->name)) {
 			free(version);
-			free(new);
 			return RET_ERROR_OOM;
 		}
 		new->new_version = version;
@@ -485,12 +483,15 @@ static retvalue upgradelist_trypackage(struct upgradelist *upgrade, void *privda
 	return RET_OK;
 }
 
-retvalue upgradelist_update(struct upgradelist *upgrade, void *privdata, const char *filename, upgrade_decide_function *decide, void *decide_data, bool ignorewrongarchitecture) {
+retvalue upgradelist_update(struct upgradelist *upgrade, void *privdata, const char *filename, const struct indexcache *cache, upgrade_decide_function *decide, void *decide_data, bool ignorewrongarchitecture) {
 	struct indexfile *i;
 	struct package package;
 	retvalue result, r;
 
-	r = indexfile_open(&i, filename, c_none);
+	if (cache != NULL)
+		r = indexfile_opencache(&i, cache);
+	else
+		r = indexfile_open(&i, filename, c_none);
 	if (!RET_IS_OK(r))
 		return r;
 
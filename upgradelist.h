@@ -13,6 +13,7 @@ typedef upgrade_decision upgrade_decide_function(void *privdata, struct target *
 struct target;
 struct logger;
 struct upgradelist;
+struct indexcache;
 
 retvalue upgradelist_initialize(struct upgradelist **, /*@dependent@*/struct target *);
 void upgradelist_free(/*@only@*/struct upgradelist *);
@@ -21,8 +22,9 @@ typedef void dumpaction(const char */*packagename*/, /*@null@*/const char */*old
 
 void upgradelist_dump(struct upgradelist *, dumpaction *);
 
-/* Take all items in 'filename' into account, and remember them coming from 'method' */
-retvalue upgradelist_update(struct upgradelist *, /*@dependent@*/void *, const char * /*filename*/, upgrade_decide_function *, void *, bool /*ignorewrongarchitecture*/);
+/* Take all items in 'filename' into account, and remember them coming from 'method'
+ * (if cache is not NULL, it contains the already parsed content of filename) */
+retvalue upgradelist_update(struct upgradelist *, /*@dependent@*/void *, const char * /*filename*/, /*@null@*/const struct indexcache *, upgrade_decide_function *, void *, bool /*ignorewrongarchitecture*/);
 
 /* Take all items in source into account */
 retvalue upgradelist_pull(struct upgradelist *, struct target *, upgrade_decide_function *, void *, void *);
@@ -0,0 +1,390 @@
+/*  This file is part of "reprepro"
+ *  Copyright (C) 2026 agent
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02111-1301  USA
+ */
+#include <config.h>
+
+#include <errno.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "error.h"
+#include "filecntl.h"
+#include "checksums.h"
+#include "stats.h"
+#include "workers.h"
+
+/* Each child gets item numbers via one pipe and answers each with a
+ * struct workresult followed by len bytes of data via another one.
+ * Closing the first pipe tells the child to exit.
+ * (The result also tells how much the counters for --stats-json
+ * increased in the child, so the parent can add that to its own.) */
+
+struct workresult {
+	size_t item;
+	retvalue r;
+	size_t len;
+	struct stats_counters counted;
+};
+
+struct worker {
+	pid_t pid;
+	int tochild, fromchild;
+	bool busy;
+};
+
+/* children currently running, as the done function of one workers_run
+ * might call another one and both together should not use more than
+ * global.workers processes */
+static int activeworkers = 0;
+
+static bool writeall(int fd, const void *data, size_t len) {
+	const char *p = data;
+
+	while (len > 0) {
+		ssize_t written = write(fd, p, len);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written <= 0)
+			return false;
+		p += written;
+		len -= written;
+	}
+	return true;
+}
+
+/* returns RET_NOTHING on immediate end of file */
+static retvalue readall(int fd, void *data, size_t len) {
+	char *p = data;
+	size_t got = 0;
+
+	while (got < len) {
+		ssize_t r = read(fd, p + got, len - got);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r < 0) {
+			int e = errno;
+			return RET_ERRNO(e);
+		}
+		if (r == 0)
+			return (got == 0)?RET_NOTHING:RET_ERROR;
+		got += r;
+	}
+	return RET_OK;
+}
+
+static void NORETURN workerchild(int in, int out, workers_workfunction *work, void *privdata) {
+	struct workresult result;
+	struct stats_counters before;
+	size_t item;
+	char *data;
+
+	while (readall(in, &item, sizeof(item)) == RET_OK) {
+		data = NULL;
+		result.item = item;
+		result.len = 0;
+		before = stats;
+		result.r = work(privdata, item, &data, &result.len);
+		if (!RET_IS_OK(result.r))
+			result.len = 0;
+		memset(&result.counted, 0, sizeof(result.counted));
+		stats_add(&result.counted, &stats, &before);
+		if (!writeall(out, &result, sizeof(result))
+		    || !writeall(out, data, result.len))
+			_exit(EXIT_FAILURE);
+		free(data);
+	}
+	(void)fflush(stdout);
+	(void)fflush(stderr);
+	_exit(EXIT_SUCCESS);
+}
+
+static int workercount(size_t count) {
+	long n = global.workers;
+
+	if (n <= 0) {
+		n = sysconf(_SC_NPROCESSORS_ONLN);
+		if (n <= 0)
+			n = 1;
+	}
+	n -= activeworkers;
+	if (n < 1)
+		n = 1;
+	if ((size_t)n > count)
+		n = count;
+	return n;
+}
+
+static retvalue runsequential(size_t count, workers_workfunction *work, workers_donefunction *done, void *privdata) {
+	retvalue result = RET_NOTHING, r;
+	size_t i;
+
+	for (i = 0 ; i < count ; i++) {
+		char *data = NULL;
+		size_t len = 0;
+
+		if (interrupted())
+			return RET_ERROR_INTERRUPTED;
+		r = work(privdata, i, &data, &len);
+		r = done(privdata, i, r, data, len);
+		free(data);
+		RET_UPDATE(result, r);
+		if (RET_WAS_ERROR(r))
+			break;
+	}
+	return result;
+}
+
+static retvalue startworkers(struct worker *workers, int n, workers_workfunction *work, void *privdata) {
+	int i, j;
+
+	(void)fflush(stdout);
+	(void)fflush(stderr);
+	for (i = 0 ; i < n ; i++) {
+		int cmd[2], res[2], e;
+
+		if (pipe(cmd) < 0) {
+			e = errno;
+			fprintf(stderr, "Error %d creating pipe: %s!\n",
+					e, strerror(e));
+			return RET_ERRNO(e);
+		}
+		if (pipe(res) < 0) {
+			e = errno;
+			(void)close(cmd[0]);
+			(void)close(cmd[1]);
+			fprintf(stderr, "Error %d creating pipe: %s!\n",
+					e, strerror(e));
+			return RET_ERRNO(e);
+		}
+		workers[i].pid = fork();
+		if (workers[i].pid < 0) {
+			e = errno;
+			(void)close(cmd[0]);
+			(void)close(cmd[1]);
+			(void)close(res[0]);
+			(void)close(res[1]);
+			fprintf(stderr, "Error %d while forking worker: %s\n",
+					e, strerror(e));
+			return RET_ERRNO(e);
+		}
+		if (workers[i].pid == 0) {
+			for (j = 0 ; j < i ; j++) {
+				(void)close(workers[j].tochild);
+				(void)close(workers[j].fromchild);
+			}
+			(void)close(cmd[1]);
+			(void)close(res[0]);
+			workerchild(cmd[0], res[1], work, privdata);
+		}
+		(void)close(cmd[0]);
+		(void)close(res[1]);
+		markcloseonexec(cmd[1]);
+		markcloseonexec(res[0]);
+		workers[i].tochild = cmd[1];
+		workers[i].fromchild = res[0];
+		workers[i].busy = false;
+		activeworkers++;
+	}
+	return RET_OK;
+}
+
+static retvalue stopworkers(struct worker *workers, int n, bool kill_them) {
+	retvalue result = RET_OK;
+	int i, status;
+
+	for (i = 0 ; i < n ; i++) {
+		if (workers[i].tochild >= 0)
+			(void)close(workers[i].tochild);
+		if (workers[i].fromchild >= 0)
+			(void)close(workers[i].fromchild);
+		if (kill_them)
+			(void)kill(workers[i].pid, SIGTERM);
+		activeworkers--;
+	}
+	for (i = 0 ; i < n ; i++) {
+		pid_t pid;
+
+		do {
+			pid = waitpid(workers[i].pid, &status, 0);
+		} while (pid < 0 && errno == EINTR);
+		if (pid < 0) {
+			int e = errno;
+			fprintf(stderr,
+"Error %d waiting for worker process %d: %s\n",
+					e, (int)workers[i].pid, strerror(e));
+			result = RET_ERRNO(e);
+		} else if (!kill_them && (!WIFEXITED(status) ||
+					WEXITSTATUS(status) != 0)) {
+			fprintf(stderr,
+"Worker process %d did not exit successfully!\n",
+					(int)workers[i].pid);
+			result = RET_ERROR;
+		}
+	}
+	return result;
+}
+
+static retvalue sendnext(struct worker *w, size_t *next, size_t count) {
+	if (*next >= count) {
+		(void)close(w->tochild);
+		w->tochild = -1;
+		return RET_NOTHING;
+	}
+	if (!writeall(w->tochild, next, sizeof(*next))) {
+		int e = errno;
+		fprintf(stderr,
+"Error %d sending work to worker process %d: %s\n",
+				e, (int)w->pid, strerror(e));
+		return RET_ERRNO(e);
+	}
+	w->busy = true;
+	(*next)++;
+	return RET_OK;
+}
+
+static retvalue getresult(struct worker *w, /*@out@*/struct workresult *result, /*@out@*/char **data_p) {
+	struct stats_counters nothing;
+	char *data = NULL;
+	retvalue r;
+
+	r = readall(w->fromchild, result, sizeof(*result));
+	if (RET_IS_OK(r) && result->len > 0) {
+		data = malloc(result->len);
+		if (FAILEDTOALLOC(data))
+			return RET_ERROR_OOM;
+		r = readall(w->fromchild, data, result->len);
+	}
+	if (!RET_IS_OK(r)) {
+		free(data);
+		fprintf(stderr,
+"Worker process %d unexpectedly stopped answering!\n",
+				(int)w->pid);
+		return RET_WAS_ERROR(r)?r:RET_ERROR;
+	}
+	w->busy = false;
+	memset(&nothing, 0, sizeof(nothing));
+	stats_add(&stats, &result->counted, &nothing);
+	*data_p = data;
+	return RET_OK;
+}
+
+retvalue workers_run(size_t count, workers_workfunction *work, workers_donefunction *done, void *privdata) {
+	struct worker *workers;
+	struct pollfd *fds;
+	retvalue result = RET_NOTHING, r;
+	size_t next = 0;
+	int n, i, busy;
+
+	n = workercount(count);
+	if (n <= 1)
+		return runsequential(count, work, done, privdata);
+
+	workers = nzNEW(n, struct worker);
+	if (FAILEDTOALLOC(workers))
+		return RET_ERROR_OOM;
+	fds = nzNEW(n, struct pollfd);
+	if (FAILEDTOALLOC(fds)) {
+		free(workers);
+		return RET_ERROR_OOM;
+	}
+	r = startworkers(workers, n, work, privdata);
+	if (RET_WAS_ERROR(r)) {
+		/* only the started ones: */
+		for (i = 0 ; i < n && workers[i].pid > 0 ; i++)
+			;
+		(void)stopworkers(workers, i, true);
+		free(fds);
+		free(workers);
+		return r;
+	}
+	busy = 0;
+	for (i = 0 ; i < n ; i++) {
+		r = sendnext(&workers[i], &next, count);
+		if (RET_IS_OK(r))
+			busy++;
+		else if (RET_WAS_ERROR(r)) {
+			result = r;
+			break;
+		}
+	}
+	while (busy > 0) {
+		int ready;
+
+		for (i = 0 ; i < n ; i++) {
+			fds[i].fd = workers[i].busy?workers[i].fromchild:-1;
+			fds[i].events = POLLIN;
+			fds[i].revents = 0;
+		}
+		ready = poll(fds, n, -1);
+		if (ready < 0) {
+			int e = errno;
+
+			if (e == EINTR && !interrupted())
+				continue;
+			if (e != EINTR) {
+				fprintf(stderr,
+"Error %d waiting for worker processes: %s\n",
+						e, strerror(e));
+				RET_UPDATE(result, RET_ERRNO(e));
+			} else
+				RET_UPDATE(result, RET_ERROR_INTERRUPTED);
+			break;
+		}
+		for (i = 0 ; i < n ; i++) {
+			struct workresult done_result;
+			char *data;
+
+			if (fds[i].revents == 0)
+				continue;
+			r = getresult(&workers[i], &done_result, &data);
+			if (RET_WAS_ERROR(r)) {
+				RET_UPDATE(result, r);
+				/* the child is no longer usable */
+				busy = -1;
+				break;
+			}
+			busy--;
+			/* the next item first, so the child does not wait
+			 * while the done function is busy */
+			if (!RET_WAS_ERROR(result) && !interrupted()) {
+				r = sendnext(&workers[i], &next, count);
+				if (RET_IS_OK(r))
+					busy++;
+				else
+					RET_ENDUPDATE(result, r);
+			}
+			r = done(privdata, done_result.item, done_result.r,
+					data, done_result.len);
+			free(data);
+			RET_UPDATE(result, r);
+		}
+		if (busy < 0)
+			break;
+	}
+	if (RET_WAS_NO_ERROR(result) && interrupted())
+		result = RET_ERROR_INTERRUPTED;
+	r = stopworkers(workers, n, busy != 0);
+	RET_ENDUPDATE(result, r);
+	free(fds);
+	free(workers);
+	return result;
+}
@@ -0,0 +1,24 @@
+#ifndef REPREPRO_WORKERS_H
+#define REPREPRO_WORKERS_H
+
+#ifndef REPREPRO_ERROR_H
+#include "error.h"
+#warning "What's hapening here?"
+#endif
+
+/* Run independent, expensive jobs (like reading .deb files) in forked
+ * child processes. The work function is called in a child and may not
+ * change anything in the parent (especially not the database), it only
+ * returns a block of data. The done function is called in the parent
+ * (in no specific order) with the result of each item. */
+
+typedef retvalue workers_workfunction(void * /*privdata*/, size_t /*item*/, /*@out@*/char ** /*data*/, /*@out@*/size_t * /*len*/);
+typedef retvalue workers_donefunction(void * /*privdata*/, size_t /*item*/, retvalue, /*@null@*/const char * /*data*/, size_t /*len*/);
+
+/* uses up to global.workers children (0 means one per processor),
+ * minus those of other workers_run calls still running (when called
+ * from a done function), runs everything in the current process if
+ * that leaves only one */
+retvalue workers_run(size_t /*count*/, workers_workfunction *, workers_donefunction *, void * /*privdata*/);
+
+#endif